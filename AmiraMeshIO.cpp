@@ -520,6 +520,7 @@ bool psurface::AmiraMeshIO<ctype>::initFromAmiraMesh(psurface::PSurface<2,ctype>
 
     // sad but true ...
     psurf->hasUpToDatePointLocationStructure = false;
+    psurf->hasUpToDateOverlapStructure = false;
 
     psurf->setupOriginalSurface();
 
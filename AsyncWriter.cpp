@@ -0,0 +1,215 @@
+#include "config.h"
+
+#include <iostream>
+#include <stdexcept>
+
+#ifdef PSURFACE_STANDALONE
+#include "TargetSurface.h"
+#else
+#include "hxsurface/Surface.h"
+#endif
+
+#include "AmiraMeshIO.h"
+#include "PSurface.h"
+#include "Hdf5IO.h"
+#include "VtkIO.h"
+#include "AsyncWriter.h"
+
+using namespace psurface;
+
+
+template <class ctype, int dim>
+void AsyncWriter<ctype,dim>::VtuJob::write(PSurface<dim,ctype>* par)
+{
+    VTKIO<ctype,dim> vtkIO(par);
+    vtkIO.createVTU(elementFilename_, graphFilename_, outputType_);
+}
+
+template <class ctype, int dim>
+void AsyncWriter<ctype,dim>::PvtuJob::write(PSurface<dim,ctype>* par)
+{
+    VTKIO<ctype,dim> vtkIO(par);
+    vtkIO.createPVTU(elementFilename_, graphFilename_, numPieces_, outputType_);
+}
+
+template <class ctype, int dim>
+void AsyncWriter<ctype,dim>::Hdf5Job::write(PSurface<dim,ctype>* par)
+{
+#if HAVE_HDF5
+    Hdf5IO<ctype,dim> hdf5IO(par);
+    hdf5IO.createHdfAndXdmf(xdmfFilename_, hdf5Filename_, base_);
+#else
+    throw std::runtime_error("Cannot write " + hdf5Filename_ + ": psurface has been compiled without hdf5 support!");
+#endif
+}
+
+template <class ctype, int dim>
+void AsyncWriter<ctype,dim>::AmiraMeshJob::write(PSurface<dim,ctype>* par)
+{
+#if defined HAVE_AMIRAMESH
+    if (!AmiraMeshIO<ctype>::writeAmiraMesh(par, filename_.c_str()))
+        throw std::runtime_error("Writing " + filename_ + " failed!");
+#else
+    throw std::runtime_error("Cannot write " + filename_ + ": psurface has been compiled without AmiraMesh support!");
+#endif
+}
+
+
+/** \brief Whether filename ends in extension */
+static bool hasExtension(const std::string& filename, const std::string& extension)
+{
+    return filename.length() >= extension.length()
+        && filename.compare(filename.length() - extension.length(), extension.length(), extension) == 0;
+}
+
+template <class ctype, int dim>
+typename AsyncWriter<ctype,dim>::Job* AsyncWriter<ctype,dim>::makeJob(const std::string& filename, bool base,
+                                                                     VTK::OutputType vtuEncoding)
+{
+    if (hasExtension(filename, ".vtu"))
+        return new VtuJob(filename, base ? "" : filename.substr(0, filename.length() - 4) + "-graph.vtu",
+                          vtuEncoding);
+
+    if (hasExtension(filename, ".pvtu"))
+        return new PvtuJob(filename, base ? "" : filename.substr(0, filename.length() - 5) + "-graph.pvtu",
+                           0, vtuEncoding);
+
+    if (hasExtension(filename, ".h5"))
+        return new Hdf5Job(filename.substr(0, filename.length() - 3) + ".xdmf", filename, base);
+
+    if (hasExtension(filename, ".am") || hasExtension(filename, ".par"))
+        return new AmiraMeshJob(filename);
+
+    throw std::runtime_error("File " + filename + " has an unknown output type.");
+}
+
+template <class ctype, int dim>
+std::string AsyncWriter<ctype,dim>::withSuffix(const std::string& filename, const std::string& suffix)
+{
+    std::string::size_type dot = filename.rfind('.');
+    return filename.substr(0, dot) + suffix + filename.substr(dot);
+}
+
+
+template <class ctype, int dim>
+AsyncWriter<ctype,dim>::AsyncWriter()
+    : snapshot_(NULL), ownsSnapshot_(false)
+{}
+
+template <class ctype, int dim>
+AsyncWriter<ctype,dim>::~AsyncWriter()
+{
+    try {
+        wait();
+    } catch (const std::exception& e) {
+        std::cerr << "AsyncWriter: " << e.what() << std::endl;
+    }
+}
+
+template <class ctype, int dim>
+void* AsyncWriter<ctype,dim>::run(void* arg)
+{
+    Task* task = static_cast<Task*>(arg);
+
+    // Exceptions must not leave the thread; they are rethrown by wait()
+    try {
+        task->job->write(task->snapshot);
+    } catch (const std::exception& e) {
+        task->error = e.what();
+    } catch (...) {
+        task->error = "unknown error";
+    }
+
+    return NULL;
+}
+
+template <class ctype, int dim>
+void AsyncWriter<ctype,dim>::write(const PSurface<dim,ctype>& par, const std::vector<Job*>& jobs)
+{
+    try {
+        wait();
+    } catch (...) {
+        for (size_t i=0; i<jobs.size(); i++)
+            delete jobs[i];
+        throw;
+    }
+
+    // Take the snapshot.  Removed vertices, edges and triangles are only
+    // marked as such in the original, so get rid of them in the copy.
+    PSurface<dim,ctype>* snapshot = new PSurface<dim,ctype>(par);
+    snapshot->garbageCollection();
+
+    start(snapshot, true, jobs);
+}
+
+template <class ctype, int dim>
+void AsyncWriter<ctype,dim>::writeInPlace(PSurface<dim,ctype>* par, const std::vector<Job*>& jobs)
+{
+    try {
+        wait();
+    } catch (...) {
+        for (size_t i=0; i<jobs.size(); i++)
+            delete jobs[i];
+        throw;
+    }
+
+    start(par, false, jobs);
+}
+
+template <class ctype, int dim>
+void AsyncWriter<ctype,dim>::start(PSurface<dim,ctype>* snapshot, bool ownsSnapshot, const std::vector<Job*>& jobs)
+{
+    snapshot_     = snapshot;
+    ownsSnapshot_ = ownsSnapshot;
+
+    // The threads get pointers into tasks_, which therefore must not be resized later
+    tasks_.resize(jobs.size());
+
+    for (size_t i=0; i<jobs.size(); i++) {
+        tasks_[i].job      = jobs[i];
+        tasks_[i].snapshot = snapshot_;
+        tasks_[i].started  = false;
+        tasks_[i].error.clear();
+    }
+
+    for (size_t i=0; i<tasks_.size(); i++) {
+        if (pthread_create(&tasks_[i].thread, NULL, run, &tasks_[i]) == 0)
+            tasks_[i].started = true;
+        else
+            run(&tasks_[i]);    // fall back to writing in this thread
+    }
+}
+
+template <class ctype, int dim>
+void AsyncWriter<ctype,dim>::wait()
+{
+    std::string error;
+
+    for (size_t i=0; i<tasks_.size(); i++) {
+        if (tasks_[i].started)
+            pthread_join(tasks_[i].thread, NULL);
+
+        if (error.empty() && !tasks_[i].error.empty())
+            error = tasks_[i].error;
+
+        delete tasks_[i].job;
+    }
+
+    tasks_.clear();
+
+    if (ownsSnapshot_)
+        delete snapshot_;
+    snapshot_ = NULL;
+
+    if (!error.empty())
+        throw std::runtime_error(error);
+}
+
+
+// ////////////////////////////////////////////////////////
+//   Explicit template instantiations.
+// ////////////////////////////////////////////////////////
+
+namespace psurface {
+  template class AsyncWriter<float,2>;
+}
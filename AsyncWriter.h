@@ -0,0 +1,191 @@
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+
+#include "common.hh"
+
+namespace psurface {
+
+// forward declarations
+template <int dim, class ctype> class PSurface;
+
+/** \brief Writes snapshots of a PSurface to files on background threads
+ *
+ * A call to write() copies the PSurface and returns right away.  The copy is
+ * then written by one thread per output file, while the caller goes on
+ * modifying the original.  At most one snapshot is in flight: write() first
+ * waits until the previous snapshot has been written.  Hence there are never
+ * more than two copies of the surface around (double buffering).
+ *
+ * The target surface is not copied, since none of the writers looks at it.
+ */
+template <class ctype, int dim>
+class AsyncWriter
+{
+public:
+
+    /** \brief One output file (or set of files) to be written from a snapshot */
+    class Job {
+    public:
+        virtual ~Job() {}
+
+        /** \brief Write the snapshot
+         *
+         * Several jobs may be run on the same snapshot concurrently, hence
+         * this must not modify the snapshot.
+         */
+        virtual void write(PSurface<dim,ctype>* par) = 0;
+    };
+
+    /** \brief Writes vtu files, see VTKIO::createVTU() */
+    class VtuJob : public Job {
+    public:
+        VtuJob(const std::string& elementFilename, const std::string& graphFilename,
+               VTK::OutputType outputType = VTK::ascii)
+            : elementFilename_(elementFilename), graphFilename_(graphFilename), outputType_(outputType)
+        {}
+
+        void write(PSurface<dim,ctype>* par);
+
+    private:
+        std::string elementFilename_, graphFilename_;
+        VTK::OutputType outputType_;
+    };
+
+    /** \brief Writes partitioned vtu files, see VTKIO::createPVTU() */
+    class PvtuJob : public Job {
+    public:
+        PvtuJob(const std::string& elementFilename, const std::string& graphFilename,
+                int numPieces = 0, VTK::OutputType outputType = VTK::ascii)
+            : elementFilename_(elementFilename), graphFilename_(graphFilename),
+              numPieces_(numPieces), outputType_(outputType)
+        {}
+
+        void write(PSurface<dim,ctype>* par);
+
+    private:
+        std::string elementFilename_, graphFilename_;
+        int numPieces_;
+        VTK::OutputType outputType_;
+    };
+
+    /** \brief Writes hdf5 (and xdmf) files, see Hdf5IO::createHdfAndXdmf()
+     *
+     * \throws std::runtime_error when run, if psurface has been compiled without hdf5 support
+     */
+    class Hdf5Job : public Job {
+    public:
+        Hdf5Job(const std::string& xdmfFilename, const std::string& hdf5Filename, bool base)
+            : xdmfFilename_(xdmfFilename), hdf5Filename_(hdf5Filename), base_(base)
+        {}
+
+        void write(PSurface<dim,ctype>* par);
+
+    private:
+        std::string xdmfFilename_, hdf5Filename_;
+        bool base_;
+    };
+
+    /** \brief Writes AmiraMesh files, see AmiraMeshIO::writeAmiraMesh()
+     *
+     * \throws std::runtime_error when run, if psurface has been compiled without AmiraMesh support
+     */
+    class AmiraMeshJob : public Job {
+    public:
+        AmiraMeshJob(const std::string& filename)
+            : filename_(filename)
+        {}
+
+        void write(PSurface<dim,ctype>* par);
+
+    private:
+        std::string filename_;
+    };
+
+    /** \brief Create the job that writes a file of the type given by its extension
+     *
+     * Known are .vtu, .pvtu, .h5 (together with an .xdmf file of the same name)
+     * and .am or .par for AmiraMesh.
+     *
+     * \param base For vtu and pvtu files: write the base grid only, without the graph file.
+     *             For hdf5 files: the flag of Hdf5IO::createHdfAndXdmf().
+     * \throws std::runtime_error if the extension is not known
+     */
+    static Job* makeJob(const std::string& filename, bool base = false,
+                        VTK::OutputType vtuEncoding = VTK::ascii);
+
+    /** \brief Insert a suffix in front of the extension of a filename, e.g. for numbered snapshots */
+    static std::string withSuffix(const std::string& filename, const std::string& suffix);
+
+    AsyncWriter();
+
+    /** \brief Waits for the snapshot in flight.  Errors are reported on std::cerr. */
+    ~AsyncWriter();
+
+    /** \brief Start writing a copy of par with the given jobs
+     *
+     * Waits for the previous snapshot first.  The jobs are run concurrently,
+     * each on a thread of its own.  The AsyncWriter takes ownership of the jobs.
+     *
+     * \throws std::runtime_error if writing the previous snapshot failed
+     */
+    void write(const PSurface<dim,ctype>& par, const std::vector<Job*>& jobs);
+
+    /** \brief Start writing a copy of par with a single job */
+    void write(const PSurface<dim,ctype>& par, Job* job) {
+        write(par, std::vector<Job*>(1, job));
+    }
+
+    /** \brief Start writing par itself with the given jobs, without taking a copy
+     *
+     * Useful if the caller has nothing else to do with the surface.  It must
+     * not be modified or deleted until wait() has returned.
+     *
+     * \throws std::runtime_error if writing the previous snapshot failed
+     */
+    void writeInPlace(PSurface<dim,ctype>* par, const std::vector<Job*>& jobs);
+
+    /** \brief Wait until the snapshot in flight has been written
+     *
+     * \throws std::runtime_error if one of its jobs failed
+     */
+    void wait();
+
+private:
+
+    /** \brief A job together with the thread running it */
+    struct Task {
+        Job* job;
+        PSurface<dim,ctype>* snapshot;
+        pthread_t thread;
+        bool started;
+        std::string error;
+    };
+
+    /** \brief The thread function */
+    static void* run(void* task);
+
+    /** \brief Start a thread for each job on the given snapshot */
+    void start(PSurface<dim,ctype>* snapshot, bool ownsSnapshot, const std::vector<Job*>& jobs);
+
+    /** \brief The snapshot in flight, or NULL */
+    PSurface<dim,ctype>* snapshot_;
+
+    /** \brief Whether snapshot_ is a copy that needs to be deleted */
+    bool ownsSnapshot_;
+
+    /** \brief The jobs writing the snapshot in flight */
+    std::vector<Task> tasks_;
+
+    // Copying is not allowed
+    AsyncWriter(const AsyncWriter&);
+    AsyncWriter& operator=(const AsyncWriter&);
+};
+
+} // namespace psurface
+
+#endif
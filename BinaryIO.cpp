@@ -0,0 +1,69 @@
+#include "config.h"
+
+#include <fstream>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "BinaryIO.h"
+
+using namespace psurface;
+
+MappedFile::MappedFile(const std::string& filename)
+    : data_(NULL), size_(0), mapped_(false)
+{
+#ifdef HAVE_SYS_MMAN_H
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Could not open " + filename);
+
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        close(fd);
+        throw std::runtime_error("Could not open " + filename);
+    }
+    size_ = status.st_size;
+
+    // Empty files cannot be mapped
+    if (size_ > 0) {
+        void* mapping = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping != MAP_FAILED) {
+            data_ = static_cast<const char*>(mapping);
+            mapped_ = true;
+        }
+    }
+    close(fd);
+
+    if (mapped_ || size_ == 0)
+        return;
+#endif
+
+    // Read the file into a buffer
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if (!file)
+        throw std::runtime_error("Could not open " + filename);
+
+    file.seekg(0, std::ios::end);
+    buffer_.resize(file.tellg());
+    file.seekg(0, std::ios::beg);
+    if (!buffer_.empty())
+        file.read(&buffer_[0], buffer_.size());
+    if (!file)
+        throw std::runtime_error("Could not read " + filename);
+
+    data_ = (buffer_.empty()) ? NULL : &buffer_[0];
+    size_ = buffer_.size();
+}
+
+
+MappedFile::~MappedFile()
+{
+#ifdef HAVE_SYS_MMAN_H
+    if (mapped_)
+        munmap(const_cast<char*>(data_), size_);
+#endif
+}
@@ -0,0 +1,75 @@
+/**
+ * @file
+ * @brief helpers for flat binary files, which may be memory-mapped
+ */
+#ifndef BINARY_IO_H
+#define BINARY_IO_H
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "psurfaceAPI.h"
+
+namespace psurface {
+
+/** \brief Write n values to a binary stream, in the native byte order */
+template <class V>
+void writeBinary(std::ostream& out, const V* values, size_t n)
+{
+    out.write(reinterpret_cast<const char*>(values), n*sizeof(V));
+}
+
+/** \brief Read n values written by writeBinary() from the memory block [pos, end)
+ *
+ * Advances pos behind the values.  The block need not be aligned.
+ * \throw std::runtime_error if the block ends before
+ */
+template <class V>
+void readBinary(const char*& pos, const char* end, V* values, size_t n)
+{
+    if (size_t(end - pos) < n*sizeof(V))
+        throw std::runtime_error("Unexpected end of binary data");
+    std::memcpy(values, pos, n*sizeof(V));
+    pos += n*sizeof(V);
+}
+
+/** \brief The contents of a file, mapped into memory read-only
+ *
+ * Where mmap() is available the file is mapped, hence several processes
+ * reading the same file share its pages.  Elsewhere it is read into a buffer.
+ */
+class PSURFACE_API MappedFile
+{
+public:
+
+    /** \throw std::runtime_error if the file cannot be opened */
+    explicit MappedFile(const std::string& filename);
+
+    ~MappedFile();
+
+    const char* begin() const { return data_; }
+
+    const char* end() const { return data_ + size_; }
+
+    size_t size() const { return size_; }
+
+private:
+
+    // not copyable
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char* data_;
+    size_t size_;
+
+    /** \brief Whether data_ is a mapping rather than a pointer into buffer_ */
+    bool mapped_;
+    std::vector<char> buffer_;
+};
+
+} // namespace psurface
+
+#endif
@@ -0,0 +1,270 @@
+#ifndef CSR_MATRIX_H
+#define CSR_MATRIX_H
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include "Vector.h"
+#include "IterativeSolvers.h"
+
+namespace psurface {
+
+/** \brief A sparse matrix in compressed sparse row (CSR) format
+ *
+ * The column indices of row i are colIndex[rowStart[i]] ... colIndex[rowStart[i+1]-1],
+ * in increasing order, and values holds the corresponding entries.
+ *
+ * The matrix is either set up from a list of entries, or its pattern is set up
+ * first, and the values are then set in place with setEntry() and addToEntry().
+ *
+ * \tparam T Type of the matrix entries
+ */
+template <class T>
+class CSRMatrix
+{
+public:
+
+    /** \brief A single matrix entry, as used for the assembly */
+    struct Triplet {
+        Triplet() {}
+
+        Triplet(int r, int c, const T& v)
+            : row(r), col(c), value(v)
+        {}
+
+        int row;
+        int col;
+        T value;
+    };
+
+    /** \brief Create an empty 0x0 matrix */
+    CSRMatrix()
+        : rowStart(1, 0), numCols_(0)
+    {}
+
+    /** \brief The number of rows of the matrix */
+    size_t nRows() const {
+        return rowStart.size() - 1;
+    }
+
+    /** \brief The number of columns of the matrix */
+    size_t nCols() const {
+        return numCols_;
+    }
+
+    /** \brief The number of stored entries */
+    size_t nNonZeros() const {
+        return colIndex.size();
+    }
+
+    /** \brief Set up the matrix from a list of entries
+     *
+     * Entries with the same row and column are summed up, in the order
+     * in which they appear in the list.  Hence the result does not depend
+     * on anything but the list itself.
+     */
+    void setFromTriplets(int nRows, int nCols, const std::vector<Triplet>& triplets) {
+
+        numCols_ = nCols;
+
+        // Sort the entries by row, keeping their order within each row
+        std::vector<int> count(nRows+1, 0);
+        for (size_t k=0; k<triplets.size(); k++) {
+            if (triplets[k].row < 0 || triplets[k].row >= nRows || triplets[k].col < 0 || triplets[k].col >= nCols)
+                throw std::runtime_error("CSRMatrix: matrix entry out of range!");
+            count[triplets[k].row+1]++;
+        }
+
+        for (int i=0; i<nRows; i++)
+            count[i+1] += count[i];
+
+        std::vector<std::pair<int,T> > sorted(triplets.size());
+        std::vector<int> next(count.begin(), count.end()-1);
+        for (size_t k=0; k<triplets.size(); k++)
+            sorted[next[triplets[k].row]++] = std::make_pair(triplets[k].col, triplets[k].value);
+
+        // Sort each row by column and merge duplicate entries
+        rowStart.resize(nRows+1);
+        colIndex.clear();
+        values.clear();
+
+        rowStart[0] = 0;
+        for (int i=0; i<nRows; i++) {
+
+            typename std::vector<std::pair<int,T> >::iterator begin = sorted.begin() + count[i];
+            typename std::vector<std::pair<int,T> >::iterator end   = sorted.begin() + count[i+1];
+            std::stable_sort(begin, end, compareColumns);
+
+            for (; begin!=end; ++begin) {
+                if (int(colIndex.size()) > rowStart[i] && colIndex.back() == begin->first)
+                    values.back() += begin->second;
+                else {
+                    colIndex.push_back(begin->first);
+                    values.push_back(begin->second);
+                }
+            }
+
+            rowStart[i+1] = colIndex.size();
+        }
+
+        setupDiagonal();
+    }
+
+    /** \brief Set up the pattern of the matrix, with all entries zero
+     *
+     * The columns of row i are given by columns[start[i]] ... columns[start[i+1]-1],
+     * in any order.  Columns that appear more than once are stored once.
+     */
+    void setPattern(int nRows, int nCols, const std::vector<int>& start, const std::vector<int>& columns) {
+
+        numCols_ = nCols;
+
+        rowStart.resize(nRows+1);
+        colIndex.clear();
+        colIndex.reserve(columns.size());
+
+        rowStart[0] = 0;
+        for (int i=0; i<nRows; i++) {
+
+            std::vector<int>::iterator begin = colIndex.end();
+            colIndex.insert(colIndex.end(), columns.begin() + start[i], columns.begin() + start[i+1]);
+
+            // colIndex does not reallocate, its capacity suffices
+            std::sort(begin, colIndex.end());
+            colIndex.erase(std::unique(begin, colIndex.end()), colIndex.end());
+
+            if (begin != colIndex.end() && (*begin < 0 || colIndex.back() >= nCols))
+                throw std::runtime_error("CSRMatrix: matrix entry out of range!");
+
+            rowStart[i+1] = colIndex.size();
+        }
+
+        values.assign(colIndex.size(), T(0));
+
+        setupDiagonal();
+    }
+
+    /** \brief Set all entries to zero, keeping the pattern */
+    void setZero() {
+        std::fill(values.begin(), values.end(), T(0));
+    }
+
+    /** \brief Multiplication with a scalar */
+    void operator*=(const T& scalar) {
+        for (size_t k=0; k<values.size(); k++)
+            values[k] *= scalar;
+    }
+
+    /** \brief The position of entry (i,j) in colIndex and values, -1 if it is not in the pattern */
+    int find(int i, int j) const {
+        std::vector<int>::const_iterator begin = colIndex.begin() + rowStart[i];
+        std::vector<int>::const_iterator end   = colIndex.begin() + rowStart[i+1];
+        std::vector<int>::const_iterator it = std::lower_bound(begin, end, j);
+        return (it != end && *it == j) ? it - colIndex.begin() : -1;
+    }
+
+    /** \brief Set an entry, which has to be in the pattern */
+    void setEntry(int i, int j, const T& value) {
+        values[position(i,j)] = value;
+    }
+
+    /** \brief Add to an entry, which has to be in the pattern */
+    void addToEntry(int i, int j, const T& value) {
+        values[position(i,j)] += value;
+    }
+
+    /** \brief Get an entry, zero if it is not stored */
+    T operator()(int i, int j) const {
+        int k = find(i,j);
+        return (k >= 0) ? values[k] : T(0);
+    }
+
+    /** \brief Compute y = A x */
+    void multVec(const std::vector<T>& x, std::vector<T>& y) const {
+        y.resize(nRows());
+        for (size_t i=0; i<nRows(); i++) {
+            T sum = 0;
+            for (int k=rowStart[i]; k<rowStart[i+1]; k++)
+                sum += values[k] * x[colIndex[k]];
+            y[i] = sum;
+        }
+    }
+
+    /** \brief Compute A v for all components of v
+     *
+     * The diagonal entry of each row is added first, like SparseMatrix::multVec() does.
+     * BiCGSTAB in single precision is sensitive to the order of the summation.
+     */
+    template <int N>
+    Vector<T,N> multVec(const Vector<T,N>& v) const {
+        Vector<T,N> result(nRows());
+        multVec(v, result);
+        return result;
+    }
+
+    /** \brief Compute result = A v for all components of v, without allocating result
+     *
+     * Each entry of the matrix is loaded once, and applied to all N components.
+     */
+    template <int N>
+    void multVec(const Vector<T,N>& v, Vector<T,N>& result) const {
+        for (size_t i=0; i<nRows(); i++) {
+            StaticVector<T,N> sum(0);
+
+            if (diagonal[i] >= 0)
+                sum += values[diagonal[i]] * v[i];
+
+            for (int k=rowStart[i]; k<rowStart[i+1]; k++)
+                if (k != diagonal[i])
+                    sum += values[k] * v[colIndex[k]];
+
+            result[i] = sum;
+        }
+    }
+
+    /** \brief Solve A x = b with BI-CGSTAB, see psurface::BiCGSTAB() */
+    size_t BiCGSTAB(const Vector<T>& b, Vector<T>& x, Vector<T>& r,
+                    const size_t& maxIter, const T& tolerance) const {
+        return psurface::BiCGSTAB(*this, b, x, r, maxIter, tolerance);
+    }
+
+    /** \brief Start of each row in colIndex and values, plus the total number of entries */
+    std::vector<int> rowStart;
+
+    /** \brief The column index of each entry */
+    std::vector<int> colIndex;
+
+    /** \brief The value of each entry */
+    std::vector<T> values;
+
+    /** \brief The position of the diagonal entry of each row, -1 if it is not in the pattern */
+    std::vector<int> diagonal;
+
+private:
+
+    /** \brief Look up the diagonal entries once the pattern is known */
+    void setupDiagonal() {
+        diagonal.resize(nRows());
+        for (size_t i=0; i<nRows(); i++)
+            diagonal[i] = find(i,i);
+    }
+
+    /** \brief The position of entry (i,j), which has to be in the pattern */
+    int position(int i, int j) const {
+        int k = find(i,j);
+        if (k < 0)
+            throw std::runtime_error("CSRMatrix: matrix entry not in the pattern!");
+        return k;
+    }
+
+    static bool compareColumns(const std::pair<int,T>& a, const std::pair<int,T>& b) {
+        return a.first < b.first;
+    }
+
+    int numCols_;
+};
+
+} // namespace psurface
+
+#endif
@@ -1,6 +1,7 @@
 #include "config.h"
 
 #include <limits>
+#include <algorithm>
 #include <stdexcept>
 
 #ifdef PSURFACE_STANDALONE
@@ -77,6 +78,8 @@ void ContactMapping<2,ctype>::build(const std::vector<std::tr1::array<ctype,2> >
         for (int j=0; j<2; j++)
             psurface_.targetVertices[i][j] = coords2[i][j];
 
+    psurface_.targetSegments = tri2;
+
     // /////////////////////////////////////////////////////
     //   Build the segments-per-vertex arrays
     // /////////////////////////////////////////////////////
@@ -143,66 +146,93 @@ void ContactMapping<2,ctype>::build(const std::vector<std::tr1::array<ctype,2> >
     // ///////////////////////////////////////////////////////////////////////
     const ctype eps = 1e-10;
 
-    for (size_t i=0; i<psurface_.targetVertices.size(); i++) {
-
-        ctype bestLocalPos = std::numeric_limits<ctype>::max();  // init to something
-        int bestSegment = -1;
-        ctype bestDist = std::numeric_limits<ctype>::max();
+    // Sort the domain segments along the coordinate axis in which the domain
+    // extends the most.  The distance along that axis alone is a lower bound
+    // for the distance of a target vertex to any point on a segment.  Hence
+    // the segments can be swept outwards from each target vertex, and the
+    // sweep stops once that bound exceeds the best projection found so far.
+    int axis = 0;
+    if (numVertices1 > 0) {
+        StaticVector<ctype,2> lowerCorner = psurface_.domainVertices[0];
+        StaticVector<ctype,2> upperCorner = psurface_.domainVertices[0];
+        for (int i=1; i<numVertices1; i++)
+            for (int j=0; j<2; j++) {
+                lowerCorner[j] = std::min(lowerCorner[j], psurface_.domainVertices[i][j]);
+                upperCorner[j] = std::max(upperCorner[j], psurface_.domainVertices[i][j]);
+            }
+        axis = (upperCorner[1]-lowerCorner[1] > upperCorner[0]-lowerCorner[0]) ? 1 : 0;
+    }
 
-        for (int j=0; j<psurface_.domainSegments.size(); j++) {
+    // The segments ordered by the lower end of their extent along the axis
+    std::vector<std::pair<ctype,int> > sweepOrder(nTri1);
+    for (int i=0; i<nTri1; i++)
+        sweepOrder[i] = std::make_pair(std::min(coords1[tri1[i][0]][axis], coords1[tri1[i][1]][axis]), i);
 
-            const StaticVector<ctype,2>& p0 = psurface_.domainVertices[psurface_.domainSegments[j].points[0]];
-            const StaticVector<ctype,2>& p1 = psurface_.domainVertices[psurface_.domainSegments[j].points[1]];
+    std::sort(sweepOrder.begin(), sweepOrder.end());
 
-            const StaticVector<ctype,2>& n0 = domainNormals[psurface_.domainSegments[j].points[0]];
-            const StaticVector<ctype,2>& n1 = domainNormals[psurface_.domainSegments[j].points[1]];
+    // The upper ends in the same order, and their running maximum
+    std::vector<ctype> sweepUpper(nTri1), sweepMaxUpper(nTri1);
+    for (int k=0; k<nTri1; k++) {
+        int i = sweepOrder[k].second;
+        sweepUpper[k]    = std::max(coords1[tri1[i][0]][axis], coords1[tri1[i][1]][axis]);
+        sweepMaxUpper[k] = (k==0) ? sweepUpper[k] : std::max(sweepUpper[k], sweepMaxUpper[k-1]);
+    }
 
-            ctype local; // the unknown...
+    // The projections don't depend on each other, and are computed concurrently.
+    // They are then inserted into the segments in the order of the target vertices.
+    const long numTargetVertices = psurface_.targetVertices.size();
+    std::vector<int>   bestSegments(numTargetVertices);
+    std::vector<ctype> bestLocalPositions(numTargetVertices);
 
-            if (NormalProjector<ctype>::computeInverseNormalProjection(p0, p1, n0, n1,
-                                                                        psurface_.targetVertices[i], local)) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (long i=0; i<numTargetVertices; i++) {
 
-                // We want that the line from the domain surface to its projection
-                // approaches the target surface from the front side, i.e., it should
-                // not pass through the body represented by the target surface.
-                // We do a simplified test by comparing the connecting segment
-                // with the normal at the target surface and the normal at the
-                // domain surface
-                /** \todo Rewrite this once we have expression templates */
-                StaticVector<ctype,2> base;
-                StaticVector<ctype, 2> baseNormal;
-                StaticVector<ctype, 2> segment;
+        const StaticVector<ctype,2>& q = psurface_.targetVertices[i];
 
-                for (int k=0; k<2; k++) {
-                    base[k]       = (1-local)*p0[k] + local*p1[k];
-                    baseNormal[k] = (1-local)*n0[k] + local*n1[k];
-                    segment[k]    = psurface_.targetVertices[i][k] - base[k];
-                }
+        ctype bestLocalPos = std::numeric_limits<ctype>::max();  // init to something
+        int bestSegment = -1;
+        ctype bestDist = std::numeric_limits<ctype>::max();
 
-                ctype distance = segment.length2();
+        // first sweep upwards through the segments that start above q ...
+        int start = std::upper_bound(sweepOrder.begin(), sweepOrder.end(),
+                                     std::make_pair(q[axis], std::numeric_limits<int>::max())) - sweepOrder.begin();
 
-                if (segment.dot(targetNormals[i]) > -0.0001
-                    && segment.dot(baseNormal) > -0.0001
-                    && distance > 1e-8) {
-                    //printf("aborting %g %g %g\n", segment * targetNormals[i], segment * baseNormal, distance);
-                    continue;
-                }
+        for (int k=start; k<nTri1; k++) {
 
-                // There may be several inverse orthogonal projections.
-                // We want the shortest one.
+            ctype gap = sweepOrder[k].first - q[axis];
+            if (gap*gap > bestDist)
+                break;
 
-                if (distance < bestDist) {
+            tryProjection(sweepOrder[k].second, q, targetNormals[i], domainNormals,
+                          bestSegment, bestLocalPos, bestDist);
+        }
 
-                    bestDist = distance;
-                    bestLocalPos = local;
-                    bestSegment  = j;
+        // ... then downwards through the ones that start below it
+        for (int k=start-1; k>=0; k--) {
 
-                }
+            ctype gap = q[axis] - sweepMaxUpper[k];
+            if (gap > 0 && gap*gap > bestDist)
+                break;
 
-            }
+            gap = q[axis] - sweepUpper[k];
+            if (gap > 0 && gap*gap > bestDist)
+                continue;
 
+            tryProjection(sweepOrder[k].second, q, targetNormals[i], domainNormals,
+                          bestSegment, bestLocalPos, bestDist);
         }
 
+        bestSegments[i]       = bestSegment;
+        bestLocalPositions[i] = bestLocalPos;
+    }
+
+    for (size_t i=0; i<psurface_.targetVertices.size(); i++) {
+
+        int bestSegment = bestSegments[i];
+        ctype bestLocalPos = bestLocalPositions[i];
+
         // /////////////////////////////////////////////
         //   We have found a valid projection
         // /////////////////////////////////////////////
@@ -260,6 +290,11 @@ void ContactMapping<2,ctype>::build(const std::vector<std::tr1::array<ctype,2> >
     //   Insert missing nodes that belong to vertices of the domain segment
     // //////////////////////////////////////////////////////////////////////
 
+    // The projections of the domain vertices, computed when they are first needed.
+    // Each vertex is shared by two segments, but only needs to be projected once.
+    std::vector<int>   vertexRangeSegments(numVertices1, -2);
+    std::vector<ctype> vertexRangeLocalPositions(numVertices1);
+
     for (int i=0; i<psurface_.domainSegments.size(); i++) {
 
         typename PSurface<1,ctype>::DomainSegment& cS = psurface_.domainSegments[i];
@@ -269,12 +304,18 @@ void ContactMapping<2,ctype>::build(const std::vector<std::tr1::array<ctype,2> >
             || !cS.nodes[0].isNodeOnVertex
             || (cS.nodes.size()==1 && cS.nodes[0].isNodeOnVertex && cS.nodes[0].domainLocalPosition > 1-eps)) {
 
-            ctype rangeLocalPosition;
-            int rangeSegment;
+            int v = cS.points[0];
+
+            if (vertexRangeSegments[v] == -2
+                && !NormalProjector<ctype>::normalProjection(psurface_.domainVertices[v], domainNormals[v],
+                                                             vertexRangeSegments[v], vertexRangeLocalPositions[v],
+                                                             tri2, coords2))
+                vertexRangeSegments[v] = -1;
+
+            ctype rangeLocalPosition = vertexRangeLocalPositions[v];
+            int rangeSegment = vertexRangeSegments[v];
 
-            if (NormalProjector<ctype>::normalProjection(psurface_.domainVertices[cS.points[0]], domainNormals[cS.points[0]],
-                                                          rangeSegment, rangeLocalPosition,
-                                                          tri2, coords2)) {
+            if (rangeSegment != -1) {
 
                 typename PSurface<1,ctype>::Node newNode(0, rangeLocalPosition, true, false, rangeSegment, rangeSegment);
 
@@ -289,12 +330,18 @@ void ContactMapping<2,ctype>::build(const std::vector<std::tr1::array<ctype,2> >
             || !cS.nodes.back().isNodeOnVertex
             || (cS.nodes.size()==1 && cS.nodes[0].isNodeOnVertex && cS.nodes[0].domainLocalPosition < eps)) {
 
-            ctype rangeLocalPosition;
-            int rangeSegment;
+            int v = cS.points[1];
 
-            if (NormalProjector<ctype>::normalProjection(psurface_.domainVertices[cS.points[1]], domainNormals[cS.points[1]],
-                                                          rangeSegment, rangeLocalPosition,
-                                                          tri2, coords2)) {
+            if (vertexRangeSegments[v] == -2
+                && !NormalProjector<ctype>::normalProjection(psurface_.domainVertices[v], domainNormals[v],
+                                                             vertexRangeSegments[v], vertexRangeLocalPositions[v],
+                                                             tri2, coords2))
+                vertexRangeSegments[v] = -1;
+
+            ctype rangeLocalPosition = vertexRangeLocalPositions[v];
+            int rangeSegment = vertexRangeSegments[v];
+
+            if (rangeSegment != -1) {
 
                 typename PSurface<1,ctype>::Node newNode(1, rangeLocalPosition, true, false, rangeSegment, rangeSegment);
 
@@ -348,6 +395,61 @@ void ContactMapping<2,ctype>::build(const std::vector<std::tr1::array<ctype,2> >
 
 }
 
+template <class ctype>
+void ContactMapping<2,ctype>::tryProjection(int j,
+                                            const StaticVector<ctype,2>& q,
+                                            const StaticVector<ctype,2>& targetNormal,
+                                            const std::vector<StaticVector<ctype,2> >& domainNormals,
+                                            int& bestSegment, ctype& bestLocalPos, ctype& bestDist) const
+{
+    const StaticVector<ctype,2>& p0 = psurface_.domainVertices[psurface_.domainSegments[j].points[0]];
+    const StaticVector<ctype,2>& p1 = psurface_.domainVertices[psurface_.domainSegments[j].points[1]];
+
+    const StaticVector<ctype,2>& n0 = domainNormals[psurface_.domainSegments[j].points[0]];
+    const StaticVector<ctype,2>& n1 = domainNormals[psurface_.domainSegments[j].points[1]];
+
+    ctype local; // the unknown...
+
+    if (!NormalProjector<ctype>::computeInverseNormalProjection(p0, p1, n0, n1, q, local))
+        return;
+
+    // We want that the line from the domain surface to its projection
+    // approaches the target surface from the front side, i.e., it should
+    // not pass through the body represented by the target surface.
+    // We do a simplified test by comparing the connecting segment
+    // with the normal at the target surface and the normal at the
+    // domain surface
+    /** \todo Rewrite this once we have expression templates */
+    StaticVector<ctype,2> base;
+    StaticVector<ctype, 2> baseNormal;
+    StaticVector<ctype, 2> segment;
+
+    for (int k=0; k<2; k++) {
+        base[k]       = (1-local)*p0[k] + local*p1[k];
+        baseNormal[k] = (1-local)*n0[k] + local*n1[k];
+        segment[k]    = q[k] - base[k];
+    }
+
+    ctype distance = segment.length2();
+
+    if (segment.dot(targetNormal) > -0.0001
+        && segment.dot(baseNormal) > -0.0001
+        && distance > 1e-8)
+        return;
+
+    // There may be several inverse orthogonal projections.
+    // We want the shortest one.  Ties go to the segment with the
+    // lower index, no matter in which order the segments are tried.
+
+    if (distance < bestDist || (distance == bestDist && j < bestSegment)) {
+
+        bestDist = distance;
+        bestLocalPos = local;
+        bestSegment  = j;
+
+    }
+}
+
 template <class ctype>
 void ContactMapping<2,ctype>::computeDiscreteDomainDirections(const DirectionFunction<2,ctype>* direction,
                                                          std::vector<StaticVector<ctype,2> >& normals)
@@ -466,13 +568,19 @@ void ContactMapping<3,ctype>::build(const std::vector<std::tr1::array<ctype,3> >
                          const std::vector<std::tr1::array<ctype,3> >& coords2,  ///< The vertices of the second surface
                          const std::vector<std::tr1::array<int,3> >& tri2,
                                     const DirectionFunction<3,ctype>* domainDirection,
-                                    const DirectionFunction<3,ctype>* targetDirection)
+                                    const DirectionFunction<3,ctype>* targetDirection,
+                                    ctype maxGap,
+                                    const TargetSurfaceIndex<ctype>* targetIndex)
 {
     int nVert1 = coords1.size();
     int nVert2 = coords2.size();
     int nTri1  = tri1.size();
     int nTri2  = tri2.size();
 
+    // Drop the parametrization from a previous run, if there is one
+    delete psurface_.surface;
+    psurface_.clear();
+
     // Create target Surface object
     Surface* surface2_ = new Surface;
 
@@ -531,7 +639,7 @@ void ContactMapping<3,ctype>::build(const std::vector<std::tr1::array<ctype,3> >
     // compute projection
     NormalProjector<ctype> projector(&psurface_);
 
-    projector.project(surface2_, domainDirection, targetDirection);
+    projector.project(surface2_, domainDirection, targetDirection, maxGap, targetIndex);
 
 }
 
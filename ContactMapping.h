@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <iostream>
+#include <limits>
 
 // Check for VC9 / VS2008 with installed feature pack.
 #if defined(_MSC_VER) && (_MSC_VER>=1500)
@@ -18,6 +19,7 @@
 #include "StaticVector.h"
 #include "PSurface.h"
 #include "IntersectionPrimitive.h"
+#include "OverlapSet.h"
 #include "IntersectionPrimitiveCollector.h"
 
 namespace psurface {
@@ -25,6 +27,9 @@ namespace psurface {
 template <int dimworld, class ctype>
 struct DirectionFunction;
 
+template <class ctype>
+class TargetSurfaceIndex;
+
 template <int dim, class ctype>
 class ContactMapping {};
 
@@ -45,6 +50,24 @@ public:
         IntersectionPrimitiveCollector<ctype>::collect(&psurface_, overlaps);
     }
 
+    /** \brief Get the overlaps as a structure of arrays */
+    void getOverlaps(OverlapSet<1,ctype>& overlaps)
+    {
+        IntersectionPrimitiveCollector<ctype>::collect(&psurface_, overlaps);
+    }
+
+    /** \brief Hand the overlaps to a visitor in chunks of at most chunkSize, instead of storing them all */
+    void getOverlaps(OverlapVisitor<1,ctype>& visitor, std::size_t chunkSize = 1024)
+    {
+        IntersectionPrimitiveCollector<ctype>::collect(&psurface_, visitor, chunkSize);
+    }
+
+    /** \brief The parametrization set up by build(), e.g. for PSurface<1,ctype>::positionMap() */
+    const PSurface<1,ctype>& getPSurface() const
+    {
+        return psurface_;
+    }
+
     // /////////////////////////////////////////////
 
 private:
@@ -56,6 +79,16 @@ private:
                                          const DirectionFunction<2,ctype>* direction,
                                          std::vector<StaticVector<ctype,2> >& normals);
 
+    /** \brief Try the inverse normal projection of the target vertex q onto the domain segment j
+     *
+     * The projection replaces the best one so far if it is valid and shorter.
+     */
+    void tryProjection(int j,
+                       const StaticVector<ctype,2>& q,
+                       const StaticVector<ctype,2>& targetNormal,
+                       const std::vector<StaticVector<ctype,2> >& domainNormals,
+                       int& bestSegment, ctype& bestLocalPos, ctype& bestDist) const;
+
     PSurface<1,ctype> psurface_;
 
 };
@@ -71,13 +104,25 @@ public:
                const std::vector<std::tr1::array<ctype,3> >& coords2,  ///< The vertices of the second surface
                const std::vector<std::tr1::array<int,3> >& tri2,       ///< The triangles of the second surface
                const DirectionFunction<3,ctype>* domainDirection = NULL,
-               const DirectionFunction<3,ctype>* targetDirection = NULL
+               const DirectionFunction<3,ctype>* targetDirection = NULL,
+               ctype maxGap = std::numeric_limits<ctype>::max(),       ///< Parts of the surfaces that are farther apart are not in contact
+               const TargetSurfaceIndex<ctype>* targetIndex = NULL     ///< A prebuilt index of the second surface, see NormalProjector::project()
                );
 
     void getOverlaps(std::vector<IntersectionPrimitive<2,ctype> >& overlaps) {
         IntersectionPrimitiveCollector<ctype>::collect(&psurface_, overlaps);
     }
 
+    /** \brief Get the overlaps as a structure of arrays */
+    void getOverlaps(OverlapSet<2,ctype>& overlaps) {
+        IntersectionPrimitiveCollector<ctype>::collect(&psurface_, overlaps);
+    }
+
+    /** \brief Hand the overlaps to a visitor in chunks of at most chunkSize, instead of storing them all */
+    void getOverlaps(OverlapVisitor<2,ctype>& visitor, std::size_t chunkSize = 1024) {
+        IntersectionPrimitiveCollector<ctype>::collect(&psurface_, visitor, chunkSize);
+    }
+
 private:
 
     PSurface<2,ctype> psurface_;
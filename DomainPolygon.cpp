@@ -45,6 +45,7 @@ void DomainPolygon::init(const DomainTriangle<float>& tri, const StaticVector<fl
 
     removeExtraEdges();
     par->hasUpToDatePointLocationStructure = false;
+    par->hasUpToDateOverlapStructure = false;
 
 }
 
@@ -58,6 +59,7 @@ void DomainPolygon::mergeTriangle(int tri, StaticVector<float,2> coords[3], int&
 
     cT.removeExtraEdges();
     par->hasUpToDatePointLocationStructure = false;
+    par->hasUpToDateOverlapStructure = false;
 
     int thePolygonEdge[2];
     int theTriangleEdge[2];
@@ -81,6 +81,12 @@ public:
         PlaneParam<float>::applyParametrization(par->iPos);
     }
 
+    /// Same as above, with the memory of the linear solver given by the caller
+    void applyParametrization(ILU0Preconditioner<float>& preconditioner,
+                              IterativeSolverWorkspace<float,2>& workspace) {
+        PlaneParam<float>::applyParametrization(par->iPos, preconditioner, workspace);
+    }
+
     ///
     void garbageCollection() {
         std::vector<int> offArr;
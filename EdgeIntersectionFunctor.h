@@ -1,5 +1,5 @@
-#ifndef POINT_INTERSECTION_FUNCTOR_H
-#define POINT_INTERSECTION_FUNCTOR_H
+#ifndef EDGE_INTERSECTION_FUNCTOR_H
+#define EDGE_INTERSECTION_FUNCTOR_H
 
 // Check for VC9 / VS2008 with installed feature pack.
 #if defined(_MSC_VER) && (_MSC_VER>=1500)
@@ -15,34 +15,21 @@
     #include <tr1/array>
 #endif
 
+#include <algorithm>
+
+#include "Box.h"
 #include "SurfaceParts.h"
 
 namespace psurface {
 
 /** \brief Functor class needed to insert McEdge objects into a MultiDimOctree
+ *
+ *  An edge intersects a box if the part of the edge that lies between the two
+ *  planes bounding the box in each direction is not empty (slab test).  The box
+ *  is considered closed.
  */
 struct EdgeIntersectionFunctor
 {
-    class MyMcBox2f 
-        : std::tr1::array<float,4>
-    {
-    public:
-        MyMcBox2f(float a, float b, float c, float d)
-        {
-            (*this)[0] = a;
-            (*this)[1] = b;
-            (*this)[2] = c;
-            (*this)[3] = d;
-        }
-
-        /// Returns TRUE if intersection of given point and Box is not empty
-        bool intersect(const StaticVector<float,2> &pt) const {
-            return (pt[0]>=(*this)[0] && pt[0]<=(*this)[1] 
-                    && pt[1]>=(*this)[2] && pt[1]<=(*this)[3]);
-        }
-
-    };
-
     /** \brief Constructor */
     EdgeIntersectionFunctor(const Vertex<float>* vertices)
         : vertices_(vertices)
@@ -51,80 +38,100 @@ struct EdgeIntersectionFunctor
     bool operator()(const std::tr1::array<float,3>& lower,
                     const std::tr1::array<float,3>& upper, const Edge& item) const {
 
-        // The edge intersects the box if one of the endpoints is within the box
-        if (Box<float,3>(lower,upper).contains(vertices_[item.from]) 
-            || Box<float,3>(lower,upper).contains(vertices_[item.to]))
-            return true;
-
-        // Otherwise, the edge intersects the box if it intersects one of the six faces
-        return (intersectsXYPatch( MyMcBox2f(lower[0], upper[0], lower[1], upper[1]), lower[2], &item) ||
-                intersectsXYPatch( MyMcBox2f(lower[0], upper[0], lower[1], upper[1]), upper[2], &item) ||
-                intersectsXZPatch( MyMcBox2f(lower[0], upper[0], lower[2], upper[2]), lower[1], &item) ||
-                intersectsXZPatch( MyMcBox2f(lower[0], upper[0], lower[2], upper[2]), upper[1], &item) ||
-                intersectsYZPatch( MyMcBox2f(lower[1], upper[1], lower[2], upper[2]), lower[0], &item) ||
-                intersectsYZPatch( MyMcBox2f(lower[1], upper[1], lower[2], upper[2]), upper[0], &item));
-    }
+        const StaticVector<float,3>& f = vertices_[item.from];
+        const StaticVector<float,3>& t = vertices_[item.to];
 
-protected:
+        // the parameter interval of the edge that is within all slabs seen so far
+        float tMin = 0;
+        float tMax = 1;
 
-    bool intersectsXYPatch(const MyMcBox2f& rect, float z, const Edge* item) const {
+        for (int i=0; i<3; i++) {
 
-        const StaticVector<float,3>& f = vertices_[item->from];
-        const StaticVector<float,3>& t = vertices_[item->to];
+            float d = t[i] - f[i];
 
-        if ( (f[2] < z && t[2] < z) || (f[2] > z && t[2] > z))
-            return false;
+            // the edge is parallel to the slab
+            if (d == 0) {
+                if (f[i] < lower[i] || f[i] > upper[i])
+                    return false;
+                continue;
+            }
 
-        float lambda = (z - f[2]) / (t[2] - f[2]);
+            float a = (lower[i] - f[i]) / d;
+            float b = (upper[i] - f[i]) / d;
 
-        StaticVector<float,2> intersection;
-        intersection[0] = f[0] + lambda*(t[0] - f[0]);
-        intersection[1] = f[1] + lambda*(t[1] - f[1]);
+            tMin = std::max(tMin, std::min(a,b));
+            tMax = std::min(tMax, std::max(a,b));
+        }
 
-        return rect.intersect(intersection);
+        return tMin <= tMax;
     }
 
+    /** \brief Tests the edge against the eight subcells of an octree cell at once
 
+        Subcell j is the one which is in the upper half of the cell in direction
+        i if bit i of j is set.  hits[j] is set to true if the edge intersects subcell j,
+        with the same result as calling operator() for subcell j.
+    */
+    void intersectSubcells(const Box<float,3>& cellBox, const Edge& item, bool* hits) const {
 
-   bool intersectsXZPatch(const MyMcBox2f& rect, float y, const Edge* item) const {
+        const StaticVector<float,3>& f = vertices_[item.from];
+        const StaticVector<float,3>& t = vertices_[item.to];
 
-        const StaticVector<float,3>& f = vertices_[item->from];
-        const StaticVector<float,3>& t = vertices_[item->to];
+        // Parameter intervals of the edge within the lower and the upper slab
+        // in each direction.  There are only six of them, the eight subcells
+        // are their combinations.
+        float slabMin[3][2], slabMax[3][2];
 
-        if ( (f[1] < y && t[1] <y) || (f[1] > y && t[1] > y))
-            return false;
+        std::tr1::array<float,3> center = cellBox.center();
 
-        float lambda = (y - f[1]) / (t[1] - f[1]);
+        for (int i=0; i<3; i++) {
 
-        StaticVector<float,2> intersection;
-        intersection[0] = f[0] + lambda*(t[0] - f[0]);
-        intersection[1] = f[2] + lambda*(t[2] - f[2]);
+            float planes[3] = {cellBox.lower()[i], center[i], cellBox.upper()[i]};
+            float d = t[i] - f[i];
 
-        return rect.intersect(intersection);
-    }
-
-    bool intersectsYZPatch(const MyMcBox2f& rect, float x, const Edge* item) const {
-
-        const StaticVector<float,3>& f = vertices_[item->from];
-        const StaticVector<float,3>& t = vertices_[item->to];
+            for (int h=0; h<2; h++) {
 
-        if ( (f[0] < x && t[0] <x) || (f[0] > x && t[0] > x))
-            return false;
+                if (d == 0) {
+                    // an empty interval if the edge is outside of the slab
+                    bool inside = f[i] >= planes[h] && f[i] <= planes[h+1];
+                    slabMin[i][h] = (inside) ? 0 : 1;
+                    slabMax[i][h] = (inside) ? 1 : 0;
+                    continue;
+                }
 
-        float lambda = (x - f[0]) / (t[0] - f[0]);
+                float a = (planes[h]   - f[i]) / d;
+                float b = (planes[h+1] - f[i]) / d;
+                slabMin[i][h] = std::min(a,b);
+                slabMax[i][h] = std::max(a,b);
+            }
+        }
 
-        StaticVector<float,2> intersection;
-        intersection[0] = f[1] + lambda*(t[1] - f[1]);
-        intersection[1] = f[2] + lambda*(t[2] - f[2]);
+        // The same operations for all subcells, without branches, so that
+        // the compiler can vectorize this loop
+        float tMin[8], tMax[8];
+        for (int j=0; j<8; j++) {
+            tMin[j] = std::max(std::max(0.0f, slabMin[0][j&1]), std::max(slabMin[1][(j>>1)&1], slabMin[2][(j>>2)&1]));
+            tMax[j] = std::min(std::min(1.0f, slabMax[0][j&1]), std::min(slabMax[1][(j>>1)&1], slabMax[2][(j>>2)&1]));
+        }
 
-        return rect.intersect(intersection);
+        for (int j=0; j<8; j++)
+            hits[j] = tMin[j] <= tMax[j];
     }
 
+protected:
+
     //const std::vector<McVertex>& vertices_;
     const Vertex<float>* vertices_;
 
 };
 
+/** \brief Use the batch test of EdgeIntersectionFunctor when an octree subdivides a cell */
+inline void intersectSubcells(const EdgeIntersectionFunctor& f, const Box<float,3>& cellBox,
+                              const Edge& item, bool* hits)
+{
+    f.intersectSubcells(cellBox, item, hits);
+}
+
 } // namespace psurface
 
 #endif
@@ -189,6 +189,7 @@
       }
 
       par->hasUpToDatePointLocationStructure = false;
+      par->hasUpToDateOverlapStructure = false;
       par->setupOriginalSurface();
 
       return par;
@@ -900,6 +900,7 @@ void writeFloatDataToFile(hid_t* file_id, hid_t* dataset_id, hid_t* dataspace_id
         }
     }
     par->hasUpToDatePointLocationStructure = false;
+    par->hasUpToDateOverlapStructure = false;
     par->setupOriginalSurface();
   };
 
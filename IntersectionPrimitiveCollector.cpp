@@ -1,6 +1,11 @@
 #include "config.h"
 
 #include <vector>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #ifdef PSURFACE_STANDALONE
 #include "TargetSurface.h"
@@ -13,19 +18,37 @@
 
 using namespace psurface;
 
+// Number of domain triangles that are collected as one unit of work
+static const long blockSize = 256;
+
+template <class T>
+static void appendBlock(std::vector<T>& mergedGrid, const std::vector<T>& block)
+{
+    mergedGrid.insert(mergedGrid.end(), block.begin(), block.end());
+}
+
+template <int dim, class ctype>
+static void appendBlock(OverlapSet<dim,ctype>& mergedGrid, const OverlapSet<dim,ctype>& block)
+{
+    mergedGrid.append(block);
+}
+
 template <class ctype>
-void IntersectionPrimitiveCollector<ctype>::collect(PSurface<2,ctype>* psurface,
-                                       std::vector<IntersectionPrimitive<2,ctype> >& mergedGrid)
+void IntersectionPrimitiveCollector<ctype>::prepare(PSurface<2,ctype>* psurface)
 {
-    if (psurface->getNumTriangles()==0)
+    if (psurface->hasUpToDateOverlapStructure || psurface->getNumTriangles()==0)
         return;
 
 
     // ///////////////////////////////////////////////////
     // Set up point location structure
     // Can we use the routine in PSurface<2,ctype> ???
+    // The triangles are independent of each other here.
     // ///////////////////////////////////////////////////
-    for (size_t i=0; i<psurface->getNumTriangles(); i++) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+    for (long i=0; i<long(psurface->getNumTriangles()); i++) {
 
         DomainTriangle<ctype>& cT = psurface->triangles(i);
 
@@ -80,8 +103,17 @@ void IntersectionPrimitiveCollector<ctype>::collect(PSurface<2,ctype>* psurface,
 
     psurface->surface->computeTrianglesPerPoint();
 
-    //
-    for (size_t i=0; i<psurface->getNumTriangles(); i++) {
+    psurface->hasUpToDateOverlapStructure = true;
+}
+
+template <class ctype>
+template <class Container>
+void IntersectionPrimitiveCollector<ctype>::collectTriangles(const PSurface<2,ctype>* psurface, long begin, long end,
+                                                            Container& mergedGrid)
+{
+    IntersectionPrimitive<2,ctype> newOverlap;
+
+    for (long i=begin; i<end; i++) {
 
         const DomainTriangle<ctype>& cT = psurface->triangles(i);
 
@@ -110,20 +142,19 @@ void IntersectionPrimitiveCollector<ctype>::collect(PSurface<2,ctype>* psurface,
             // //////////////////////////////////////////////
             // Assemble the triangles
             // //////////////////////////////////////////////
-            mergedGrid.push_back(IntersectionPrimitive<2,ctype>());
-            mergedGrid.back().tris[0] = i;
-            mergedGrid.back().tris[1] = targetTri;
+            newOverlap.tris[0] = i;
+            newOverlap.tris[1] = targetTri;
 
             for (int j=0; j<3; j++) {
 
                 // Local coordinates in the domain triangle
-                mergedGrid.back().localCoords[0][j] = cT.nodes[cPT.vertices(j)].domainPos();
+                newOverlap.localCoords[0][j] = cT.nodes[cPT.vertices(j)].domainPos();
 
                 // Local coordinates in the target triangle
-                mergedGrid.back().localCoords[1][j] = psurface->getLocalTargetCoords(GlobalNodeIdx(i, cPT.vertices(j)), targetTri);
+                newOverlap.localCoords[1][j] = psurface->getLocalTargetCoords(GlobalNodeIdx(i, cPT.vertices(j)), targetTri);
 
                 // world coordinates in the domain triangle
-                mergedGrid.back().points[j] =
+                newOverlap.points[j] =
                     PlaneParam<ctype>::template linearInterpol<StaticVector<ctype,3> >(cT.nodes[cPT.vertices(j)].domainPos(),
                                                                               psurface->vertices(cT.vertices[0]),
                                                                               psurface->vertices(cT.vertices[1]),
@@ -131,61 +162,177 @@ void IntersectionPrimitiveCollector<ctype>::collect(PSurface<2,ctype>* psurface,
 
             }
 
-        }
+            mergedGrid.push_back(newOverlap);
 
+        }
     }
+}
 
+template <class ctype>
+void IntersectionPrimitiveCollector<ctype>::collect(const PSurface<2,ctype>* psurface,
+                                       std::vector<IntersectionPrimitive<2,ctype> >& mergedGrid)
+{
+    collectBlocks(psurface, mergedGrid);
 }
 
 template <class ctype>
-void IntersectionPrimitiveCollector<ctype>::collect(const PSurface<1,ctype>* psurface,
-                                       std::vector<IntersectionPrimitive<1,ctype> >& mergedGrid)
+void IntersectionPrimitiveCollector<ctype>::collect(const PSurface<2,ctype>* psurface,
+                                       OverlapSet<2,ctype>& mergedGrid)
 {
-    for (size_t i=0; i<psurface->domainSegments.size(); i++) {
+    collectBlocks(psurface, mergedGrid);
+}
 
-        const typename PSurface<1,ctype>::DomainSegment&    cS = psurface->domainSegments[i];
-        const std::vector<typename PSurface<1,ctype>::Node>& nodes = psurface->domainSegments[i].nodes;
+template <class ctype>
+template <class Container>
+void IntersectionPrimitiveCollector<ctype>::collectBlocks(const PSurface<2,ctype>* psurface, Container& mergedGrid)
+{
+    if (psurface->getNumTriangles()==0)
+        return;
 
-        ////////////////////////////////
-        for (int j=0; j<int(nodes.size())-1; j++) {
+    assert(psurface->hasUpToDateOverlapStructure);
 
-            /** \todo Should be in here for true edge handling */
-            // Don't do anything if the current pair of points is not connected by an edge
-            if (nodes[j].rightRangeSegment == -1)
-                continue;
+    // The triangles are split into blocks, which are collected concurrently
+    // into buffers of their own.  The buffers are then appended in block
+    // order, which keeps the result independent of the number of threads.
+    const long numTriangles = psurface->getNumTriangles();
+    const long numBlocks = (numTriangles + blockSize - 1) / blockSize;
 
-            // //////////////////////////////////////////////
-            // Assemble new overlap
-            // //////////////////////////////////////////////
-            IntersectionPrimitive<1,ctype> newOverlap;
-            newOverlap.tris[0] = i;
-            newOverlap.tris[1] = nodes[j].rightRangeSegment;
+    std::vector<Container> blocks(numBlocks);
 
-            newOverlap.localCoords[0][0][0] = nodes[j].domainLocalPosition;
-            newOverlap.localCoords[0][1][0] = nodes[j+1].domainLocalPosition;
+    // Exceptions must not leave the parallel region; they are rethrown afterwards.
+    std::vector<char> failed(numBlocks, false);
 
-            // if the target of a node is a vertex on the target surface, its
-            // rangeLocalPosition is always 0.  But its equivalent coordinate
-            // in the two overlaps that contain it has to be once 1 and once zero.
-            // That explains the following conditional clause
-            newOverlap.localCoords[1][0][0] = (nodes[j].isNodeOnTargetVertex) ? 1 : nodes[j].rangeLocalPosition;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (long b=0; b<numBlocks; b++) {
+        try {
+            collectTriangles(psurface, b*blockSize, std::min((b+1)*blockSize, numTriangles), blocks[b]);
+        } catch (typename PSurface<2,ctype>::ParamError) {
+            failed[b] = true;
+        }
+    }
 
-            newOverlap.localCoords[1][1][0] = nodes[j+1].rangeLocalPosition;
+    for (long b=0; b<numBlocks; b++)
+        if (failed[b])
+            throw typename PSurface<2,ctype>::ParamError();
 
-            // Compute the world position of the overlap on the domain side */
-            newOverlap.points[0][0] = psurface->domainVertices[cS.points[0]][0] * (1-nodes[j].domainLocalPosition)
-                + psurface->domainVertices[cS.points[1]][0] * nodes[j].domainLocalPosition;
-            newOverlap.points[0][1] = psurface->domainVertices[cS.points[0]][1] * (1-nodes[j].domainLocalPosition)
-                + psurface->domainVertices[cS.points[1]][1] * nodes[j].domainLocalPosition;
+    size_t size = mergedGrid.size();
+    for (long b=0; b<numBlocks; b++)
+        size += blocks[b].size();
+    mergedGrid.reserve(size);
 
-            newOverlap.points[1][0] = psurface->domainVertices[cS.points[0]][0] * (1-cS.nodes[j+1].domainLocalPosition)
-                + psurface->domainVertices[cS.points[1]][0] * cS.nodes[j+1].domainLocalPosition;
-            newOverlap.points[1][1] = psurface->domainVertices[cS.points[0]][1] * (1-cS.nodes[j+1].domainLocalPosition)
-                + psurface->domainVertices[cS.points[1]][1] * cS.nodes[j+1].domainLocalPosition;
+    for (long b=0; b<numBlocks; b++)
+        appendBlock(mergedGrid, blocks[b]);
+}
 
-            mergedGrid.push_back(newOverlap);
+template <class ctype>
+void IntersectionPrimitiveCollector<ctype>::collect(const PSurface<2,ctype>* psurface,
+                                       OverlapVisitor<2,ctype>& visitor, std::size_t chunkSize)
+{
+    if (psurface->getNumTriangles()==0)
+        return;
+
+    assert(psurface->hasUpToDateOverlapStructure);
+
+    chunkSize = std::max(chunkSize, std::size_t(1));
+
+    // Like above, but only a few blocks per thread are collected at a time.
+    // They are handed to the visitor and then reused for the next round.
+    const long numTriangles = psurface->getNumTriangles();
+    const long numBlocks = (numTriangles + blockSize - 1) / blockSize;
+#ifdef _OPENMP
+    const long blocksPerRound = std::min(4L*omp_get_max_threads(), numBlocks);
+#else
+    const long blocksPerRound = 1;
+#endif
+
+    std::vector<std::vector<IntersectionPrimitive<2,ctype> > > blocks(blocksPerRound);
+    std::vector<char> failed(blocksPerRound);
+
+    for (long first=0; first<numBlocks; first+=blocksPerRound) {
+
+        const long n = std::min(blocksPerRound, numBlocks-first);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for (long b=0; b<n; b++) {
+            blocks[b].clear();
+            failed[b] = false;
+            try {
+                collectTriangles(psurface, (first+b)*blockSize, std::min((first+b+1)*blockSize, numTriangles), blocks[b]);
+            } catch (typename PSurface<2,ctype>::ParamError) {
+                failed[b] = true;
+            }
         }
 
+        for (long b=0; b<n; b++)
+            if (failed[b])
+                throw typename PSurface<2,ctype>::ParamError();
+
+        for (long b=0; b<n; b++)
+            for (size_t k=0; k<blocks[b].size(); k+=chunkSize)
+                visitor.visit(&blocks[b][k], std::min(chunkSize, blocks[b].size()-k));
+    }
+}
+
+template <class ctype>
+bool IntersectionPrimitiveCollector<ctype>::segmentOverlap(const PSurface<1,ctype>* psurface, int i, int j,
+                                                          IntersectionPrimitive<1,ctype>& overlap)
+{
+    const typename PSurface<1,ctype>::DomainSegment&    cS = psurface->domainSegments[i];
+    const std::vector<typename PSurface<1,ctype>::Node>& nodes = psurface->domainSegments[i].nodes;
+
+    /** \todo Should be in here for true edge handling */
+    // Don't do anything if the current pair of points is not connected by an edge
+    if (nodes[j].rightRangeSegment == -1)
+        return false;
+
+    // //////////////////////////////////////////////
+    // Assemble new overlap
+    // //////////////////////////////////////////////
+    overlap.tris[0] = i;
+    overlap.tris[1] = nodes[j].rightRangeSegment;
+
+    overlap.localCoords[0][0][0] = nodes[j].domainLocalPosition;
+    overlap.localCoords[0][1][0] = nodes[j+1].domainLocalPosition;
+
+    // if the target of a node is a vertex on the target surface, its
+    // rangeLocalPosition is always 0.  But its equivalent coordinate
+    // in the two overlaps that contain it has to be once 1 and once zero.
+    // That explains the following conditional clause
+    overlap.localCoords[1][0][0] = (nodes[j].isNodeOnTargetVertex) ? 1 : nodes[j].rangeLocalPosition;
+
+    overlap.localCoords[1][1][0] = nodes[j+1].rangeLocalPosition;
+
+    // Compute the world position of the overlap on the domain side */
+    overlap.points[0][0] = psurface->domainVertices[cS.points[0]][0] * (1-nodes[j].domainLocalPosition)
+        + psurface->domainVertices[cS.points[1]][0] * nodes[j].domainLocalPosition;
+    overlap.points[0][1] = psurface->domainVertices[cS.points[0]][1] * (1-nodes[j].domainLocalPosition)
+        + psurface->domainVertices[cS.points[1]][1] * nodes[j].domainLocalPosition;
+
+    overlap.points[1][0] = psurface->domainVertices[cS.points[0]][0] * (1-cS.nodes[j+1].domainLocalPosition)
+        + psurface->domainVertices[cS.points[1]][0] * cS.nodes[j+1].domainLocalPosition;
+    overlap.points[1][1] = psurface->domainVertices[cS.points[0]][1] * (1-cS.nodes[j+1].domainLocalPosition)
+        + psurface->domainVertices[cS.points[1]][1] * cS.nodes[j+1].domainLocalPosition;
+
+    return true;
+}
+
+template <class ctype>
+void IntersectionPrimitiveCollector<ctype>::collect(const PSurface<1,ctype>* psurface,
+                                       std::vector<IntersectionPrimitive<1,ctype> >& mergedGrid)
+{
+    IntersectionPrimitive<1,ctype> newOverlap;
+
+    for (size_t i=0; i<psurface->domainSegments.size(); i++) {
+
+        ////////////////////////////////
+        for (int j=0; j<int(psurface->domainSegments[i].nodes.size())-1; j++)
+            if (segmentOverlap(psurface, i, j, newOverlap))
+                mergedGrid.push_back(newOverlap);
+
     }
 
 #if 0
@@ -197,6 +344,50 @@ void IntersectionPrimitiveCollector<ctype>::collect(const PSurface<1,ctype>* psu
 //     exit(0);
 }
 
+template <class ctype>
+void IntersectionPrimitiveCollector<ctype>::collect(const PSurface<1,ctype>* psurface,
+                                       OverlapSet<1,ctype>& mergedGrid)
+{
+    IntersectionPrimitive<1,ctype> newOverlap;
+
+    for (size_t i=0; i<psurface->domainSegments.size(); i++)
+        for (int j=0; j<int(psurface->domainSegments[i].nodes.size())-1; j++)
+            if (segmentOverlap(psurface, i, j, newOverlap))
+                mergedGrid.push_back(newOverlap);
+}
+
+template <class ctype>
+void IntersectionPrimitiveCollector<ctype>::collect(const PSurface<1,ctype>* psurface,
+                                       OverlapVisitor<1,ctype>& visitor, std::size_t chunkSize)
+{
+    chunkSize = std::max(chunkSize, std::size_t(1));
+
+    std::vector<IntersectionPrimitive<1,ctype> > chunk;
+    chunk.reserve(chunkSize);
+
+    IntersectionPrimitive<1,ctype> newOverlap;
+
+    for (size_t i=0; i<psurface->domainSegments.size(); i++) {
+
+        for (int j=0; j<int(psurface->domainSegments[i].nodes.size())-1; j++) {
+
+            if (!segmentOverlap(psurface, i, j, newOverlap))
+                continue;
+
+            chunk.push_back(newOverlap);
+
+            if (chunk.size() == chunkSize) {
+                visitor.visit(&chunk[0], chunk.size());
+                chunk.clear();
+            }
+        }
+
+    }
+
+    if (!chunk.empty())
+        visitor.visit(&chunk[0], chunk.size());
+}
+
 // ////////////////////////////////////////////////////////
 //   Explicit template instantiations.
 //   If you need more, you can add them here.
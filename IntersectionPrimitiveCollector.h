@@ -1,8 +1,10 @@
 #ifndef INTERSECTION_PRIMITIVE_COLLECTOR_H
 #define INTERSECTION_PRIMITIVE_COLLECTOR_H
 
+#include <cstddef>
 #include <vector>
 #include "IntersectionPrimitive.h"
+#include "OverlapSet.h"
 
 #include "psurfaceAPI.h"
 
@@ -11,19 +13,128 @@ namespace psurface {
 template <int dim, class ctype>
 class PSurface;
 
+/** \brief Receives the overlaps of a merged grid chunk by chunk
+ *
+ * Derive from this class and hand it to IntersectionPrimitiveCollector::collect()
+ * to consume the merged grid on the fly, without ever holding all of it in memory.
+ */
+template <int dim, class ctype>
+class OverlapVisitor {
+
+public:
+
+    virtual ~OverlapVisitor() {}
+
+    /** \brief Called for each chunk of consecutive overlaps
+     *
+     * The chunks arrive in the order of the domain elements, and from
+     * a single thread.  The array is only valid during the call.
+     */
+    virtual void visit(const IntersectionPrimitive<dim,ctype>* overlaps, std::size_t n) = 0;
+
+};
+
 template <class ctype>
 class PSURFACE_API IntersectionPrimitiveCollector {
 
 public:
 
-    /** \brief Collection of the merged grid */
-    static void collect(PSurface<2,ctype>* psurface,
+    /** \brief Set up the graphs on the domain triangles for the collection of the merged grid
+     *
+     * Inserts the triangular closure and the cyclic edge orderings on all domain
+     * triangles, and sets up the trianglesPerPoint array of the target surface.
+     * The triangles are processed in parallel.  Does nothing if
+     * psurface->hasUpToDateOverlapStructure is set; sets it otherwise.
+     */
+    static void prepare(PSurface<2,ctype>* psurface);
+
+    /** \brief Collection of the merged grid
+     *
+     * The PSurface must have been set up by prepare() before.  The domain
+     * triangles are processed in parallel; the overlaps are appended to
+     * mergedGrid ordered by domain triangle, just like in a serial run.
+     */
+    static void collect(const PSurface<2,ctype>* psurface,
                         std::vector<IntersectionPrimitive<2,ctype> >& mergedGrid);
 
+    /** \brief Collection of the merged grid, calls prepare() first */
+    static void collect(PSurface<2,ctype>* psurface,
+                        std::vector<IntersectionPrimitive<2,ctype> >& mergedGrid)
+    {
+        prepare(psurface);
+        collect(static_cast<const PSurface<2,ctype>*>(psurface), mergedGrid);
+    }
+
+    /** \brief Collection of the merged grid, handed out in chunks of at most chunkSize overlaps
+     *
+     * The PSurface must have been set up by prepare() before.  Batches of
+     * domain triangles are processed in parallel, hence memory usage only
+     * depends on the number of threads, not on the size of the merged grid.
+     */
+    static void collect(const PSurface<2,ctype>* psurface,
+                        OverlapVisitor<2,ctype>& visitor, std::size_t chunkSize = 1024);
+
+    /** \brief Collection of the merged grid into a structure of arrays
+     *
+     * Works like the version for std::vector, but fills the OverlapSet
+     * directly.  The overlaps are appended to mergedGrid.
+     */
+    static void collect(const PSurface<2,ctype>* psurface,
+                        OverlapSet<2,ctype>& mergedGrid);
+
+    /** \brief Collection of the merged grid into a structure of arrays, calls prepare() first */
+    static void collect(PSurface<2,ctype>* psurface,
+                        OverlapSet<2,ctype>& mergedGrid)
+    {
+        prepare(psurface);
+        collect(static_cast<const PSurface<2,ctype>*>(psurface), mergedGrid);
+    }
+
+    /** \brief Collection of the merged grid in chunks, calls prepare() first */
+    static void collect(PSurface<2,ctype>* psurface,
+                        OverlapVisitor<2,ctype>& visitor, std::size_t chunkSize = 1024)
+    {
+        prepare(psurface);
+        collect(static_cast<const PSurface<2,ctype>*>(psurface), visitor, chunkSize);
+    }
+
     /** \brief Collection of the merged grid */
     static void collect(const PSurface<1,ctype>* psurface,
                         std::vector<IntersectionPrimitive<1,ctype> >& mergedGrid);
 
+    /** \brief Collection of the merged grid into a structure of arrays */
+    static void collect(const PSurface<1,ctype>* psurface,
+                        OverlapSet<1,ctype>& mergedGrid);
+
+    /** \brief Collection of the merged grid, handed out in chunks of at most chunkSize overlaps */
+    static void collect(const PSurface<1,ctype>* psurface,
+                        OverlapVisitor<1,ctype>& visitor, std::size_t chunkSize = 1024);
+
+private:
+
+    /** \brief Append the overlaps on all domain triangles to mergedGrid, in parallel
+     *
+     * \tparam Container std::vector<IntersectionPrimitive> or OverlapSet
+     */
+    template <class Container>
+    static void collectBlocks(const PSurface<2,ctype>* psurface, Container& mergedGrid);
+
+    /** \brief Append the overlaps on the domain triangles [begin, end) to mergedGrid
+     *
+     * \tparam Container std::vector<IntersectionPrimitive> or OverlapSet
+     * \throws PSurface<2,ctype>::ParamError
+     */
+    template <class Container>
+    static void collectTriangles(const PSurface<2,ctype>* psurface, long begin, long end,
+                                 Container& mergedGrid);
+
+    /** \brief Compute the overlap between nodes j and j+1 on domain segment i
+     *
+     * \return false if there is no overlap, because the nodes are not connected
+     */
+    static bool segmentOverlap(const PSurface<1,ctype>* psurface, int i, int j,
+                               IntersectionPrimitive<1,ctype>& overlap);
+
 };
 
 } // namespace psurface
@@ -0,0 +1,452 @@
+#ifndef ITERATIVE_SOLVERS_H
+#define ITERATIVE_SOLVERS_H
+
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "Vector.h"
+#include "StaticVector.h"
+
+namespace psurface {
+
+template <class T> class CSRMatrix;
+
+/** \brief The vectors used by BiCGSTAB() and CG()
+ *
+ * A workspace can be handed to several solves.  Its vectors are only
+ * allocated if they are too small for the system.
+ *
+ * \tparam N The number of right-hand sides solved for at once
+ */
+template <class T, int N = 2>
+struct IterativeSolverWorkspace
+{
+    /** \brief Make room for systems with n unknowns */
+    void resize(size_t n) {
+        r.resize(n);
+        r0.resize(n);
+        p.resize(n);
+        v.resize(n);
+        s.resize(n);
+        t.resize(n);
+        y.resize(n);
+        z.resize(n);
+    }
+
+    /** \brief The residual after the solve */
+    Vector<T,N> r;
+
+    Vector<T,N> r0, p, v, s, t, y, z;
+};
+
+
+/** \brief The preconditioner that does nothing */
+template <class T>
+struct IdentityPreconditioner
+{
+    /** \brief Compute z = r */
+    template <int N>
+    void apply(const Vector<T,N>& r, Vector<T,N>& z) const {
+        for (size_t i=0; i<r.size(); i++)
+            z[i] = r[i];
+    }
+};
+
+
+/** \brief Jacobi preconditioner, scales by the inverse of the diagonal */
+template <class T>
+class JacobiPreconditioner
+{
+public:
+
+    /** \brief Set up the preconditioner for a matrix
+     * \throw std::runtime_error if a diagonal entry is zero
+     */
+    void setup(const CSRMatrix<T>& A) {
+        invDiagonal_.resize(A.nRows());
+        for (size_t i=0; i<A.nRows(); i++) {
+            T d = (A.diagonal[i] >= 0) ? A.values[A.diagonal[i]] : T(0);
+            if (d == T(0))
+                throw std::runtime_error("JacobiPreconditioner: zero diagonal entry!");
+            invDiagonal_[i] = T(1) / d;
+        }
+    }
+
+    /** \brief Compute z = D^{-1} r */
+    template <int N>
+    void apply(const Vector<T,N>& r, Vector<T,N>& z) const {
+        for (size_t i=0; i<r.size(); i++)
+            z[i] = invDiagonal_[i] * r[i];
+    }
+
+private:
+
+    std::vector<T> invDiagonal_;
+};
+
+
+/** \brief Incomplete LU decomposition without fill-in, ILU(0)
+ *
+ * The factors have the pattern of the matrix.  L has a unit diagonal,
+ * and both factors are stored in one array of values.
+ */
+template <class T>
+class ILU0Preconditioner
+{
+public:
+
+    /** \brief Set up the preconditioner for a matrix
+     *
+     * Setting it up again reuses the memory, if the new matrix is not larger.
+     *
+     * \throw std::runtime_error if a diagonal entry is missing, or a pivot is zero
+     */
+    void setup(const CSRMatrix<T>& A) {
+        const int n = A.nRows();
+
+        rowStart_ = A.rowStart;
+        colIndex_ = A.colIndex;
+        values_   = A.values;
+        diagonal_ = A.diagonal;
+
+        for (int i=0; i<n; i++) {
+            if (diagonal_[i] < 0)
+                throw std::runtime_error("ILU0Preconditioner: missing diagonal entry!");
+        }
+
+        // The position of each column in the current row, -1 if it is not there
+        position_.assign(A.nCols(), -1);
+
+        for (int i=0; i<n; i++) {
+
+            for (int k=A.rowStart[i]; k<A.rowStart[i+1]; k++)
+                position_[A.colIndex[k]] = k;
+
+            for (int k=A.rowStart[i]; k<diagonal_[i]; k++) {
+
+                int j = A.colIndex[k];
+                if (values_[diagonal_[j]] == T(0))
+                    throw std::runtime_error("ILU0Preconditioner: zero pivot!");
+
+                values_[k] /= values_[diagonal_[j]];
+
+                // Subtract the multiple of row j, dropping entries outside of the pattern
+                for (int l=diagonal_[j]+1; l<A.rowStart[j+1]; l++)
+                    if (position_[A.colIndex[l]] >= 0)
+                        values_[position_[A.colIndex[l]]] -= values_[k] * values_[l];
+            }
+
+            if (values_[diagonal_[i]] == T(0))
+                throw std::runtime_error("ILU0Preconditioner: zero pivot!");
+
+            for (int k=A.rowStart[i]; k<A.rowStart[i+1]; k++)
+                position_[A.colIndex[k]] = -1;
+        }
+    }
+
+    /** \brief Compute z = (LU)^{-1} r */
+    template <int N>
+    void apply(const Vector<T,N>& r, Vector<T,N>& z) const {
+        const std::vector<int>& rowStart = rowStart_;
+        const std::vector<int>& colIndex = colIndex_;
+        const int n = diagonal_.size();
+
+        // Forward substitution with L
+        for (int i=0; i<n; i++) {
+            StaticVector<T,N> sum = r[i];
+            for (int k=rowStart[i]; k<diagonal_[i]; k++)
+                sum -= values_[k] * z[colIndex[k]];
+            z[i] = sum;
+        }
+
+        // Backward substitution with U
+        for (int i=n-1; i>=0; i--) {
+            StaticVector<T,N> sum = z[i];
+            for (int k=diagonal_[i]+1; k<rowStart[i+1]; k++)
+                sum -= values_[k] * z[colIndex[k]];
+            z[i] = sum / values_[diagonal_[i]];
+        }
+    }
+
+private:
+
+    std::vector<int> rowStart_;
+    std::vector<int> colIndex_;
+
+    std::vector<T> values_;
+
+    /** \brief The position of the diagonal entry of each row */
+    std::vector<int> diagonal_;
+
+    /** \brief Scratch space of setup() */
+    std::vector<int> position_;
+};
+
+
+/** \brief Throw if the divisor of BiCGSTAB() is numerically zero
+ *
+ * A NaN does not throw, it makes BiCGSTAB() return false instead.
+ */
+template <class T>
+void checkBiCGSTABBreakdown(const char* name, T value, T threshold, size_t iteration) {
+  if (std::abs(value) <= threshold) {
+    std::ostringstream os;
+    os << "Breakdown in BiCGSTAB - " << name << " "
+       << value << " <= " << threshold
+       << " after " << iteration << " iterations";
+    throw std::runtime_error(os.str());
+  }
+}
+
+
+/** \brief Solve A x = b with preconditioned BI-CGSTAB, for a nonsymmetric matrix A
+ *
+ * Solves for all N components of the Vector at once.  Nothing is allocated
+ * during the iteration, all vectors are taken from the workspace.  Each
+ * vector update computes the scalar products that follow it in the same loop.
+ * The preconditioner is applied from the right, hence the residuals are those
+ * of the original system.
+ *
+ * \tparam Matrix A matrix type providing <tt>void multVec(const Vector<T,N>&, Vector<T,N>&) const</tt>
+ *         and <tt>nCols()</tt>, like SparseMatrix and CSRMatrix
+ * \tparam Preconditioner Provides <tt>void apply(const Vector<T,N>& r, Vector<T,N>& z) const</tt>
+ * \param x The initial iterate, and the solution
+ * \param workspace Holds the final residual in workspace.r
+ * \param tolerance The residual is reduced by this factor
+ * \param iterations If given, the number of iterations is stored here
+ * \return Whether the method has converged within maxIter iterations
+ * \throw std::runtime_error if the method breaks down
+ */
+template <class Matrix, class Preconditioner, class T, int N>
+bool BiCGSTAB(const Matrix& A, const Preconditioner& M, const Vector<T,N>& b, Vector<T,N>& x,
+              IterativeSolverWorkspace<T,N>& workspace, size_t maxIter, T tolerance,
+              size_t* iterations = NULL) {
+  // Smaller divisors count as zero; their squares still are normal numbers
+  const T epsilon = std::sqrt(std::numeric_limits<T>::min());
+  const size_t n = A.nCols();
+
+  workspace.resize(n);
+  Vector<T,N>& r  = workspace.r;
+  Vector<T,N>& r0 = workspace.r0;
+  Vector<T,N>& p  = workspace.p;
+  Vector<T,N>& v  = workspace.v;
+  Vector<T,N>& s  = workspace.s;
+  Vector<T,N>& t  = workspace.t;
+  Vector<T,N>& y  = workspace.y;
+  Vector<T,N>& z  = workspace.z;
+
+  T rho, rho_old, alpha, beta, omega, h, norm0, norm;
+
+  // r = r0 = b - A x, and rho = r0 * r
+  A.multVec(x, r);
+  rho = 0;
+  for (size_t i=0; i<n; i++) {
+    r[i] = b[i] - r[i];
+    r0[i] = r[i];
+    p[i] = v[i] = StaticVector<T,N>(0);
+    rho += r0[i].dot(r[i]);
+  }
+  norm = norm0 = std::sqrt(rho);
+
+  rho_old = alpha = omega = 1;
+
+  if (iterations)
+    *iterations = 0;
+
+  if (norm < (tolerance * norm0) || norm < 1e-15)
+    return true;
+
+  for (size_t k = 0; k < maxIter; ++k) {
+    if (iterations)
+      *iterations = k+1;
+
+    checkBiCGSTABBreakdown("rho", rho_old, epsilon, k);
+    checkBiCGSTABBreakdown("omega", omega, epsilon, k);
+
+    beta = (rho/rho_old)*(alpha/omega);
+    for (size_t i=0; i<n; i++)
+      p[i] = r[i] + beta*(p[i] - omega * v[i]);
+
+    M.apply(p, y);
+    A.multVec(y, v);
+    h = r0 * v;
+
+    checkBiCGSTABBreakdown("r0*v", h, epsilon, k);
+
+    // x += alpha y, s = r - alpha v, and norm = |s|
+    alpha = rho/h;
+    norm = 0;
+    for (size_t i=0; i<n; i++) {
+      x[i] += alpha * y[i];
+      s[i] = r[i] - alpha * v[i];
+      norm += s[i].dot(s[i]);
+    }
+    norm = std::sqrt(norm);
+
+    if (norm < (tolerance * norm0)) {
+      for (size_t i=0; i<n; i++)
+        r[i] = s[i];
+      return true;
+    }
+
+    M.apply(s, z);
+    A.multVec(z, t);
+
+    T ts = 0, tt = 0;
+    for (size_t i=0; i<n; i++) {
+      ts += t[i].dot(s[i]);
+      tt += t[i].dot(t[i]);
+    }
+
+    checkBiCGSTABBreakdown("t*t", tt, epsilon*epsilon, k);
+
+    omega = ts/tt;
+
+    // x += omega z, r = s - omega t, norm = |r|, and the next rho = r0 * r
+    rho_old = rho;
+    rho = norm = 0;
+    for (size_t i=0; i<n; i++) {
+      x[i] += omega * z[i];
+      r[i] = s[i] - omega * t[i];
+      norm += r[i].dot(r[i]);
+      rho  += r0[i].dot(r[i]);
+    }
+    norm = std::sqrt(norm);
+
+    if (norm < (tolerance * norm0)  || norm < 1e-15)
+      return true;
+
+    // The system contains NaNs, the iteration cannot recover from them
+    if (norm != norm)
+      return false;
+  }
+
+  return false;
+}
+
+
+/** \brief Solve A x = b with BI-CGSTAB, for a nonsymmetric matrix A
+ *
+ * Solves for all N components of the Vector at once.
+ *
+ * \tparam Matrix A matrix type providing <tt>void multVec(const Vector<T,N>&, Vector<T,N>&) const</tt>
+ *         and <tt>nCols()</tt>, like SparseMatrix and CSRMatrix
+ * \param x The initial iterate, and the solution
+ * \param r The final residual
+ * \return The number of iterations
+ * \throw std::runtime_error if the method breaks down or does not converge
+ */
+template <class Matrix, class T, int N>
+size_t BiCGSTAB(const Matrix& A, const Vector<T,N>& b, Vector<T,N>& x, Vector<T,N>& r,
+                const size_t& maxIter, const T& tolerance) {
+  IterativeSolverWorkspace<T,N> workspace;
+  size_t iterations;
+
+  bool converged = BiCGSTAB(A, IdentityPreconditioner<T>(), b, x, workspace, maxIter, tolerance, &iterations);
+  r = workspace.r;
+
+  if (!converged)
+    throw std::runtime_error("BiCGSTAB did not converge.");
+
+  return iterations;
+}
+
+
+/** \brief Solve A x = b with the preconditioned method of conjugate gradients
+ *
+ * For symmetric positive definite matrices A and preconditioners.  Solves for
+ * all N components of the Vector at once, and allocates nothing during the iteration.
+ *
+ * \tparam Matrix A matrix type providing <tt>void multVec(const Vector<T,N>&, Vector<T,N>&) const</tt>
+ *         and <tt>nCols()</tt>, like SparseMatrix and CSRMatrix
+ * \tparam Preconditioner Provides <tt>void apply(const Vector<T,N>& r, Vector<T,N>& z) const</tt>
+ * \param x The initial iterate, and the solution
+ * \param workspace Holds the final residual in workspace.r
+ * \param tolerance The residual is reduced by this factor
+ * \param iterations If given, the number of iterations is stored here
+ * \return Whether the method has converged within maxIter iterations
+ * \throw std::runtime_error if the method breaks down, which happens if A is not positive definite
+ */
+template <class Matrix, class Preconditioner, class T, int N>
+bool CG(const Matrix& A, const Preconditioner& M, const Vector<T,N>& b, Vector<T,N>& x,
+        IterativeSolverWorkspace<T,N>& workspace, size_t maxIter, T tolerance,
+        size_t* iterations = NULL) {
+  const size_t n = A.nCols();
+
+  workspace.resize(n);
+  Vector<T,N>& r = workspace.r;
+  Vector<T,N>& p = workspace.p;
+  Vector<T,N>& q = workspace.v;
+  Vector<T,N>& z = workspace.z;
+
+  A.multVec(x, r);
+  T norm0 = 0;
+  for (size_t i=0; i<n; i++) {
+    r[i] = b[i] - r[i];
+    norm0 += r[i].dot(r[i]);
+  }
+  norm0 = std::sqrt(norm0);
+
+  if (iterations)
+    *iterations = 0;
+
+  if (norm0 < 1e-15)
+    return true;
+
+  M.apply(r, z);
+  T rz = 0;
+  for (size_t i=0; i<n; i++) {
+    p[i] = z[i];
+    rz += r[i].dot(z[i]);
+  }
+
+  for (size_t k = 0; k < maxIter; ++k) {
+    if (iterations)
+      *iterations = k+1;
+
+    A.multVec(p, q);
+    T pq = p * q;
+
+    if (!(pq > 0)) {
+      std::ostringstream os;
+      os << "Breakdown in CG - p*Ap = " << pq
+         << " after " << k << " iterations, the matrix is not positive definite";
+      throw std::runtime_error(os.str());
+    }
+
+    // x += alpha p, r -= alpha q, and norm = |r|
+    T alpha = rz/pq;
+    T norm = 0;
+    for (size_t i=0; i<n; i++) {
+      x[i] += alpha * p[i];
+      r[i] -= alpha * q[i];
+      norm += r[i].dot(r[i]);
+    }
+    norm = std::sqrt(norm);
+
+    if (norm < (tolerance * norm0) || norm < 1e-15)
+      return true;
+
+    // The system contains NaNs, the iteration cannot recover from them
+    if (norm != norm)
+      return false;
+
+    M.apply(r, z);
+    T rzNew = r * z;
+    T beta = rzNew/rz;
+    rz = rzNew;
+
+    for (size_t i=0; i<n; i++)
+      p[i] = z[i] + beta * p[i];
+  }
+
+  return false;
+}
+
+} // namespace psurface
+
+#endif
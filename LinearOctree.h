@@ -0,0 +1,840 @@
+/**
+ * @file
+ * @brief pointerless octree, built in one go
+ */
+#ifndef LINEAR_OCTREE_H
+#define LINEAR_OCTREE_H
+
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include "Box.h"
+#include "BinaryIO.h"
+#include "OctreeLookupScratch.h"
+
+namespace psurface {
+
+/** A static, pointerless variant of MultiDimOctree.
+ *
+ *  The tree is built in one go from an array of items, and it cannot be
+ *  changed afterwards.  All cells are stored in a single array, in depth-first
+ *  order with the children of each cell ordered like in MultiDimOctree
+ *  (bit i of the child number selects the upper half in direction i).
+ *  Hence each cell is followed by the cells of its subtree, and the leaves
+ *  appear in Morton order.  The items of all leaves are stored in one shared
+ *  array, as indices into the array the tree has been built from.
+ *
+ *  The geometric information is provided by a functor, just as for
+ *  MultiDimOctree.  The functor class F has to provide the operator
+ *
+ *  @code
+ *  bool operator()(const CoordType& lower, const CoordType& upper, const T& item);
+ *  @endcode
+ *
+ *  The lookup methods have the same semantics as the ones of MultiDimOctree
+ *  with unique lookup enabled, i.e., each item is reported at most once.
+ *
+ *  \tparam T the data type of the stored data
+ *  \tparam F the data type of the geometry functor
+ *  \tparam C the type of the coordinates used; (const) access via operator[] is required
+ *  \tparam dim the dimension of the tree (has to be the same as for the coordinates)
+ */
+template <class T, typename F, typename C, int dim>
+class LinearOctree
+{
+public:
+
+    /// @brief the type of the stored data
+    typedef T                 DataType;
+
+    /// @brief the type of the functor that tells about the items' geometry
+    typedef F                 CoordFunctor;
+
+    /// @brief a type describing a box in dim dimensions
+    typedef Box<C, dim>       BoxType;
+
+    /// @brief the type of the coordinates used
+    typedef C                 CoordType;
+
+    /// @brief the type of the container that stores the
+    /// results of lookup operations
+    typedef std::vector<T*>   ResultContainer;
+
+    /// @brief a constant depicting the # of subcells
+    /// a cell is devided into
+    static const int SUBCELLS = 1 << dim;
+
+    /** Constructor.  The arguments have the same meaning as for MultiDimOctree.
+     *  The tree is empty until build() is called.
+     */
+    LinearOctree(const BoxType &bbox, const F* f_, int maxDepth=6, int maxElemPerLeaf=10)
+    {
+        init(bbox, f_, maxDepth, maxElemPerLeaf);
+    }
+
+    /// @brief Default constructor.
+    LinearOctree()
+        : maxDepth(0), maxElemPerLeaf(0), baseAddress(0), nElements(0), f(NULL)
+    {
+        clear();
+    }
+
+    /// Removes all elements and initializes the octree from scratch.
+    void init(const BoxType &bbox, const F* f_, int maxDepth=6, int maxElemPerLeaf=10)
+    {
+        box = bbox;
+        f = f_;
+        this->maxDepth = maxDepth;
+        this->maxElemPerLeaf = maxElemPerLeaf;
+        clear();
+    }
+
+    /// Removes all elements.
+    void clear();
+
+    /** Builds the tree for the elements [begin, end) of an array, replacing
+     *  its former contents.  The elements are not copied, hence they must
+     *  not be moved or deleted as long as the tree is used.
+     */
+    void build(T* begin, T* end);
+
+    /**
+     * @brief writes the tree to a binary stream
+     *
+     * The cells and the shared item array are written as they are, as a flat
+     * sequence of 32-bit integers and coordinates in the native byte order,
+     * which read() can use without testing any element against any cell.
+     * @param out the stream
+     * @param base the first element of the array the tree has been built from
+     */
+    void write(std::ostream& out, const T* base) const;
+
+    /**
+     * @brief restores a tree written by write()
+     *
+     * Replaces the contents of the tree, its bounding box, and its maximum
+     * depth and leaf size.  The functor is kept.
+     * @param begin the start of the data, e.g. in a memory-mapped file
+     * @param end one past the end of the data
+     * @param base the first element of an array holding the elements
+     *        at the same positions as the array the tree has been written with
+     * @param nElements the size of that array
+     * @return the end of the tree data
+     * @throw std::runtime_error if the data is not a valid tree of this type
+     */
+    const char* read(const char* begin, const char* end, T* base, int nElements);
+
+    /**@name lookup methods */
+    //@{
+    /** This method appends all elements of the leaf containing point
+        @c pos to the dynamic array @c result. */
+    int lookup(const std::tr1::array<C,dim>& pos, ResultContainer& result) const;
+
+    /** Same as lookup except that indices instead of pointers are returned. */
+    int lookupIndex(const std::tr1::array<C,dim>& pos, std::vector<int>& result) const;
+
+    /** This methods appends all elements that intersect a given box. */
+    int lookup(const BoxType &queryBox, ResultContainer& result);
+
+    /** Same as lookup except that indices instead of pointers are returned. */
+    int lookupIndex(const BoxType& queryBox, std::vector<int>& result);
+
+    /** Point lookups visit a single leaf and need no scratch.  These overloads
+        exist for the sake of a common interface with MultiDimOctree. */
+    int lookup(const std::tr1::array<C,dim>& pos, ResultContainer& result, OctreeLookupScratch&) const
+    {
+        return lookup(pos, result);
+    }
+
+    /// Same as lookupIndex for a point.
+    int lookupIndex(const std::tr1::array<C,dim>& pos, std::vector<int>& result, OctreeLookupScratch&) const
+    {
+        return lookupIndex(pos, result);
+    }
+
+    /** Same as lookup, but the state of the query is kept in @c scratch
+        instead of the tree.  Hence several threads can query the tree at once,
+        each with a scratch object of its own. */
+    int lookup(const BoxType &queryBox, ResultContainer& result, OctreeLookupScratch& scratch) const;
+
+    /// Same as lookupIndex, with the state of the query kept in @c scratch.
+    int lookupIndex(const BoxType& queryBox, std::vector<int>& result, OctreeLookupScratch& scratch) const;
+
+    /** Visits the elements of all leafs crossed by the segment
+        <tt>origin + t*direction</tt>, <tt>tMin <= t <= tMax</tt>, front to back,
+        with the same semantics as MultiDimOctree::traverseSegment().  The visitor
+        is called as
+
+        @code
+        void operator()(T* element, C& tMax);
+        @endcode
+
+        and may decrease @c tMax to stop the traversal early. */
+    template <class V>
+    void traverseSegment(const std::tr1::array<C,dim>& origin, const std::tr1::array<C,dim>& direction,
+                         C tMin, C tMax, V& visitor, OctreeLookupScratch& scratch) const;
+
+    /** This method appends the @c k elements closest to point @c pos to
+        @c result, ordered by increasing distance, and their distances to
+        @c distances, with the same semantics as MultiDimOctree::lookupNearest(). */
+    template <class D>
+    int lookupNearest(const std::tr1::array<C,dim>& pos, int k, const D& distance,
+                      ResultContainer& result, std::vector<C>& distances, OctreeLookupScratch& scratch,
+                      C maxDistance = std::numeric_limits<C>::max()) const;
+
+    /** Returns the element closest to point @c pos, and its distance in
+        @c bestDistance, or NULL if there is no element within @c maxDistance. */
+    template <class D>
+    T* lookupNearest(const std::tr1::array<C,dim>& pos, const D& distance, C& bestDistance,
+                     OctreeLookupScratch& scratch, C maxDistance = std::numeric_limits<C>::max()) const;
+    //@}
+
+    /// Print some statistics to stdout.
+    void info() const;
+
+    /// Returns size of complete octree in bytes.
+    int memSize() const { return cells.size()*sizeof(Cell) + items.size()*sizeof(int); }
+
+    /// Returns true if octree contains no elements.
+    int isEmpty() const { return items.empty(); }
+
+    /// Returns maximum depth of octree.
+    int getMaxDepth() const { return maxDepth; }
+
+    /// Returns maximum number of elements per leaf.
+    int getMaxElemPerLeaf() const { return maxElemPerLeaf; }
+
+    /// Returns the address of the first element of the array the tree has been built from.
+    const T* getBaseAddress() const { return baseAddress; }
+
+    /// Returns global bounding box as defined in constructor or @c init.
+    void getBoundingBox(BoxType &bb) const { bb = box; }
+
+protected:
+
+    /*
+     * A cell of the tree.  The children of a cell, if any, directly follow it
+     * in the array of all cells, each of them followed by its own subtree.
+     */
+    struct Cell
+    {
+        // index of the first cell after the subtree of this one
+        int next;
+        // for leaves: position of the first item in the array "items"
+        int offset;
+        // for leaves: number of items
+        int n;
+    };
+
+    bool isLeaf(int cell) const { return cells[cell].next == cell+1; }
+
+    /// @brief the box of the j-th child of a cell, computed like in MultiDimOctree
+    static BoxType childBox(const BoxType& cellBox, int j);
+
+    void build(int depth, const BoxType& cellBox, const std::vector<int>& candidates);
+
+    void lookupIndex(int cell, const BoxType& cellBox, const BoxType& queryBox, std::vector<int>& result,
+                     OctreeLookupScratch& scratch) const;
+
+    /// @brief clips the parameter interval [t0,t1] of a ray to a box, false if it misses the box
+    static bool clipRay(const std::tr1::array<C,dim>& origin, const std::tr1::array<C,dim>& direction,
+                        const BoxType& cellBox, C& t0, C& t1);
+
+    template <class V>
+    void traverseSegment(int cell, const BoxType& cellBox, const std::tr1::array<C,dim>& origin,
+                         const std::tr1::array<C,dim>& direction, C tMin, C& tMax, V& visitor,
+                         OctreeLookupScratch& scratch) const;
+
+    /// @brief the Euclidean distance of a point from a box, zero if it is inside
+    static C boxDistance(const BoxType& cellBox, const std::tr1::array<C,dim>& pos);
+
+    /// @brief all cells in depth-first order
+    std::vector<Cell> cells;
+
+    /// @brief the items of all leaves, leaf after leaf
+    std::vector<int> items;
+
+    BoxType                      box;
+    int                          maxDepth;
+    unsigned int                 maxElemPerLeaf;
+    T*                           baseAddress;
+    int                          nElements;
+
+    // The state of the queries through the non-const lookup methods
+    OctreeLookupScratch          lookupScratch;
+
+    // The functor used to determine whether an element is contained in a given box
+    const F*                     f;
+};
+
+/// @if EXCLUDETHIS
+
+template <class T, typename F, typename C, int dim>
+void LinearOctree<T, F, C, dim>::clear()
+{
+    baseAddress = 0;
+    nElements = 0;
+    items.clear();
+
+    // An empty root leaf
+    cells.resize(1);
+    cells[0].next = 1;
+    cells[0].offset = 0;
+    cells[0].n = 0;
+}
+
+
+template <class T, typename F, typename C, int dim>
+typename LinearOctree<T, F, C, dim>::BoxType LinearOctree<T, F, C, dim>::childBox(const BoxType& cellBox, int j)
+{
+    std::tr1::array<C,dim> lower, upper, center = cellBox.center();
+    for (int i = 0; i < dim; ++i)
+    {
+        if (j & (1 << i))
+        {
+            lower[i] = center[i];
+            upper[i] = cellBox.upper()[i];
+        }
+        else
+        {
+            lower[i] = cellBox.lower()[i];
+            upper[i] = center[i];
+        }
+    }
+    return BoxType(lower, upper);
+}
+
+
+template <class T, typename F, typename C, int dim>
+void LinearOctree<T, F, C, dim>::build(T* begin, T* end)
+{
+    clear();
+    cells.clear();
+
+    baseAddress = begin;
+    nElements = end - begin;
+
+    // Elements which do not intersect the bounding box are not inserted
+    std::vector<int> candidates;
+    for (int i=0; i<nElements; i++)
+        if ((*f)(box.lower(), box.upper(), begin[i]))
+            candidates.push_back(i);
+
+    build(0, box, candidates);
+}
+
+
+template <class T, typename F, typename C, int dim>
+void LinearOctree<T, F, C, dim>::build(int depth, const BoxType& cellBox, const std::vector<int>& candidates)
+{
+    int cell = cells.size();
+    cells.push_back(Cell());
+
+    if (depth<maxDepth && candidates.size()>maxElemPerLeaf)
+    {
+        cells[cell].offset = 0;
+        cells[cell].n = 0;
+
+        // Distribute the items among the children, and build their subtrees
+        std::vector<int> childCandidates;
+        childCandidates.reserve(candidates.size());
+
+        for (int j = 0; j < SUBCELLS; ++j)
+        {
+            BoxType childElemBox = childBox(cellBox, j);
+
+            childCandidates.clear();
+            for (size_t k=0; k<candidates.size(); k++)
+                if ((*f)(childElemBox.lower(), childElemBox.upper(), baseAddress[candidates[k]]))
+                    childCandidates.push_back(candidates[k]);
+
+            build(depth+1, childElemBox, childCandidates);
+        }
+    }
+    else
+    {
+        cells[cell].offset = items.size();
+        cells[cell].n = candidates.size();
+        items.insert(items.end(), candidates.begin(), candidates.end());
+    }
+
+    cells[cell].next = cells.size();
+}
+
+
+template <class T, typename F, typename C, int dim>
+void LinearOctree<T, F, C, dim>::write(std::ostream& out, const T* base) const
+{
+    int header[6] = {dim, int(sizeof(C)), maxDepth, int(maxElemPerLeaf), int(cells.size()), int(items.size())};
+    writeBinary(out, header, 6);
+    writeBinary(out, &box.lower()[0], dim);
+    writeBinary(out, &box.upper()[0], dim);
+
+    // the items are stored relative to the array the tree has been built from
+    int shift = baseAddress - base;
+
+    for (size_t i = 0; i < cells.size(); ++i)
+    {
+        int cell[3] = {cells[i].next, cells[i].offset, cells[i].n};
+        writeBinary(out, cell, 3);
+    }
+    for (size_t k = 0; k < items.size(); ++k)
+    {
+        int item = items[k] + shift;
+        writeBinary(out, &item, 1);
+    }
+}
+
+
+template <class T, typename F, typename C, int dim>
+const char* LinearOctree<T, F, C, dim>::read(const char* begin, const char* end, T* base, int nElements)
+{
+    const char* pos = begin;
+
+    int header[6];
+    readBinary(pos, end, header, 6);
+    if (header[0] != dim || header[1] != int(sizeof(C)))
+        throw std::runtime_error("LinearOctree: the data does not match the type of the tree");
+
+    int nCells = header[4];
+    int nItems = header[5];
+    if (nCells < 1 || nItems < 0)
+        throw std::runtime_error("LinearOctree: invalid number of cells or items");
+
+    std::tr1::array<C,dim> lower, upper;
+    readBinary(pos, end, &lower[0], dim);
+    readBinary(pos, end, &upper[0], dim);
+
+    // the cells and items have to fit into the data, before any memory is allocated for them
+    if (size_t(end - pos) / sizeof(int) < 3*size_t(nCells) + size_t(nItems))
+        throw std::runtime_error("LinearOctree: unexpected end of the data");
+
+    std::vector<int> cellData(3*nCells);
+    readBinary(pos, end, &cellData[0], cellData.size());
+
+    std::vector<int> newItems(nItems);
+    if (nItems > 0)
+        readBinary(pos, end, &newItems[0], nItems);
+
+    // Check the data before changing anything.  The subtree of each cell ends
+    // behind it, and the one of the root at the end.
+    if (cellData[0] != nCells)
+        throw std::runtime_error("LinearOctree: invalid subtree");
+    for (int i = 0; i < nCells; ++i)
+        if (cellData[3*i] <= i || cellData[3*i] > nCells)
+            throw std::runtime_error("LinearOctree: invalid subtree");
+
+    for (int i = 0; i < nCells; ++i)
+    {
+        int next = cellData[3*i];
+        if (next == i+1)
+        {
+            int offset = cellData[3*i+1], n = cellData[3*i+2];
+            if (offset < 0 || n < 0 || offset > nItems - n)
+                throw std::runtime_error("LinearOctree: invalid number of items");
+            continue;
+        }
+
+        // the subtrees of the children fill the one of the cell
+        int child = i+1;
+        for (int j = 0; j < SUBCELLS; ++j)
+        {
+            if (child >= next)
+                throw std::runtime_error("LinearOctree: invalid subtree");
+            child = cellData[3*child];
+        }
+        if (child != next)
+            throw std::runtime_error("LinearOctree: invalid subtree");
+    }
+
+    for (int k = 0; k < nItems; ++k)
+        if (newItems[k] < 0 || newItems[k] >= nElements)
+            throw std::runtime_error("LinearOctree: item out of range");
+
+    box = BoxType(lower, upper);
+    maxDepth = header[2];
+    maxElemPerLeaf = header[3];
+    baseAddress = base;
+    this->nElements = nElements;
+
+    cells.resize(nCells);
+    for (int i = 0; i < nCells; ++i)
+    {
+        cells[i].next   = cellData[3*i];
+        cells[i].offset = cellData[3*i+1];
+        cells[i].n      = cellData[3*i+2];
+    }
+    items.swap(newItems);
+
+    return pos;
+}
+
+
+template <class T, typename F, typename C, int dim>
+int LinearOctree<T, F, C, dim>::lookup(const std::tr1::array<C,dim>& pos, ResultContainer& result) const
+{
+    std::vector<int> indices;
+    lookupIndex(pos, indices);
+
+    for (size_t i=0; i<indices.size(); i++)
+        result.push_back(baseAddress + indices[i]);
+    return result.size();
+}
+
+
+template <class T, typename F, typename C, int dim>
+int LinearOctree<T, F, C, dim>::lookupIndex(const std::tr1::array<C,dim>& pos, std::vector<int>& result) const
+{
+    if (!box.contains(pos))
+        return result.size();
+
+    // Descend to the leaf that contains the point
+    BoxType cellBox(box);
+    int cell = 0;
+
+    while (!isLeaf(cell))
+    {
+        std::tr1::array<C,dim> center = cellBox.center();
+
+        int config = 0;
+        for (int i = 0; i < dim; ++i)
+            if (pos[i] >= center[i])
+                config |= (1 << i);
+
+        // skip the subtrees of the children before the one we want
+        int child = cell+1;
+        for (int j = 0; j < config; ++j)
+            child = cells[child].next;
+
+        cellBox = childBox(cellBox, config);
+        cell = child;
+    }
+
+    // A single leaf does not contain any item twice
+    result.insert(result.end(), items.begin() + cells[cell].offset, items.begin() + cells[cell].offset + cells[cell].n);
+    return result.size();
+}
+
+
+template <class T, typename F, typename C, int dim>
+int LinearOctree<T, F, C, dim>::lookup(const BoxType& queryBox, ResultContainer& result)
+{
+    return lookup(queryBox, result, lookupScratch);
+}
+
+
+template <class T, typename F, typename C, int dim>
+int LinearOctree<T, F, C, dim>::lookup(const BoxType& queryBox, ResultContainer& result,
+                                       OctreeLookupScratch& scratch) const
+{
+    std::vector<int> indices;
+    lookupIndex(queryBox, indices, scratch);
+
+    for (size_t i=0; i<indices.size(); i++)
+        result.push_back(baseAddress + indices[i]);
+    return result.size();
+}
+
+
+template <class T, typename F, typename C, int dim>
+int LinearOctree<T, F, C, dim>::lookupIndex(const BoxType& queryBox, std::vector<int>& result)
+{
+    return lookupIndex(queryBox, result, lookupScratch);
+}
+
+
+template <class T, typename F, typename C, int dim>
+int LinearOctree<T, F, C, dim>::lookupIndex(const BoxType& queryBox, std::vector<int>& result,
+                                            OctreeLookupScratch& scratch) const
+{
+    BoxType b(box);
+
+    scratch.newQuery(nElements);
+
+    if (b.intersects(queryBox))
+        lookupIndex(0, b, queryBox, result, scratch);
+
+    return result.size();
+}
+
+
+template <class T, typename F, typename C, int dim>
+void LinearOctree<T, F, C, dim>::lookupIndex(int cell, const BoxType& cellBox, const BoxType& queryBox, std::vector<int>& result,
+                                             OctreeLookupScratch& scratch) const
+{
+    if (isLeaf(cell))
+    {
+        for (int i=0; i<cells[cell].n; i++)
+        {
+            int k = items[cells[cell].offset + i];
+
+            // get the functor of the element and check for intersection.
+            // Marking the element first skips it when it is found again in another leaf.
+            if (scratch.mark(k) && (*f)(queryBox.lower(), queryBox.upper(), baseAddress[k]))
+                result.push_back(k);
+        }
+        return;
+    }
+
+    std::tr1::array<C,dim> center = cellBox.center();
+
+    int child = cell+1;
+    for (int j = 0; j < SUBCELLS; ++j, child = cells[child].next)
+    {
+        // The same test as in MultiDimOctree
+        bool intersects_subcell = true;
+        for (int i = 0; i < dim; ++i)
+        {
+            if (j & (1 << i))
+                intersects_subcell = intersects_subcell && (queryBox.upper()[i] >= center[i]);
+            else
+                intersects_subcell = intersects_subcell && (queryBox.lower()[i] < center[i]);
+        }
+
+        // if intersecting then descend recursively to subcell
+        if (intersects_subcell)
+            lookupIndex(child, childBox(cellBox, j), queryBox, result, scratch);
+    }
+}
+
+
+template <class T, typename F, typename C, int dim>
+bool LinearOctree<T, F, C, dim>::clipRay(const std::tr1::array<C,dim>& origin, const std::tr1::array<C,dim>& direction,
+                                         const BoxType& cellBox, C& t0, C& t1)
+{
+    for (int i = 0; i < dim; ++i)
+    {
+        if (direction[i] == 0)
+        {
+            // parallel to the slab
+            if (origin[i] < cellBox.lower()[i] || origin[i] > cellBox.upper()[i])
+                return false;
+            continue;
+        }
+
+        C tLower = (cellBox.lower()[i] - origin[i]) / direction[i];
+        C tUpper = (cellBox.upper()[i] - origin[i]) / direction[i];
+        if (tLower > tUpper)
+            std::swap(tLower, tUpper);
+
+        t0 = std::max(t0, tLower);
+        t1 = std::min(t1, tUpper);
+        if (t0 > t1)
+            return false;
+    }
+    return true;
+}
+
+
+template <class T, typename F, typename C, int dim>
+template <class V>
+void LinearOctree<T, F, C, dim>::traverseSegment(const std::tr1::array<C,dim>& origin, const std::tr1::array<C,dim>& direction,
+                                                 C tMin, C tMax, V& visitor, OctreeLookupScratch& scratch) const
+{
+    scratch.newQuery(nElements);
+
+    C t0 = tMin, t1 = tMax;
+    if (clipRay(origin, direction, box, t0, t1))
+        traverseSegment(0, box, origin, direction, tMin, tMax, visitor, scratch);
+}
+
+
+template <class T, typename F, typename C, int dim>
+template <class V>
+void LinearOctree<T, F, C, dim>::traverseSegment(int cell, const BoxType& cellBox, const std::tr1::array<C,dim>& origin,
+                                                 const std::tr1::array<C,dim>& direction, C tMin, C& tMax, V& visitor,
+                                                 OctreeLookupScratch& scratch) const
+{
+    if (isLeaf(cell))
+    {
+        for (int i=0; i<cells[cell].n; i++)
+        {
+            int k = items[cells[cell].offset + i];
+            if (scratch.mark(k))
+                visitor(baseAddress + k, tMax);
+        }
+        return;
+    }
+
+    // Find the children crossed by the segment, and sort them by the entry parameter
+    C entry[SUBCELLS];
+    int order[SUBCELLS];
+    int first[SUBCELLS];
+    int nCrossed = 0;
+
+    int child = cell+1;
+    for (int j = 0; j < SUBCELLS; ++j, child = cells[child].next)
+    {
+        C t0 = tMin, t1 = tMax;
+        if (!clipRay(origin, direction, childBox(cellBox, j), t0, t1))
+            continue;
+
+        int k = nCrossed++;
+        for (; k > 0 && entry[k-1] > t0; --k)
+        {
+            entry[k] = entry[k-1];
+            order[k] = order[k-1];
+            first[k] = first[k-1];
+        }
+        entry[k] = t0;
+        order[k] = j;
+        first[k] = child;
+    }
+
+    for (int k = 0; k < nCrossed; ++k)
+    {
+        // the visitor may have shortened the segment in the meantime
+        if (entry[k] > tMax)
+            break;
+        traverseSegment(first[k], childBox(cellBox, order[k]), origin, direction, tMin, tMax, visitor, scratch);
+    }
+}
+
+
+template <class T, typename F, typename C, int dim>
+C LinearOctree<T, F, C, dim>::boxDistance(const BoxType& cellBox, const std::tr1::array<C,dim>& pos)
+{
+    C dist2 = 0;
+    for (int i = 0; i < dim; ++i)
+    {
+        C d = std::max(C(0), std::max(cellBox.lower()[i] - pos[i], pos[i] - cellBox.upper()[i]));
+        dist2 += d*d;
+    }
+    return std::sqrt(dist2);
+}
+
+
+template <class T, typename F, typename C, int dim>
+template <class D>
+int LinearOctree<T, F, C, dim>::lookupNearest(const std::tr1::array<C,dim>& pos, int k, const D& distance,
+                                              ResultContainer& result, std::vector<C>& distances,
+                                              OctreeLookupScratch& scratch, C maxDistance) const
+{
+    if (k <= 0)
+        return result.size();
+
+    scratch.newQuery(nElements);
+
+    // The k closest elements found so far, by increasing distance
+    std::vector<std::pair<C,T*> > best;
+
+    // The cells still to be visited, closest first.  The second entry points
+    // into the array of the cells and their boxes.
+    typedef std::pair<C,int> QueueEntry;
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry> > queue;
+    std::vector<std::pair<int,BoxType> > visited;
+
+    C rootDistance = boxDistance(box, pos);
+    if (rootDistance <= maxDistance)
+    {
+        visited.push_back(std::make_pair(0, box));
+        queue.push(QueueEntry(rootDistance, 0));
+    }
+
+    while (!queue.empty())
+    {
+        C bound = (best.size() == size_t(k)) ? best.back().first : maxDistance;
+        if (queue.top().first > bound)
+            break;
+
+        int cell = visited[queue.top().second].first;
+        BoxType cellBox = visited[queue.top().second].second;
+        queue.pop();
+
+        if (isLeaf(cell))
+        {
+            for (int i=0; i<cells[cell].n; i++)
+            {
+                int index = items[cells[cell].offset + i];
+                if (!scratch.mark(index))
+                    continue;
+
+                std::pair<C,T*> candidate(distance(pos, baseAddress[index]), baseAddress + index);
+                if (candidate.first > maxDistance)
+                    continue;
+
+                if (best.size() == size_t(k))
+                {
+                    if (!(candidate < best.back()))
+                        continue;
+                    best.pop_back();
+                }
+                best.insert(std::upper_bound(best.begin(), best.end(), candidate), candidate);
+            }
+            continue;
+        }
+
+        bound = (best.size() == size_t(k)) ? best.back().first : maxDistance;
+
+        int child = cell+1;
+        for (int j = 0; j < SUBCELLS; ++j, child = cells[child].next)
+        {
+            BoxType childCellBox = childBox(cellBox, j);
+            C childDistance = boxDistance(childCellBox, pos);
+            if (childDistance <= bound)
+            {
+                visited.push_back(std::make_pair(child, childCellBox));
+                queue.push(QueueEntry(childDistance, visited.size()-1));
+            }
+        }
+    }
+
+    for (size_t j = 0; j < best.size(); ++j)
+    {
+        result.push_back(best[j].second);
+        distances.push_back(best[j].first);
+    }
+    return result.size();
+}
+
+
+template <class T, typename F, typename C, int dim>
+template <class D>
+T* LinearOctree<T, F, C, dim>::lookupNearest(const std::tr1::array<C,dim>& pos, const D& distance, C& bestDistance,
+                                             OctreeLookupScratch& scratch, C maxDistance) const
+{
+    ResultContainer result;
+    std::vector<C> distances;
+    lookupNearest(pos, 1, distance, result, distances, scratch, maxDistance);
+
+    if (result.empty())
+        return NULL;
+
+    bestDistance = distances[0];
+    return result[0];
+}
+
+
+template <class T, typename F, typename C, int dim>
+void LinearOctree<T, F, C, dim>::info() const
+{
+    int nLeafs = 0;
+    int minNumElements = 999999;
+    int maxNumElements = 0;
+
+    for (size_t i=0; i<cells.size(); i++)
+    {
+        if (isLeaf(i))
+        {
+            nLeafs++;
+            minNumElements = std::min(minNumElements, cells[i].n);
+            maxNumElements = std::max(maxNumElements, cells[i].n);
+        }
+    }
+
+    std::cout << "LinearOctree: " << cells.size()-nLeafs << " nodes,"
+              << nLeafs << " leafs (" << (float) memSize()/(1024*1024) << " MB)" << std::endl;
+    std::cout << "LinearOctree: " << items.size() << " elements,"
+              << " (" << (float)items.size()/nLeafs << " per leaf, " << minNumElements << "..." << maxNumElements << ")" << std::endl;
+}
+
+/// @endif
+
+} // namespace psurface
+
+#endif // LINEAR_OCTREE_H
@@ -0,0 +1,293 @@
+#include "config.h"
+
+#include <cmath>
+#include <cassert>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include "MortarAssembler.h"
+#include "Simd.h"
+
+using namespace psurface;
+
+// Number of overlaps whose local matrices are computed together in one vectorized sweep
+static const size_t chunkSize = 128;
+
+// Number of overlaps that are assembled as one unit of work
+static const size_t blockSize = 16*chunkSize;
+
+
+/** \brief The parts of the assembly that depend on the dimension */
+template <int dim, class ctype>
+struct MortarTraits;
+
+template <class ctype>
+struct MortarTraits<1,ctype>
+{
+    /** \brief Gauss-Legendre rules on [0,1] */
+    static void quadratureRule(int order, std::vector<std::tr1::array<ctype,2> >& points, std::vector<ctype>& weights)
+    {
+        std::vector<double> x, w;
+
+        if (order <= 1) {
+            x.push_back(0.5);                        w.push_back(1);
+        } else if (order <= 3) {
+            const double d = 0.5/std::sqrt(3.0);
+            x.push_back(0.5-d);                      w.push_back(0.5);
+            x.push_back(0.5+d);                      w.push_back(0.5);
+        } else if (order <= 5) {
+            const double d = 0.5*std::sqrt(0.6);
+            x.push_back(0.5-d);                      w.push_back(5.0/18);
+            x.push_back(0.5);                        w.push_back(8.0/18);
+            x.push_back(0.5+d);                      w.push_back(5.0/18);
+        } else
+            throw std::runtime_error("MortarAssembler: no quadrature rule of the requested order!");
+
+        points.resize(x.size());
+        weights.resize(x.size());
+        for (size_t q=0; q<x.size(); q++) {
+            points[q][0] = 1-x[q];
+            points[q][1] = x[q];
+            weights[q]   = w[q];
+        }
+    }
+
+    /** \brief The lengths of the overlaps [begin, begin+n) */
+    static void measures(const OverlapSet<1,ctype>& overlaps, size_t begin, size_t n, ctype* measure)
+    {
+        const ctype* x0 = &overlaps.points[0][0][begin];
+        const ctype* y0 = &overlaps.points[0][1][begin];
+        const ctype* x1 = &overlaps.points[1][0][begin];
+        const ctype* y1 = &overlaps.points[1][1][begin];
+
+        PSURFACE_SIMD
+        for (size_t k=0; k<n; k++) {
+            const ctype dx = x1[k] - x0[k];
+            const ctype dy = y1[k] - y0[k];
+            measure[k] = std::sqrt(dx*dx + dy*dy);
+        }
+    }
+
+    /** \brief The P1 basis functions at the local coordinates x, as used by IntersectionPrimitiveCollector */
+    static void shapeFunctions(const ctype (*x)[chunkSize], ctype (*phi)[chunkSize], size_t n)
+    {
+        PSURFACE_SIMD
+        for (size_t k=0; k<n; k++) {
+            phi[0][k] = 1 - x[0][k];
+            phi[1][k] = x[0][k];
+        }
+    }
+};
+
+template <class ctype>
+struct MortarTraits<2,ctype>
+{
+    /** \brief Symmetric rules on triangles, from Dunavant (1985) */
+    static void quadratureRule(int order, std::vector<std::tr1::array<ctype,3> >& points, std::vector<ctype>& weights)
+    {
+        points.clear();
+        weights.clear();
+
+        if (order <= 1) {
+            addOrbit(1.0/3, 1, points, weights);
+        } else if (order <= 2) {
+            addOrbit(1.0/6, 1.0/3, points, weights);
+        } else if (order <= 4) {
+            addOrbit(0.445948490915965, 0.223381589678011, points, weights);
+            addOrbit(0.091576213509771, 0.109951743655322, points, weights);
+        } else if (order <= 5) {
+            addOrbit(1.0/3, 0.225, points, weights);
+            addOrbit(0.470142064105115, 0.132394152788506, points, weights);
+            addOrbit(0.101286507323456, 0.125939180544827, points, weights);
+        } else
+            throw std::runtime_error("MortarAssembler: no quadrature rule of the requested order!");
+    }
+
+    /** \brief Add the points (a, a, 1-2a) and their permutations, each with weight w */
+    static void addOrbit(double a, double w, std::vector<std::tr1::array<ctype,3> >& points, std::vector<ctype>& weights)
+    {
+        const int n = (a == 1.0/3) ? 1 : 3;
+        for (int i=0; i<n; i++) {
+            std::tr1::array<ctype,3> p;
+            for (int j=0; j<3; j++)
+                p[j] = (j==i && n==3) ? 1-2*a : a;
+            points.push_back(p);
+            weights.push_back(w);
+        }
+    }
+
+    /** \brief The areas of the overlaps [begin, begin+n) */
+    static void measures(const OverlapSet<2,ctype>& overlaps, size_t begin, size_t n, ctype* measure)
+    {
+        const ctype* p[3][3];
+        for (int j=0; j<3; j++)
+            for (int c=0; c<3; c++)
+                p[j][c] = &overlaps.points[j][c][begin];
+
+        PSURFACE_SIMD
+        for (size_t k=0; k<n; k++) {
+            const ctype a0 = p[1][0][k] - p[0][0][k], a1 = p[1][1][k] - p[0][1][k], a2 = p[1][2][k] - p[0][2][k];
+            const ctype b0 = p[2][0][k] - p[0][0][k], b1 = p[2][1][k] - p[0][1][k], b2 = p[2][2][k] - p[0][2][k];
+            const ctype c0 = a1*b2 - a2*b1;
+            const ctype c1 = a2*b0 - a0*b2;
+            const ctype c2 = a0*b1 - a1*b0;
+            measure[k] = ctype(0.5) * std::sqrt(c0*c0 + c1*c1 + c2*c2);
+        }
+    }
+
+    /** \brief The P1 basis functions at the local coordinates x, as used by PlaneParam::linearInterpol() */
+    static void shapeFunctions(const ctype (*x)[chunkSize], ctype (*phi)[chunkSize], size_t n)
+    {
+        PSURFACE_SIMD
+        for (size_t k=0; k<n; k++) {
+            phi[0][k] = x[0][k];
+            phi[1][k] = x[1][k];
+            phi[2][k] = 1 - x[0][k] - x[1][k];
+        }
+    }
+};
+
+
+template <int dim, class ctype>
+MortarAssembler<dim,ctype>::MortarAssembler(int order)
+{
+    MortarTraits<dim,ctype>::quadratureRule(order, quadPoints_, quadWeights_);
+}
+
+template <int dim, class ctype>
+void MortarAssembler<dim,ctype>::assemble(const OverlapSet<dim,ctype>& overlaps,
+                                          const std::vector<std::tr1::array<int,nPoints> >& domainElements, int numDomainVertices,
+                                          const std::vector<std::tr1::array<int,nPoints> >& targetElements, int numTargetVertices,
+                                          CSRMatrix<ctype>& D, CSRMatrix<ctype>& M) const
+{
+    typedef typename CSRMatrix<ctype>::Triplet Triplet;
+
+    // The blocks are assembled concurrently into entry lists of their own.
+    // These are then concatenated in block order, which keeps the result
+    // independent of the number of threads.
+    const long numBlocks = (overlaps.size() + blockSize - 1) / blockSize;
+
+    std::vector<std::vector<Triplet> > dBlocks(numBlocks), mBlocks(numBlocks);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (long b=0; b<numBlocks; b++) {
+        dBlocks[b].reserve(blockSize*nPoints*nPoints);
+        mBlocks[b].reserve(blockSize*nPoints*nPoints);
+
+        const size_t end = std::min((b+1)*blockSize, overlaps.size());
+        for (size_t begin=b*blockSize; begin<end; begin+=chunkSize)
+            assembleChunk(overlaps, begin, std::min(begin+chunkSize, end),
+                          domainElements, targetElements, dBlocks[b], mBlocks[b]);
+    }
+
+    std::vector<Triplet> entries;
+    entries.reserve(overlaps.size()*nPoints*nPoints);
+
+    for (long b=0; b<numBlocks; b++) {
+        entries.insert(entries.end(), dBlocks[b].begin(), dBlocks[b].end());
+        std::vector<Triplet>().swap(dBlocks[b]);
+    }
+    D.setFromTriplets(numDomainVertices, numDomainVertices, entries);
+
+    entries.clear();
+    for (long b=0; b<numBlocks; b++) {
+        entries.insert(entries.end(), mBlocks[b].begin(), mBlocks[b].end());
+        std::vector<Triplet>().swap(mBlocks[b]);
+    }
+    M.setFromTriplets(numDomainVertices, numTargetVertices, entries);
+}
+
+template <int dim, class ctype>
+void MortarAssembler<dim,ctype>::assembleChunk(const OverlapSet<dim,ctype>& overlaps, size_t begin, size_t end,
+                                               const std::vector<std::tr1::array<int,nPoints> >& domainElements,
+                                               const std::vector<std::tr1::array<int,nPoints> >& targetElements,
+                                               std::vector<typename CSRMatrix<ctype>::Triplet>& dEntries,
+                                               std::vector<typename CSRMatrix<ctype>::Triplet>& mEntries) const
+{
+    typedef typename CSRMatrix<ctype>::Triplet Triplet;
+
+    const size_t n = end - begin;
+    assert(n <= chunkSize);
+
+    // The local matrices of all overlaps in the chunk, overlap index last
+    ctype localD[nPoints][nPoints][chunkSize];
+    ctype localM[nPoints][nPoints][chunkSize];
+
+    for (int a=0; a<nPoints; a++)
+        for (int c=0; c<nPoints; c++)
+            for (size_t k=0; k<n; k++)
+                localD[a][c][k] = localM[a][c][k] = 0;
+
+    ctype measure[chunkSize];
+    MortarTraits<dim,ctype>::measures(overlaps, begin, n, measure);
+
+    // Local coordinates and basis function values at the current quadrature point
+    ctype domainCoords[dim][chunkSize], targetCoords[dim][chunkSize];
+    ctype phi[nPoints][chunkSize], psi[nPoints][chunkSize];
+
+    for (size_t q=0; q<quadWeights_.size(); q++) {
+
+        const std::tr1::array<ctype,nPoints>& beta = quadPoints_[q];
+
+        for (int c=0; c<dim; c++) {
+            for (size_t k=0; k<n; k++)
+                domainCoords[c][k] = targetCoords[c][k] = 0;
+
+            for (int j=0; j<nPoints; j++) {
+                const ctype* x = &overlaps.localCoords[0][j][c][begin];
+                const ctype* y = &overlaps.localCoords[1][j][c][begin];
+
+                PSURFACE_SIMD
+                for (size_t k=0; k<n; k++) {
+                    domainCoords[c][k] += beta[j] * x[k];
+                    targetCoords[c][k] += beta[j] * y[k];
+                }
+            }
+        }
+
+        MortarTraits<dim,ctype>::shapeFunctions(domainCoords, phi, n);
+        MortarTraits<dim,ctype>::shapeFunctions(targetCoords, psi, n);
+
+        const ctype w = quadWeights_[q];
+
+        for (int a=0; a<nPoints; a++)
+            for (int c=0; c<nPoints; c++) {
+                PSURFACE_SIMD
+                for (size_t k=0; k<n; k++) {
+                    const ctype wphi = w * measure[k] * phi[a][k];
+                    localD[a][c][k] += wphi * phi[c][k];
+                    localM[a][c][k] += wphi * psi[c][k];
+                }
+            }
+    }
+
+    // Scatter the local matrices
+    for (size_t k=0; k<n; k++) {
+
+        const std::tr1::array<int,nPoints>& domainVertices = domainElements[overlaps.domainElements[begin+k]];
+        const std::tr1::array<int,nPoints>& targetVertices = targetElements[overlaps.targetElements[begin+k]];
+
+        for (int a=0; a<nPoints; a++)
+            for (int c=0; c<nPoints; c++) {
+                dEntries.push_back(Triplet(domainVertices[a], domainVertices[c], localD[a][c][k]));
+                mEntries.push_back(Triplet(domainVertices[a], targetVertices[c], localM[a][c][k]));
+            }
+    }
+}
+
+
+// ////////////////////////////////////////////////////////
+//   Explicit template instantiations.
+//   If you need more, you can add them here.
+// ////////////////////////////////////////////////////////
+
+namespace psurface {
+  template class PSURFACE_EXPORT MortarAssembler<1,float>;
+  template class PSURFACE_EXPORT MortarAssembler<1,double>;
+
+  template class PSURFACE_EXPORT MortarAssembler<2,float>;
+  template class PSURFACE_EXPORT MortarAssembler<2,double>;
+}
@@ -0,0 +1,97 @@
+#ifndef MORTAR_ASSEMBLER_H
+#define MORTAR_ASSEMBLER_H
+
+#include <vector>
+
+// Check for VC9 / VS2008 with installed feature pack.
+#if defined(_MSC_VER) && (_MSC_VER>=1500)
+    #if defined(_CPPLIB_VER) && _CPPLIB_VER>=505
+        #include <array>
+    #else
+        #error Please install the Visual Studio 2008 SP1 for TR1 support.
+    #endif
+#else
+    #include <tr1/array>
+#endif
+
+#include "IntersectionPrimitive.h"
+#include "OverlapSet.h"
+#include "CSRMatrix.h"
+
+#include "psurfaceAPI.h"
+
+namespace psurface {
+
+/** \brief Assembles the mortar coupling matrices from the overlaps of a ContactMapping
+ *
+ * For first-order Lagrange elements on both surfaces, with basis functions
+ * \f$\phi_i\f$ on the domain (nonmortar) side and \f$\psi_j\f$ on the target
+ * (mortar) side, this computes
+ * \f[ D_{ij} = \int \phi_i \phi_j, \qquad M_{ij} = \int \phi_i \psi_j, \f]
+ * where the integrals are taken over the overlaps.  Each overlap is
+ * integrated with a quadrature rule of the given order.
+ *
+ * The element lists are the ones that have been handed to ContactMapping::build().
+ *
+ \tparam dim Dimension of the coupling surfaces
+ \tparam ctype Type used for coordinates
+ */
+template <int dim, class ctype>
+class PSURFACE_API MortarAssembler {
+
+public:
+
+    /** \brief Number of vertices of a dim-dimensional simplex */
+    enum {nPoints = dim+1};
+
+    /** \brief Set up the quadrature rule
+     *
+     * \param order Polynomial order that is to be integrated exactly.  Products of
+     *              two first-order basis functions need order 2, the maximum is 5.
+     * \throws std::runtime_error if there is no quadrature rule of that order
+     */
+    MortarAssembler(int order = 2);
+
+    /** \brief Assemble D and M
+     *
+     * \param overlaps The overlaps, as returned by ContactMapping::getOverlaps()
+     * \param domainElements The vertices of the domain (nonmortar) elements
+     * \param numDomainVertices The number of domain vertices, i.e., the number of rows of D and M
+     * \param targetElements The vertices of the target (mortar) elements
+     * \param numTargetVertices The number of target vertices, i.e., the number of columns of M
+     */
+    void assemble(const OverlapSet<dim,ctype>& overlaps,
+                  const std::vector<std::tr1::array<int,nPoints> >& domainElements, int numDomainVertices,
+                  const std::vector<std::tr1::array<int,nPoints> >& targetElements, int numTargetVertices,
+                  CSRMatrix<ctype>& D, CSRMatrix<ctype>& M) const;
+
+    /** \brief Assemble D and M from an array of IntersectionPrimitives */
+    void assemble(const std::vector<IntersectionPrimitive<dim,ctype> >& overlaps,
+                  const std::vector<std::tr1::array<int,nPoints> >& domainElements, int numDomainVertices,
+                  const std::vector<std::tr1::array<int,nPoints> >& targetElements, int numTargetVertices,
+                  CSRMatrix<ctype>& D, CSRMatrix<ctype>& M) const
+    {
+        assemble(OverlapSet<dim,ctype>(overlaps),
+                 domainElements, numDomainVertices, targetElements, numTargetVertices, D, M);
+    }
+
+private:
+
+    /** \brief Assemble the local matrices of the overlaps [begin, end) into D and M entries */
+    void assembleChunk(const OverlapSet<dim,ctype>& overlaps, size_t begin, size_t end,
+                       const std::vector<std::tr1::array<int,nPoints> >& domainElements,
+                       const std::vector<std::tr1::array<int,nPoints> >& targetElements,
+                       std::vector<typename CSRMatrix<ctype>::Triplet>& dEntries,
+                       std::vector<typename CSRMatrix<ctype>::Triplet>& mEntries) const;
+
+    /** \brief Barycentric coordinates of the quadrature points with respect to the overlap */
+    std::vector<std::tr1::array<ctype,nPoints> > quadPoints_;
+
+    /** \brief Quadrature weights, they sum up to one */
+    std::vector<ctype> quadWeights_;
+
+};
+
+} // namespace psurface
+
+#endif
@@ -6,10 +6,19 @@
 #define MULTI_DIM_OCTREE_HH
 
 #include <iostream>
+#include <cmath>
 #include <vector>
 #include <deque>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
 #include <map>
+#include <stdexcept>
 #include "Box.h"
+#include "BinaryIO.h"
+#include "OctreeLookupScratch.h"
 
 // can be defined if desired
 #ifndef MEMINCREMENT
@@ -18,6 +27,31 @@
 
 namespace psurface {
 
+/** Tests an item against all subcells of an octree cell.  hits[j] is set to TRUE
+ *  if the item intersects subcell j, which is the upper half of the cell in
+ *  direction i if bit i of j is set.
+ *
+ *  This default implementation calls the functor once for each subcell.
+ *  Functors which can test all subcells at once may provide an overload
+ *  in their own namespace, which is then used by MultiDimOctree.
+ */
+template <class F, class T, class C, int dim>
+void intersectSubcells(const F& f, const Box<C,dim>& cellBox, const T& item, bool* hits)
+{
+    std::tr1::array<C,dim> center = cellBox.center();
+    std::tr1::array<C,dim> lower, upper;
+
+    for (int j = 0; j < (1 << dim); ++j)
+    {
+        for (int i = 0; i < dim; ++i)
+        {
+            lower[i] = (j & (1 << i)) ? center[i] : cellBox.lower()[i];
+            upper[i] = (j & (1 << i)) ? cellBox.upper()[i] : center[i];
+        }
+        hits[j] = f(lower, upper, item);
+    }
+}
+
 /** This class implements a dimension independent structure suitable for point
  *  location. It works like a quadtree or an octree, hence the name.
  *  Items of type T can be inserted. The octree provides a
@@ -105,6 +139,46 @@ public:
    */
     bool insert(T* element);
 
+    /** Builds the octree for the elements [begin, end) of an array at once,
+     *  replacing its former contents.  The resulting tree is the same as when
+     *  inserting the elements one after the other, up to the order of the
+     *  elements within the leafs, but the elements are tested against each
+     *  cell only once.  The subtrees of the root are built concurrently.
+     *  Elements may be inserted and removed afterwards as usual.
+     *  @param begin the first element
+     *  @param end one past the last element
+     */
+    void build(T* begin, T* end);
+
+    /**
+     * @brief writes the tree to a binary stream
+     *
+     * Only the structure of the tree is written, in a format that read() can
+     * restore without testing any element against any cell.  The elements
+     * are stored as their positions in an array, which all of them have to
+     * be part of.  The data is a flat sequence of 32-bit integers and
+     * coordinates in the native byte order, and can be read from a
+     * memory-mapped file.
+     * @param out the stream
+     * @param base the first element of the array
+     */
+    void write(std::ostream& out, const T* base) const;
+
+    /**
+     * @brief restores a tree written by write()
+     *
+     * Replaces the contents of the tree, its bounding box, and its maximum
+     * depth and leaf size.  The functor and the unique lookup setup are kept.
+     * @param begin the start of the data, e.g. in a memory-mapped file
+     * @param end one past the end of the data
+     * @param base the first element of an array holding the elements
+     *        at the same positions as the array the tree has been written with
+     * @param nElements the size of that array
+     * @return the end of the tree data
+     * @throw std::runtime_error if the data is not a valid tree of this type
+     */
+    const char* read(const char* begin, const char* end, T* base, int nElements);
+
     /**
      * @brief removes an element from the octree
      * @param element the element to remove
@@ -131,6 +205,82 @@ public:
     /** Same as lookup except that indices instead of pointers are
         returned. Requires prior call to enableUniqueLookup. */
     int lookupIndex(const BoxType& queryBox, std::vector<int>& result);
+
+    /** Same as lookup, but the state of unique lookups is kept in @c scratch
+        instead of the tree.  Hence several threads can query the tree at once,
+        each with a scratch object of its own. */
+    int lookup(const std::tr1::array<C,dim>& pos, ResultContainer& result, OctreeLookupScratch& scratch) const;
+
+    /// Same as lookupIndex, with the state of the query kept in @c scratch.
+    int lookupIndex(const std::tr1::array<C,dim>& pos, std::vector<int>& result, OctreeLookupScratch& scratch) const;
+
+    /// Same as lookup, with the state of the query kept in @c scratch.
+    int lookup(const BoxType &queryBox, ResultContainer& result, OctreeLookupScratch& scratch) const;
+
+    /// Same as lookupIndex, with the state of the query kept in @c scratch.
+    int lookupIndex(const BoxType& queryBox, std::vector<int>& result, OctreeLookupScratch& scratch) const;
+
+    /** Visits the elements of all leafs crossed by the segment
+        <tt>origin + t*direction</tt>, <tt>tMin <= t <= tMax</tt>, front to back,
+        i.e., in the order in which the segment enters the leafs.  The visitor
+        is called as
+
+        @code
+        void operator()(T* element, C& tMax);
+        @endcode
+
+        It may decrease @c tMax, for example to the parameter of the closest hit
+        found so far.  The traversal then stops before the first leaf that is
+        entered behind the new @c tMax.  As for the point lookup, the elements
+        of the leafs are not tested against the segment.  With unique lookup
+        each element is visited once. */
+    template <class V>
+    void traverseSegment(const std::tr1::array<C,dim>& origin, const std::tr1::array<C,dim>& direction,
+                         C tMin, C tMax, V& visitor, OctreeLookupScratch& scratch) const;
+
+    /** This method appends all elements of the leafs crossed by the segment
+        from @c from to @c to, ordered by the position where the segment enters their leafs. */
+    int lookupSegment(const std::tr1::array<C,dim>& from, const std::tr1::array<C,dim>& to,
+                      ResultContainer& result, OctreeLookupScratch& scratch) const;
+
+    /** This method appends all elements within a region, e.g., a cone or a prism.
+        The region class R culls the cells through
+
+        @code
+        bool intersects(const std::tr1::array<C,dim>& lower, const std::tr1::array<C,dim>& upper) const;
+        @endcode
+
+        which may return true for cells that do not intersect the region,
+        but must not return false for cells that do.  The elements of the
+        cells that pass are tested with <tt>elementTest(region, element)</tt>. */
+    template <class R, class E>
+    int lookupRegion(const R& region, const E& elementTest, ResultContainer& result, OctreeLookupScratch& scratch) const;
+
+    /** This method appends the @c k elements closest to point @c pos to
+        @c result, ordered by increasing distance, and their distances to
+        @c distances.  The distance functor D is called as
+
+        @code
+        C operator()(const std::tr1::array<C,dim>& pos, const T& element) const;
+        @endcode
+
+        and has to return the Euclidean distance, since the cells are visited
+        closest first and skipped once they are farther away than the k-th
+        closest element found.  This is exact for elements that lie within
+        the bounding box of the tree.  Elements farther away than
+        @c maxDistance are not reported, and among elements with the same
+        distance those with lower addresses come first. */
+    template <class D>
+    int lookupNearest(const std::tr1::array<C,dim>& pos, int k, const D& distance,
+                      ResultContainer& result, std::vector<C>& distances, OctreeLookupScratch& scratch,
+                      C maxDistance = std::numeric_limits<C>::max()) const;
+
+    /** Returns the element closest to point @c pos, and its distance in
+        @c bestDistance, or NULL if there is no element within @c maxDistance.
+        Same as lookupNearest for k=1. */
+    template <class D>
+    T* lookupNearest(const std::tr1::array<C,dim>& pos, const D& distance, C& bestDistance,
+                     OctreeLookupScratch& scratch, C maxDistance = std::numeric_limits<C>::max()) const;
     //@}
 
     /// Removes all elements and deletes all leafs of the octree.
@@ -166,8 +316,9 @@ public:
         that a single element is reported multiple times by lookup.
         This behavior can be suppressed if all elements inserted into
         the octree are arranged subsequently in a single array. In this
-        case a bitfield of the size of the array is allocated. The bitfield
-        is used to mark an element the first time it is found.
+        case each lookup marks an element the first time it is found, in an
+        array of the size of the element array that is kept in an
+        OctreeLookupScratch object.
 
         The details: @c baseAddress denotes the address of the first element
         of the array, while @c nElements denotes the total size of the
@@ -256,11 +407,36 @@ protected:
 
     bool insert(int elem, int depth, const BoxType &elemBox, T* idx);
 
+    /// @brief Builds the subtree of cell elem of the container cells, for the given items
+    void build(std::deque<Element>& cells, int elem, int depth, const BoxType &elemBox,
+               const std::vector<T*>& items) const;
+
+    /// @brief the box of the j-th subcell of a cell
+    static BoxType childBox(const BoxType &elemBox, int j);
+
     bool remove(int elem, const BoxType &elemBox, const T* toBeDeleted);
 
-    void lookup(int elem, BoxType &elemBox, const std::tr1::array<C,dim>& pos, ResultContainer& result);
+    void lookup(int elem, const BoxType &elemBox, const std::tr1::array<C,dim>& pos, ResultContainer& result,
+                OctreeLookupScratch* scratch) const;
+
+    void lookup(int elem, const BoxType &elemBox, const BoxType& queryBox, ResultContainer& result,
+                OctreeLookupScratch* scratch) const;
+
+    /// @brief the part [t0,t1] of the ray origin + t*direction within a box, returns false if it misses the box
+    static bool clipRay(const std::tr1::array<C,dim>& origin, const std::tr1::array<C,dim>& direction,
+                        const BoxType& elemBox, C& t0, C& t1);
 
-    void lookup(int elem, const BoxType &elemBox, const BoxType& queryBox, ResultContainer& result);
+    template <class V>
+    void traverseSegment(int elem, const BoxType &elemBox, const std::tr1::array<C,dim>& origin,
+                         const std::tr1::array<C,dim>& direction, C tMin, C& tMax, V& visitor,
+                         OctreeLookupScratch* scratch) const;
+
+    template <class R, class E>
+    void lookupRegion(int elem, const BoxType &elemBox, const R& region, const E& elementTest,
+                      ResultContainer& result, OctreeLookupScratch* scratch) const;
+
+    /// @brief the Euclidean distance of a point from a box, zero if it is inside
+    static C boxDistance(const BoxType& elemBox, const std::tr1::array<C,dim>& pos);
 
     void subdivide(int elem, const BoxType &elemBox);
 
@@ -268,12 +444,80 @@ protected:
     int                          maxDepth;
     unsigned int                 maxElemPerLeaf;
     const T*                     baseAddress;
-    std::vector<bool>            lookupFlags;
+    int                          nUniqueElements;
+
+    // The state of unique lookups through the non-const lookup methods
+    OctreeLookupScratch          lookupScratch;
 
         // The functor used to determine whether an element is contained in a given box
     const F*                     f;
 };
 
+/** A finite circular cone, for use as a region in MultiDimOctree::lookupRegion.
+ *  It consists of the points whose projection onto the axis lies between
+ *  the apex and <tt>apex + length*axis</tt>, and whose angle with the axis is
+ *  at most the given half opening angle.
+ */
+template <typename C, int dim>
+struct OctreeCone
+{
+    /** @param apex the apex of the cone
+     *  @param axis the direction of the axis, does not need to be normalized
+     *  @param halfAngle half the opening angle in radians, less than pi/2
+     *  @param length the height of the cone
+     */
+    OctreeCone(const std::tr1::array<C,dim>& apex, const std::tr1::array<C,dim>& axis, C halfAngle, C length)
+        : apex(apex), axis(axis), slope(std::tan(halfAngle)), length(length)
+    {
+        C norm = 0;
+        for (int i = 0; i < dim; ++i)
+            norm += axis[i]*axis[i];
+        norm = std::sqrt(norm);
+        for (int i = 0; i < dim; ++i)
+            this->axis[i] /= norm;
+    }
+
+    /// Conservative test of a box, through its circumsphere
+    bool intersects(const std::tr1::array<C,dim>& lower, const std::tr1::array<C,dim>& upper) const
+    {
+        C radius2 = 0, height = 0, dist2 = 0;
+        for (int i = 0; i < dim; ++i)
+        {
+            C v = C(0.5)*(lower[i]+upper[i]) - apex[i];
+            radius2 += C(0.25)*(upper[i]-lower[i])*(upper[i]-lower[i]);
+            height += v*axis[i];
+            dist2 += v*v;
+        }
+        C radius = std::sqrt(radius2);
+
+        if (height < -radius || height > length + radius)
+            return false;
+
+        // The sphere is farther away from the axis than the widest part of the cone next to it
+        C axisDist = std::sqrt(std::max(dist2 - height*height, C(0)));
+        return axisDist - radius <= std::max(std::min(height + radius, length), C(0)) * slope;
+    }
+
+    /// Tests whether a point lies inside the cone
+    bool contains(const std::tr1::array<C,dim>& p) const
+    {
+        C height = 0, dist2 = 0;
+        for (int i = 0; i < dim; ++i)
+        {
+            C v = p[i] - apex[i];
+            height += v*axis[i];
+            dist2 += v*v;
+        }
+
+        return height >= 0 && height <= length && dist2 - height*height <= height*height*slope*slope;
+    }
+
+    std::tr1::array<C,dim> apex;
+    std::tr1::array<C,dim> axis;
+    C slope;
+    C length;
+};
+
 /// @if EXCLUDETHIS
 
 template <class T, typename F, typename C, int dim>
@@ -287,6 +531,7 @@ template <class T, typename F, typename C, int dim>
 MultiDimOctree<T, F, C, dim>::MultiDimOctree()
 {
     baseAddress = 0;
+    nUniqueElements = 0;
     maxDepth = 0;
         f = NULL;
     maxElemPerLeaf = 0;
@@ -306,9 +551,7 @@ template <class T, typename F, typename C, int dim>
 void MultiDimOctree<T, F, C, dim>::enableUniqueLookup(int n, const T* addr)
 {
     baseAddress = addr;
-    lookupFlags.resize(n);
-    for (size_t i=0; i<lookupFlags.size(); i++)
-        lookupFlags[i] = false;
+    nUniqueElements = n;
 }
 
 
@@ -316,7 +559,7 @@ template <class T, typename F, typename C, int dim>
 void MultiDimOctree<T, F, C, dim>::disableUniqueLookup()
 {
     baseAddress = 0;
-    lookupFlags.resize(0);
+    nUniqueElements = 0;
 }
 
 
@@ -324,7 +567,7 @@ template <class T, typename F, typename C, int dim>
 void MultiDimOctree<T, F, C, dim>::clear()
 {
     baseAddress = 0;
-    lookupFlags.resize(0);
+    nUniqueElements = 0;
 
     // Just keep the root node. remax(1,1) is wrong since the root node
     // then would not be marked as a leaf.
@@ -340,7 +583,7 @@ void MultiDimOctree<T, F, C, dim>::init(const BoxType& b, const F* f_, int depth
         f = f_;
 
     baseAddress = 0;
-    lookupFlags.resize(0);
+    nUniqueElements = 0;
     maxDepth = depth;
     maxElemPerLeaf = elemPerLeaf;
 
@@ -410,33 +653,276 @@ bool MultiDimOctree<T, F, C, dim>::insert(int elem, int depth, const BoxType &el
     // the return value
     bool inserted = false;
 
-    // helpful points that describe box corners
-        std::tr1::array<C,dim> upper, lower;
-    // iterate over all subcells and check for intersections between
-    // item and subcells
+    // check for intersections between item and all subcells
+    bool hits[SUBCELLS];
+    intersectSubcells(*f, elemBox, *idx, hits);
+
+    // insert the item into each child element whose box it intersects
     for (int j = 0; j < SUBCELLS; ++j)
+        if (hits[j])
+            inserted = insert(firstChild+j, depth, childBox(elemBox, j), idx) || inserted;
+    return inserted;
+}
+
+
+template <class T, typename F, typename C, int dim>
+typename MultiDimOctree<T, F, C, dim>::BoxType MultiDimOctree<T, F, C, dim>::childBox(const BoxType &elemBox, int j)
+{
+    std::tr1::array<C,dim> lower, upper;
+    for(int i = 0; i < dim; ++i)
     {
-        // compute the next child cell
-        for(int i = 0; i < dim; ++i)
+        if (j & (1 << i))
         {
-            if (j & (1 << i))
-            {
-                lower[i] = elemBox.center()[i];
-                upper[i] = elemBox.upper()[i];
-            }
-            else
-            {
-                lower[i] = elemBox.lower()[i];
-                upper[i] = elemBox.center()[i];
-            }
+            lower[i] = elemBox.center()[i];
+            upper[i] = elemBox.upper()[i];
+        }
+        else
+        {
+            lower[i] = elemBox.lower()[i];
+            upper[i] = elemBox.center()[i];
         }
-        // if the item intersects the child element's box
-        // insert it into this box
-        BoxType childElemBox(lower, upper);
-        if ((*f)(lower, upper, *idx))
-            inserted = inserted || insert(firstChild+j, depth, childElemBox, idx);
     }
-    return inserted;
+    return BoxType(lower, upper);
+}
+
+
+template <class T, typename F, typename C, int dim>
+void MultiDimOctree<T, F, C, dim>::build(T* begin, T* end)
+{
+    // Keep the bounding box, functor, and unique lookup setup
+    allElements.clear();
+    allElements.push_back(Element());
+
+    if (f == NULL)
+        return;
+
+    // Elements which do not intersect the bounding box are not inserted
+    std::vector<T*> items;
+    for (T* t = begin; t != end; ++t)
+        if ((*f)(box.lower(), box.upper(), *t))
+            items.push_back(t);
+
+    if (maxDepth<=0 || items.size()<=maxElemPerLeaf)
+    {
+        build(allElements, 0, 0, box, items);
+        return;
+    }
+
+    // Subdivide the root, and build the subtrees of its children concurrently,
+    // each one in a container of its own
+    allElements.front().isLeaf = 0;
+    allElements.front().n = 1;
+    for (int j = 0; j < SUBCELLS; ++j)
+        allElements.push_back(Element());
+
+    // Test all items against all children of the root.  The flags are chars,
+    // because the entries of a vector<bool> cannot be written concurrently.
+    int nItems = items.size();
+    std::vector<char> hits(nItems*SUBCELLS);
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int k = 0; k < nItems; ++k)
+    {
+        bool itemHits[SUBCELLS];
+        intersectSubcells(*f, box, *items[k], itemHits);
+        for (int j = 0; j < SUBCELLS; ++j)
+            hits[k*SUBCELLS+j] = itemHits[j];
+    }
+
+    std::vector<std::deque<Element> > subtrees(SUBCELLS);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int j = 0; j < SUBCELLS; ++j)
+    {
+        std::vector<T*> childItems;
+        for (int k = 0; k < nItems; ++k)
+            if (hits[k*SUBCELLS+j])
+                childItems.push_back(items[k]);
+
+        subtrees[j].push_back(Element());
+        build(subtrees[j], 0, 1, childBox(box, j), childItems);
+    }
+
+    // Append the subtrees.  Their roots are the children of the root,
+    // and all other cells are shifted to the end of allElements.
+    for (int j = 0; j < SUBCELLS; ++j)
+    {
+        int offset = allElements.size() - 1;
+
+        for (size_t i = 0; i < subtrees[j].size(); ++i)
+        {
+            Element& source = subtrees[j][i];
+            Element& target = (i==0) ? allElements[1+j] : (allElements.push_back(Element()), allElements.back());
+
+            target.isLeaf = source.isLeaf;
+            target.n = (source.isLeaf) ? source.n : source.n + offset;
+
+            // hand over the item array
+            target.indices = source.indices;
+            source.indices = NULL;
+        }
+    }
+}
+
+
+template <class T, typename F, typename C, int dim>
+void MultiDimOctree<T, F, C, dim>::build(std::deque<Element>& cells, int elem, int depth, const BoxType &elemBox,
+                                         const std::vector<T*>& items) const
+{
+    // References to the elements of a deque stay valid when appending
+    Element& element = cells[elem];
+
+    if (depth>=maxDepth || items.size()<=maxElemPerLeaf)
+    {
+        element.n = items.size();
+        if (element.n > 0)
+        {
+            // Allocate in multiples of MEMINCREMENT, like insert does
+            int size = (element.n + MEMINCREMENT - 1) / MEMINCREMENT * MEMINCREMENT;
+            element.indices = (T**) malloc(size*sizeof(T*));
+            std::copy(items.begin(), items.end(), element.indices);
+        }
+        return;
+    }
+
+    int firstChild = cells.size();
+    element.isLeaf = 0;
+    element.n = firstChild;
+
+    for (int j = 0; j < SUBCELLS; ++j)
+        cells.push_back(Element());
+
+    // Each item is tested against the subcells of the cells it is in only,
+    // and against all of them at once
+    std::vector<std::vector<T*> > childItems(SUBCELLS);
+
+    for (size_t k = 0; k < items.size(); ++k)
+    {
+        bool hits[SUBCELLS];
+        intersectSubcells(*f, elemBox, *items[k], hits);
+        for (int j = 0; j < SUBCELLS; ++j)
+            if (hits[j])
+                childItems[j].push_back(items[k]);
+    }
+
+    for (int j = 0; j < SUBCELLS; ++j)
+    {
+        build(cells, firstChild+j, depth+1, childBox(elemBox, j), childItems[j]);
+
+        // release the memory before building the next subtree
+        std::vector<T*>().swap(childItems[j]);
+    }
+}
+
+
+template <class T, typename F, typename C, int dim>
+void MultiDimOctree<T, F, C, dim>::write(std::ostream& out, const T* base) const
+{
+    int header[5] = {dim, int(sizeof(C)), maxDepth, int(maxElemPerLeaf), int(allElements.size())};
+    writeBinary(out, header, 5);
+    writeBinary(out, &box.lower()[0], dim);
+    writeBinary(out, &box.upper()[0], dim);
+
+    // the cells, and the items of all leaves leaf after leaf
+    std::vector<int> cells(2*allElements.size());
+    std::vector<int> items;
+
+    for (size_t i = 0; i < allElements.size(); ++i)
+    {
+        const Element& element = allElements[i];
+        cells[2*i]   = element.isLeaf;
+        cells[2*i+1] = element.n;
+
+        if (element.isLeaf)
+            for (unsigned int k = 0; k < element.n; ++k)
+                items.push_back(element.indices[k] - base);
+    }
+
+    int nItems = items.size();
+    writeBinary(out, &cells[0], cells.size());
+    writeBinary(out, &nItems, 1);
+    if (nItems > 0)
+        writeBinary(out, &items[0], nItems);
+}
+
+
+template <class T, typename F, typename C, int dim>
+const char* MultiDimOctree<T, F, C, dim>::read(const char* begin, const char* end, T* base, int nElements)
+{
+    const char* pos = begin;
+
+    int header[5];
+    readBinary(pos, end, header, 5);
+    if (header[0] != dim || header[1] != int(sizeof(C)))
+        throw std::runtime_error("MultiDimOctree: the data does not match the type of the tree");
+
+    int nCells = header[4];
+    if (nCells < 1 || (nCells - 1) % SUBCELLS != 0)
+        throw std::runtime_error("MultiDimOctree: invalid number of cells");
+
+    std::tr1::array<C,dim> lower, upper;
+    readBinary(pos, end, &lower[0], dim);
+    readBinary(pos, end, &upper[0], dim);
+
+    std::vector<int> cells(2*nCells);
+    readBinary(pos, end, &cells[0], cells.size());
+
+    int nItems;
+    readBinary(pos, end, &nItems, 1);
+    if (nItems < 0)
+        throw std::runtime_error("MultiDimOctree: invalid number of items");
+
+    std::vector<int> items(nItems);
+    if (nItems > 0)
+        readBinary(pos, end, &items[0], nItems);
+
+    // Check the data before changing anything
+    int nLeafItems = 0;
+    for (int i = 0; i < nCells; ++i)
+    {
+        int n = cells[2*i+1];
+        if (cells[2*i])
+            nLeafItems += n;
+        else if (n <= i || n + SUBCELLS > nCells)
+            throw std::runtime_error("MultiDimOctree: invalid subcell index");
+        if (n < 0 || nLeafItems > nItems)
+            throw std::runtime_error("MultiDimOctree: invalid number of items");
+    }
+    if (nLeafItems != nItems)
+        throw std::runtime_error("MultiDimOctree: invalid number of items");
+    for (int k = 0; k < nItems; ++k)
+        if (items[k] < 0 || items[k] >= nElements)
+            throw std::runtime_error("MultiDimOctree: item out of range");
+
+    box = BoxType(lower, upper);
+    maxDepth = header[2];
+    maxElemPerLeaf = header[3];
+
+    allElements.clear();
+    allElements.resize(nCells);
+
+    int k = 0;
+    for (int i = 0; i < nCells; ++i)
+    {
+        Element& element = allElements[i];
+        element.isLeaf = cells[2*i];
+        element.n = cells[2*i+1];
+
+        if (element.isLeaf && element.n > 0)
+        {
+            // Allocate in multiples of MEMINCREMENT, like insert does
+            int size = (element.n + MEMINCREMENT - 1) / MEMINCREMENT * MEMINCREMENT;
+            element.indices = (T**) malloc(size*sizeof(T*));
+            for (unsigned int j = 0; j < element.n; ++j)
+                element.indices[j] = base + items[k++];
+        }
+    }
+
+    return pos;
 }
 
 
@@ -591,51 +1077,63 @@ void MultiDimOctree<T, F, C, dim>::info()
 
 template <class T, typename F, typename C, int dim>
 int MultiDimOctree<T, F, C, dim>::lookup(const std::tr1::array<C,dim>& pos, ResultContainer& result)
+{
+    return lookup(pos, result, lookupScratch);
+}
+
+
+template <class T, typename F, typename C, int dim>
+int MultiDimOctree<T, F, C, dim>::lookup(const std::tr1::array<C,dim>& pos, ResultContainer& result,
+                                         OctreeLookupScratch& scratch) const
 {
     BoxType b(box);
 
+    if (baseAddress)
+        scratch.newQuery(nUniqueElements);
+
     if (b.contains(pos))
-        lookup(0, b, pos, result);
+        lookup(0, b, pos, result, (baseAddress) ? &scratch : NULL);
 
-    // Ensure that lookupFlags is clean again...
-    if (baseAddress)
-    {
-        for (int i=result.size()-1; i>=0; i--)
-        {
-            int n = result[i] - baseAddress;
-            lookupFlags[n] = false;
-        }
-    }
     return result.size();
 }
 
 
 template <class T, typename F, typename C, int dim>
 int MultiDimOctree<T, F, C, dim>::lookup(const BoxType& queryBox, ResultContainer& result)
+{
+    return lookup(queryBox, result, lookupScratch);
+}
+
+
+template <class T, typename F, typename C, int dim>
+int MultiDimOctree<T, F, C, dim>::lookup(const BoxType& queryBox, ResultContainer& result,
+                                         OctreeLookupScratch& scratch) const
 {
     BoxType b(box);
 
+    if (baseAddress)
+        scratch.newQuery(nUniqueElements);
+
     if (b.intersects(queryBox))
-        lookup(0, b, queryBox, result);
+        lookup(0, b, queryBox, result, (baseAddress) ? &scratch : NULL);
 
-    // Ensure that lookupFlags is clean again...
-    if (baseAddress)
-    {
-        for (int i=result.size()-1; i>=0; i--)
-        {
-            int n = result[i] - baseAddress;
-            lookupFlags[n] = false;
-        }
-    }
     return result.size();
 }
 
 
 template <class T, typename F, typename C, int dim>
 int MultiDimOctree<T, F, C, dim>::lookupIndex(const BoxType& queryBox, std::vector<int>& result)
+{
+    return lookupIndex(queryBox, result, lookupScratch);
+}
+
+
+template <class T, typename F, typename C, int dim>
+int MultiDimOctree<T, F, C, dim>::lookupIndex(const BoxType& queryBox, std::vector<int>& result,
+                                              OctreeLookupScratch& scratch) const
 {
     ResultContainer tmpResult;
-    lookup(queryBox, tmpResult);
+    lookup(queryBox, tmpResult, scratch);
 
     int n = tmpResult.size();
     for (int i=0; i<n; i++)
@@ -645,9 +1143,10 @@ int MultiDimOctree<T, F, C, dim>::lookupIndex(const BoxType& queryBox, std::vect
 
 
 template <class T, typename F, typename C, int dim>
-void MultiDimOctree<T, F, C, dim>::lookup(int elem, const BoxType &elemBox, const BoxType& queryBox, ResultContainer& result)
+void MultiDimOctree<T, F, C, dim>::lookup(int elem, const BoxType &elemBox, const BoxType& queryBox, ResultContainer& result,
+                                          OctreeLookupScratch* scratch) const
 {
-    Element& element = allElements[elem];
+    const Element& element = allElements[elem];
 
     if (element.isLeaf)
     {
@@ -658,14 +1157,10 @@ void MultiDimOctree<T, F, C, dim>::lookup(int elem, const BoxType &elemBox, cons
             // get the functor of the element and check for intersection
             if ((*this->f)(queryBox.lower(), queryBox.upper(), *t))
             {
-                if (baseAddress)
+                if (scratch)
                 { // this indicates unique lookup strategy
-                    int k = t - baseAddress;
-                    if (lookupFlags[k] == 0)
-                    {
+                    if (scratch->mark(t - baseAddress))
                         result.push_back(t);
-                        lookupFlags[k] = true;
-                    }
                 } else
                     result.push_back(t); // t may be appended multiple times
             }
@@ -703,7 +1198,7 @@ void MultiDimOctree<T, F, C, dim>::lookup(int elem, const BoxType &elemBox, cons
             if (intersects_subcell)
             {
                 BoxType childElemBox(lower, upper);
-                lookup(firstChild+j, childElemBox, queryBox, result);
+                lookup(firstChild+j, childElemBox, queryBox, result, scratch);
             }
         }
     }
@@ -712,9 +1207,17 @@ void MultiDimOctree<T, F, C, dim>::lookup(int elem, const BoxType &elemBox, cons
 
 template <class T, typename F, typename C, int dim>
 int MultiDimOctree<T, F, C, dim>::lookupIndex(const std::tr1::array<C,dim>& pos, std::vector<int>& result)
+{
+    return lookupIndex(pos, result, lookupScratch);
+}
+
+
+template <class T, typename F, typename C, int dim>
+int MultiDimOctree<T, F, C, dim>::lookupIndex(const std::tr1::array<C,dim>& pos, std::vector<int>& result,
+                                              OctreeLookupScratch& scratch) const
 {
     ResultContainer tmpResult;
-    lookup(pos, tmpResult);
+    lookup(pos, tmpResult, scratch);
 
     int n = tmpResult.size();
     for (int i=0; i<n; i++)
@@ -724,23 +1227,20 @@ int MultiDimOctree<T, F, C, dim>::lookupIndex(const std::tr1::array<C,dim>& pos,
 
 
 template <class T, typename F, typename C, int dim>
-void MultiDimOctree<T, F, C, dim>::lookup(int elem, BoxType &elemBox, const std::tr1::array<C,dim>& pos, ResultContainer& result)
+void MultiDimOctree<T, F, C, dim>::lookup(int elem, const BoxType &elemBox, const std::tr1::array<C,dim>& pos, ResultContainer& result,
+                                          OctreeLookupScratch* scratch) const
 {
-    Element& element = allElements[elem];
+    const Element& element = allElements[elem];
 
     if (element.isLeaf)
     {
         for (unsigned int i=0; i<element.n; i++)
         {
             T* t = element.indices[i];
-            if (baseAddress)
+            if (scratch)
             { // this indicates unique lookup strategy
-                unsigned int k = t - baseAddress;
-                if (lookupFlags[k] == 0)
-                {
+                if (scratch->mark(t - baseAddress))
                     result.push_back(t);
-                    lookupFlags[k] = true;
-                }
             }
             else
                 result.push_back(t); // t may be appended multiple times
@@ -769,11 +1269,311 @@ void MultiDimOctree<T, F, C, dim>::lookup(int elem, BoxType &elemBox, const std:
             }
         }
         BoxType childElemBox(lower, upper);
-        lookup(firstChild+config, childElemBox, pos, result);
+        lookup(firstChild+config, childElemBox, pos, result, scratch);
+    }
+}
+
+
+template <class T, typename F, typename C, int dim>
+bool MultiDimOctree<T, F, C, dim>::clipRay(const std::tr1::array<C,dim>& origin, const std::tr1::array<C,dim>& direction,
+                                           const BoxType& elemBox, C& t0, C& t1)
+{
+    for (int i = 0; i < dim; ++i)
+    {
+        if (direction[i] == 0)
+        {
+            // parallel to the slab
+            if (origin[i] < elemBox.lower()[i] || origin[i] > elemBox.upper()[i])
+                return false;
+            continue;
+        }
+
+        C tLower = (elemBox.lower()[i] - origin[i]) / direction[i];
+        C tUpper = (elemBox.upper()[i] - origin[i]) / direction[i];
+        if (tLower > tUpper)
+            std::swap(tLower, tUpper);
+
+        t0 = std::max(t0, tLower);
+        t1 = std::min(t1, tUpper);
+        if (t0 > t1)
+            return false;
+    }
+    return true;
+}
+
+
+template <class T, typename F, typename C, int dim>
+template <class V>
+void MultiDimOctree<T, F, C, dim>::traverseSegment(const std::tr1::array<C,dim>& origin, const std::tr1::array<C,dim>& direction,
+                                                   C tMin, C tMax, V& visitor, OctreeLookupScratch& scratch) const
+{
+    if (baseAddress)
+        scratch.newQuery(nUniqueElements);
+
+    C t0 = tMin, t1 = tMax;
+    if (clipRay(origin, direction, box, t0, t1))
+        traverseSegment(0, box, origin, direction, tMin, tMax, visitor, (baseAddress) ? &scratch : NULL);
+}
+
+
+template <class T, typename F, typename C, int dim>
+template <class V>
+void MultiDimOctree<T, F, C, dim>::traverseSegment(int elem, const BoxType &elemBox, const std::tr1::array<C,dim>& origin,
+                                                   const std::tr1::array<C,dim>& direction, C tMin, C& tMax, V& visitor,
+                                                   OctreeLookupScratch* scratch) const
+{
+    const Element& element = allElements[elem];
+
+    if (element.isLeaf)
+    {
+        for (unsigned int i=0; i<element.n; i++)
+        {
+            T* t = element.indices[i];
+            if (scratch == NULL || scratch->mark(t - baseAddress))
+                visitor(t, tMax);
+        }
+        return;
+    }
+
+    int firstChild = element.n;
+
+    // Find the children crossed by the segment, and sort them by the entry parameter
+    C entry[SUBCELLS];
+    int order[SUBCELLS];
+    int nCrossed = 0;
+
+    for (int j = 0; j < SUBCELLS; ++j)
+    {
+        C t0 = tMin, t1 = tMax;
+        if (!clipRay(origin, direction, childBox(elemBox, j), t0, t1))
+            continue;
+
+        int k = nCrossed++;
+        for (; k > 0 && entry[k-1] > t0; --k)
+        {
+            entry[k] = entry[k-1];
+            order[k] = order[k-1];
+        }
+        entry[k] = t0;
+        order[k] = j;
+    }
+
+    for (int k = 0; k < nCrossed; ++k)
+    {
+        // the visitor may have shortened the segment in the meantime
+        if (entry[k] > tMax)
+            break;
+        traverseSegment(firstChild+order[k], childBox(elemBox, order[k]), origin, direction, tMin, tMax, visitor, scratch);
     }
 }
 
 
+/// @brief Collects the elements visited by MultiDimOctree::traverseSegment
+template <class T, class C>
+struct OctreeSegmentCollector
+{
+    OctreeSegmentCollector(std::vector<T*>& result) : result(result) {}
+
+    void operator()(T* element, C&) { result.push_back(element); }
+
+    std::vector<T*>& result;
+};
+
+
+template <class T, typename F, typename C, int dim>
+int MultiDimOctree<T, F, C, dim>::lookupSegment(const std::tr1::array<C,dim>& from, const std::tr1::array<C,dim>& to,
+                                                ResultContainer& result, OctreeLookupScratch& scratch) const
+{
+    std::tr1::array<C,dim> direction;
+    for (int i = 0; i < dim; ++i)
+        direction[i] = to[i] - from[i];
+
+    OctreeSegmentCollector<T,C> collector(result);
+    traverseSegment(from, direction, C(0), C(1), collector, scratch);
+    return result.size();
+}
+
+
+template <class T, typename F, typename C, int dim>
+template <class R, class E>
+int MultiDimOctree<T, F, C, dim>::lookupRegion(const R& region, const E& elementTest,
+                                               ResultContainer& result, OctreeLookupScratch& scratch) const
+{
+    if (baseAddress)
+        scratch.newQuery(nUniqueElements);
+
+    if (region.intersects(box.lower(), box.upper()))
+        lookupRegion(0, box, region, elementTest, result, (baseAddress) ? &scratch : NULL);
+
+    return result.size();
+}
+
+
+template <class T, typename F, typename C, int dim>
+template <class R, class E>
+void MultiDimOctree<T, F, C, dim>::lookupRegion(int elem, const BoxType &elemBox, const R& region, const E& elementTest,
+                                                ResultContainer& result, OctreeLookupScratch* scratch) const
+{
+    const Element& element = allElements[elem];
+
+    if (element.isLeaf)
+    {
+        for (unsigned int i=0; i<element.n; i++)
+        {
+            T* t = element.indices[i];
+            if (scratch)
+            {
+                // An element that fails the test fails it in every leaf
+                if (scratch->mark(t - baseAddress) && elementTest(region, *t))
+                    result.push_back(t);
+            }
+            else if (elementTest(region, *t))
+                result.push_back(t);
+        }
+        return;
+    }
+
+    int firstChild = element.n;
+
+    for (int j = 0; j < SUBCELLS; ++j)
+    {
+        BoxType childElemBox = childBox(elemBox, j);
+        if (region.intersects(childElemBox.lower(), childElemBox.upper()))
+            lookupRegion(firstChild+j, childElemBox, region, elementTest, result, scratch);
+    }
+}
+
+
+template <class T, typename F, typename C, int dim>
+C MultiDimOctree<T, F, C, dim>::boxDistance(const BoxType& elemBox, const std::tr1::array<C,dim>& pos)
+{
+    C dist2 = 0;
+    for (int i = 0; i < dim; ++i)
+    {
+        C d = std::max(C(0), std::max(elemBox.lower()[i] - pos[i], pos[i] - elemBox.upper()[i]));
+        dist2 += d*d;
+    }
+    return std::sqrt(dist2);
+}
+
+
+template <class T, typename F, typename C, int dim>
+template <class D>
+int MultiDimOctree<T, F, C, dim>::lookupNearest(const std::tr1::array<C,dim>& pos, int k, const D& distance,
+                                                ResultContainer& result, std::vector<C>& distances,
+                                                OctreeLookupScratch& scratch, C maxDistance) const
+{
+    if (k <= 0)
+        return result.size();
+
+    if (baseAddress)
+        scratch.newQuery(nUniqueElements);
+
+    // The k closest elements found so far, by increasing distance
+    std::vector<std::pair<C,T*> > best;
+
+    // The cells still to be visited, closest first.  The second entry points
+    // into the array of the cells and their boxes.
+    typedef std::pair<C,int> QueueEntry;
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry> > queue;
+    std::vector<std::pair<int,BoxType> > cells;
+
+    C rootDistance = boxDistance(box, pos);
+    if (rootDistance <= maxDistance)
+    {
+        cells.push_back(std::make_pair(0, box));
+        queue.push(QueueEntry(rootDistance, 0));
+    }
+
+    while (!queue.empty())
+    {
+        C bound = (best.size() == size_t(k)) ? best.back().first : maxDistance;
+        if (queue.top().first > bound)
+            break;
+
+        int elem = cells[queue.top().second].first;
+        BoxType elemBox = cells[queue.top().second].second;
+        queue.pop();
+
+        const Element& element = allElements[elem];
+
+        if (element.isLeaf)
+        {
+            for (unsigned int i=0; i<element.n; i++)
+            {
+                T* t = element.indices[i];
+
+                // Without unique lookup an element may have been found in another leaf before
+                if (baseAddress)
+                {
+                    if (!scratch.mark(t - baseAddress))
+                        continue;
+                }
+                else
+                {
+                    bool found = false;
+                    for (size_t j = 0; j < best.size(); ++j)
+                        found = found || (best[j].second == t);
+                    if (found)
+                        continue;
+                }
+
+                std::pair<C,T*> candidate(distance(pos, *t), t);
+                if (candidate.first > maxDistance)
+                    continue;
+
+                if (best.size() == size_t(k))
+                {
+                    if (!(candidate < best.back()))
+                        continue;
+                    best.pop_back();
+                }
+                best.insert(std::upper_bound(best.begin(), best.end(), candidate), candidate);
+            }
+            continue;
+        }
+
+        int firstChild = element.n;
+        bound = (best.size() == size_t(k)) ? best.back().first : maxDistance;
+
+        for (int j = 0; j < SUBCELLS; ++j)
+        {
+            BoxType childElemBox = childBox(elemBox, j);
+            C childDistance = boxDistance(childElemBox, pos);
+            if (childDistance <= bound)
+            {
+                cells.push_back(std::make_pair(firstChild+j, childElemBox));
+                queue.push(QueueEntry(childDistance, cells.size()-1));
+            }
+        }
+    }
+
+    for (size_t j = 0; j < best.size(); ++j)
+    {
+        result.push_back(best[j].second);
+        distances.push_back(best[j].first);
+    }
+    return result.size();
+}
+
+
+template <class T, typename F, typename C, int dim>
+template <class D>
+T* MultiDimOctree<T, F, C, dim>::lookupNearest(const std::tr1::array<C,dim>& pos, const D& distance, C& bestDistance,
+                                               OctreeLookupScratch& scratch, C maxDistance) const
+{
+    ResultContainer result;
+    std::vector<C> distances;
+    lookupNearest(pos, 1, distance, result, distances, scratch, maxDistance);
+
+    if (result.empty())
+        return NULL;
+
+    bestDistance = distances[0];
+    return result[0];
+}
+
+
 template <class T, typename F, typename C, int dim>
 bool MultiDimOctree<T, F, C, dim>::remove(int elem, const BoxType &elemBox, const T* toBeDeleted)
 {
@@ -807,33 +1607,14 @@ bool MultiDimOctree<T, F, C, dim>::remove(int elem, const BoxType &elemBox, cons
         // the result value
         bool removed = false;
 
-        // helpful points that describe box corners
-        std::tr1::array<C,dim> upper, lower;
-        // iterate over all subcells and check for intersections between
-        // item and subcells
-        for (int j = 0; j < SUBCELLS; ++j)
-        {
-            // compute the next child cell
-            for(int i = 0; i < dim; ++i)
-            {
-                if (j & (1 << i))
-                {
-                    lower[i] = elemBox.center()[i];
-                    upper[i] = elemBox.upper()[i];
-                }
-                else
-                {
-                    lower[i] = elemBox.lower()[i];
-                    upper[i] = elemBox.center()[i];
-                }
-            }
-            // if the item intersects the child element's box
-            // insert it into this box
-            BoxType childElemBox(lower, upper);
-            if ((*this->f)(lower, upper, *toBeDeleted))
-                removed = removed || remove(firstChild+j, childElemBox, toBeDeleted);
-        }
+        // check for intersections between item and all subcells
+        bool hits[SUBCELLS];
+        intersectSubcells(*f, elemBox, *toBeDeleted, hits);
 
+        // remove the item from each child element whose box it intersects
+        for (int j = 0; j < SUBCELLS; ++j)
+            if (hits[j])
+                removed = remove(firstChild+j, childBox(elemBox, j), toBeDeleted) || removed;
         return removed;
     }
 }
@@ -11,6 +11,11 @@
 #include "NodeBundle.h"
 #include "PathVertex.h"
 
+#include "TargetSurfaceIndex.h"
+#include "MultiDimOctree.h"
+#include "PointIntersectionFunctor.h"
+#include "Simd.h"
+
 #ifdef PSURFACE_STANDALONE
 #include "TargetSurface.h"
 #else
@@ -21,60 +26,313 @@
 #include <exception>
 #include <vector>
 #include <set>
+#include <algorithm>
+#include <limits>
 
 using namespace psurface;
 
-/** \brief An Exception that is thrown whenever during the insertion of a target edge
- *         the inverse projection is not unique or does not exist at all.
+/** \brief The determinant of the 3x3 matrix with columns a, b, c
+ *
+ * Computed in the same way as StaticMatrix::det(), for use in the SIMD lanes of the batched kernels.
+ */
+template <class ctype>
+static inline ctype det3(ctype a0, ctype a1, ctype a2, ctype b0, ctype b1, ctype b2, ctype c0, ctype c1, ctype c2)
+{
+    return a0*(b1*c2 - c1*b2) - b0*(a1*c2 - c1*a2) + c0*(a1*b2 - b1*a2);
+}
+
+/** \brief The Newton correction -J^{-1} F for the Jacobian J with columns a, b, c
+ *
+ * Computed in the same way as StaticMatrix::inverse() and StaticMatrix::multMatrixVec().
+ */
+template <class ctype>
+static inline void newtonCorrection(const ctype* a, const ctype* b, const ctype* c, const ctype* F, ctype* correction)
+{
+    ctype d = det3(a[0], a[1], a[2], b[0], b[1], b[2], c[0], c[1], c[2]);
+
+    ctype inv[3][3];
+    inv[0][0] =  (b[1]*c[2] - c[1]*b[2]) / d;
+    inv[0][1] = -(b[0]*c[2] - c[0]*b[2]) / d;
+    inv[0][2] =  (b[0]*c[1] - c[0]*b[1]) / d;
+    inv[1][0] = -(a[1]*c[2] - c[1]*a[2]) / d;
+    inv[1][1] =  (a[0]*c[2] - c[0]*a[2]) / d;
+    inv[1][2] = -(a[0]*c[1] - c[0]*a[1]) / d;
+    inv[2][0] =  (a[1]*b[2] - b[1]*a[2]) / d;
+    inv[2][1] = -(a[0]*b[2] - b[0]*a[2]) / d;
+    inv[2][2] =  (a[0]*b[1] - b[0]*a[1]) / d;
+
+    for (int r=0; r<3; r++)
+        correction[r] = (-F[0])*inv[r][0] + (-F[1])*inv[r][1] + (-F[2])*inv[r][2];
+}
+
+/** \brief The closest point to p on the triangle abc, in barycentric coordinates
+ *
+ * Follows Ericson, Real-Time Collision Detection, Section 5.1.5.
+ * \param localCoords The weights of a and b, as returned by rayIntersectsTriangle()
  */
-class WrongEdgeException: public std::exception
+template <class ctype>
+static StaticVector<ctype,3> closestPointOnTriangle(const StaticVector<ctype,3>& p,
+                                                   const StaticVector<ctype,3>& a, const StaticVector<ctype,3>& b,
+                                                   const StaticVector<ctype,3>& c, StaticVector<ctype,2>& localCoords)
+{
+    StaticVector<ctype,3> ab = b - a;
+    StaticVector<ctype,3> ac = c - a;
+    StaticVector<ctype,3> ap = p - a;
+
+    // the weights of b and c
+    ctype v, w;
+
+    ctype d1 = ab.dot(ap);
+    ctype d2 = ac.dot(ap);
+
+    StaticVector<ctype,3> bp = p - b;
+    ctype d3 = ab.dot(bp);
+    ctype d4 = ac.dot(bp);
+
+    StaticVector<ctype,3> cp = p - c;
+    ctype d5 = ab.dot(cp);
+    ctype d6 = ac.dot(cp);
+
+    ctype va = d3*d6 - d5*d4;
+    ctype vb = d5*d2 - d1*d6;
+    ctype vc = d1*d4 - d3*d2;
+
+    if (d1 <= 0 && d2 <= 0) {
+        v = 0; w = 0;                                   // vertex a
+    } else if (d3 >= 0 && d4 <= d3) {
+        v = 1; w = 0;                                   // vertex b
+    } else if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+        v = d1 / (d1 - d3); w = 0;                      // edge ab
+    } else if (d6 >= 0 && d5 <= d6) {
+        v = 0; w = 1;                                   // vertex c
+    } else if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+        v = 0; w = d2 / (d2 - d6);                      // edge ac
+    } else if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+        w = (d4 - d3) / ((d4 - d3) + (d5 - d6));        // edge bc
+        v = 1 - w;
+    } else {
+        ctype denom = 1 / (va + vb + vc);               // interior
+        v = vb * denom;
+        w = vc * denom;
+    }
+
+    localCoords[0] = 1 - v - w;
+    localCoords[1] = v;
+
+    return a + ab*v + ac*w;
+}
+
+
+/** \brief The distance of a point from the target triangle of a box in a TargetSurfaceIndex */
+template <class ctype>
+struct TriangleDistance
 {
-public:
-    WrongEdgeException(std::string str) :
-        str_(str)
+    TriangleDistance(const Surface* surf, const Surface* targetSurface,
+                     const TargetSurfaceIndex<ctype>* index, const std::vector<bool>* contact)
+        : surf(surf), targetSurface(targetSurface), index(index), contact(contact)
     {}
 
-    virtual const char* what() const throw()
+    /** \brief The target triangle belonging to a box */
+    int triangle(const Box<ctype,3>& box) const
     {
-        return str_.c_str();
+        return index->triangle(&box - index->boxes());
     }
 
-    virtual ~WrongEdgeException() throw()
-    {}
+    /** \brief The closest point on a target triangle */
+    StaticVector<ctype,3> closestPoint(const std::tr1::array<ctype,3>& pos, int tri, StaticVector<ctype,2>& localCoords) const
+    {
+        StaticVector<ctype,3> p, corners[3];
+        for (int k=0; k<3; k++) {
+            p[k] = pos[k];
+            for (int j=0; j<3; j++)
+                corners[j][k] = surf->points[targetSurface->triangles[tri].points[j]][k];
+        }
+        return closestPointOnTriangle(p, corners[0], corners[1], corners[2], localCoords);
+    }
+
+    /** \brief The distance from the triangle of a box, infinite for triangles that are not in contact */
+    ctype operator()(const std::tr1::array<ctype,3>& pos, const Box<ctype,3>& box) const
+    {
+        int tri = triangle(box);
+        if (contact && !(*contact)[tri])
+            return std::numeric_limits<ctype>::max();
 
-private:
-    const std::string str_;
+        StaticVector<ctype,2> localCoords;
+        StaticVector<ctype,3> x = closestPoint(pos, tri, localCoords);
+
+        ctype dist2 = 0;
+        for (int k=0; k<3; k++)
+            dist2 += (x[k]-pos[k])*(x[k]-pos[k]);
+        return std::sqrt(dist2);
+    }
+
+    const Surface* surf;
+    const Surface* targetSurface;
+    const TargetSurfaceIndex<ctype>* index;
+
+    /** \brief If given, the triangles that are in contact, the others are skipped */
+    const std::vector<bool>* contact;
 };
 
-/** \brief An Exception that is thrown whenever during the insertion of a target edge
- *         the inverse projection is leaving the image of the projection.
- */
-class EdgeLeavingImageException: public std::exception
+
+/** \brief The points within a given distance of a triangle, as a region for MultiDimOctree::lookupRegion() */
+template <class ctype>
+struct TriangleNeighborhood
 {
-public:
-    EdgeLeavingImageException(std::string str) :
-        str_(str)
-    {}
+    TriangleNeighborhood(const StaticVector<ctype,3>& a, const StaticVector<ctype,3>& b,
+                         const StaticVector<ctype,3>& c, ctype radius)
+        : radius(radius)
+    {
+        corners[0] = a;
+        corners[1] = b;
+        corners[2] = c;
+
+        for (int k=0; k<3; k++) {
+            lower[k] = std::min(std::min(a[k], b[k]), c[k]) - radius;
+            upper[k] = std::max(std::max(a[k], b[k]), c[k]) + radius;
+        }
+    }
 
-    virtual const char* what() const throw()
+    /** \brief Conservative test of a box, against the bounding box of the triangle inflated by the radius */
+    bool intersects(const std::tr1::array<ctype,3>& cellLower, const std::tr1::array<ctype,3>& cellUpper) const
+    {
+        for (int k=0; k<3; k++)
+            if (cellUpper[k] < lower[k] || upper[k] < cellLower[k])
+                return false;
+        return true;
+    }
+
+    /** \brief Tests whether a point is not farther away from the triangle than the radius */
+    bool contains(const StaticVector<ctype,3>& p) const
+    {
+        StaticVector<ctype,2> localCoords;
+        StaticVector<ctype,3> x = closestPointOnTriangle(p, corners[0], corners[1], corners[2], localCoords);
+        return (x-p).length2() <= radius*radius;
+    }
+
+    StaticVector<ctype,3> corners[3];
+    std::tr1::array<ctype,3> lower, upper;
+    ctype radius;
+};
+
+
+/** \brief Tests a target vertex against a TriangleNeighborhood */
+template <class ctype>
+struct NeighborhoodContainsPoint
+{
+    bool operator()(const TriangleNeighborhood<ctype>& region, const StaticVector<ctype,3>& p) const
     {
-        return str_.c_str();
+        return region.contains(p);
     }
+};
 
-    virtual ~EdgeLeavingImageException() throw()
+
+template <class ctype>
+struct NormalProjector<ctype>::ClosestRayHit
+{
+    ClosestRayHit(NormalProjector<ctype>* projector, const Surface* surf, const Surface* targetSurface,
+                  const StaticVector<ctype,3>& basePoint, const StaticVector<ctype,3>& direction, ctype eps)
+        : projector(projector), surf(surf), targetSurface(targetSurface),
+          basePoint(basePoint), direction(direction), eps(eps), n(0),
+          bestTri(-1), bestDist(std::numeric_limits<ctype>::max()),
+          index(NULL), contact(NULL), slack(0), maxDist(std::numeric_limits<ctype>::max())
     {}
 
-private:
-    const std::string str_;
+    /** \brief Add a candidate triangle, the candidates are tested once a batch is full */
+    void add(int tri)
+    {
+        batch[n++] = tri;
+        if (n == projectionBatchSize)
+            flush();
+    }
+
+    /** \brief Test the candidates that have been added since the last batch */
+    void flush()
+    {
+        // copy the coordinates, because they are stored in a McVec3f when compiled as part of Amira
+        StaticVector<ctype,3> p0[projectionBatchSize], p1[projectionBatchSize], p2[projectionBatchSize];
+        for (int l=0; l<n; l++)
+            for (int k=0; k<3; k++) {
+                p0[l][k] = surf->points[targetSurface->triangles[batch[l]].points[0]][k];
+                p1[l][k] = surf->points[targetSurface->triangles[batch[l]].points[1]][k];
+                p2[l][k] = surf->points[targetSurface->triangles[batch[l]].points[2]][k];
+            }
+
+        StaticVector<ctype,2> domainPos[projectionBatchSize];
+        ctype dist[projectionBatchSize];
+        bool hit[projectionBatchSize];
+        projector->rayIntersectsTriangles(basePoint, direction, p0, p1, p2, n, domainPos, dist, hit, eps);
+
+        // Among several closest hits take the triangle with the lowest index,
+        // independent of the order in which the candidates have been added
+        for (int l=0; l<n; l++)
+            if (hit[l] && std::fabs(dist[l]) <= maxDist
+                && (dist[l]<bestDist || (dist[l]==bestDist && batch[l]<bestTri))) {
+                bestTri  = batch[l];
+                bestDPos = domainPos[l];
+                bestDist = dist[l];
+            }
+
+        n = 0;
+    }
+
+    /** \brief Visit the box of a triangle during an octree traversal along the ray */
+    void operator()(const Box<ctype,3>* box, ctype& tMax)
+    {
+        int tri = index->triangle(box - index->boxes());
+        if (contact && !(*contact)[tri])
+            return;
+        add(tri);
+
+        // The leafs entered behind the closest hit cannot contain a closer one,
+        // up to the round-off in the ray parameters
+        if (bestTri != -1)
+            tMax = std::min(tMax, bestDist + slack + ctype(1e-3)*std::fabs(bestDist));
+    }
+
+    NormalProjector<ctype>* projector;
+    const Surface* surf;
+    const Surface* targetSurface;
+    const StaticVector<ctype,3>& basePoint;
+    const StaticVector<ctype,3>& direction;
+    ctype eps;
+
+    /** \brief The candidates that have not been tested yet */
+    int batch[projectionBatchSize];
+    int n;
+
+    int bestTri;
+    StaticVector<ctype,2> bestDPos;
+    ctype bestDist;
+
+    /** \brief The octree of the target triangles */
+    const TargetSurfaceIndex<ctype>* index;
+
+    /** \brief If given, the triangles that are in contact, the others are skipped */
+    const std::vector<bool>* contact;
+
+    /** \brief The ray parameter corresponding to the enlargement of the boxes */
+    ctype slack;
+
+    /** \brief Hits farther away than this ray parameter, in either direction, are rejected */
+    ctype maxDist;
 };
 
+
 template <class ctype>
 void NormalProjector<ctype>::project(const Surface* targetSurface,
                                      const DirectionFunction<3,ctype>* domainDirection,
-                                     const DirectionFunction<3,ctype>* targetDirection)
+                                     const DirectionFunction<3,ctype>* targetDirection,
+                                     ctype maxGap,
+                                     const TargetSurfaceIndex<ctype>* targetIndex)
 {
     const double eps = 1e-4;
 
+    if (targetIndex && (targetIndex->size() != targetIndex->getNumSurfaceTriangles()
+                        || targetIndex->getTolerance() != eps
+                        || !targetIndex->matches(targetSurface)))
+        throw std::runtime_error("The target surface index does not belong to the target surface");
+
     PSurfaceFactory<2,ctype> factory(psurface_);
 
     const Surface* surf = psurface_->surface;
@@ -96,15 +354,26 @@ void NormalProjector<ctype>::project(const Surface* targetSurface,
     std::vector<StaticVector<ctype,3> > targetNormals(targetSurface->points.size());
     computeDiscreteTargetDirections(targetSurface, targetDirection, targetNormals);
 
+    // /////////////////////////////////////////////////////////////
+    //   If there is a maximum gap, find the parts of the surfaces
+    //   that can be in contact at all, and only look at those
+    // /////////////////////////////////////////////////////////////
+
+    const bool cull = maxGap < std::numeric_limits<ctype>::max();
+
+    std::vector<int> contactTriangles;
+    std::vector<std::vector<int> > domainTrisPerTargetVertex, targetTrisPerDomainVertex;
+    if (cull) {
+        computeContactCandidates(targetSurface, maxGap, contactTriangles, targetTrisPerDomainVertex);
+        computeVertexCandidates(targetSurface, maxGap, contactTriangles, domainTrisPerTargetVertex);
+    }
+
     // /////////////////////////////////////////////////////////////////////////////////////
     // Insert the vertices of the contact boundary as nodes on the intermediate manifold
     // /////////////////////////////////////////////////////////////////////////////////////
 
-    // TODO: Use an octree here.  The MultiDimOctree should get a method that returns
-    // all verticess close to the cone spanned by the search directions at the domain
-    // surface triangles.  Only those vertices should then be checked.
-    // We need this quickly, because it is mentioned in the psurface papers, which
-    // has already been submitted.
+    // Without a maximum gap, the region of the target vertices that can be projected
+    // onto a domain triangle is unbounded, hence all domain triangles are tried.
 
     // This array stores the preimages of each vertex in the target surface
     std::vector<NodeBundle> projectedTo(surf->points.size());
@@ -126,52 +395,82 @@ void NormalProjector<ctype>::project(const Surface* targetSurface,
         for (int k=0; k<3; k++)
             targetVertex[k] = surf->points[i][k];
         //std::cout<<i<<". target vertex "<<targetVertex<<std::endl;
-        for (size_t j=0; j<psurface_->getNumTriangles(); j++) {
-            const StaticVector<ctype,3>& p0 = psurface_->vertices(psurface_->triangles(j).vertices[0]);
-            const StaticVector<ctype,3>& p1 = psurface_->vertices(psurface_->triangles(j).vertices[1]);
-            const StaticVector<ctype,3>& p2 = psurface_->vertices(psurface_->triangles(j).vertices[2]);
-
-            const StaticVector<ctype,3>& n0 = domainNormals[psurface_->triangles(j).vertices[0]];
-            const StaticVector<ctype,3>& n1 = domainNormals[psurface_->triangles(j).vertices[1]];
-            const StaticVector<ctype,3>& n2 = domainNormals[psurface_->triangles(j).vertices[2]];
-
-            StaticVector<ctype,3> x; // the unknown...
-            if (computeInverseNormalProjection(p0, p1, p2, n0, n1, n2, targetVertex, x)) {
-
-                // We want that the line from the domain surface to its projection
-                // approaches the target surface from the front side, i.e., it should
-                // not pass through the body represented by the target surface.
-                // We do a simplified test by comparing the connecting segment
-                // with the normal at the target surface and the normal at the
-                // domain surface
-                StaticVector<ctype,3> base       = p0*x[0] + p1*x[1] + (1-x[0]-x[1])*p2;
-                StaticVector<ctype,3> baseNormal = n0*x[0] + n1*x[1] + (1-x[0]-x[1])*n2;
-                StaticVector<ctype,3> segment(surf->points[i][0] - base[0],
-                                surf->points[i][1] - base[1],
-                                surf->points[i][2] - base[2]);
-
-                ctype distance = segment.length() * segment.length();
-
-                // if both conditions are not fulfilled we might want to allow some overlaps
-                if(segment.dot(targetNormals[i]) > eps
-                    && segment.dot(baseNormal) < -eps) {
-                        if (distance > 1e-1) // TODO this value should be set problem dependent
-                            continue;
-                } else if( segment.dot(targetNormals[i]) > eps
-                    || segment.dot(baseNormal) < -eps)
+
+        // With a maximum gap, only the domain triangles closer to the vertex than maxGap
+        // are tried, since a projection that is not longer than maxGap ends on one of them.
+        if (cull && domainTrisPerTargetVertex[i].empty())
+            continue;
+
+        size_t nCandidates = (cull) ? domainTrisPerTargetVertex[i].size() : psurface_->getNumTriangles();
+
+        // Project onto the candidates in batches, and then evaluate the
+        // results in the same order as the candidates
+        for (size_t c=0; c<nCandidates; c+=projectionBatchSize) {
+
+            int batch[projectionBatchSize];
+            int batchSize = std::min(nCandidates-c, size_t(projectionBatchSize));
+            for (int l=0; l<batchSize; l++)
+                batch[l] = (cull) ? domainTrisPerTargetVertex[i][c+l] : c+l;
+
+            StaticVector<ctype,3> xs[projectionBatchSize];
+            bool found[projectionBatchSize];
+            computeInverseNormalProjections(batch, batchSize, domainNormals, targetVertex, xs, found);
+
+            for (int l=0; l<batchSize; l++) {
+
+                if (!found[l])
                     continue;
 
-                // There may be several inverse orthogonal projections.
-                // We want the shortest one.
+                int j = batch[l];
+                const StaticVector<ctype,3>& x = xs[l];
 
-                if (distance < bestDist) {
+                const StaticVector<ctype,3>& p0 = psurface_->vertices(psurface_->triangles(j).vertices[0]);
+                const StaticVector<ctype,3>& p1 = psurface_->vertices(psurface_->triangles(j).vertices[1]);
+                const StaticVector<ctype,3>& p2 = psurface_->vertices(psurface_->triangles(j).vertices[2]);
 
-                    bestDist = distance;
-                    bestDPos[0] = x[0];
-                    bestDPos[1] = x[1];
-                    bestTri  = j;
+                const StaticVector<ctype,3>& n0 = domainNormals[psurface_->triangles(j).vertices[0]];
+                const StaticVector<ctype,3>& n1 = domainNormals[psurface_->triangles(j).vertices[1]];
+                const StaticVector<ctype,3>& n2 = domainNormals[psurface_->triangles(j).vertices[2]];
+
+
+                    // We want that the line from the domain surface to its projection
+                    // approaches the target surface from the front side, i.e., it should
+                    // not pass through the body represented by the target surface.
+                    // We do a simplified test by comparing the connecting segment
+                    // with the normal at the target surface and the normal at the
+                    // domain surface
+                    StaticVector<ctype,3> base       = p0*x[0] + p1*x[1] + (1-x[0]-x[1])*p2;
+                    StaticVector<ctype,3> baseNormal = n0*x[0] + n1*x[1] + (1-x[0]-x[1])*n2;
+                    StaticVector<ctype,3> segment(surf->points[i][0] - base[0],
+                                    surf->points[i][1] - base[1],
+                                    surf->points[i][2] - base[2]);
+
+                    ctype distance = segment.length() * segment.length();
+
+                    if (cull && distance > maxGap*maxGap)
+                        continue;
+
+                    // if both conditions are not fulfilled we might want to allow some overlaps
+                    if(segment.dot(targetNormals[i]) > eps
+                        && segment.dot(baseNormal) < -eps) {
+                            if (distance > 1e-1) // TODO this value should be set problem dependent
+                                continue;
+                    } else if( segment.dot(targetNormals[i]) > eps
+                        || segment.dot(baseNormal) < -eps)
+                        continue;
+
+                    // There may be several inverse orthogonal projections.
+                    // We want the shortest one.
+
+                    if (distance < bestDist) {
+
+                        bestDist = distance;
+                        bestDPos[0] = x[0];
+                        bestDPos[1] = x[1];
+                        bestTri  = j;
+
+                    }
 
-                }
 
             }
 
@@ -193,10 +492,29 @@ void NormalProjector<ctype>::project(const Surface* targetSurface,
     //   Place ghost nodes at the vertices of the domain surface
     // ///////////////////////////////////////////////////////////////////
 
-    // TODO: Use an octree here.  The MultiDimOctree should get a method that returns
-    // all triangles close to a given ray.  Only those triangles should then be checked.
-    // We need this quickly, because it is mentioned in the psurface papers, which
-    // has already been submitted.
+    // The normal rays are tested against those target triangles only whose boxes
+    // in an octree are crossed by the ray.  With a maximum gap the triangles close
+    // to each vertex are known already, and the octree is only needed for the
+    // closest point fallback: a given index of all triangles is used with a list
+    // of the triangles close to the domain surface, otherwise an index of just
+    // these is built.
+    TargetSurfaceIndex<ctype> contactIndex;
+    const TargetSurfaceIndex<ctype>* index = targetIndex;
+    std::vector<bool> isContactTriangle;
+
+    if (!index) {
+        if (!cull || closestPointFallback_)
+            contactIndex.build(targetSurface, eps, (cull) ? &contactTriangles : NULL);
+        index = &contactIndex;
+    } else if (cull) {
+        isContactTriangle.resize(targetSurface->triangles.size(), false);
+        for (size_t t=0; t<contactTriangles.size(); t++)
+            isContactTriangle[contactTriangles[t]] = true;
+    }
+
+    const std::vector<bool>* contact = (isContactTriangle.empty()) ? NULL : &isContactTriangle;
+    OctreeLookupScratch scratch;
+
     int ghost = 0;
     for (int i=0; i<psurface_->getNumVertices(); i++) {
 
@@ -205,45 +523,54 @@ void NormalProjector<ctype>::project(const Surface* targetSurface,
         if (vertexHasBeenHandled[i])
             continue;
 
-        StaticVector<ctype,2> bestDPos;
-        int bestTri = -1;
-        ctype bestDist = std::numeric_limits<ctype>::max();
-
         const StaticVector<ctype,3>& basePoint = psurface_->vertices(i);
         StaticVector<ctype,3> normal;
         normal[0] = domainNormals[i][0];
         normal[1] = domainNormals[i][1];
         normal[2] = domainNormals[i][2];
 
-        for (int j=0; j<targetSurface->triangles.size(); j++) {
+        ClosestRayHit closest(this, surf, targetSurface, basePoint, normal, eps);
 
-            StaticVector<ctype,2> domainPos;
-            ctype dist;
+        // With a maximum gap, only the target triangles close to the vertex are tried,
+        // and only hits that are not farther away than maxGap are accepted.
+        // Vertices far away from the target surface get no ghost node.
+        if (cull) {
+            if (targetTrisPerDomainVertex[i].empty())
+                continue;
 
-            // copy the coordinates, because they are stored in a McVec3f when compiled as part of Amira
-            StaticVector<ctype,3> p0, p1, p2;
-            for (int k=0; k<3; k++) {
-                p0[k] = surf->points[targetSurface->triangles[j].points[0]][k];
-                p1[k] = surf->points[targetSurface->triangles[j].points[1]][k];
-                p2[k] = surf->points[targetSurface->triangles[j].points[2]][k];
-            }
+            closest.maxDist = maxGap / normal.length();
+            for (size_t c=0; c<targetTrisPerDomainVertex[i].size(); c++)
+                closest.add(targetTrisPerDomainVertex[i][c]);
 
-            if (rayIntersectsTriangle(basePoint, normal, p0, p1, p2, domainPos, dist, eps)) {
+        } else if (index->size() > 0) {
+            // rayIntersectsTriangle() accepts hits up to 0.1 behind the base point
+            closest.index   = index;
+            closest.contact = contact;
+            closest.slack   = index->getMaxMargin() / normal.length();
 
-                if (dist<bestDist) {
-                    bestTri = j;
-                    bestDPos = domainPos;
-                    bestDist = dist;
-                }
+            index->tree().traverseSegment(basePoint, normal, ctype(-0.1) - closest.slack,
+                                          std::numeric_limits<ctype>::max(), closest, scratch);
+        }
 
-            }
+        closest.flush();
+
+        // Fall back to the closest point on the target surface, if requested
+        if (closest.bestTri == -1 && closestPointFallback_ && index->size() > 0) {
 
+            TriangleDistance<ctype> distance(surf, targetSurface, index, contact);
+            ctype nearestDistance;
+            Box<ctype,3>* nearest = index->tree().lookupNearest(basePoint, distance, nearestDistance, scratch, maxGap);
+
+            if (nearest) {
+                closest.bestTri = distance.triangle(*nearest);
+                distance.closestPoint(basePoint, closest.bestTri, closest.bestDPos);
+            }
         }
 
         // Set ghost node mapping to the closest triangle intersected by the normal ray
-        if (bestTri != -1) {
+        if (closest.bestTri != -1) {
             ghost++;
-            factory.insertGhostNode(i, bestTri, bestDPos);
+            factory.insertGhostNode(i, closest.bestTri, closest.bestDPos);
         }
     }
     std::cout<<ghost<<" ghost nodes added\n";
@@ -256,7 +583,13 @@ void NormalProjector<ctype>::project(const Surface* targetSurface,
 
     std::set<std::pair<int,int> > visitedEdges;
 
-    for (int i=0; i<targetSurface->triangles.size(); i++) {
+    // With a maximum gap, only the triangles close to the domain surface are inserted,
+    // and of those only the edges whose vertices have both been projected within maxGap.
+    int nTargetTris = (cull) ? contactTriangles.size() : targetSurface->triangles.size();
+
+    for (int t=0; t<nTargetTris; t++) {
+
+        int i = (cull) ? contactTriangles[t] : t;
         //std::cout<<"Target tri "<<i<<" has corners "<<targetSurface->triangles[i].points[0]<<","<<targetSurface->triangles[i].points[1]<<","<<targetSurface->triangles[i].points[2]<<std::endl;
         for (int j=0; j<3; j++) {
 
@@ -269,14 +602,19 @@ void NormalProjector<ctype>::project(const Surface* targetSurface,
             int max = std::max(from,to);
             int min = from + to - max;
 
-            // Mark this edge as visited.  The return value is true, if this
-            // edge has not been visited before.
-            bool wasInserted = visitedEdges.insert(std::make_pair(min,max)).second;
-
             // If both nodes are not in the preimage we cannot insert the edge
             if (projectedTo[from].size() == 0 && projectedTo[to].size() == 0)
                 continue;
 
+            // An edge that leaves the contact region would end in the middle of the
+            // domain surface, where the domain vertices have no ghost nodes
+            if (cull && (projectedTo[from].size() == 0 || projectedTo[to].size() == 0))
+                continue;
+
+            // Mark this edge as visited.  The return value is true, if this
+            // edge has not been visited before.
+            bool wasInserted = visitedEdges.insert(std::make_pair(min,max)).second;
+
             if (wasInserted) {
 
                 // if only one node is projected then start from that one so we can add
@@ -289,16 +627,11 @@ void NormalProjector<ctype>::project(const Surface* targetSurface,
 
                 // store the path so we don't have to compute it twice
                 std::vector<PathVertex<ctype> > edgePath(1);
-                try {
-                if (edgeCanBeInserted(domainNormals, from, to, projectedTo, edgePath))
+                // If the edge leaves the image, add it as far as possible
+                if (edgeCanBeInserted(domainNormals, from, to, projectedTo, edgePath) != WALK_FAILED)
                     insertEdge(factory, from, to, edgePath);
                 //else
                     //std::cout<< "Skipping edge (" << from << ", " << to << ") ..." << std::endl;
-                    // catch the Leaving edge exception and add the edge as far as possible
-                } catch (EdgeLeavingImageException e) {
-                    //std::cout<<"Exception caught! "<<e.what()<<std::endl;
-                    insertEdge(factory, from, to, edgePath);
-                }
             }
 
         }
@@ -306,6 +639,164 @@ void NormalProjector<ctype>::project(const Surface* targetSurface,
     }
 
     setupEdgePointArrays();
+
+    // The triangle graphs have been rebuilt, cached traversal data is stale
+    psurface_->hasUpToDatePointLocationStructure = false;
+    psurface_->hasUpToDateOverlapStructure = false;
+}
+
+
+template <class ctype>
+void NormalProjector<ctype>::computeContactCandidates(const Surface* targetSurface, ctype maxGap,
+                                                      std::vector<int>& contactTriangles,
+                                                      std::vector<std::vector<int> >& targetTrisPerDomainVertex)
+{
+    const int nDomainTris = psurface_->getNumTriangles();
+    const int nTargetTris = targetSurface->triangles.size();
+
+    // The bounding boxes of all triangles, the domain ones inflated by maxGap.
+    // The domain triangles come first.
+    std::vector<StaticVector<ctype,3> > lower(nDomainTris + nTargetTris);
+    std::vector<StaticVector<ctype,3> > upper(nDomainTris + nTargetTris);
+
+    for (int i=0; i<nDomainTris; i++) {
+        lower[i] = upper[i] = psurface_->vertices(psurface_->triangles(i).vertices[0]);
+        for (int j=1; j<3; j++) {
+            const StaticVector<ctype,3>& p = psurface_->vertices(psurface_->triangles(i).vertices[j]);
+            for (int k=0; k<3; k++) {
+                lower[i][k] = std::min(lower[i][k], p[k]);
+                upper[i][k] = std::max(upper[i][k], p[k]);
+            }
+        }
+
+        for (int k=0; k<3; k++) {
+            lower[i][k] -= maxGap;
+            upper[i][k] += maxGap;
+        }
+    }
+
+    for (int i=0; i<nTargetTris; i++) {
+        for (int k=0; k<3; k++)
+            lower[nDomainTris+i][k] = upper[nDomainTris+i][k] = targetSurface->points[targetSurface->triangles[i].points[0]][k];
+        for (int j=1; j<3; j++)
+            for (int k=0; k<3; k++) {
+                ctype c = targetSurface->points[targetSurface->triangles[i].points[j]][k];
+                lower[nDomainTris+i][k] = std::min(lower[nDomainTris+i][k], c);
+                upper[nDomainTris+i][k] = std::max(upper[nDomainTris+i][k], c);
+            }
+    }
+
+    // Sweep along the x-axis.  Each box is tested against the boxes from the other
+    // surface that are still open, i.e., have not ended before it starts.
+    std::vector<std::pair<ctype,int> > order(lower.size());
+    for (size_t i=0; i<lower.size(); i++)
+        order[i] = std::make_pair(lower[i][0], int(i));
+
+    std::sort(order.begin(), order.end());
+
+    std::vector<int> open[2];
+    std::vector<std::pair<int,int> > pairs;
+
+    for (size_t i=0; i<order.size(); i++) {
+
+        int box  = order[i].second;
+        int side = (box < nDomainTris) ? 0 : 1;
+
+        std::vector<int>& others = open[1-side];
+
+        // Throw out the boxes that have ended, and test the others
+        size_t nOpen = 0;
+        for (size_t j=0; j<others.size(); j++) {
+
+            int other = others[j];
+            if (upper[other][0] < order[i].first)
+                continue;
+
+            others[nOpen++] = other;
+
+            if (lower[box][1] <= upper[other][1] && lower[other][1] <= upper[box][1]
+                && lower[box][2] <= upper[other][2] && lower[other][2] <= upper[box][2])
+                pairs.push_back((side==0) ? std::make_pair(box, other-nDomainTris)
+                                          : std::make_pair(other, box-nDomainTris));
+        }
+        others.resize(nOpen);
+
+        open[side].push_back(box);
+    }
+
+    // Distribute the pairs to the vertices
+    contactTriangles.clear();
+    for (size_t i=0; i<pairs.size(); i++)
+        contactTriangles.push_back(pairs[i].second);
+
+    std::sort(contactTriangles.begin(), contactTriangles.end());
+    contactTriangles.erase(std::unique(contactTriangles.begin(), contactTriangles.end()), contactTriangles.end());
+
+    targetTrisPerDomainVertex.assign(psurface_->getNumVertices(), std::vector<int>());
+
+    for (size_t i=0; i<pairs.size(); i++)
+        for (int j=0; j<3; j++)
+            targetTrisPerDomainVertex[psurface_->triangles(pairs[i].first).vertices[j]].push_back(pairs[i].second);
+
+    for (size_t i=0; i<targetTrisPerDomainVertex.size(); i++) {
+        std::vector<int>& tris = targetTrisPerDomainVertex[i];
+        std::sort(tris.begin(), tris.end());
+        tris.erase(std::unique(tris.begin(), tris.end()), tris.end());
+    }
+}
+
+
+template <class ctype>
+void NormalProjector<ctype>::computeVertexCandidates(const Surface* targetSurface, ctype maxGap,
+                                                     const std::vector<int>& contactTriangles,
+                                                     std::vector<std::vector<int> >& domainTrisPerTargetVertex)
+{
+    domainTrisPerTargetVertex.assign(targetSurface->points.size(), std::vector<int>());
+
+    // The vertices of the contact triangles, the others are farther away from the domain surface
+    std::vector<int> vertices;
+    for (size_t i=0; i<contactTriangles.size(); i++)
+        for (int j=0; j<3; j++)
+            vertices.push_back(targetSurface->triangles[contactTriangles[i]].points[j]);
+
+    std::sort(vertices.begin(), vertices.end());
+    vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+    if (vertices.empty())
+        return;
+
+    // copy the coordinates, because they are stored in a McVec3f when compiled as part of Amira
+    std::vector<StaticVector<ctype,3> > points(vertices.size());
+    for (size_t i=0; i<vertices.size(); i++)
+        for (int k=0; k<3; k++)
+            points[i][k] = targetSurface->points[vertices[i]][k];
+
+    Box<ctype,3> boundingBox(points[0], points[0]);
+    for (size_t i=1; i<points.size(); i++)
+        boundingBox.extendBy(points[i]);
+
+    PointIntersectionFunctor<ctype> functor;
+    MultiDimOctree<StaticVector<ctype,3>, PointIntersectionFunctor<ctype>, ctype, 3> tree(boundingBox, &functor);
+    tree.build(&points[0], &points[0] + points.size());
+    tree.enableUniqueLookup(points.size(), &points[0]);
+
+    // The domain triangles are visited in increasing order, hence the lists are sorted
+    OctreeLookupScratch scratch;
+    std::vector<StaticVector<ctype,3>*> result;
+
+    for (size_t i=0; i<psurface_->getNumTriangles(); i++) {
+
+        TriangleNeighborhood<ctype> region(psurface_->vertices(psurface_->triangles(i).vertices[0]),
+                                           psurface_->vertices(psurface_->triangles(i).vertices[1]),
+                                           psurface_->vertices(psurface_->triangles(i).vertices[2]),
+                                           maxGap);
+
+        result.clear();
+        tree.lookupRegion(region, NeighborhoodContainsPoint<ctype>(), result, scratch);
+
+        for (size_t j=0; j<result.size(); j++)
+            domainTrisPerTargetVertex[vertices[result[j] - &points[0]]].push_back(i);
+    }
 }
 
 
@@ -552,7 +1043,7 @@ void NormalProjector<ctype>::insertEdgeSegment(PSurfaceFactory<2,ctype>& factory
 }
 
 template <class ctype>
-bool NormalProjector<ctype>::edgeCanBeInserted(const std::vector<StaticVector<ctype,3> >& normals,
+typename NormalProjector<ctype>::EdgeWalkStatus NormalProjector<ctype>::edgeCanBeInserted(const std::vector<StaticVector<ctype,3> >& normals,
                                         int from, int to,
                                         const std::vector<NodeBundle>& projectedTo,
                                         std::vector<PathVertex<ctype> >& edgePath)
@@ -581,7 +1072,7 @@ bool NormalProjector<ctype>::edgeCanBeInserted(const std::vector<StaticVector<ct
             for (int j=0; j<edgePath.back().bundle_.size(); j++)
                 if (curr[i].tri==edgePath.back().bundle_[j].tri) {
                     edgePath.back().tri_ = curr[i].tri;
-                    return true;
+                    return WALK_CONTINUES;
                 }
     }
 
@@ -609,7 +1100,7 @@ bool NormalProjector<ctype>::edgeCanBeInserted(const std::vector<StaticVector<ct
             edgePath.back().type_ = psurface_->nodes(projectedTo[to][0]).type;
             edgePath.back().enteringEdge_ = enteringEdge;
             edgePath.back().lambda_ = 1.0;
-            return true;
+            return WALK_CONTINUES;
         }
 
         if ((currType==Node<ctype>::GHOST_NODE || currType==Node<ctype>::CORNER_NODE)
@@ -625,91 +1116,71 @@ bool NormalProjector<ctype>::edgeCanBeInserted(const std::vector<StaticVector<ct
                 for (int j=0; j<edgePath.back().bundle_.size(); j++)
                     if (curr[i].tri==edgePath.back().bundle_[j].tri) {
                         edgePath.back().tri_ = curr[i].tri;
-                        return true;
+                        return WALK_CONTINUES;
                 }
         }
 
 
+        EdgeWalkStatus status;
+
         switch (currType) {
         case Node<ctype>::TOUCHING_NODE:
 
-            if (!testInsertEdgeFromTouchingNode(normals, from, to, lambda, curr, currType,
-                        currTri, enteringEdge, edgePath, offset))
-                return false;
+            status = testInsertEdgeFromTouchingNode(normals, from, to, lambda, curr, currType,
+                                                    currTri, enteringEdge, edgePath, offset);
             break;
 
         case Node<ctype>::GHOST_NODE:
         case Node<ctype>::CORNER_NODE:
 
-            try {
-                if (!testInsertEdgeFromCornerNode(normals, from, to, lambda,
-                                              curr, currType, currTri, enteringEdge,edgePath, offset))
-                return false;
-            } catch (WrongEdgeException e) {
-
-                std::cout<<"Exception caught! "<<e.what()<<std::endl;
-
-                // if we were already ran into that node, then the projection of the path does not exist
-                if (edgePath.back()==wrongEdgeNode)
-                    return false;
-
-                // this edge led to a wrong triangle so check if another edge is also feasible
-                offset = (edgePath.back().edge_+1)%3;
-                currTri = edgePath.back().tri_;
-                currType = edgePath.back().type_;
-                lambda = edgePath[edgePath.size()-2].lambda_;
-                enteringEdge = edgePath.back().enteringEdge_;
-                wrongEdgeNode = edgePath.back();
-                edgePath.pop_back();
-            }
+            status = testInsertEdgeFromCornerNode(normals, from, to, lambda,
+                                                  curr, currType, currTri, enteringEdge, edgePath, offset);
             break;
 
         case Node<ctype>::INTERSECTION_NODE:
 
-            try {
-                if (!testInsertEdgeFromIntersectionNode(normals, from, to, lambda,
-                        curr, currType, currTri, enteringEdge, edgePath, offset))
-                return false;
-            } catch (WrongEdgeException e) {
-
-                std::cout<<"Exception caught! "<<e.what()<<std::endl;
-
-                // if we were already ran into that node, then the projection of the path does not exist
-                if (edgePath.back()==wrongEdgeNode)
-                    return false;
-
-                // this edge led to a wrong triangle so check if another edge is also feasible
-                offset = (edgePath.back().edge_+1)%3;
-                currTri = edgePath.back().tri_;
-                currType = edgePath.back().type_;
-                lambda = edgePath[edgePath.size()-2].lambda_;
-                enteringEdge = edgePath.back().enteringEdge_;
-                wrongEdgeNode = edgePath.back();
-                edgePath.pop_back();
-            }
+            status = testInsertEdgeFromIntersectionNode(normals, from, to, lambda,
+                                                        curr, currType, currTri, enteringEdge, edgePath, offset);
             break;
 
         case Node<ctype>::INTERIOR_NODE:
 
-            if (!testInsertEdgeFromInteriorNode(normals, from, to, lambda,
-                        curr, currType, currTri, enteringEdge, edgePath, offset))
-                return false;
-
+            status = testInsertEdgeFromInteriorNode(normals, from, to, lambda,
+                                                    curr, currType, currTri, enteringEdge, edgePath, offset);
             break;
 
         default:
             std::cout << "ERROR: unknown node type found!" << std::endl;
             abort();
         }
+
+        if (status == WALK_FAILED || status == WALK_LEFT_IMAGE)
+            return status;
+
+        if (status == WALK_WRONG_EDGE) {
+
+            // if we were already ran into that node, then the projection of the path does not exist
+            if (edgePath.back()==wrongEdgeNode)
+                return WALK_FAILED;
+
+            // this edge led to a wrong triangle so check if another edge is also feasible
+            offset = (edgePath.back().edge_+1)%3;
+            currTri = edgePath.back().tri_;
+            currType = edgePath.back().type_;
+            lambda = edgePath[edgePath.size()-2].lambda_;
+            enteringEdge = edgePath.back().enteringEdge_;
+            wrongEdgeNode = edgePath.back();
+            edgePath.pop_back();
+        }
     }
 
     //std::cout << "should not occur" << std::endl;
-    return true;
+    return WALK_CONTINUES;
 }
 
 
 template <class ctype>
-bool NormalProjector<ctype>::testInsertEdgeFromInteriorNode(const std::vector<StaticVector<ctype,3> >& normals,
+typename NormalProjector<ctype>::EdgeWalkStatus NormalProjector<ctype>::testInsertEdgeFromInteriorNode(const std::vector<StaticVector<ctype,3> >& normals,
                                                      int from, int to, ctype &lambda,
                                                      NodeBundle& curr,
                                                      typename Node<ctype>::NodeType& currType, int& currTri,
@@ -719,34 +1190,38 @@ bool NormalProjector<ctype>::testInsertEdgeFromInteriorNode(const std::vector<St
     // loop over the three edges of the current triangle (except for the entering edge) and
     // check whether the paramPolyEdge leaves the triangle via this edge
     ctype eps = 1e-5;
+
+    const Surface* surf = psurface_->surface;
+
+    StaticVector<ctype,3> targetFrom, targetTo;
+    for (int k=0; k<3; k++) {
+        targetFrom[k] = surf->points[from][k];
+        targetTo[k]   = surf->points[to][k];
+    }
+
+    // test all edges at once, and evaluate the results in the order given by offset
+    StaticVector<ctype,3> xs[3];
+    bool hits[3];
+    triangleEdgesIntersectNormalFan(targetFrom, targetTo, currTri, enteringEdge, normals, xs, hits);
+
     int i=offset;
     for (int j=0; j<3; j++,i=(i+1)%3) {
 
         if (i==enteringEdge)
             continue;
 
-        StaticVector<ctype,3> x;
-        int p = psurface_->triangles(currTri).vertices[i];
         int q = psurface_->triangles(currTri).vertices[(i+1)%3];
 
-        const Surface* surf = psurface_->surface;
-
-        StaticVector<ctype,3> targetFrom, targetTo;
-        for (int k=0; k<3; k++) {
-            targetFrom[k] = surf->points[from][k];
-            targetTo[k]   = surf->points[to][k];
-        }
+        if (hits[i]) {
 
-        if (edgeIntersectsNormalFan(targetFrom, targetTo,
-                                    psurface_->vertices(p), psurface_->vertices(q),
-                                    normals[p], normals[q], x)) {
+            const StaticVector<ctype,3>& x = xs[i];
 
             const ctype& newLambda = x[1];
             const ctype& mu        = x[0];
 
             if (newLambda < lambda) {
                 // Error: the normal projection is not continuous!
-                return false;
+                return WALK_FAILED;
             }
 
             int corner = -1;
@@ -767,8 +1242,7 @@ bool NormalProjector<ctype>::testInsertEdgeFromInteriorNode(const std::vector<St
 
                     // add node on the path to the array
                     edgePath.push_back(PathVertex<ctype>(currTri,i,mu,currType,NodeBundle(),newLambda,enteringEdge));
-                    throw(EdgeLeavingImageException("In [testInsertEdgeFromInteriorNode] Edge leaving the image!\n"));
-                    return false;
+                    return WALK_LEFT_IMAGE;
 
                 }
 
@@ -788,7 +1262,7 @@ bool NormalProjector<ctype>::testInsertEdgeFromInteriorNode(const std::vector<St
                 enteringEdge = e;
 
 
-                return true;
+                return WALK_CONTINUES;
 
             } else {
 
@@ -822,7 +1296,7 @@ bool NormalProjector<ctype>::testInsertEdgeFromInteriorNode(const std::vector<St
                 assert(currType==type(curr));
                 lambda = newLambda;
                 edgePath.push_back(PathVertex<ctype>(currTri,i,mu,currType,curr, newLambda, enteringEdge, corner));
-                return true;
+                return WALK_CONTINUES;
 
             }
 
@@ -830,13 +1304,13 @@ bool NormalProjector<ctype>::testInsertEdgeFromInteriorNode(const std::vector<St
 
     }
 
-    return false;
+    return WALK_FAILED;
 }
 
 
 
 template <class ctype>
-bool NormalProjector<ctype>::testInsertEdgeFromIntersectionNode(const std::vector<StaticVector<ctype,3> >& normals,
+typename NormalProjector<ctype>::EdgeWalkStatus NormalProjector<ctype>::testInsertEdgeFromIntersectionNode(const std::vector<StaticVector<ctype,3> >& normals,
                                                          int from, int to, ctype &lambda,
                                                          NodeBundle& curr,
                                                          typename Node<ctype>::NodeType& currType, int& currTri,
@@ -848,34 +1322,37 @@ bool NormalProjector<ctype>::testInsertEdgeFromIntersectionNode(const std::vecto
     // check whether the paramPolyEdge leaves the triangle via this edge
     ctype eps = 1e-5;
 
+    const Surface* surf = psurface_->surface;
+
+    StaticVector<ctype,3> targetFrom, targetTo;
+    for (int k=0; k<3; k++) {
+        targetFrom[k] = surf->points[from][k];
+        targetTo[k]   = surf->points[to][k];
+    }
+
+    // test all edges at once, and evaluate the results in the order given by offset
+    StaticVector<ctype,3> xs[3];
+    bool hits[3];
+    triangleEdgesIntersectNormalFan(targetFrom, targetTo, currTri, enteringEdge, normals, xs, hits);
+
     int i=offset;
     for (int j=0; j<3; j++,i=(i+1)%3) {
 
         if (i==enteringEdge)
             continue;
 
-        StaticVector<ctype,3> x;
-        int p = psurface_->triangles(currTri).vertices[i];
         int q = psurface_->triangles(currTri).vertices[(i+1)%3];
 
-        const Surface* surf = psurface_->surface;
-
-        StaticVector<ctype,3> targetFrom, targetTo;
-        for (int k=0; k<3; k++) {
-            targetFrom[k] = surf->points[from][k];
-            targetTo[k]   = surf->points[to][k];
-        }
+        if (hits[i]) {
 
-        if (edgeIntersectsNormalFan(targetFrom, targetTo,
-                                    psurface_->vertices(p), psurface_->vertices(q),
-                                    normals[p], normals[q], x)) {
+            const StaticVector<ctype,3>& x = xs[i];
 
             const ctype& newLambda = x[1];
             const ctype& mu        = x[0];
 
             if (newLambda < lambda) {
                 // Error: the normal projection is not continuous!
-                return false;
+                return WALK_FAILED;
             }
 
             int corner = -1;
@@ -896,9 +1373,7 @@ bool NormalProjector<ctype>::testInsertEdgeFromIntersectionNode(const std::vecto
 
                     // add node on the path to the array
                     edgePath.push_back(PathVertex<ctype>(currTri,i,mu,currType,NodeBundle(),newLambda,enteringEdge));
-                    throw(EdgeLeavingImageException("In [testInsertEdgeFromIntersectionNode] Edge leaving the image!\n"));
-                    // Error: Normal images leaves domain surface!
-                    return false;
+                    return WALK_LEFT_IMAGE;
                 }
 
                 // add intersection nodes on both sides
@@ -915,7 +1390,7 @@ bool NormalProjector<ctype>::testInsertEdgeFromIntersectionNode(const std::vecto
                 enteringEdge = e;
 
 
-                return true;
+                return WALK_CONTINUES;
 
             } else {
 
@@ -924,27 +1399,29 @@ bool NormalProjector<ctype>::testInsertEdgeFromIntersectionNode(const std::vecto
                 // get all ghost nodes for the base grid vertex
                 int vertex = psurface_->triangles(currTri).vertices[corner];
                 curr = psurface_->getNodeBundleAtVertex(vertex);
+                // With a maximum gap, vertices far from the target surface have no ghost node
+                if (curr[0].idx == -1)
+                    return WALK_FAILED;
                 currType = Node<ctype>::GHOST_NODE;
                 assert(currType==type(curr));
                 lambda = newLambda;
 
                 edgePath.push_back(PathVertex<ctype>(currTri,i,mu,currType,curr,
                                 newLambda, enteringEdge, corner));
-                return true;
+                return WALK_CONTINUES;
 
             }
 
         }
     }
 
-    throw(WrongEdgeException("No intersection found (in testInsertEdgeFromIntersectionNode)!\n"));
-    return false;
+    return WALK_WRONG_EDGE;
 }
 
 
 
 template <class ctype>
-bool NormalProjector<ctype>::testInsertEdgeFromTouchingNode(const std::vector<StaticVector<ctype,3> >& normals,
+typename NormalProjector<ctype>::EdgeWalkStatus NormalProjector<ctype>::testInsertEdgeFromTouchingNode(const std::vector<StaticVector<ctype,3> >& normals,
                                                      int from, int to, ctype &lambda,
                                                      NodeBundle& curr,
                                                      typename Node<ctype>::NodeType& currType, int& currTri,
@@ -960,31 +1437,34 @@ bool NormalProjector<ctype>::testInsertEdgeFromTouchingNode(const std::vector<St
         const DomainTriangle<ctype>& cT = psurface_->triangles(curr[i].tri);
         int currentEdge = cT.nodes[curr[i].idx].getDomainEdge();
 
+        StaticVector<ctype,3> targetFrom, targetTo;
+        for (int l=0; l<3; l++) {
+            targetFrom[l] = surf->points[from][l];
+            targetTo[l]   = surf->points[to][l];
+        }
+
+        // test all edges at once, and evaluate the results in the order given by offset
+        StaticVector<ctype,3> xs[3];
+        bool hits[3];
+        triangleEdgesIntersectNormalFan(targetFrom, targetTo, curr[i].tri, currentEdge, normals, xs, hits);
+
         int j=offset;
         for (int k=0; k<3; k++,j=(j+1)%3) {
         //for (int j=0; j<3; j++) {
             if (j==currentEdge)
                 continue;
 
-            StaticVector<ctype,3> x;
-            int p = cT.vertices[j];
             int q = cT.vertices[(j+1)%3];
 
-            StaticVector<ctype,3> targetFrom, targetTo;
-            for (int l=0; l<3; l++) {
-                targetFrom[l] = surf->points[from][l];
-                targetTo[l]   = surf->points[to][l];
-            }
+            if (hits[j]) {
 
-            if (edgeIntersectsNormalFan(targetFrom, targetTo,
-                                        psurface_->vertices(p), psurface_->vertices(q),
-                                        normals[p], normals[q], x)) {
+                const StaticVector<ctype,3>& x = xs[j];
 
                 const ctype& newLambda = x[1];
 
                 if (newLambda < lambda) {
                     // Edge insertion not possible: the normal projection is not continuous!
-                    return false;
+                    return WALK_FAILED;
                 }
 
                 int corner = -1;
@@ -1007,9 +1487,7 @@ bool NormalProjector<ctype>::testInsertEdgeFromTouchingNode(const std::vector<St
 
                         // add node on the path to the array
                         edgePath.push_back(PathVertex<ctype>(curr[i].tri,j,x[0],currType,NodeBundle(),newLambda,enteringEdge));
-                        throw(EdgeLeavingImageException("In [testInsertEdgeFromTouchingNode] Edge leaving the image!\n"));
-                        // Error: Normal images leaves domain surface!
-                        return false;
+                        return WALK_LEFT_IMAGE;
                     }
 
                     // add intersection nodes on both sides
@@ -1025,7 +1503,7 @@ bool NormalProjector<ctype>::testInsertEdgeFromTouchingNode(const std::vector<St
                     enteringEdge = e;
 
 
-                    return true;
+                    return WALK_CONTINUES;
 
                 } else {
                     // parameter polyedge is leaving base grid triangle through a ghost node
@@ -1034,13 +1512,16 @@ bool NormalProjector<ctype>::testInsertEdgeFromTouchingNode(const std::vector<St
                     int vertex = psurface_->triangles(curr[i].tri).vertices[corner];
                     int copyTri = curr[i].tri;
                     curr = psurface_->getNodeBundleAtVertex(vertex);
+                    // With a maximum gap, vertices far from the target surface have no ghost node
+                    if (curr[0].idx == -1)
+                        return WALK_FAILED;
                     currType = Node<ctype>::GHOST_NODE;
                     assert(currType==type(curr));
                     lambda = newLambda;
 
                     edgePath.push_back(PathVertex<ctype>(copyTri,j,x[0],currType,curr,
                                     newLambda, enteringEdge,corner));
-                    return true;
+                    return WALK_CONTINUES;
 
                 }
 
@@ -1050,14 +1531,14 @@ bool NormalProjector<ctype>::testInsertEdgeFromTouchingNode(const std::vector<St
 
     }
 
-    return false;
+    return WALK_FAILED;
 
 }
 
 
 
 template <class ctype>
-bool NormalProjector<ctype>::testInsertEdgeFromCornerNode(const std::vector<StaticVector<ctype,3> >& normals,
+typename NormalProjector<ctype>::EdgeWalkStatus NormalProjector<ctype>::testInsertEdgeFromCornerNode(const std::vector<StaticVector<ctype,3> >& normals,
                                                    int from, int to, ctype &lambda,
                                                    NodeBundle& curr,
                                                    typename Node<ctype>::NodeType& currType, int& currTri,
@@ -1116,9 +1597,7 @@ bool NormalProjector<ctype>::testInsertEdgeFromCornerNode(const std::vector<Stat
                     edgePath.push_back(PathVertex<ctype>(cT,oppEdge, x[0],currType,NodeBundle(),
                                         newLambda, leavingEdge));
 
-                    throw(EdgeLeavingImageException("In [testInsertEdgeFromCornerNode]: Edge leaving the image!\n"));
-
-                    return false;
+                    return WALK_LEFT_IMAGE;
                 }
 
                 // add intersection nodes on both sides
@@ -1133,7 +1612,7 @@ bool NormalProjector<ctype>::testInsertEdgeFromCornerNode(const std::vector<Stat
                 leavingEdge = e;
 
 
-                return true;
+                return WALK_CONTINUES;
 
             } else {
 
@@ -1142,12 +1621,15 @@ bool NormalProjector<ctype>::testInsertEdgeFromCornerNode(const std::vector<Stat
                 // get all ghost nodes for the base grid vertex
                 int vertex = psurface_->triangles(curr[i].tri).vertices[corner];
                 curr = psurface_->getNodeBundleAtVertex(vertex);
+                // With a maximum gap, vertices far from the target surface have no ghost node
+                if (curr[0].idx == -1)
+                    return WALK_FAILED;
                 currType = Node<ctype>::GHOST_NODE;
                 assert(currType == type(curr));
                 lambda = newLambda;
 
                 edgePath.push_back(PathVertex<ctype>(cT,oppEdge,x[0],currType,curr, newLambda, leavingEdge, corner));
-                return true;
+                return WALK_CONTINUES;
 
             }
 
@@ -1155,14 +1637,7 @@ bool NormalProjector<ctype>::testInsertEdgeFromCornerNode(const std::vector<Stat
 
     }
 
-    // TODO think about the case below
-    throw(WrongEdgeException("No intersection found (in testInsertEdgeFromCornerNode)!\n"));
-
-    // If we get to here this means that the intersection of the edge from 'from' to 'to' with
-    // the star around the vertex corresponding to the corner node we are testing consists
-    // only of a single point.  This can happen if the star is not a full circle.  In this
-    // case the edge cannot be inserted and consequently we return 'false'.
-    return false;
+    return WALK_WRONG_EDGE;
 }
 
 
@@ -1191,9 +1666,9 @@ bool NormalProjector<ctype>::onSameTriangle(const int& tri, const NodeBundle& b)
 
 
 template <class ctype>
-bool NormalProjector<ctype>::computeInverseNormalProjection(const StaticVector<ctype,3>& p0, const StaticVector<ctype,3>& p1, const StaticVector<ctype,3>& p2,
-                                                     const StaticVector<ctype,3>& n0, const StaticVector<ctype,3>& n1, const StaticVector<ctype,3>& n2,
-                                                     const StaticVector<ctype,3>& target, StaticVector<ctype,3>& x)
+int NormalProjector<ctype>::directInverseNormalProjection(const StaticVector<ctype,3>& p0, const StaticVector<ctype,3>& p1, const StaticVector<ctype,3>& p2,
+                                                          const StaticVector<ctype,3>& n0, const StaticVector<ctype,3>& n1, const StaticVector<ctype,3>& n2,
+                                                          const StaticVector<ctype,3>& target, StaticVector<ctype,3>& x)
 {
     const ctype eps = 1e-6;
 
@@ -1223,15 +1698,16 @@ bool NormalProjector<ctype>::computeInverseNormalProjection(const StaticVector<c
     // linear coefficient
     ctype linear = n2.dot(p02p12) + p2q.dot(n02p12) + p2q.dot(p02n12);
 
-    // save all zeros we find
-    std::vector<ctype> zeros;
+    // save all zeros we find, there are at most three
+    ctype zeros[3];
+    int nZeros = 0;
 
     if (std::fabs(cubic) <1e-10 && std::fabs(quadratic)<1e-10 && std::fabs(linear)<1e-10) {
-        return false;
+        return 0;
     } else if (std::fabs(cubic) <1e-10 && std::fabs(quadratic)<1e-10) {
 
         // problem is linear
-        zeros.push_back(-constant/linear);
+        zeros[nZeros++] = -constant/linear;
 
     } else if(std::fabs(cubic)<1e-10) {
 
@@ -1243,10 +1719,10 @@ bool NormalProjector<ctype>::computeInverseNormalProjection(const StaticVector<c
 
         // no real solution
         if (sqt<-1e-10)
-            return false;
+            return 0;
 
-        zeros.push_back(-0.5*p + std::sqrt(sqt));
-        zeros.push_back(-0.5*p -std::sqrt(sqt));
+        zeros[nZeros++] = -0.5*p + std::sqrt(sqt);
+        zeros[nZeros++] = -0.5*p -std::sqrt(sqt);
 
     } else {
 
@@ -1272,7 +1748,7 @@ bool NormalProjector<ctype>::computeInverseNormalProjection(const StaticVector<c
             nu = -q/2-std::sqrt(D);
             zer += std::pow(std::fabs(nu),1.0/3.0) * ((nu<-1e-10) ? -1 : 1);
 
-            zeros.push_back(zer-quadratic/3);
+            zeros[nZeros++] = zer-quadratic/3;
 
         } else if (D<-1e-10) {
 
@@ -1281,34 +1757,33 @@ bool NormalProjector<ctype>::computeInverseNormalProjection(const StaticVector<c
             ctype b = std::acos(-0.5*q*std::sqrt(-27/(std::pow(p,3))));
 
             for (int i=0;i<3; i++)
-                zeros.push_back(std::pow(-1,i+1)*a*std::cos((b+(1-i)*M_PI)/3) -quadratic/3);
+                zeros[nZeros++] = std::pow(-1,i+1)*a*std::cos((b+(1-i)*M_PI)/3) -quadratic/3;
 
 
         } else {
             // one single and one double zero
 
             if (std::fabs(q)<1e-10) {
-                zeros.push_back(-quadratic/3);
+                zeros[nZeros++] = -quadratic/3;
 
                 if (p<-1e-10)
-                    zeros.push_back(std::sqrt(-p)-quadratic/3);
+                    zeros[nZeros++] = std::sqrt(-p)-quadratic/3;
 
             } else if (std::fabs(p)<1e-10) { // is this case correct?
 
                 double nu = std::pow(std::fabs(q),1.0/3.0) * ((q<-eps) ? -1 : 1);
-                zeros.push_back(nu-quadratic/3);
+                zeros[nZeros++] = nu-quadratic/3;
 
             } else {
-                zeros.push_back(3*q/p - quadratic/3);
-                zeros.push_back(-1.5*q/p - quadratic/3);
+                zeros[nZeros++] = 3*q/p - quadratic/3;
+                zeros[nZeros++] = -1.5*q/p - quadratic/3;
             }
         }
     }
 
     int index = -1;
     StaticVector<ctype,3> r;
-    std::vector<StaticVector<ctype,3> > lamb(zeros.size());
-    for (int i=0;i<zeros.size();i++) {
+    for (int i=0;i<nZeros;i++) {
 
         ctype nu=zeros[i];
         // only look in the direction of the outer normals
@@ -1349,7 +1824,6 @@ bool NormalProjector<ctype>::computeInverseNormalProjection(const StaticVector<c
                 break;
 
         }
-        lamb[i] = r;
         if (r[0] > -eps && r[1]> -eps && (r[0]+r[1] < 1+eps)) {
             index = i;
             x = r;
@@ -1358,16 +1832,25 @@ bool NormalProjector<ctype>::computeInverseNormalProjection(const StaticVector<c
 
     StaticVector<ctype,3> res = p2q + x[0]*p02 + x[1]*p12 + x[2]*x[0]*n02+x[2]*x[1]*n12+x[2]*n2;
 
-    if (res.length()<1e-6) {
-        if (index >= 0)
-            return true;
+    if (res.length()<1e-6)
+        return (index >= 0) ? 1 : 0;
 
-        return false;
-    }
+    // Direct solution failed, Newton's method is needed
+    return -1;
+}
 
-    //std::cout<<"Direct solution failed, use Newton method\n";
+template <class ctype>
+bool NormalProjector<ctype>::computeInverseNormalProjection(const StaticVector<ctype,3>& p0, const StaticVector<ctype,3>& p1, const StaticVector<ctype,3>& p2,
+                                                     const StaticVector<ctype,3>& n0, const StaticVector<ctype,3>& n1, const StaticVector<ctype,3>& n2,
+                                                     const StaticVector<ctype,3>& target, StaticVector<ctype,3>& x)
+{
+    const ctype eps = 1e-6;
 
-    StaticVector<ctype,3> oldX = x;
+    int direct = directInverseNormalProjection(p0, p1, p2, n0, n1, n2, target, x);
+    if (direct >= 0)
+        return direct;
+
+    //std::cout<<"Direct solution failed, use Newton method\n";
 
     // Fix some initial value
     // Some problems have two solutions and the Newton converges to the wrong one
@@ -1392,6 +1875,12 @@ bool NormalProjector<ctype>::computeInverseNormalProjection(const StaticVector<c
 
     }
 
+    StaticVector<ctype,3> p02 = p0 - p2;
+    StaticVector<ctype,3> p12 = p1 - p2;
+    StaticVector<ctype,3> p2q = p2 - target;
+    StaticVector<ctype,3> n02 = n0 - n2;
+    StaticVector<ctype,3> n12 = n1 - n2;
+
     StaticVector<ctype,3> res2 = p2q + x[0]*p02 + x[1]*p12 + x[2]*x[0]*n02+x[2]*x[1]*n12+x[2]*n2;
 
     if (x[0]>-eps && x[1]>-eps && (x[0]+x[1] <1+eps)) {
@@ -1408,14 +1897,144 @@ bool NormalProjector<ctype>::computeInverseNormalProjection(const StaticVector<c
 
 
 template <class ctype>
-bool NormalProjector<ctype>::edgeIntersectsNormalFan(const StaticVector<ctype,3>& q0, const StaticVector<ctype,3>& q1,
-                                              const StaticVector<ctype,3>& p0, const StaticVector<ctype,3>& p1,
-                                              const StaticVector<ctype,3>& n0, const StaticVector<ctype,3>& n1,
-                                              StaticVector<ctype,3>& x)
+void NormalProjector<ctype>::computeInverseNormalProjections(const int* tris, int n,
+                                                             const std::vector<StaticVector<ctype,3> >& normals,
+                                                             const StaticVector<ctype,3>& target,
+                                                             StaticVector<ctype,3>* x, bool* success)
 {
-    int i;
+#ifdef PSURFACE_SCALAR_KERNELS
+    for (int k=0; k<n; k++) {
+        const DomainTriangle<ctype>& cT = psurface_->triangles(tris[k]);
+        success[k] = computeInverseNormalProjection(psurface_->vertices(cT.vertices[0]),
+                                                    psurface_->vertices(cT.vertices[1]),
+                                                    psurface_->vertices(cT.vertices[2]),
+                                                    normals[cT.vertices[0]], normals[cT.vertices[1]], normals[cT.vertices[2]],
+                                                    target, x[k]);
+    }
+#else
+    const ctype eps = 1e-6;
+    const int B = projectionBatchSize;
+
+    assert(n <= B);
+
+    // Try the closed-form solution first, and collect the triangles where it fails
+    int lane[B];
+    int nLanes = 0;
+
+    for (int k=0; k<n; k++) {
+
+        const DomainTriangle<ctype>& cT = psurface_->triangles(tris[k]);
+
+        int direct = directInverseNormalProjection(psurface_->vertices(cT.vertices[0]),
+                                                   psurface_->vertices(cT.vertices[1]),
+                                                   psurface_->vertices(cT.vertices[2]),
+                                                   normals[cT.vertices[0]], normals[cT.vertices[1]], normals[cT.vertices[2]],
+                                                   target, x[k]);
+
+        if (direct >= 0)
+            success[k] = direct;
+        else
+            lane[nLanes++] = k;
+    }
+
+    if (nLanes == 0)
+        return;
+
+    // ///////////////////////////////////////////////////////////////////
+    //   Newton's method for the remaining triangles, one per SIMD lane.
+    //   The arithmetic is the same as in computeInverseNormalProjection().
+    // ///////////////////////////////////////////////////////////////////
+
+    // p0-p2, p1-p2, n0-n2, n1-n2, n2, p2, p2-target, and the iterate, coordinate first
+    ctype p02[3][B], p12[3][B], n02[3][B], n12[3][B], n2[3][B], p2[3][B], p2q[3][B];
+    ctype X[3][B];
 
-    ctype eps = 1e-6;
+    // Lanes whose iteration has reached a fixed point don't change anymore
+    int active[B];
+
+    for (int l=0; l<B; l++) {
+
+        // Unused lanes get copies of the first one
+        int k = lane[(l<nLanes) ? l : 0];
+        const DomainTriangle<ctype>& cT = psurface_->triangles(tris[k]);
+
+        for (int c=0; c<3; c++) {
+            ctype q0 = psurface_->vertices(cT.vertices[0])[c];
+            ctype q1 = psurface_->vertices(cT.vertices[1])[c];
+            ctype q2 = psurface_->vertices(cT.vertices[2])[c];
+
+            p02[c][l] = q0 - q2;
+            p12[c][l] = q1 - q2;
+            n02[c][l] = normals[cT.vertices[0]][c] - normals[cT.vertices[2]][c];
+            n12[c][l] = normals[cT.vertices[1]][c] - normals[cT.vertices[2]][c];
+            n2[c][l]  = normals[cT.vertices[2]][c];
+            p2[c][l]  = q2;
+            p2q[c][l] = q2 - target[c];
+
+            // Fix some initial value
+            // Some problems have two solutions and the Newton converges to the wrong one
+            X[c][l] = 0.5;
+        }
+
+        active[l] = (l<nLanes);
+    }
+
+    for (int i=0; i<30; i++) {
+
+        PSURFACE_SIMD
+        for (int l=0; l<B; l++) {
+
+            // F(x), and the columns a, b, c of its derivative
+            ctype F[3], a[3], b[3], c[3];
+            for (int r=0; r<3; r++) {
+                F[r] = X[0][l]*p02[r][l] + X[1][l]*p12[r][l] + X[2][l]*X[0][l]*n02[r][l] + X[2][l]*X[1][l]*n12[r][l]
+                     + X[2][l]*n2[r][l] + p2[r][l] - target[r];
+                a[r] = p02[r][l] + X[2][l]*n02[r][l];
+                b[r] = p12[r][l] + X[2][l]*n12[r][l];
+                c[r] = X[0][l]*n02[r][l] + X[1][l]*n12[r][l] + n2[r][l];
+            }
+
+            ctype correction[3];
+            newtonCorrection(a, b, c, F, correction);
+
+            active[l] = active[l] && (correction[0] != 0 || correction[1] != 0 || correction[2] != 0);
+
+            for (int r=0; r<3; r++)
+                X[r][l] = (active[l]) ? X[r][l] + correction[r] : X[r][l];
+        }
+
+        int nActive = 0;
+        for (int l=0; l<nLanes; l++)
+            nActive += active[l];
+
+        if (nActive == 0)
+            break;
+    }
+
+    for (int l=0; l<nLanes; l++) {
+
+        int k = lane[l];
+        for (int c=0; c<3; c++)
+            x[k][c] = X[c][l];
+
+        StaticVector<ctype,3> res2;
+        for (int c=0; c<3; c++)
+            res2[c] = p2q[c][l] + x[k][0]*p02[c][l] + x[k][1]*p12[c][l] + x[k][2]*x[k][0]*n02[c][l]
+                    + x[k][2]*x[k][1]*n12[c][l] + x[k][2]*n2[c][l];
+
+        // Newton did not converge either
+        success[k] = x[k][0]>-eps && x[k][1]>-eps && (x[k][0]+x[k][1] <1+eps) && !(res2.length()>1e-6);
+    }
+#endif
+}
+
+template <class ctype>
+int NormalProjector<ctype>::directEdgeIntersectsNormalFan(const StaticVector<ctype,3>& q0, const StaticVector<ctype,3>& q1,
+                                                          const StaticVector<ctype,3>& p0, const StaticVector<ctype,3>& p1,
+                                                          const StaticVector<ctype,3>& n0, const StaticVector<ctype,3>& n1,
+                                                          StaticVector<ctype,3>& x)
+{
+    const ctype eps = 1e-6;
     // solve a quadratic scalar equation for the distance parameter eta, then compute the barycentric coordinates from it
 
     StaticVector<ctype,3> n10 = n1 - n0;
@@ -1434,15 +2053,16 @@ bool NormalProjector<ctype>::edgeIntersectsNormalFan(const StaticVector<ctype,3>
     // constant coefficient
     ctype constant = p0q0.dot(q10p10);
 
-    // save all zeros we find
-    std::vector<ctype> zeros;
+    // save all zeros we find, there are at most two
+    ctype zeros[2];
+    int nZeros = 0;
 
     if (std::fabs(quadratic)<1e-10 && std::fabs(linear)<1e-10) {
-        return false;
+        return 0;
     } else if (std::fabs(quadratic)<1e-10) {
 
         // problem is linear
-        zeros.push_back(-constant/linear);
+        zeros[nZeros++] = -constant/linear;
 
     } else {
 
@@ -1454,17 +2074,16 @@ bool NormalProjector<ctype>::edgeIntersectsNormalFan(const StaticVector<ctype,3>
 
         // no real solution
         if (sqt<-1e-10)
-            return false;
+            return 0;
 
-        zeros.push_back(-0.5*p + std::sqrt(sqt));
-        zeros.push_back(-0.5*p -std::sqrt(sqt));
+        zeros[nZeros++] = -0.5*p + std::sqrt(sqt);
+        zeros[nZeros++] = -0.5*p -std::sqrt(sqt);
 
     }
 
     int index = -1;
     StaticVector<ctype,3> r;
-    std::vector<StaticVector<ctype,3> > lamb(zeros.size());
-    for (int i=0;i<zeros.size();i++) {
+    for (int i=0;i<nZeros;i++) {
 
         ctype eta=zeros[i];
 
@@ -1497,7 +2116,6 @@ bool NormalProjector<ctype>::edgeIntersectsNormalFan(const StaticVector<ctype,3>
                 break;
 
         }
-        lamb[i] = r;
         if (r[0] >= -eps && r[1]>= -eps && (r[0]<=1+eps)  && (r[1] <= 1+eps)) {
             index = i;
             x = r;
@@ -1507,15 +2125,26 @@ bool NormalProjector<ctype>::edgeIntersectsNormalFan(const StaticVector<ctype,3>
 
     StaticVector<ctype,3> res = p0q0 + x[0]*p10 + x[2]*n0 + x[2]*x[0]*n10 -x[1]*q10;
     if (res.length()<eps)
-    {
-        if (index >= 0)
-            return true;
+        return (index >= 0) ? 1 : 0;
+
+    // Direct solution failed, Newton's method is needed
+    return -1;
+}
 
-        return false;
-    }
+
+template <class ctype>
+bool NormalProjector<ctype>::edgeIntersectsNormalFan(const StaticVector<ctype,3>& q0, const StaticVector<ctype,3>& q1,
+                                              const StaticVector<ctype,3>& p0, const StaticVector<ctype,3>& p1,
+                                              const StaticVector<ctype,3>& n0, const StaticVector<ctype,3>& n1,
+                                              StaticVector<ctype,3>& x)
+{
+    const ctype eps = 1e-6;
+
+    int direct = directEdgeIntersectsNormalFan(q0, q1, p0, p1, n0, n1, x);
+    if (direct >= 0)
+        return direct;
 
     // if the direct compuation failed, use a Newton method to compute at least one zero
-    StaticVector<ctype,3> oldX = x;
 
     // Fix some initial value
     // sometimes it only works when the initial value is an intersection...
@@ -1523,7 +2152,7 @@ bool NormalProjector<ctype>::edgeIntersectsNormalFan(const StaticVector<ctype,3>
     x[2] = 0.5;
     StaticVector<ctype,3> newtonCorrection;
 
-    for (i=0; i<30; i++) {
+    for (int i=0; i<30; i++) {
 
         // compute Newton correction
 
@@ -1541,6 +2170,11 @@ bool NormalProjector<ctype>::edgeIntersectsNormalFan(const StaticVector<ctype,3>
 
     }
 
+    StaticVector<ctype,3> p0q0 = p0 - q0;
+    StaticVector<ctype,3> p10 = p1 - p0;
+    StaticVector<ctype,3> n10 = n1 - n0;
+    StaticVector<ctype,3> q10 = q1 - q0;
+
     StaticVector<ctype,3> res2 = p0q0 + x[0]*p10 + x[2]*n0 + x[2]*x[0]*n10 -x[1]*q10;
     if (res2.length()<=eps) {
 
@@ -1556,6 +2190,142 @@ bool NormalProjector<ctype>::edgeIntersectsNormalFan(const StaticVector<ctype,3>
     return false;
 }
 
+template <class ctype>
+void NormalProjector<ctype>::triangleEdgesIntersectNormalFan(const StaticVector<ctype,3>& q0, const StaticVector<ctype,3>& q1,
+                                                             int tri, int skipEdge,
+                                                             const std::vector<StaticVector<ctype,3> >& normals,
+                                                             StaticVector<ctype,3>* x, bool* hit)
+{
+    const DomainTriangle<ctype>& cT = psurface_->triangles(tri);
+
+#ifdef PSURFACE_SCALAR_KERNELS
+    for (int k=0; k<3; k++) {
+
+        hit[k] = false;
+        if (k==skipEdge)
+            continue;
+
+        int p = cT.vertices[k];
+        int q = cT.vertices[(k+1)%3];
+
+        x[k].assign(0);
+        hit[k] = edgeIntersectsNormalFan(q0, q1, psurface_->vertices(p), psurface_->vertices(q), normals[p], normals[q], x[k]);
+    }
+#else
+    const ctype eps = 1e-6;
+
+    // Three edges, padded to the next SIMD width
+    const int B = 4;
+
+    // Try the closed-form solution first, and collect the edges where it fails
+    int lane[3];
+    int nLanes = 0;
+
+    for (int k=0; k<3; k++) {
+
+        hit[k] = false;
+        if (k==skipEdge)
+            continue;
+
+        int p = cT.vertices[k];
+        int q = cT.vertices[(k+1)%3];
+
+        x[k].assign(0);
+        int direct = directEdgeIntersectsNormalFan(q0, q1, psurface_->vertices(p), psurface_->vertices(q),
+                                                   normals[p], normals[q], x[k]);
+
+        if (direct >= 0)
+            hit[k] = direct;
+        else
+            lane[nLanes++] = k;
+    }
+
+    if (nLanes == 0)
+        return;
+
+    // ///////////////////////////////////////////////////////////////////
+    //   Newton's method for the remaining edges, one per SIMD lane.
+    //   The arithmetic is the same as in edgeIntersectsNormalFan().
+    // ///////////////////////////////////////////////////////////////////
+
+    const StaticVector<ctype,3> q10 = q1 - q0;
+    const StaticVector<ctype,3> q01 = q0 - q1;
+
+    // p0-q0, p1-p0, n0, n1-n0, and the iterate, coordinate first
+    ctype p0q0[3][B], p10[3][B], n0[3][B], n10[3][B];
+    ctype X[3][B];
+
+    // Lanes whose iteration has reached a fixed point don't change anymore
+    int active[B];
+
+    for (int l=0; l<B; l++) {
+
+        // Unused lanes get copies of the first one
+        int k = lane[(l<nLanes) ? l : 0];
+        int p = cT.vertices[k];
+        int q = cT.vertices[(k+1)%3];
+
+        for (int c=0; c<3; c++) {
+            p0q0[c][l] = psurface_->vertices(p)[c] - q0[c];
+            p10[c][l]  = psurface_->vertices(q)[c] - psurface_->vertices(p)[c];
+            n0[c][l]   = normals[p][c];
+            n10[c][l]  = normals[q][c] - normals[p][c];
+
+            // Fix some initial value
+            X[c][l] = 0.5;
+        }
+
+        active[l] = (l<nLanes);
+    }
+
+    for (int i=0; i<30; i++) {
+
+        PSURFACE_SIMD
+        for (int l=0; l<B; l++) {
+
+            // F(x), and the columns a, b, c of its derivative
+            ctype F[3], a[3], b[3], c[3];
+            for (int r=0; r<3; r++) {
+                F[r] = p0q0[r][l] + X[0][l]*p10[r][l] + X[2][l]*n0[r][l] + X[2][l]*X[0][l]*n10[r][l] - X[1][l]*q10[r];
+                a[r] = p10[r][l] + X[2][l]*n10[r][l];
+                b[r] = q01[r];
+                c[r] = n0[r][l] + X[0][l]*n10[r][l];
+            }
+
+            ctype correction[3];
+            newtonCorrection(a, b, c, F, correction);
+
+            active[l] = active[l] && (correction[0] != 0 || correction[1] != 0 || correction[2] != 0);
+
+            for (int r=0; r<3; r++)
+                X[r][l] = (active[l]) ? X[r][l] + correction[r] : X[r][l];
+        }
+
+        int nActive = 0;
+        for (int l=0; l<nLanes; l++)
+            nActive += active[l];
+
+        if (nActive == 0)
+            break;
+    }
+
+    for (int l=0; l<nLanes; l++) {
+
+        int k = lane[l];
+        for (int c=0; c<3; c++)
+            x[k][c] = X[c][l];
+
+        StaticVector<ctype,3> res2;
+        for (int c=0; c<3; c++)
+            res2[c] = p0q0[c][l] + x[k][0]*p10[c][l] + x[k][2]*n0[c][l] + x[k][2]*x[k][0]*n10[c][l] - x[k][1]*q10[c];
+
+        // Unlike edgeIntersectsNormalFan(), don't complain if Newton did not converge:
+        // the caller typically looks at the first intersection only
+        hit[k] = res2.length()<=eps && x[k][0]>=-eps && x[k][0]<=(1+eps) && x[k][1]>=-eps && x[k][1]<=(1+eps);
+    }
+#endif
+}
+
 
 template <class ctype>
 bool NormalProjector<ctype>::rayIntersectsTriangle(const StaticVector<ctype,3>& basePoint, const StaticVector<ctype,3>& direction,
@@ -1617,6 +2387,77 @@ bool NormalProjector<ctype>::rayIntersectsTriangle(const StaticVector<ctype,3>&
 }
 
 
+template <class ctype>
+void NormalProjector<ctype>::rayIntersectsTriangles(const StaticVector<ctype,3>& basePoint, const StaticVector<ctype,3>& direction,
+                                                    const StaticVector<ctype,3>* a, const StaticVector<ctype,3>* b, const StaticVector<ctype,3>* c,
+                                                    int n,
+                                                    StaticVector<ctype,2>* localCoords, ctype* normalDist, bool* hit, ctype eps)
+{
+#ifdef PSURFACE_SCALAR_KERNELS
+    for (int k=0; k<n; k++)
+        hit[k] = rayIntersectsTriangle(basePoint, direction, a[k], b[k], c[k], localCoords[k], normalDist[k], eps);
+#else
+    const int B = projectionBatchSize;
+
+    assert(n <= B);
+
+    // b-a, c-a, and basePoint-a, coordinate first.  Unused lanes get copies of the first triangle.
+    ctype e1[3][B], e2[3][B], pa[3][B];
+    for (int l=0; l<B; l++) {
+        int k = (l<n) ? l : 0;
+        for (int i=0; i<3; i++) {
+            e1[i][l] = b[k][i] - a[k][i];
+            e2[i][l] = c[k][i] - a[k][i];
+            pa[i][l] = basePoint[i] - a[k][i];
+        }
+    }
+
+    const ctype& d0 = direction[0];
+    const ctype& d1 = direction[1];
+    const ctype& d2 = direction[2];
+
+    // The arithmetic is the same as in rayIntersectsTriangle()
+    ctype nu[B], lambda[B], mu[B];
+    int parallel[B];
+
+    PSURFACE_SIMD
+    for (int l=0; l<B; l++) {
+
+        ctype l1 = std::sqrt(e1[0][l]*e1[0][l] + e1[1][l]*e1[1][l] + e1[2][l]*e1[2][l]);
+        ctype l2 = std::sqrt(e2[0][l]*e2[0][l] + e2[1][l]*e2[1][l] + e2[2][l]*e2[2][l]);
+
+        parallel[l] = std::fabs(det3(e1[0][l]/l1, e1[1][l]/l1, e1[2][l]/l1,
+                                     e2[0][l]/l2, e2[1][l]/l2, e2[2][l]/l2,
+                                     d0, d1, d2)) < eps;
+
+        // Cramer's rule
+        ctype det = det3(e1[0][l], e1[1][l], e1[2][l], e2[0][l], e2[1][l], e2[2][l], d0, d1, d2);
+
+        nu[l]     = det3(e1[0][l], e1[1][l], e1[2][l], e2[0][l], e2[1][l], e2[2][l], pa[0][l], pa[1][l], pa[2][l]) / det;
+        lambda[l] = det3(pa[0][l], pa[1][l], pa[2][l], e2[0][l], e2[1][l], e2[2][l], d0, d1, d2) / det;
+        mu[l]     = det3(e1[0][l], e1[1][l], e1[2][l], pa[0][l], pa[1][l], pa[2][l], d0, d1, d2) / det;
+    }
+
+    for (int k=0; k<n; k++) {
+
+        if (parallel[k]) {
+            hit[k] = false;
+            continue;
+        }
+
+        // only allow a certain overlaps
+        hit[k] = !(nu[k]>1e-1) && !(lambda[k]<-eps) && !(mu[k]<-eps) && !(lambda[k] + mu[k] > 1+eps);
+
+        if (hit[k]) {
+            localCoords[k][0] = 1-lambda[k]-mu[k];
+            localCoords[k][1] = lambda[k];
+            normalDist[k]     = -nu[k];
+        }
+    }
+#endif
+}
+
+
 template <class ctype>
 NodeIdx NormalProjector<ctype>::getCornerNode(const DomainTriangle<ctype>& cT, int corner)
 {
@@ -8,6 +8,7 @@
 #include "psurfaceAPI.h"
 
 #include <vector>
+#include <limits>
 
 #ifdef PSURFACE_STANDALONE
 namespace psurface { class Surface; }
@@ -23,6 +24,8 @@ class NodeBundle;
 class GlobalNodeIdx;
 template <int dimworld, class ctype>
 struct DirectionFunction;
+template <class ctype>
+class TargetSurfaceIndex;
 
 /** \brief Construct a PSurface object by projecting one surface in normal direction onto another
 
@@ -33,16 +36,62 @@ class PSURFACE_API NormalProjector {
 public:
 
     NormalProjector(PSurface<2,ctype>* psurface)
-        : psurface_(psurface)
+        : psurface_(psurface), closestPointFallback_(false)
     {}
 
+    /** \brief Map domain vertices whose normal ray misses the target surface to the closest target point
+     *
+     * By default such vertices get no ghost node.  With the fallback they are
+     * mapped to the closest point on the target surface instead, if that is
+     * not farther away than the maximum gap given to project().
+     */
+    void setClosestPointFallback(bool fallback) { closestPointFallback_ = fallback; }
+
+    /** \brief Project the target surface onto the domain surface
+     *
+     * \param maxGap If given, only the target triangles closer than this to the
+     *        domain surface are projected, as if the target surface consisted of
+     *        them alone.  This is much faster if only small parts of the surfaces
+     *        are in contact.
+     * \param targetIndex If given, an index of all triangles of the target surface, which
+     *        is used instead of building one.  This saves time if there are several
+     *        projections onto the same target surface.
+     * \throw std::runtime_error if the index does not belong to the target surface
+     */
     void project(const Surface* targetSurface,
                  const DirectionFunction<3,ctype>* domainDirection,
-                 const DirectionFunction<3,ctype>* targetDirection
+                 const DirectionFunction<3,ctype>* targetDirection,
+                 ctype maxGap = std::numeric_limits<ctype>::max(),
+                 const TargetSurfaceIndex<ctype>* targetIndex = NULL
                     );
 
 protected:
 
+    /** \brief Find the domain and target triangles that are closer than maxGap to each other
+     *
+     * The bounding boxes of the domain triangles are inflated by maxGap, and tested
+     * for overlap with the bounding boxes of the target triangles by sweep and prune.
+     *
+     * \param contactTriangles The target triangles close to any domain triangle, in increasing order
+     * \param targetTrisPerDomainVertex For each domain vertex, the target triangles
+     *        close to a domain triangle containing it, in increasing order
+     */
+    void computeContactCandidates(const Surface* targetSurface, ctype maxGap,
+                                  std::vector<int>& contactTriangles,
+                                  std::vector<std::vector<int> >& targetTrisPerDomainVertex);
+
+    /** \brief Find the domain triangles that are closer than maxGap to each vertex of the contact triangles
+     *
+     * The vertices are put into an octree, and each domain triangle looks up
+     * the vertices within maxGap of it with MultiDimOctree::lookupRegion().
+     *
+     * \param domainTrisPerTargetVertex For each target vertex, the domain triangles
+     *        close to it, in increasing order
+     */
+    void computeVertexCandidates(const Surface* targetSurface, ctype maxGap,
+                                 const std::vector<int>& contactTriangles,
+                                 std::vector<std::vector<int> >& domainTrisPerTargetVertex);
+
     void computeDiscreteDomainDirections(const DirectionFunction<3,ctype>* direction,
                                          std::vector<StaticVector<ctype,3> >& normals);
 
@@ -66,40 +115,56 @@ protected:
     //   Methods needed to test whether an edge can be projected completely
     // ///////////////////////////////////////////////////////////////////////
 
-    /** \brief Check if we can insert a target edge and store the path on the domain surface. */
-    bool edgeCanBeInserted(const std::vector<StaticVector<ctype,3> >& normals,
-                           int from, 
-                           int to,
-                           const std::vector<NodeBundle>& projectedTo,
-                           std::vector<PathVertex<ctype> >& edgePath);
-
-    bool testInsertEdgeFromInteriorNode(const std::vector<StaticVector<ctype,3> >& normals, 
-                                        int from, int to, ctype& lambda,
-                                        NodeBundle& curr,
-                                        typename Node<ctype>::NodeType& currType, int& currTri,
-                                        int& enteringEdge, std::vector<PathVertex<ctype> >& edgePath,
-                                        int offset);
-
-    bool testInsertEdgeFromIntersectionNode(const std::vector<StaticVector<ctype,3> >& normals, 
-                                            int from, int to, ctype& lambda,
-                                            NodeBundle& curr,
-                                            typename Node<ctype>::NodeType& currType, int& currTri,
-                                            int& enteringEdge,std::vector<PathVertex<ctype> >& edgePath,
-                                            int offset);
-
-    bool testInsertEdgeFromTouchingNode(const std::vector<StaticVector<ctype,3> >& normals, 
-                                        int from, int to, ctype& lambda,
-                                        NodeBundle& curr,
-                                        typename Node<ctype>::NodeType& currType, int& currTri,
-                                        int& enteringEdge, std::vector<PathVertex<ctype> >& edgePath,
-                                        int offset);
-
-    bool testInsertEdgeFromCornerNode(const std::vector<StaticVector<ctype,3> >& normals, 
-                                      int from, int to, ctype& lambda,
-                                      NodeBundle& curr, 
-                                      typename Node<ctype>::NodeType& currType, int& currTri,
-                                      int& enteringEdge, std::vector<PathVertex<ctype> >& edgePath,
-                                      int offset);
+    /** \brief The outcome of the edge walk, and of each of its steps */
+    enum EdgeWalkStatus {
+        WALK_CONTINUES,   ///< The step has extended the path, resp. the path has reached the end of the target edge
+        WALK_FAILED,      ///< The normal projection of the target edge is not continuous, it cannot be inserted
+        WALK_LEFT_IMAGE,  ///< The target edge leaves the image of the projection, the path ends on the boundary
+        WALK_WRONG_EDGE   ///< The step found no intersection, the previous one has to try another domain edge
+    };
+
+    /** \brief Check if we can insert a target edge and store the path on the domain surface.
+     *
+     * \return WALK_CONTINUES if the complete edge can be inserted, WALK_LEFT_IMAGE if the part
+     *         stored in edgePath can be inserted, and WALK_FAILED if the edge cannot be inserted
+     */
+    EdgeWalkStatus edgeCanBeInserted(const std::vector<StaticVector<ctype,3> >& normals,
+                                     int from,
+                                     int to,
+                                     const std::vector<NodeBundle>& projectedTo,
+                                     std::vector<PathVertex<ctype> >& edgePath);
+
+    /* The single steps of the edge walk, one for each type of the current node.
+     * Return WALK_CONTINUES if the path has been extended by a node.
+     */
+
+    EdgeWalkStatus testInsertEdgeFromInteriorNode(const std::vector<StaticVector<ctype,3> >& normals, 
+                                                  int from, int to, ctype& lambda,
+                                                  NodeBundle& curr,
+                                                  typename Node<ctype>::NodeType& currType, int& currTri,
+                                                  int& enteringEdge, std::vector<PathVertex<ctype> >& edgePath,
+                                                  int offset);
+
+    EdgeWalkStatus testInsertEdgeFromIntersectionNode(const std::vector<StaticVector<ctype,3> >& normals, 
+                                                      int from, int to, ctype& lambda,
+                                                      NodeBundle& curr,
+                                                      typename Node<ctype>::NodeType& currType, int& currTri,
+                                                      int& enteringEdge,std::vector<PathVertex<ctype> >& edgePath,
+                                                      int offset);
+
+    EdgeWalkStatus testInsertEdgeFromTouchingNode(const std::vector<StaticVector<ctype,3> >& normals, 
+                                                  int from, int to, ctype& lambda,
+                                                  NodeBundle& curr,
+                                                  typename Node<ctype>::NodeType& currType, int& currTri,
+                                                  int& enteringEdge, std::vector<PathVertex<ctype> >& edgePath,
+                                                  int offset);
+
+    EdgeWalkStatus testInsertEdgeFromCornerNode(const std::vector<StaticVector<ctype,3> >& normals, 
+                                                int from, int to, ctype& lambda,
+                                                NodeBundle& curr, 
+                                                typename Node<ctype>::NodeType& currType, int& currTri,
+                                                int& enteringEdge, std::vector<PathVertex<ctype> >& edgePath,
+                                                int offset);
 
     void addCornerNodeBundle(int v, 
                              int nN
@@ -120,6 +185,45 @@ protected:
     /** \brief Get the type of the nodes in a bundle (it must be the same for all) */
     typename Node<ctype>::NodeType type(const NodeBundle& b) const;
 
+    /** \brief Number of triangles that a point or ray is tested against at once
+     *
+     * The Newton iterations of computeInverseNormalProjections() and the ray tests
+     * of rayIntersectsTriangles() run in that many SIMD lanes, hence multiples of
+     * the SIMD width (4, 8, or 16) are good choices.
+     *
+     * If PSURFACE_SCALAR_KERNELS is defined at compile time, the batched methods
+     * call the scalar ones for each triangle instead.  This is meant for validation,
+     * both give the same results.
+     */
+    enum {projectionBatchSize = 8};
+
+    /** \brief Compute the inverse normal projections of a point onto several domain triangles
+     *
+     * Does the same as computeInverseNormalProjection() for each of the triangles.
+     * Those for which the closed-form solution fails are handed to Newton's method
+     * together, one per SIMD lane, and each lane stops once it has reached a fixed point.
+     *
+     * \param tris The domain triangles, at most projectionBatchSize of them
+     * \param n The number of triangles
+     * \param normals The domain vertex normals
+     * \param target The point to be projected
+     * \param x The result for each triangle, valid if success is set for it
+     * \param success Whether the point has an inverse projection onto each triangle
+     */
+    void computeInverseNormalProjections(const int* tris, int n,
+                                         const std::vector<StaticVector<ctype,3> >& normals,
+                                         const StaticVector<ctype,3>& target,
+                                         StaticVector<ctype,3>* x, bool* success);
+
+    /** \brief The closed-form part of computeInverseNormalProjection()
+     *
+     * \return 1 if the projection has been found, 0 if there is none, and -1 if
+     *         Newton's method is needed to decide
+     */
+    int directInverseNormalProjection(const StaticVector<ctype,3>& p0, const StaticVector<ctype,3>& p1, const StaticVector<ctype,3>& p2,
+                                      const StaticVector<ctype,3>& n0, const StaticVector<ctype,3>& n1, const StaticVector<ctype,3>& n2,
+                                      const StaticVector<ctype,3>& target, StaticVector<ctype,3>& x);
+
     /** basically by solving the nonlinear system of equations 
      * \f$ F(x) := x_0 (p_0 - p_1) + x_1 (p_1 - p_2) + x_2 x_0(n_0 - n_2) + x_2 x_1 (n_1 - n_2)
      * + x_2 n_2 + p_2 - p = 0\f$ using standard Newton iteration.
@@ -144,6 +248,60 @@ protected:
                                ctype& normalDist,
                                ctype eps);
 
+    /** \brief The closed-form part of edgeIntersectsNormalFan()
+     *
+     * \return 1 if an intersection has been found, 0 if there is none, and -1 if
+     *         Newton's method is needed to decide
+     */
+    int directEdgeIntersectsNormalFan(const StaticVector<ctype,3>& q0, const StaticVector<ctype,3>& q1,
+                                      const StaticVector<ctype,3>& p0, const StaticVector<ctype,3>& p1,
+                                      const StaticVector<ctype,3>& n0, const StaticVector<ctype,3>& n1,
+                                      StaticVector<ctype,3>& x);
+
+    /** \brief Test a target edge against the normal fans of the edges of a domain triangle
+     *
+     * Does the same as edgeIntersectsNormalFan() for each edge i, which is the edge
+     * from corner i to corner (i+1)%3 of the triangle.  The edges for which the
+     * closed-form solution fails are handed to Newton's method together.
+     * Edges where Newton's method does not converge are silently reported as not hit.
+     *
+     * \param q0, q1 The ends of the target edge
+     * \param tri The domain triangle
+     * \param skipEdge An edge that is not tested, e.g. the one the target edge has entered through, or -1
+     * \param x The intersection for each edge, valid if hit is set for it
+     * \param hit Whether the target edge intersects the normal fan of each edge
+     */
+    void triangleEdgesIntersectNormalFan(const StaticVector<ctype,3>& q0, const StaticVector<ctype,3>& q1,
+                                         int tri, int skipEdge,
+                                         const std::vector<StaticVector<ctype,3> >& normals,
+                                         StaticVector<ctype,3>* x, bool* hit);
+
+    /** \brief Test a ray against several triangles
+     *
+     * Does the same as rayIntersectsTriangle() for each triangle (a[k], b[k], c[k]),
+     * with one triangle per SIMD lane.
+     *
+     * \param n The number of triangles, at most projectionBatchSize
+     * \param hit Whether the ray intersects each triangle
+     */
+    void rayIntersectsTriangles(const StaticVector<ctype,3>& basePoint,
+                                const StaticVector<ctype,3>& direction,
+                                const StaticVector<ctype,3>* a, const StaticVector<ctype,3>* b, const StaticVector<ctype,3>* c,
+                                int n,
+                                StaticVector<ctype,2>* localCoords,
+                                ctype* normalDist,
+                                bool* hit,
+                                ctype eps);
+
+    /** \brief Finds the closest target triangle hit by a ray
+     *
+     * Collects candidate triangles, tests them with rayIntersectsTriangles() in batches,
+     * and keeps the closest hit.  Also serves as the visitor of an octree traversal
+     * along the ray, see MultiDimOctree::traverseSegment().
+     */
+    struct ClosestRayHit;
+    friend struct ClosestRayHit;
+
     // ///////////////////////////////////////////////////////////////
     //   A few static methods for the 1d-in-2d case.
     // ///////////////////////////////////////////////////////////////
@@ -175,6 +333,9 @@ protected:
 
     PSurface<2,ctype>* psurface_;
 
+    /** \brief Whether domain vertices missed by their normal rays are mapped to the closest target point */
+    bool closestPointFallback_;
+
 };
 
 } // namespace psurface
@@ -0,0 +1,60 @@
+/**
+ * @file
+ * @brief caller-owned state of the const octree lookups
+ */
+#ifndef OCTREE_LOOKUP_SCRATCH_H
+#define OCTREE_LOOKUP_SCRATCH_H
+
+#include <vector>
+#include <algorithm>
+
+namespace psurface {
+
+/** Per-query state of the const lookup methods of MultiDimOctree and LinearOctree.
+ *
+ *  A unique lookup marks each element when it is found for the first time.
+ *  Instead of clearing these marks after the query, the scratch stamps the
+ *  elements with a counter that is increased with every query.  The tree
+ *  itself is not changed by a lookup, hence several threads can query the
+ *  same tree at once, as long as each of them uses a scratch object of its own.
+ */
+class OctreeLookupScratch
+{
+public:
+
+    OctreeLookupScratch() : stamp_(0) {}
+
+    /// Starts a new query over the elements 0, ..., n-1
+    void newQuery(size_t n)
+    {
+        if (stamps_.size() != n) {
+            stamps_.assign(n, 0);
+            stamp_ = 0;
+        }
+
+        // Reset the stamps when the counter wraps around
+        if (++stamp_ == 0) {
+            std::fill(stamps_.begin(), stamps_.end(), 0);
+            stamp_ = 1;
+        }
+    }
+
+    /// Marks element k, returns false if it has been marked before during the current query
+    bool mark(size_t k)
+    {
+        if (stamps_[k] == stamp_)
+            return false;
+        stamps_[k] = stamp_;
+        return true;
+    }
+
+private:
+
+    std::vector<unsigned int> stamps_;
+
+    unsigned int stamp_;
+};
+
+} // namespace psurface
+
+#endif
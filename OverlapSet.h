@@ -0,0 +1,163 @@
+#ifndef OVERLAP_SET_H
+#define OVERLAP_SET_H
+
+#include <cstddef>
+#include <vector>
+
+#include "IntersectionPrimitive.h"
+
+namespace psurface {
+
+/** \brief A set of IntersectionPrimitives, stored as a structure of arrays
+ *
+ * Holds the same information as a std::vector<IntersectionPrimitive<dim,ctype> >,
+ * but each scalar component is kept in a contiguous array of its own.  For example,
+ * the x coordinates of the first points of all overlaps are
+ * <tt>points[0][0][0], points[0][0][1], ...</tt>.  Loops over the overlaps, like
+ * the quadrature loops of a mortar assembly, can then be vectorized by the compiler.
+ *
+ \tparam dim Dimension of the coupling surfaces
+ \tparam ctype Type used for coordinates
+ */
+template <int dim, class ctype>
+class OverlapSet {
+
+public:
+
+    /** \brief Dimension of the world space */
+    enum {dimworld = dim+1};
+
+    /** \brief Number of vertices of a dim-dimensional simplex */
+    enum {nPoints = dim+1};
+
+    /** \brief Create an empty set */
+    OverlapSet() {}
+
+    /** \brief Create a set from an array of IntersectionPrimitives */
+    explicit OverlapSet(const std::vector<IntersectionPrimitive<dim,ctype> >& primitives) {
+        assign(primitives);
+    }
+
+    /** \brief The number of overlaps */
+    std::size_t size() const {
+        return domainElements.size();
+    }
+
+    bool empty() const {
+        return domainElements.empty();
+    }
+
+    /** \brief Remove all overlaps */
+    void clear() {
+        resize(0);
+    }
+
+    /** \brief Reserve memory for n overlaps in all arrays */
+    void reserve(std::size_t n) {
+        domainElements.reserve(n);
+        targetElements.reserve(n);
+        for (int j=0; j<nPoints; j++) {
+            for (int c=0; c<dimworld; c++)
+                points[j][c].reserve(n);
+            for (int c=0; c<dim; c++) {
+                localCoords[0][j][c].reserve(n);
+                localCoords[1][j][c].reserve(n);
+            }
+        }
+    }
+
+    /** \brief Resize all arrays to n overlaps */
+    void resize(std::size_t n) {
+        domainElements.resize(n);
+        targetElements.resize(n);
+        for (int j=0; j<nPoints; j++) {
+            for (int c=0; c<dimworld; c++)
+                points[j][c].resize(n);
+            for (int c=0; c<dim; c++) {
+                localCoords[0][j][c].resize(n);
+                localCoords[1][j][c].resize(n);
+            }
+        }
+    }
+
+    /** \brief Append an overlap */
+    void push_back(const IntersectionPrimitive<dim,ctype>& primitive) {
+        domainElements.push_back(primitive.tris[0]);
+        targetElements.push_back(primitive.tris[1]);
+        for (int j=0; j<nPoints; j++) {
+            for (int c=0; c<dimworld; c++)
+                points[j][c].push_back(primitive.points[j][c]);
+            for (int c=0; c<dim; c++) {
+                localCoords[0][j][c].push_back(primitive.localCoords[0][j][c]);
+                localCoords[1][j][c].push_back(primitive.localCoords[1][j][c]);
+            }
+        }
+    }
+
+    /** \brief Append all overlaps of another set */
+    void append(const OverlapSet& other) {
+        domainElements.insert(domainElements.end(), other.domainElements.begin(), other.domainElements.end());
+        targetElements.insert(targetElements.end(), other.targetElements.begin(), other.targetElements.end());
+        for (int j=0; j<nPoints; j++) {
+            for (int c=0; c<dimworld; c++)
+                points[j][c].insert(points[j][c].end(), other.points[j][c].begin(), other.points[j][c].end());
+            for (int i=0; i<2; i++)
+                for (int c=0; c<dim; c++)
+                    localCoords[i][j][c].insert(localCoords[i][j][c].end(),
+                                                other.localCoords[i][j][c].begin(), other.localCoords[i][j][c].end());
+        }
+    }
+
+    /** \brief Get the k-th overlap as an IntersectionPrimitive */
+    void get(std::size_t k, IntersectionPrimitive<dim,ctype>& primitive) const {
+        primitive.tris[0] = domainElements[k];
+        primitive.tris[1] = targetElements[k];
+        for (int j=0; j<nPoints; j++) {
+            for (int c=0; c<dimworld; c++)
+                primitive.points[j][c] = points[j][c][k];
+            for (int c=0; c<dim; c++) {
+                primitive.localCoords[0][j][c] = localCoords[0][j][c][k];
+                primitive.localCoords[1][j][c] = localCoords[1][j][c][k];
+            }
+        }
+    }
+
+    /** \brief Replace the contents by an array of IntersectionPrimitives */
+    void assign(const std::vector<IntersectionPrimitive<dim,ctype> >& primitives) {
+        clear();
+        reserve(primitives.size());
+        for (std::size_t k=0; k<primitives.size(); k++)
+            push_back(primitives[k]);
+    }
+
+    /** \brief Convert to an array of IntersectionPrimitives */
+    void toPrimitives(std::vector<IntersectionPrimitive<dim,ctype> >& primitives) const {
+        primitives.resize(size());
+        for (std::size_t k=0; k<size(); k++)
+            get(k, primitives[k]);
+    }
+
+    /** \brief The domain element of each overlap, like IntersectionPrimitive::tris[0] */
+    std::vector<int> domainElements;
+
+    /** \brief The target element of each overlap, like IntersectionPrimitive::tris[1] */
+    std::vector<int> targetElements;
+
+    /** \brief The world coordinates of the overlaps, like IntersectionPrimitive::points
+     *
+     * The first index selects the vertex, the second one the component.
+     */
+    std::tr1::array<std::tr1::array<std::vector<ctype>, dimworld>, nPoints> points;
+
+    /** \brief The local coordinates of the overlap vertices, like IntersectionPrimitive::localCoords
+     *
+     * The first index selects the domain resp. target side, the second one
+     * the vertex and the third one the component.
+     */
+    std::tr1::array<std::tr1::array<std::tr1::array<std::vector<ctype>, dim>, nPoints>, 2> localCoords;
+
+};
+
+} // namespace psurface
+
+#endif
@@ -1,6 +1,7 @@
 #include "config.h"
 
 #include <vector>
+#include <algorithm>
 
 // Check for VC9 / VS2008 with installed feature pack.
 #if defined(_MSC_VER) && (_MSC_VER>=1500)
@@ -55,6 +56,9 @@ void PSurface<dim,ctype>::clear()
 {
     surface = NULL;
 
+    hasUpToDatePointLocationStructure = false;
+    hasUpToDateOverlapStructure = false;
+
     iPos.clear();
     SurfaceBase<Vertex<ctype>, Edge, DomainTriangle<ctype> >::clear();
 }
@@ -236,6 +240,7 @@ void PSurface<dim,ctype>::removeExtraEdges()
     }
 
     hasUpToDatePointLocationStructure = false;
+    hasUpToDateOverlapStructure = false;
 }
 
 template <int dim, class ctype>
@@ -277,6 +282,7 @@ void PSurface<dim,ctype>::createPointLocationStructure()
     }
 
     hasUpToDatePointLocationStructure = true;
+    hasUpToDateOverlapStructure = false;
 }
 
 
@@ -687,40 +693,125 @@ int PSurface<dim,ctype>::getImageSurfaceTriangle(int tri,
     int i;
 
     std::tr1::array<GlobalNodeIdx, 3> actualVertices;
-    std::tr1::array<std::vector<int>, 3> trianglesPerNode;
 
     getActualVertices(tri, nds, actualVertices);
 
     assert(surface->trianglesPerPoint.size());
 
+#ifdef PSURFACE_STANDALONE
+    // The three lists are sorted, hence their common triangle can be found
+    // by a sorted-set intersection.  Mostly, no list needs to be copied.
+    std::tr1::array<std::vector<int>, 3> buffers;
+    std::tr1::array<const int*, 3> begin, end;
+
+    for (i=0; i<3; i++)
+        getTargetTriangleRange(actualVertices[i], buffers[i], begin[i], end[i]);
+
+    while (begin[0]!=end[0] && begin[1]!=end[1] && begin[2]!=end[2]) {
+
+        int candidate = std::max(*begin[0], std::max(*begin[1], *begin[2]));
+
+        if (*begin[0]==candidate && *begin[1]==candidate && *begin[2]==candidate)
+            return candidate;
+
+        for (i=0; i<3; i++)
+            begin[i] = std::lower_bound(begin[i], end[i], candidate);
+
+    }
+#else
+    std::tr1::array<std::vector<int>, 3> trianglesPerNode;
+
     for (i=0; i<3; i++)
         trianglesPerNode[i] = getTargetTrianglesPerNode(actualVertices[i]);
 
     for (i=0; i<trianglesPerNode[0].size(); i++) {
 
-#ifdef PSURFACE_STANDALONE
-        if (std::find(trianglesPerNode[1].begin(),
-                      trianglesPerNode[1].end(),
-                      trianglesPerNode[0][i]) != trianglesPerNode[1].end() &&
-            std::find(trianglesPerNode[2].begin(),
-                      trianglesPerNode[2].end(),
-                      trianglesPerNode[0][i]) != trianglesPerNode[2].end())
-            return trianglesPerNode[0][i];
-#else
         if (mcSmallArray::index(trianglesPerNode[1], trianglesPerNode[0][i])!=-1 &&
             mcSmallArray::index(trianglesPerNode[2], trianglesPerNode[0][i])!=-1)
             return trianglesPerNode[0][i];
-#endif
 
     }
+#endif
 
     return -1;
 }
 
+#ifdef PSURFACE_STANDALONE
+template <int dim, class ctype>
+void PSurface<dim,ctype>::getTargetTriangleRange(const GlobalNodeIdx& n, std::vector<int>& buffer,
+                                                 const int*& begin, const int*& end) const
+{
+    const Node<ctype>& cN = this->triangles(n.tri).nodes[n.idx];
+    const ctype eps = 1e-6;
+
+    int point;
+
+    switch (cN.type) {
+    case Node<ctype>::GHOST_NODE: {
+
+        // The triangle the node is on, and the one across the edge it may be on
+        int targetTri = cN.getNodeNumber();
+        int edge = -1;
+
+        if (cN.dP[0] + cN.dP[1] > 1-eps)
+            edge = 0;
+        else if (cN.dP[0] < eps)
+            edge = 1;
+        else if (cN.dP[1] < eps)
+            edge = 2;
+
+        buffer.resize(1);
+        buffer[0] = targetTri;
+
+        if (edge != -1) {
+            int neighbor = surface->triangleNeighbors[targetTri][edge];
+
+            if (neighbor >= 0)
+                buffer.push_back(neighbor);
+            else if (neighbor == -2)
+                getTrianglesPerEdge(surface->triangles[targetTri].points[edge],
+                                    surface->triangles[targetTri].points[(edge+1)%3],
+                                    buffer, targetTri);
+        }
+
+        std::sort(buffer.begin(), buffer.end());
+
+        begin = &buffer[0];
+        end   = begin + buffer.size();
+        return;
+    }
+    case Node<ctype>::INTERSECTION_NODE:
+        //this case should only occur for boundary nodes
+        if (!cN.isBoundary())
+            assert(false);
+
+        point = cN.boundary;
+        break;
+
+    default:
+        point = cN.getNodeNumber();
+    }
+
+    Surface::IndexRange range = surface->trianglesPerPoint[point];
+    begin = range.begin();
+    end   = range.end();
+}
+#endif
+
 template <int dim, class ctype>
 std::vector<int> PSurface<dim,ctype>::getTargetTrianglesPerNode(const GlobalNodeIdx& n) const
 {
     assert(surface->trianglesPerPoint.size());
+
+#ifdef PSURFACE_STANDALONE
+    std::vector<int> buffer;
+    const int* begin;
+    const int* end;
+
+    getTargetTriangleRange(n, buffer, begin, end);
+
+    return std::vector<int>(begin, end);
+#else
     const Node<ctype>& cN = this->triangles(n.tri).nodes[n.idx];
     const ctype eps = 1e-6;
 
@@ -775,7 +866,7 @@ std::vector<int> PSurface<dim,ctype>::getTargetTrianglesPerNode(const GlobalNode
         result[i] = surface->trianglesPerPoint[cN.getNodeNumber()][i];
 
     return result;
-
+#endif
 }
 
 /// This is a service routine only for getTargetTrianglesPerNode
@@ -785,9 +876,9 @@ void PSurface<dim,ctype>::getTrianglesPerEdge(int from, int to, std::vector<int>
     for (int i=0; i<surface->trianglesPerPoint[from].size(); i++) {
 
 #ifdef PSURFACE_STANDALONE
-        if (std::find(surface->trianglesPerPoint[to].begin(),
-                      surface->trianglesPerPoint[to].end(),
-                      surface->trianglesPerPoint[from][i]) != surface->trianglesPerPoint[to].end() &&
+        if (std::binary_search(surface->trianglesPerPoint[to].begin(),
+                               surface->trianglesPerPoint[to].end(),
+                               surface->trianglesPerPoint[from][i]) &&
             surface->trianglesPerPoint[from][i] != exception)
 
 #else
@@ -928,6 +1019,9 @@ int PSurface<dim,ctype>::invertTriangles(int patch)
 
         }
 
+    if (count)
+        hasUpToDateOverlapStructure = false;
+
     return count;
 }
 
@@ -37,6 +37,11 @@ public:
     /** \brief An exception being thrown by code in this class */
     class ParamError {};
 
+    /// Default constructor
+    PSurface()
+        : hasUpToDatePointLocationStructure(false), hasUpToDateOverlapStructure(false), surface(NULL)
+    {}
+
     /// Destructor
     virtual ~PSurface();
 
@@ -263,6 +268,15 @@ protected:
     /// This is a service routine only for getTargetTrianglesPerNode
     void getTrianglesPerEdge(int from, int to, std::vector<int>& tris, int exception) const;
 
+#ifdef PSURFACE_STANDALONE
+    /** \brief The target triangles that contain the image of a node, as a sorted range
+     *
+     * The range points either into Surface::trianglesPerPoint, or into buffer.
+     */
+    void getTargetTriangleRange(const GlobalNodeIdx& n, std::vector<int>& buffer,
+                                const int*& begin, const int*& end) const;
+#endif
+
     /** \brief Internal routine used by map()
      */
     void handleMapOnEdge(int tri, const StaticVector<ctype,2>& p, const StaticVector<ctype,2>& a, const StaticVector<ctype,2>& b,
@@ -282,6 +296,12 @@ public:
         You should not set it deliberately unless you know what you're doing.*/
     bool hasUpToDatePointLocationStructure;
 
+    /** This flag is set by IntersectionPrimitiveCollector::prepare() once the graphs
+        on the domain triangles are set up for the collection of the merged grid.
+        Code that modifies these graphs has to reset it, just like
+        hasUpToDatePointLocationStructure. */
+    bool hasUpToDateOverlapStructure;
+
     /// The image positions of all nodes \deprecated To be replaced by a procedural interface
     std::vector<StaticVector<ctype,3> > iPos;
 
@@ -349,17 +369,57 @@ public:
     /** \brief Convenience function for accessing the position of points on the target surface.
      *
      * Given a point \f$x\f$ on the base grid, this routine returns the position
-     * of \f$\phi(x)\f$.
-     *
-     * \bug This method is a stub, and not actually implemented yet.  It will print an
-     *    error message and abort.
+     * of \f$\phi(x)\f$.  The pair of nodes enclosing \f$x\f$ is found by a binary
+     * search, and the image is interpolated linearly between their images.
      *
-     * @return <tt>true</tt> if everything went correctly, <tt> false</tt> if not.
+     * @param tri The domain segment
+     * @param p Local position on that segment
+     * @param result The image position
+     * @return <tt>true</tt> if everything went correctly, <tt> false</tt> if the point
+     *         has no image on the target surface.
      */
     bool positionMap(int tri, StaticVector<ctype,1>& p, StaticVector<ctype,2>& result) const
     {
-        std::cerr << "Method PSurface<1,...>::positionMap is not implemented yet!" << std::endl;
-        abort();
+        const std::vector<Node>& nodes = domainSegments[tri].nodes;
+
+        if (nodes.size() < 2
+            || p[0] < nodes[0].domainLocalPosition
+            || p[0] > nodes.back().domainLocalPosition)
+            return false;
+
+        // Find the last node that is not right of p, but leave at least one node to its right
+        int lower = 0;
+        int upper = nodes.size()-1;
+        while (upper - lower > 1) {
+            int middle = (lower + upper) / 2;
+            if (nodes[middle].domainLocalPosition <= p[0])
+                lower = middle;
+            else
+                upper = middle;
+        }
+
+        const Node& left  = nodes[lower];
+        const Node& right = nodes[lower+1];
+
+        int targetSegment = left.rightRangeSegment;
+        if (targetSegment == -1)
+            return false;
+
+        // The local positions of both nodes on the target segment.  A node on a target
+        // vertex always has the position 0, but is the end of the segment to its left.
+        ctype l0 = (left.isNodeOnTargetVertex) ? 1 : left.rangeLocalPosition;
+        ctype l1 = right.rangeLocalPosition;
+
+        ctype width = right.domainLocalPosition - left.domainLocalPosition;
+        ctype mu = (width > 0) ? (p[0] - left.domainLocalPosition) / width : 0;
+        ctype local = (1-mu)*l0 + mu*l1;
+
+        const StaticVector<ctype,2>& a = targetVertices[targetSegments[targetSegment][0]];
+        const StaticVector<ctype,2>& b = targetVertices[targetSegments[targetSegment][1]];
+        for (int i=0; i<2; i++)
+            result[i] = (1-local)*a[i] + local*b[i];
+
+        return true;
     }
 
 
@@ -4,7 +4,7 @@
 #include "PSurfaceSmoother.h"
 #include "CircularPatch.h"
 #include "DomainPolygon.h"
-#include "SparseMatrix.h"
+#include "CSRMatrix.h"
 
 
 using namespace psurface;
@@ -35,7 +35,7 @@ void PSurfaceSmoother<ctype>::applyEdgeRelaxation(PSurface<2,ctype>* psurface, i
         keepPatches) {
             applyHorizontalRelaxation(quadri, psurface);
         } else
-            quadri.applyParametrization();
+            quadri.applyParametrization(preconditioner_, workspace_);
 
     // undo the merge
     CircularPatch<float> cutter(2, psurface);
@@ -68,8 +68,8 @@ void PSurfaceSmoother<ctype>::applyEdgeRelaxation(PSurface<2,ctype>* psurface, i
 
     if (psurface->triangles(cE.triangles[0]).patch != psurface->triangles(cE.triangles[1]).patch &&
         keepPatches) {
-        psurface->triangles(cE.triangles[0]).applyParametrization(psurface->iPos);
-        psurface->triangles(cE.triangles[1]).applyParametrization(psurface->iPos);
+        psurface->triangles(cE.triangles[0]).applyParametrization(psurface->iPos, preconditioner_, workspace_);
+        psurface->triangles(cE.triangles[1]).applyParametrization(psurface->iPos, preconditioner_, workspace_);
     }
 
     psurface->triangles(cE.triangles[0]).checkConsistency("PostRelax0");
@@ -82,13 +82,12 @@ void PSurfaceSmoother<ctype>::applyEdgeRelaxation(PSurface<2,ctype>* psurface, i
 
 // Smooth only in horizontal direction
 //
-// TODO: This implementation is wastefull:  We solve for x- and y- coordinates, but then
-// throw away the y-coordinates again.  Doesn't matter much...
+// Only the x-coordinates are solved for, with a single right-hand side
 template <class ctype>
 void PSurfaceSmoother<ctype>::applyHorizontalRelaxation(DomainPolygon& quadri, PSurface<2,ctype>* psurface)
 {
     // compute lambdas
-    SparseMatrix<float> lambda_ij(quadri.nodes.size());
+    CSRMatrix<float> lambda_ij;
 
     quadri.computeFloaterLambdas(lambda_ij, psurface->iPos);
 
@@ -99,9 +98,7 @@ void PSurfaceSmoother<ctype>::applyHorizontalRelaxation(DomainPolygon& quadri, P
         lambda_ij.setEntry(i, i, 1);
 
     // compute the right side, only x-coordinates are interesting
-    Vector<float> b(quadri.nodes.size());
-
-    std::fill(b.begin(), b.end(), StaticVector<float,2>(0));
+    Vector<float,1> b(quadri.nodes.size(), StaticVector<float,1>(0));
 
     for (int i=0; i<quadri.nodes.size(); i++)
         if (!quadri.nodes[i].isINTERIOR_NODE())
@@ -109,14 +106,16 @@ void PSurfaceSmoother<ctype>::applyHorizontalRelaxation(DomainPolygon& quadri, P
 
     // solve the system
     int maxIter=3000;
-    Vector<float> residual(quadri.nodes.size());
-    Vector<float> result = b;
+    Vector<float,1> result(quadri.nodes.size());
 
     // xCoords
     for (int i=0; i<quadri.nodes.size(); i++)
-        result[i] = quadri.nodes[i].domainPos();
+        result[i][0] = quadri.nodes[i].domainPos()[0];
+
+    preconditioner_.setup(lambda_ij);
 
-    lambda_ij.BiCGSTAB(b, result, residual, maxIter, 0.000001);
+    if (!BiCGSTAB(lambda_ij, preconditioner_, b, result, horizontalWorkspace_, maxIter, 0.000001f))
+        throw std::runtime_error("BiCGSTAB did not converge.");
 
     for (size_t i=0; i<quadri.nodes.size(); i++)
         if (quadri.nodes[i].isINTERIOR_NODE())
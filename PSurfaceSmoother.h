@@ -3,6 +3,7 @@
 
 #include "HxParamToolBox.h"
 #include "DomainPolygon.h"
+#include "IterativeSolvers.h"
 
 #include "psurfaceAPI.h"
 
@@ -17,6 +18,9 @@ class PSURFACE_API PSurfaceSmoother
 public:
 
     /** \brief Smooth the parametrization graph across a specific base grid edge
+     *
+     * The memory of the linear solves is kept by the smoother, hence use
+     * the same smoother for all edges.
      *
      * \param psurface The psurface object to be smoothed
      * \param edge The edge to smooth
@@ -24,19 +28,24 @@ public:
      * \param nodeStack Source of temporary memory.  Needs to be given from the outside, to be
      *          persistent across calls
      */
-    static void applyEdgeRelaxation(PSurface<2,ctype>* psurface, int edge, 
+    void applyEdgeRelaxation(PSurface<2,ctype>* psurface, int edge, 
                                     bool keepPatches, std::vector<unsigned int>& nodeStack);
 
     ///
     void applyVertexRelaxation();
 
     ///
-    static void applyHorizontalRelaxation(DomainPolygon& quadri, PSurface<2,ctype>* psurface);
+    void applyHorizontalRelaxation(DomainPolygon& quadri, PSurface<2,ctype>* psurface);
     
 private:
 
     static void moveSubGraph(int startingNode, DomainPolygon& from, int centerNode);
 
+    /** \brief The memory of the linear solves, reused across calls */
+    ILU0Preconditioner<float> preconditioner_;
+    IterativeSolverWorkspace<float,2> workspace_;
+    IterativeSolverWorkspace<float,1> horizontalWorkspace_;
+
 };
 
 }
@@ -10,7 +10,7 @@
 
 #include "PlaneParam.h"
 #include "StaticMatrix.h"
-#include "SparseMatrix.h"
+#include "CSRMatrix.h"
 
 // Check for VC9 / VS2008 without SP1, which lacks the C99 math conformance stuff.
 #if defined(_MSC_VER) && _MSC_VER==1500
@@ -408,9 +408,19 @@ void PlaneParam<ctype>::unflipTriangles(const std::vector<StaticVector<ctype,3>
 ////////////////////////////////////////////////////////////////
 template <class ctype>
 void PlaneParam<ctype>::applyParametrization(const std::vector<StaticVector<ctype,3> >& nodePositions)
+{
+    ILU0Preconditioner<ctype> preconditioner;
+    IterativeSolverWorkspace<ctype> workspace;
+    applyParametrization(nodePositions, preconditioner, workspace);
+}
+
+template <class ctype>
+void PlaneParam<ctype>::applyParametrization(const std::vector<StaticVector<ctype,3> >& nodePositions,
+                                             ILU0Preconditioner<ctype>& preconditioner,
+                                             IterativeSolverWorkspace<ctype,2>& workspace)
 {
     // compute lambdas
-    SparseMatrix<ctype> lambda_ij(nodes.size());
+    CSRMatrix<ctype> lambda_ij;
 
     computeFloaterLambdas(lambda_ij, nodePositions);
 
@@ -433,13 +443,15 @@ void PlaneParam<ctype>::applyParametrization(const std::vector<StaticVector<ctyp
 
     // solve the system
     int maxIter=3000;
-    Vector<ctype> residue(nodes.size());
     Vector<ctype> result(nodes.size());
 
     for (size_t i=0; i<nodes.size(); i++)
       result[i] = nodes[i].domainPos();
 
-    lambda_ij.BiCGSTAB(b, result, residue, maxIter, 1e-6);
+    preconditioner.setup(lambda_ij);
+
+    if (!BiCGSTAB(lambda_ij, preconditioner, b, result, workspace, maxIter, ctype(1e-6)))
+        throw std::runtime_error("BiCGSTAB did not converge.");
 
     for (size_t i=0; i<nodes.size(); i++)
         if (nodes[i].isINTERIOR_NODE())
@@ -454,14 +466,25 @@ void PlaneParam<ctype>::applyParametrization(const std::vector<StaticVector<ctyp
 // computes lambda_ij for the Floater-Parametrization
 ////////////////////////////////////////////////////////
 template <class ctype>
-void PlaneParam<ctype>::computeFloaterLambdas(SparseMatrix<ctype>& lambda_ij,
+void PlaneParam<ctype>::computeFloaterLambdas(CSRMatrix<ctype>& lambda_ij,
                                        const std::vector<StaticVector<ctype,3> >& nodePositions)
 {
     int k, l;
 
-    assert(lambda_ij.nRows()==nodes.size() && lambda_ij.nCols()==nodes.size());
+    // init lambda array: the diagonal, and the neighbors of the interior points
+    std::vector<int> rowStart(nodes.size()+1);
+    std::vector<int> columns;
+
+    rowStart[0] = 0;
+    for (size_t i=0; i<nodes.size(); i++) {
+        columns.push_back(i);
+        if (nodes[i].isINTERIOR_NODE())
+            for (k=0; k<nodes[i].degree(); k++)
+                columns.push_back(nodes[i].neighbors(k));
+        rowStart[i+1] = columns.size();
+    }
 
-    // init lambda array
+    lambda_ij.setPattern(nodes.size(), nodes.size(), rowStart, columns);
 
     // for all interiorPoints do
     for (size_t i=0; i<nodes.size(); i++) {
@@ -536,6 +559,16 @@ void PlaneParam<ctype>::computeFloaterLambdas(SparseMatrix<ctype>& lambda_ij,
 
             }
 
+            // Degenerate stars can give NaN weights, which no solver recovers from.
+            // Use the uniform weights then, like for a failed polar map.
+            for (k=lambda_ij.rowStart[i]; k<lambda_ij.rowStart[i+1]; k++)
+                if (std::isnan(lambda_ij.values[k]))
+                    break;
+
+            if (k < lambda_ij.rowStart[i+1])
+                for (k=0; k<p.degree(); k++)
+                    lambda_ij.setEntry(i, p.neighbors(k), 1/((ctype)p.degree()));
+
         }
     }
 }
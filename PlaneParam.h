@@ -11,7 +11,9 @@
 
 namespace psurface {
 
-template<class T> class SparseMatrix;
+template<class T> class CSRMatrix;
+template<class T> class ILU0Preconditioner;
+template<class T, int N> class IterativeSolverWorkspace;
 
 template <int dim, class ctype>
 class PSurface;
@@ -435,6 +437,15 @@ public:
     ///
     void applyParametrization(const std::vector<StaticVector<ctype,3> >& nodePositions);
 
+    /** \brief Same as above, with the memory of the linear solver given by the caller
+     *
+     * Callers that install many parametrizations keep the preconditioner and the
+     * workspace around, so that their memory is reused from one solve to the next.
+     */
+    void applyParametrization(const std::vector<StaticVector<ctype,3> >& nodePositions,
+                              ILU0Preconditioner<ctype>& preconditioner,
+                              IterativeSolverWorkspace<ctype,2>& workspace);
+
     ///
     void unflipTriangles(const std::vector<StaticVector<ctype,3> >& nodePositions);
 
@@ -457,7 +468,7 @@ public:
 
     void removeExtraEdges();
     
-    void computeFloaterLambdas(SparseMatrix<ctype>& lambda_ij,
+    void computeFloaterLambdas(CSRMatrix<ctype>& lambda_ij,
                                const std::vector<StaticVector<ctype,3> >& nodePositions);
 
     bool polarMap(const StaticVector<ctype,3>& center, const std::vector<StaticVector<ctype,3> > &threeDStarVertices, 
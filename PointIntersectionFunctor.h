@@ -3,6 +3,8 @@
 
 #include "StaticVector.h"
 
+namespace psurface {
+
 /** \brief Functor class needed to insert StaticVector<.,3> objects into a MultiDimOctree
  */
 template <class ctype>
@@ -18,5 +20,6 @@ struct PointIntersectionFunctor
 
 };
 
+} // namespace psurface
 
 #endif
@@ -0,0 +1,11 @@
+#ifndef PSURFACE_SIMD_H
+#define PSURFACE_SIMD_H
+
+// Ask the compiler to vectorize the following loop, if OpenMP 4 is available
+#if defined(_OPENMP) && _OPENMP >= 201307
+#define PSURFACE_SIMD _Pragma("omp simd")
+#else
+#define PSURFACE_SIMD
+#endif
+
+#endif
@@ -4,8 +4,7 @@
 #include <vector>
 #include "Vector.h"
 #include "StaticVector.h"
-#include <stdexcept>
-#include <sstream>
+#include "IterativeSolvers.h"
 
 namespace psurface {
 
@@ -89,89 +88,29 @@ public:
     }
 
     ///
-    Vector<T> multVec(const Vector<T>& v) const {
-        assert(v.size()==nCols());
+    template <int N>
+    Vector<T,N> multVec(const Vector<T,N>& v) const {
+        Vector<T,N> result(nRows());
+        multVec(v, result);
+        return result;
+    }
 
-        Vector<T> result(v.size(), StaticVector<T, 2>(0));
+    /// Compute result = A v for all N components of v, without allocating result
+    template <int N>
+    void multVec(const Vector<T,N>& v, Vector<T,N>& result) const {
+        assert(v.size()==nCols() && result.size()==nRows());
 
-        for (size_t i=0; i<nRows(); i++)
+        for (size_t i=0; i<nRows(); i++) {
+            result[i] = StaticVector<T, N>(0);
             for (size_t j=0; j<data[i].size(); j++)
                 result[i] += data[i][j].value * v[data[i][j].col];
-
-      return result;
+        }
     }
 
     /// another iterative solver for nonsymmetric matrices: BI-CGSTAB
     size_t BiCGSTAB(const Vector<T>& b, Vector<T>& x, Vector<T>& r,
                   const size_t& maxIter, const T& tolerance) const {
-      const float EPSILON=1e-20;
-      const size_t n = numCols;
-
-      T rho, rho_old, alpha, beta, omega, h, norm0;
-      Vector<T> r0(n), p(n, StaticVector<T, 2>(0)), v(n, StaticVector<T, 2>(0)), s(n), t(n);
-
-      r = r0 = b - multVec(x);
-      norm0 = r0.length();
-
-      rho_old = alpha = omega = 1;
-
-      if (r.length() < (tolerance * norm0) || r.length() < 1e-15)
-        return 0;
-
-      for (size_t k = 0; k < maxIter; ++k) {
-        rho = r0 * r;
-
-        if (std::abs(rho) <= EPSILON) {
-          std::ostringstream os;
-          os << "Breakdown in BiCGSTAB - rho "
-             << rho << " <= EPSILON " << EPSILON
-             << " after " << k << " iterations";
-          throw std::runtime_error(os.str());
-        }
-
-        if (std::abs(omega) <= EPSILON) {
-          std::ostringstream os;
-          os << "Breakdown in BiCGSTAB - omega "
-             << omega << " <= EPSILON " << EPSILON
-             << " after " << k << " iterations";
-          throw std::runtime_error(os.str());
-        }
-
-        beta = (rho/rho_old)*(alpha/omega);
-        p = r + beta*(p - omega * v);
-
-        v = multVec(p);
-        h = r0 * v;
-
-        if (std::abs(h) < EPSILON) {
-          std::ostringstream os;
-          os << "Breakdown in BiCGSTAB - h "
-             << h << " < EPSILON " << EPSILON
-             << " after " << k << " iterations";
-          throw std::runtime_error(os.str());
-        }
-
-        alpha = rho/h;
-        x += alpha * p;
-
-        s = r - alpha * v;
-
-        if (s.length() < (tolerance * norm0))
-          return k;
-
-        t = multVec(s);
-        omega = (t*s)/(t*t);
-
-        x += omega * s;
-        r = s - omega*t;
-
-        rho_old = rho;
-
-        if (r.length() < (tolerance * norm0)  || r.length() < 1e-15)
-          return k;
-      }
-
-      throw std::runtime_error("BiCGSTAB did not converge.");
+      return psurface::BiCGSTAB(*this, b, x, r, maxIter, tolerance);
     }
 };
 
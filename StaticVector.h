@@ -123,6 +123,13 @@ public:
         return *this;
     }
 
+    /** \brief Subtraction */
+    StaticVector<T,N>& operator-=(const StaticVector<T,N>& other) {
+        for (size_t i=0; i<N; i++)
+            (*this)[i] -= other[i];
+        return *this;
+    }
+
     /** \brief Division */
     StaticVector<T,N>& operator/=(const T& divisor) {
         for (size_t i=0; i<N; i++)
@@ -51,15 +51,54 @@ void Surface::computeTrianglesPerPoint()
     int nPoints = points.size();
     int nTriangles = triangles.size();
 
-    trianglesPerPoint.resize(nPoints);
+    // count the triangles per point
+    std::vector<int>& offsets = trianglesPerPoint.offsets;
+    offsets.assign(nPoints+1, 0);
+
+    for (int i=0; i<nTriangles; i++)
+        for (int j=0; j<3; j++)
+            offsets[triangles[i].points[j]+1]++;
 
     for (int k=0; k<nPoints; k++)
-        trianglesPerPoint[k].resize(0);
+        offsets[k+1] += offsets[k];
+
+    // fill in the triangles.  They are visited in increasing order, hence each list ends up sorted.
+    trianglesPerPoint.indices.resize(offsets[nPoints]);
+    std::vector<int> next(offsets.begin(), offsets.end()-1);
+
+    for (int i=0; i<nTriangles; i++)
+        for (int j=0; j<3; j++)
+            trianglesPerPoint.indices[next[triangles[i].points[j]]++] = i;
+
+    // find the neighbors across the edges
+    triangleNeighbors.resize(nTriangles);
 
     for (int i=0; i<nTriangles; i++) {
-        Surface::Triangle& tri = triangles[i];
-        trianglesPerPoint[tri.points[0]].push_back(i);
-        trianglesPerPoint[tri.points[1]].push_back(i);
-        trianglesPerPoint[tri.points[2]].push_back(i);
+
+        for (int k=0; k<3; k++) {
+
+            IndexRange from = trianglesPerPoint[triangles[i].points[k]];
+            IndexRange to   = trianglesPerPoint[triangles[i].points[(k+1)%3]];
+
+            int neighbor = -1;
+
+            // intersection of two sorted lists
+            const int* a = from.begin();
+            const int* b = to.begin();
+            while (a!=from.end() && b!=to.end()) {
+                if (*a < *b)
+                    ++a;
+                else if (*b < *a)
+                    ++b;
+                else {
+                    if (*a != i)
+                        neighbor = (neighbor == -1) ? *a : -2;
+                    ++a;
+                    ++b;
+                }
+            }
+
+            triangleNeighbors[i][k] = neighbor;
+        }
     }
 }
@@ -48,6 +48,43 @@ class Surface {
         std::tr1::array<int,3> points;
 
     };
+
+    /// A read-only view of one row of an IndexTable.
+    class IndexRange {
+      public:
+        IndexRange(const int* begin, const int* end) : begin_(begin), end_(end) {}
+
+        const int* begin() const { return begin_; }
+
+        const int* end() const { return end_; }
+
+        size_t size() const { return end_ - begin_; }
+
+        int operator[](size_t i) const { return begin_[i]; }
+
+      private:
+        const int* begin_;
+        const int* end_;
+    };
+
+    /** Lists of indices for a set of objects, all stored in one array (CSR
+        format).  The list of object i is @c indices[offsets[i]] ...
+        @c indices[offsets[i+1]-1]. */
+    class IndexTable {
+      public:
+        /// The number of lists.
+        size_t size() const { return offsets.empty() ? 0 : offsets.size()-1; }
+
+        /// The list of object i.
+        IndexRange operator[](int i) const {
+            const int* base = indices.empty() ? NULL : &indices[0];
+            return IndexRange(base + offsets[i], base + offsets[i+1]);
+        }
+
+        std::vector<int> offsets;
+
+        std::vector<int> indices;
+    };
     
     //@}
 
@@ -61,10 +98,16 @@ class Surface {
     /// Array of all surface triangles (required).
     std::vector<Triangle> triangles;       
 
-    /** Stores for each point all incident triangles. To initialize this
-        array the method @c computeTrianglesPerPoint() has to be called
-        explicitely. */
-    std::vector< std::vector<int> > trianglesPerPoint;
+    /** Stores for each point all incident triangles, in increasing order.
+        To initialize this array the method @c computeTrianglesPerPoint()
+        has to be called explicitely. */
+    IndexTable trianglesPerPoint;
+
+    /** Stores for each triangle the neighbor across each of its edges.  Edge
+        k goes from @c points[k] to @c points[(k+1)%3].  The entry is -1 if
+        the edge is on the boundary, and -2 if more than two triangles share
+        it.  Initialized by @c computeTrianglesPerPoint(). */
+    std::vector<std::tr1::array<int,3> > triangleNeighbors;
 
     //@}
 
@@ -81,7 +124,7 @@ class Surface {
 
     /**@name Internal methods */ //@{
 
-    /** Initializes the array @c trianglePerPoint. */
+    /** Initializes the arrays @c trianglesPerPoint and @c triangleNeighbors. */
     void computeTrianglesPerPoint();
 
     //@}
@@ -0,0 +1,309 @@
+#include "config.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+#include "TargetSurfaceIndex.h"
+#include "BinaryIO.h"
+#include "StaticVector.h"
+
+#ifdef PSURFACE_STANDALONE
+#include "TargetSurface.h"
+#else
+#include "hxsurface/Surface.h"
+#endif
+
+using namespace psurface;
+
+// Identifies index files, and the version of their format
+static const char indexFileMagic[8] = {'P','S','U','R','F','I','D','X'};
+static const int indexFileVersion = 2;
+
+
+/** \brief The bounding box of a triangle, enlarged by the tolerance that rayIntersectsTriangle()
+ *         allows in the local coordinates, and by some round-off
+ */
+template <class ctype, class Points, class Corners>
+static Box<ctype,3> enlargedTriangleBox(const Points& points, const Corners& corners, double eps, ctype& margin)
+{
+    std::tr1::array<ctype,3> lower, upper;
+    for (int k=0; k<3; k++) {
+        lower[k] = upper[k] = points[corners[0]][k];
+        for (int l=1; l<3; l++) {
+            lower[k] = std::min(lower[k], ctype(points[corners[l]][k]));
+            upper[k] = std::max(upper[k], ctype(points[corners[l]][k]));
+        }
+    }
+
+    ctype size = 0, magnitude = 0;
+    for (int k=0; k<3; k++) {
+        size = std::max(size, upper[k] - lower[k]);
+        magnitude = std::max(magnitude, std::max(std::fabs(lower[k]), std::fabs(upper[k])));
+    }
+    margin = 10*eps*size + 100*std::numeric_limits<ctype>::epsilon()*magnitude;
+
+    for (int k=0; k<3; k++) {
+        lower[k] -= margin;
+        upper[k] += margin;
+    }
+    return Box<ctype,3>(lower, upper);
+}
+
+
+/** \brief Add some bytes to a checksum (32-bit FNV-1a) */
+static void addBytesToChecksum(unsigned int& checksum, const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i=0; i<size; i++) {
+        checksum ^= bytes[i];
+        checksum *= 16777619u;
+    }
+}
+
+/** \brief Add the corners of a triangle to a checksum, with their coordinates in single precision */
+template <class Points, class Corners>
+static void addToChecksum(unsigned int& checksum, const Points& points, const Corners& corners)
+{
+    for (int l=0; l<3; l++) {
+        int corner = corners[l];
+        addBytesToChecksum(checksum, &corner, sizeof(int));
+        for (int k=0; k<3; k++) {
+            float x = points[corner][k];
+            addBytesToChecksum(checksum, &x, sizeof(float));
+        }
+    }
+}
+
+static const unsigned int emptyChecksum = 2166136261u;
+
+
+template <class ctype>
+void TargetSurfaceIndex<ctype>::build(const Surface* surface, double eps, const std::vector<int>* triangles)
+{
+    nSurfaceTriangles_ = surface->triangles.size();
+    eps_ = eps;
+    maxMargin_ = 0;
+
+    if (triangles)
+        triangles_ = *triangles;
+    else
+        triangles_.clear();
+
+    checksum_ = emptyChecksum;
+    for (int t=0; t<nSurfaceTriangles_; t++)
+        addToChecksum(checksum_, surface->points, surface->triangles[t].points);
+
+    const size_t nBoxes = (triangles) ? triangles->size() : nSurfaceTriangles_;
+    boxes_.clear();
+    boxes_.reserve(nBoxes);
+
+    for (size_t t=0; t<nBoxes; t++) {
+        ctype margin;
+        boxes_.push_back(enlargedTriangleBox(surface->points, surface->triangles[triangle(t)].points, eps, margin));
+        maxMargin_ = std::max(maxMargin_, margin);
+    }
+
+    buildTree();
+}
+
+
+template <class ctype>
+void TargetSurfaceIndex<ctype>::build(const std::vector<std::tr1::array<ctype,3> >& coords,
+                                      const std::vector<std::tr1::array<int,3> >& triangles, double eps)
+{
+    nSurfaceTriangles_ = triangles.size();
+    eps_ = eps;
+    maxMargin_ = 0;
+    triangles_.clear();
+
+    // The projection sees the vertices as ContactMapping::build() stores them
+    // in the target Surface, in single precision
+    std::vector<StaticVector<float,3> > points(coords.size());
+    for (size_t i=0; i<coords.size(); i++)
+        for (int k=0; k<3; k++)
+            points[i][k] = coords[i][k];
+
+    checksum_ = emptyChecksum;
+    for (int t=0; t<nSurfaceTriangles_; t++)
+        addToChecksum(checksum_, points, triangles[t]);
+
+    boxes_.clear();
+    boxes_.reserve(nSurfaceTriangles_);
+
+    for (int t=0; t<nSurfaceTriangles_; t++) {
+        ctype margin;
+        boxes_.push_back(enlargedTriangleBox(points, triangles[t], eps, margin));
+        maxMargin_ = std::max(maxMargin_, margin);
+    }
+
+    buildTree();
+}
+
+
+template <class ctype>
+bool TargetSurfaceIndex<ctype>::matches(const Surface* surface) const
+{
+    if (int(surface->triangles.size()) != nSurfaceTriangles_)
+        return false;
+
+    unsigned int checksum = emptyChecksum;
+    for (int t=0; t<nSurfaceTriangles_; t++)
+        addToChecksum(checksum, surface->points, surface->triangles[t].points);
+
+    return checksum == checksum_;
+}
+
+
+template <class ctype>
+void TargetSurfaceIndex<ctype>::buildTree()
+{
+    int n = boxes_.size();
+
+    if (n == 0) {
+        tree_.clear();
+        return;
+    }
+
+    Box<ctype,3> boundingBox(boxes_[0]);
+    for (int t=1; t<n; t++) {
+        boundingBox.extendBy(boxes_[t].lower());
+        boundingBox.extendBy(boxes_[t].upper());
+    }
+
+    tree_.init(boundingBox, &functor_);
+    tree_.build(&boxes_[0], &boxes_[0] + n);
+}
+
+
+template <class ctype>
+void TargetSurfaceIndex<ctype>::write(std::ostream& out) const
+{
+    int header[5] = {indexFileVersion, int(sizeof(ctype)), nSurfaceTriangles_, int(boxes_.size()), int(triangles_.size())};
+    writeBinary(out, indexFileMagic, 8);
+    writeBinary(out, header, 5);
+    writeBinary(out, &checksum_, 1);
+    writeBinary(out, &eps_, 1);
+    writeBinary(out, &maxMargin_, 1);
+
+    if (!triangles_.empty())
+        writeBinary(out, &triangles_[0], triangles_.size());
+
+    for (size_t t=0; t<boxes_.size(); t++) {
+        writeBinary(out, &boxes_[t].lower()[0], 3);
+        writeBinary(out, &boxes_[t].upper()[0], 3);
+    }
+
+    if (!boxes_.empty())
+        tree_.write(out, &boxes_[0]);
+}
+
+
+template <class ctype>
+void TargetSurfaceIndex<ctype>::write(const std::string& filename) const
+{
+    std::ofstream file(filename.c_str(), std::ios::binary);
+    if (!file)
+        throw std::runtime_error("Could not create " + filename);
+
+    write(file);
+
+    if (!file)
+        throw std::runtime_error("Could not write " + filename);
+}
+
+
+template <class ctype>
+void TargetSurfaceIndex<ctype>::read(const char* begin, const char* end)
+{
+    const char* pos = begin;
+
+    char magic[8];
+    readBinary(pos, end, magic, 8);
+    if (!std::equal(magic, magic+8, indexFileMagic))
+        throw std::runtime_error("Not a target surface index");
+
+    int header[5];
+    readBinary(pos, end, header, 5);
+    if (header[0] != indexFileVersion)
+        throw std::runtime_error("Unsupported version of the target surface index format");
+    if (header[1] != int(sizeof(ctype)))
+        throw std::runtime_error("The target surface index has been written for another coordinate type");
+
+    int nSurfaceTriangles = header[2];
+    int n = header[3];
+    int nTriangles = header[4];
+    if (nSurfaceTriangles < 0 || n < 0 || (nTriangles != 0 && nTriangles != n))
+        throw std::runtime_error("Invalid target surface index");
+
+    unsigned int checksum;
+    readBinary(pos, end, &checksum, 1);
+
+    double eps;
+    ctype maxMargin;
+    readBinary(pos, end, &eps, 1);
+    readBinary(pos, end, &maxMargin, 1);
+
+    std::vector<int> triangles(nTriangles);
+    if (nTriangles > 0)
+        readBinary(pos, end, &triangles[0], nTriangles);
+    for (int t=0; t<nTriangles; t++)
+        if (triangles[t] < 0 || triangles[t] >= nSurfaceTriangles)
+            throw std::runtime_error("Invalid target surface index");
+    if (nTriangles == 0 && n != nSurfaceTriangles)
+        throw std::runtime_error("Invalid target surface index");
+
+    std::vector<Box<ctype,3> > boxes;
+    boxes.reserve(n);
+    for (int t=0; t<n; t++) {
+        std::tr1::array<ctype,3> lower, upper;
+        readBinary(pos, end, &lower[0], 3);
+        readBinary(pos, end, &upper[0], 3);
+        boxes.push_back(Box<ctype,3>(lower, upper));
+    }
+
+    // The octree points into the boxes, which must not be moved afterwards
+    boxes_.swap(boxes);
+    triangles_.swap(triangles);
+    nSurfaceTriangles_ = nSurfaceTriangles;
+    checksum_ = checksum;
+    eps_ = eps;
+    maxMargin_ = maxMargin;
+
+    // read() replaces the bounding box, hence an uninitialized one is fine here
+    tree_.init(Box<ctype,3>(), &functor_);
+    if (n == 0)
+        return;
+
+    try {
+        tree_.read(pos, end, &boxes_[0], n);
+    } catch (...) {
+        // leave an empty index behind
+        boxes_.clear();
+        triangles_.clear();
+        nSurfaceTriangles_ = 0;
+        checksum_ = emptyChecksum;
+        throw;
+    }
+}
+
+
+template <class ctype>
+void TargetSurfaceIndex<ctype>::read(const std::string& filename)
+{
+    MappedFile file(filename);
+    read(file.begin(), file.end());
+}
+
+
+// ////////////////////////////////////////////////////////
+//   Explicit template instantiations.
+//   If you need more, you can add them here.
+// ////////////////////////////////////////////////////////
+
+namespace psurface {
+  template class PSURFACE_EXPORT TargetSurfaceIndex<float>;
+  template class PSURFACE_EXPORT TargetSurfaceIndex<double>;
+}
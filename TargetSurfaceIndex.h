@@ -0,0 +1,158 @@
+/**
+ * @file
+ * @brief octree of the triangles of a target surface, which can be reused and saved
+ */
+#ifndef TARGET_SURFACE_INDEX_H
+#define TARGET_SURFACE_INDEX_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Box.h"
+#include "LinearOctree.h"
+
+#include "psurfaceAPI.h"
+
+#ifdef PSURFACE_STANDALONE
+namespace psurface { class Surface; }
+#else
+class Surface;
+#endif
+
+namespace psurface {
+
+/** \brief Functor class needed to insert Box objects into an octree */
+template <class ctype>
+struct BoxIntersectionFunctor
+{
+    bool operator()(const std::tr1::array<ctype,3>& lower, const std::tr1::array<ctype,3>& upper,
+                    const Box<ctype,3>& item) const
+    {
+        return lower[0] <= item.upper()[0] && item.lower()[0] <= upper[0]
+            && lower[1] <= item.upper()[1] && item.lower()[1] <= upper[1]
+            && lower[2] <= item.upper()[2] && item.lower()[2] <= upper[2];
+    }
+};
+
+/** \brief An octree of the triangles of a target surface, for several projections onto it
+
+NormalProjector::project() tests the normal rays of the domain vertices against
+the target triangles whose bounding boxes are crossed by the rays, and finds these
+boxes in an octree.  The boxes are enlarged by the tolerance of the ray-triangle
+test.  If there are many projections onto the same target surface, the index can
+be built once and handed to each of them.  It can also be written to a file, and
+read back in later runs, which is much faster than building it.
+
+The file holds the boxes and the structure of the octree, and is read without any
+geometric tests.  Its byte order is the native one.  It also holds a checksum of
+the surface, hence an index of another surface or of a deformed one is detected.
+
+\tparam ctype The type used for coordinates
+*/
+template <class ctype>
+class PSURFACE_API TargetSurfaceIndex
+{
+public:
+
+    /** \brief The type of the octree of the triangle boxes, built once and never changed */
+    typedef LinearOctree<Box<ctype,3>, BoxIntersectionFunctor<ctype>, ctype, 3> TreeType;
+
+    TargetSurfaceIndex()
+        : nSurfaceTriangles_(0), checksum_(2166136261u), eps_(0), maxMargin_(0)
+    {}
+
+    /** \brief Build the index for the triangles of a surface
+     *
+     * \param surface The surface, it has to be the target surface of the projections
+     * \param eps The tolerance of the ray-triangle tests of NormalProjector
+     * \param triangles If given, only these triangles are inserted.  NormalProjector::project()
+     *        accepts indices of all triangles only.
+     */
+    void build(const Surface* surface, double eps = 1e-4, const std::vector<int>* triangles = NULL);
+
+    /** \brief Build the index for a surface given by its vertices and triangles, like in ContactMapping::build()
+     *
+     * \param coords The vertices of the surface
+     * \param triangles The triangles of the surface
+     * \param eps The tolerance of the ray-triangle tests of NormalProjector
+     */
+    void build(const std::vector<std::tr1::array<ctype,3> >& coords,
+               const std::vector<std::tr1::array<int,3> >& triangles, double eps = 1e-4);
+
+    /** \brief Write the index to a binary stream */
+    void write(std::ostream& out) const;
+
+    /** \brief Write the index to a file
+     * \throw std::runtime_error if the file cannot be written
+     */
+    void write(const std::string& filename) const;
+
+    /** \brief Read an index written by write() from a block of memory
+     * \throw std::runtime_error if the data is not a valid index for this coordinate type
+     */
+    void read(const char* begin, const char* end);
+
+    /** \brief Read an index from a file, which is mapped into memory if possible
+     * \throw std::runtime_error if the file cannot be read, or is not a valid index
+     */
+    void read(const std::string& filename);
+
+    /** \brief Whether the index has been built for a surface with the same triangles and vertices
+     *
+     * Compares a checksum of the triangles and of the vertex coordinates, as NormalProjector sees them.
+     */
+    bool matches(const Surface* surface) const;
+
+    /** \brief The number of triangles of the surface the index has been built for */
+    int getNumSurfaceTriangles() const { return nSurfaceTriangles_; }
+
+    /** \brief The tolerance of the ray-triangle tests the boxes have been enlarged for */
+    double getTolerance() const { return eps_; }
+
+    /** \brief The number of triangles in the index */
+    int size() const { return boxes_.size(); }
+
+    /** \brief The triangle of the k-th box */
+    int triangle(int k) const { return (triangles_.empty()) ? k : triangles_[k]; }
+
+    /** \brief The boxes, in the order of the triangles in the index */
+    const Box<ctype,3>* boxes() const { return (boxes_.empty()) ? NULL : &boxes_[0]; }
+
+    /** \brief The largest amount any box has been enlarged by */
+    ctype getMaxMargin() const { return maxMargin_; }
+
+    /** \brief The octree of the boxes, it is valid only if the index is not empty */
+    const TreeType& tree() const { return tree_; }
+
+private:
+
+    // not copyable, the octree points to the boxes
+    TargetSurfaceIndex(const TargetSurfaceIndex&);
+    TargetSurfaceIndex& operator=(const TargetSurfaceIndex&);
+
+    /** \brief Build the octree of the boxes */
+    void buildTree();
+
+    std::vector<Box<ctype,3> > boxes_;
+
+    /** \brief The triangle of each box, empty if all triangles are in the index */
+    std::vector<int> triangles_;
+
+    int nSurfaceTriangles_;
+
+    /** \brief A checksum of the triangles and vertices of the surface */
+    unsigned int checksum_;
+
+    double eps_;
+
+    ctype maxMargin_;
+
+    BoxIntersectionFunctor<ctype> functor_;
+
+    TreeType tree_;
+};
+
+} // namespace psurface
+
+#endif
@@ -49,7 +49,7 @@ void Triangulator::triangulateStar(const std::vector<int> &border, int center,
 void Triangulator::estimateStarError(const std::vector<int> &border, int center,
                                      const QualityRequest &quality, const std::vector<int> &fullStar,
                                      VertexHeap::ErrorValue& qualityValue,
-                                     MultiDimOctree<Edge, EdgeIntersectionFunctor, float, 3>& edgeOctree,
+                                     const MultiDimOctree<Edge, EdgeIntersectionFunctor, float, 3>& edgeOctree,
                                      PSurface<2,float>* par)
 {
     /////////////////////////////////////
@@ -96,7 +96,7 @@ void Triangulator::triangulateHalfStar(const std::vector<int> &border, int cente
 void Triangulator::estimateHalfStarError(const std::vector<int> &border, int center,
                                          const QualityRequest &quality, const std::vector<int> &fullStar,
                                          VertexHeap::ErrorValue& qualityValue,
-                                         MultiDimOctree<Edge, EdgeIntersectionFunctor, float, 3>& edgeOctree,
+                                         const MultiDimOctree<Edge, EdgeIntersectionFunctor, float, 3>& edgeOctree,
                                          PSurface<2,float>* par)
 {
     /////////////////////////////////////
@@ -266,7 +266,7 @@ bool Triangulator::isLegalEdge(const StaticVector<float,2>& a, const StaticVecto
 void Triangulator::evaluate(const CircularPatch<float>* cP, int removedVertex,
                             const QualityRequest &quality, VertexHeap::ErrorValue& error,
                             const std::vector<int> &fullStar,
-                            MultiDimOctree<Edge, EdgeIntersectionFunctor, float, 3>& edgeOctree,
+                            const MultiDimOctree<Edge, EdgeIntersectionFunctor, float, 3>& edgeOctree,
                             const PSurface<2,float>* par)
 {
     error.unblock();
@@ -283,8 +283,10 @@ void Triangulator::evaluate(const CircularPatch<float>* cP, int removedVertex,
         Box<float,3> resultBox;
         cP->getBoundingBox(resultBox);
 
+        // The octree is only read, so that concurrent evaluations may share it
         std::vector<Edge*> tmpCloseEdges;
-        edgeOctree.lookup(resultBox, tmpCloseEdges);
+        OctreeLookupScratch scratch;
+        edgeOctree.lookup(resultBox, tmpCloseEdges, scratch);
 
         for (size_t i=0; i<tmpCloseEdges.size(); i++) {
 
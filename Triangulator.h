@@ -41,7 +41,7 @@ namespace Triangulator {
                                             const QualityRequest &quality, 
                                             const std::vector<int> &fullStar, 
                                             VertexHeap::ErrorValue& qualityValue,
-                                            MultiDimOctree<Edge, EdgeIntersectionFunctor, float, 3>& edgeOctree, 
+                                            const MultiDimOctree<Edge, EdgeIntersectionFunctor, float, 3>& edgeOctree, 
                            PSurface<2,float>* par); 
 
     ///
@@ -49,7 +49,7 @@ namespace Triangulator {
                                                 const QualityRequest &quality,
                                                 const std::vector<int> &fullStar, 
                                                 VertexHeap::ErrorValue& qualityValue,
-                                                MultiDimOctree<Edge, EdgeIntersectionFunctor, float, 3>& edgeOctree, 
+                                                const MultiDimOctree<Edge, EdgeIntersectionFunctor, float, 3>& edgeOctree, 
                                PSurface<2,float>* par); 
 
 
@@ -75,7 +75,7 @@ namespace Triangulator {
                                    const QualityRequest &quality, 
                                    VertexHeap::ErrorValue& qualityValue, 
                                    const std::vector<int> &fullStar, 
-                                   MultiDimOctree<Edge, EdgeIntersectionFunctor, float, 3>& edgeOctree, 
+                                   const MultiDimOctree<Edge, EdgeIntersectionFunctor, float, 3>& edgeOctree, 
                   const PSurface<2,float>* par);
 
 };
@@ -7,12 +7,21 @@
 #include <assert.h>
 
 namespace psurface {
-  template <typename T>
+  /** \brief A vector with N components per entry, for solving with N right-hand sides at once
+   *
+   * \tparam T Type of the components
+   * \tparam N The number of components of each entry
+   */
+  template <typename T, int N = 2>
   class Vector
-    : public std::vector<StaticVector<T, 2> >
+    : public std::vector<StaticVector<T, N> >
   {
   public:
-    typedef StaticVector<T, 2> VType;
+    typedef StaticVector<T, N> VType;
+
+    /** \brief Create an empty vector */
+    Vector()
+    {}
 
     /** \brief Default constructor.  Leaves the vector uninitialized. */
     Vector(const int& n)
@@ -27,15 +36,15 @@ namespace psurface {
     }
 
     /** \brief Copy constructor */
-    Vector(const Vector<T>& other)
+    Vector(const Vector<T,N>& other)
       : std::vector<VType>(other.size())
     {
-      for (int i=0; i<this->size(); i++)
+      for (size_t i=0; i<this->size(); i++)
         (*this)[i] = other[i];
     }
 
     /** \brief Addition */
-    Vector<T>& operator+=(const Vector<T>& other) {
+    Vector<T,N>& operator+=(const Vector<T,N>& other) {
       assert(other.size() == this->size());
 
       for (size_t i=0; i<this->size(); i++)
@@ -45,7 +54,7 @@ namespace psurface {
     }
 
     /** \brief Division */
-    Vector<T>& operator/=(const T& divisor) {
+    Vector<T,N>& operator/=(const T& divisor) {
       for (size_t i=0; i<this->size(); i++)
         (*this)[i] /= divisor;
 
@@ -53,8 +62,8 @@ namespace psurface {
     }
 
     /** \brief Unary minus */
-    friend Vector<T> operator-(const Vector<T>& a) {
-      Vector<T> result(a.size());
+    friend Vector<T,N> operator-(const Vector<T,N>& a) {
+      Vector<T,N> result(a.size());
 
       for (size_t i=0; i<a.size(); i++)
         result[i] = -a[i];
@@ -63,10 +72,10 @@ namespace psurface {
     }
 
     /** \brief Addition */
-    friend Vector<T> operator+(const Vector<T>& a, const Vector<T>& b) {
+    friend Vector<T,N> operator+(const Vector<T,N>& a, const Vector<T,N>& b) {
       assert(a.size() == b.size());
 
-      Vector<T> result(a.size());
+      Vector<T,N> result(a.size());
 
       for (size_t i=0; i<a.size(); i++)
         result[i] = a[i] + b[i];
@@ -75,10 +84,10 @@ namespace psurface {
     }
 
     /** \brief Subtraction */
-    friend Vector<T> operator-(const Vector<T>& a, const Vector<T>& b) {
+    friend Vector<T,N> operator-(const Vector<T,N>& a, const Vector<T,N>& b) {
       assert(a.size() == b.size());
 
-      Vector<T> result(a.size());
+      Vector<T,N> result(a.size());
 
       for (size_t i=0; i<a.size(); i++)
         result[i] = a[i] - b[i];
@@ -87,7 +96,7 @@ namespace psurface {
     }
 
     /** \brief Vector Product */
-    T operator*(const Vector<T>& other) const {
+    T operator*(const Vector<T,N>& other) const {
       assert(this->size() == other.size());
 
       T result = 0;
@@ -99,8 +108,8 @@ namespace psurface {
     }
 
     /** \brief Scalar multiplication from the left */
-    friend Vector<T> operator*(const T& s, const Vector<T>& a) {
-      Vector<T> result(a.size());
+    friend Vector<T,N> operator*(const T& s, const Vector<T,N>& a) {
+      Vector<T,N> result(a.size());
 
       for (size_t i=0; i<a.size(); i++)
         result[i] = s * a[i];
@@ -109,13 +118,13 @@ namespace psurface {
     }
 
     /** \brief Scalar multiplication from the right */
-    friend Vector<T> operator*(const Vector<T>& a, const T& s) {
+    friend Vector<T,N> operator*(const Vector<T,N>& a, const T& s) {
       return s * a;
     }
 
     /** \brief Scalar division */
-    friend Vector<T> operator/(const Vector<T>& a, const T& s) {
-      Vector<T> result(a.size());
+    friend Vector<T,N> operator/(const Vector<T,N>& a, const T& s) {
+      Vector<T,N> result(a.size());
 
       for (size_t i=0; i<a.size(); i++)
         result[i] = a[i] / s;
@@ -124,7 +133,7 @@ namespace psurface {
     }
 
     /** \brief Vector product */
-    T dot(const Vector<T>& a) const {
+    T dot(const Vector<T,N>& a) const {
       return (*this) * a;
     }
 
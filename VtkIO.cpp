@@ -1,9 +1,18 @@
+#include "config.h"
+
 #define  HAVE_AMIRAMESH
 #include <vector>
 #include <string.h>
 #include <memory>
 #include <tr1/memory>
 #include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "StaticVector.h"
 #include "Domains.h"
@@ -11,6 +20,7 @@
 #include "PSurfaceFactory.h"
 #include "VtkIO.h"
 #include "vtuwriter.hh"
+#include "pvtuwriter.hh"
 
 
   template<class ctype,int dim>
@@ -18,125 +28,238 @@
   {
     par = psurface;
 
+    outputType = VTK::ascii;
+
     numVertices  = par->getNumVertices();
     numTriangles = par->getNumTriangles();
 
     numNodes      = 0;
     numParamEdges = 0;
 
+    // Only count here.  The plane graphs are written triangle by triangle
+    // straight from the PSurface, without an intermediate global copy.
     for (int i=0; i<numTriangles; i++) {
         numNodes      += par->triangles(i).nodes.size();
         numParamEdges += par->triangles(i).getNumRegularEdges();
     }
-
-    /////////////////////////////////////////////////////////////////////
-
-    //plane graph on each base grid triangle, saved as a list of nodes and a list of edges.
-    int arrayIdx           = 0;
-    int edgeArrayIdx       = 0;
-
-    nodeType.resize(numNodes);
-    nodePositions.resize(numNodes);
-    parameterEdgeArray.resize(numParamEdges);
-
-    for (int i=0; i<numTriangles; i++) {
-        const DomainTriangle<ctype>& cT = par->triangles(i);
-
-        std::vector<int> newIdx(cT.nodes.size());
-
-        // Copy triangle vertex coordinates, for easier-to-write access
-        StaticVector<ctype,3> cCoords[3];
-        for(int j = 0; j < 3; j++)
-            cCoords[j] = par->vertices(par->triangles(i).vertices[j]);
-
-        for (size_t cN=0; cN<cT.nodes.size(); cN++) {
-
-                for (int k = 0; k < 3; k++)
-                (nodePositions[arrayIdx])[k] = cCoords[0][k]*cT.nodes[cN].domainPos()[0]
-                                              +cCoords[1][k]*cT.nodes[cN].domainPos()[1]
-                                              +cCoords[2][k]*(1 - cT.nodes[cN].domainPos()[0] - cT.nodes[cN].domainPos()[1]);
-                nodeType[arrayIdx] = cT.nodes[cN].type;
-                newIdx[cN] = arrayIdx;
-                arrayIdx++;
-
-        }
-
-        // the parameterEdges for this triangle
-        typename PlaneParam<ctype>::UndirectedEdgeIterator cE;
-        for (cE = cT.firstUndirectedEdge(); cE.isValid(); ++cE){
-            if(cE.isRegularEdge())
-            {
-                parameterEdgeArray[edgeArrayIdx][0] = newIdx[cE.from()];
-                parameterEdgeArray[edgeArrayIdx][1] = newIdx[cE.to()];
-                edgeArrayIdx++;
-            }
-        }
-    }
   };
 
   //write the psurface into vtu file
   template<class ctype,int dim>
-  void psurface::VTKIO<ctype,dim>::createVTU(const std::string& element_filename, const std::string& graph_filename)
+  void psurface::VTKIO<ctype,dim>::createVTU(const std::string& element_filename, const std::string& graph_filename,
+                                              VTK::OutputType outputType)
   {
+    this->outputType = outputType;
+
+    Piece all;
+    makePiece(0, numTriangles, false, all);
+
     std::ofstream element_file;
-    element_file.open(element_filename.c_str());
+    element_file.open(element_filename.c_str(), std::ios::binary);
     if (! element_file.is_open())
       std::cout << "Could not create " << element_filename << std::endl;
-    writeElementDataFile(element_file);
+    writeElementDataFile(element_file, all);
     element_file.close();
 
     if (!graph_filename.empty()) {
       std::ofstream graph_file;
-      graph_file.open(graph_filename.c_str());
+      graph_file.open(graph_filename.c_str(), std::ios::binary);
       if (! graph_file.is_open())
         std::cout << "Could not create " << graph_filename << std::endl;
-      writeGraphDataFile(graph_file);
+      writeGraphDataFile(graph_file, all);
       graph_file.close();
     }
   }
 
+  //write the psurface into partitioned pvtu files
+  template<class ctype,int dim>
+  void psurface::VTKIO<ctype,dim>::createPVTU(const std::string& element_filename, const std::string& graph_filename,
+                                               int numPieces, VTK::OutputType outputType)
+  {
+    this->outputType = outputType;
+
+    if (numPieces <= 0) {
+#ifdef _OPENMP
+      numPieces = omp_get_max_threads();
+#else
+      numPieces = 1;
+#endif
+    }
+    numPieces = std::max(1, std::min(numPieces, numTriangles));
+
+    // Split the triangles such that all pieces have about the same number of nodes,
+    // since the graph files dominate the output.
+    std::vector<Piece> pieces(numPieces);
+    int begin = 0;
+    long nodes = 0;
+    for (int i = 0; i < numPieces; i++) {
+      long nodeTarget = (long(numNodes) * (i+1)) / numPieces;
+      int end = begin;
+      // leave at least one triangle for each of the remaining pieces
+      while (end < numTriangles - (numPieces-1-i) && (nodes < nodeTarget || end == begin))
+        nodes += par->triangles(end++).nodes.size();
+      if (i == numPieces-1)
+        end = numTriangles;
+      makePiece(begin, end, true, pieces[i]);
+      begin = end;
+    }
+
+    writePieces(element_filename, pieces, false);
+
+    if (!graph_filename.empty())
+      writePieces(graph_filename, pieces, true);
+  }
+
+  template<class ctype,int dim>
+  void psurface::VTKIO<ctype,dim>::makePiece(int begin, int end, bool renumberVertices, Piece& piece) const
+  {
+    piece.begin         = begin;
+    piece.end           = end;
+    piece.numNodes      = 0;
+    piece.numParamEdges = 0;
+    piece.vertices.clear();
+
+    for (int i = begin; i < end; i++) {
+      const DomainTriangle<ctype>& cT = par->triangles(i);
+      piece.numNodes      += cT.nodes.size();
+      piece.numParamEdges += cT.getNumRegularEdges();
+      if (renumberVertices)
+        for (int j = 0; j < 3; j++)
+          piece.vertices.push_back(cT.vertices[j]);
+    }
+
+    std::sort(piece.vertices.begin(), piece.vertices.end());
+    piece.vertices.erase(std::unique(piece.vertices.begin(), piece.vertices.end()), piece.vertices.end());
+  }
+
+  template<class ctype,int dim>
+  void psurface::VTKIO<ctype,dim>::writePieces(const std::string& filename, const std::vector<Piece>& pieces,
+                                                bool graph) const
+  {
+    std::string baseName = filename;
+    if (baseName.length() >= 5 && baseName.substr(baseName.length()-5) == ".pvtu")
+      baseName.erase(baseName.length()-5);
+
+    // the pieces are referenced relative to the location of the pvtu file
+    std::string::size_type slash = baseName.rfind('/');
+    std::string pieceDir  = (slash == std::string::npos) ? "" : baseName.substr(0, slash+1);
+    std::string pieceBase = (slash == std::string::npos) ? baseName : baseName.substr(slash+1);
+
+    std::vector<std::string> pieceNames(pieces.size());
+    for (size_t i = 0; i < pieces.size(); i++) {
+      std::ostringstream name;
+      name << pieceBase << "-" << i << ".vtu";
+      pieceNames[i] = name.str();
+    }
+
+    // Every piece gets a stream and a VTUWriter of its own, so they can be written concurrently.
+    // Exceptions must not leave the parallel region; they are reported afterwards.
+    std::vector<std::string> errors(pieces.size());
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (long i = 0; i < long(pieces.size()); i++) {
+      try {
+        std::string pieceFilename = pieceDir + pieceNames[i];
+        std::ofstream file(pieceFilename.c_str(), std::ios::binary);
+        if (! file.is_open())
+          throw std::runtime_error("Could not create " + pieceFilename);
+        if (graph)
+          writeGraphDataFile(file, pieces[i]);
+        else
+          writeElementDataFile(file, pieces[i]);
+      } catch (const std::exception& e) {
+        errors[i] = e.what();
+      }
+    }
+
+    for (size_t i = 0; i < errors.size(); i++)
+      if (!errors[i].empty())
+        throw std::runtime_error(errors[i]);
+
+    std::ofstream file(filename.c_str());
+    if (! file.is_open())
+      throw std::runtime_error("Could not create " + filename);
+
+    VTK::PVTUWriter writer(file, VTK::unstructuredGrid);
+    writer.beginMain();
+
+    if (graph) {
+      writer.beginPointData("nodetype");
+      writer.addArray<ctype>("nodetype", 1);
+      writer.endPointData();
+    } else {
+      writer.beginCellData();
+      writer.addArray<int>("Patch", 1);
+      writer.endCellData();
+    }
+
+    writer.beginPoints();
+    writer.addArray<ctype>("Coordinates", 3);
+    writer.endPoints();
+
+    for (size_t i = 0; i < pieceNames.size(); i++)
+      writer.addPiece(pieceNames[i]);
+
+    writer.endMain();
+  }
+
   //write data file to stream
   template<class ctype,int dim>
-  void psurface::VTKIO<ctype,dim>::writeElementDataFile(std::ostream& s)
+  void psurface::VTKIO<ctype,dim>::writeElementDataFile(std::ostream& s, const Piece& piece) const
   {
     VTK::FileType fileType = VTK::unstructuredGrid;
-    VTK::OutputType outputtype = VTK::ascii;
-    VTK::VTUWriter writer(s, outputtype, fileType);
+    VTK::VTUWriter writer(s, outputType, fileType);
 
-    writer.beginMain(numTriangles, numVertices);
+    writer.beginMain(piece.end - piece.begin, piece.vertices.empty() ? numVertices : piece.vertices.size());
 
     // Points
-    writeElementGridPoints(writer);
+    writeElementGridPoints(writer, piece);
     // Cells
-    writeElementGridCells(writer);
+    writeElementGridCells(writer, piece);
     // Cell data
-    writeElementGridCellData(writer);
+    writeElementGridCellData(writer, piece);
 
     writer.endMain();
+
+    // write the appended section, if required by the output type
+    if (writer.beginAppended()) {
+      writeElementGridPoints(writer, piece);
+      writeElementGridCells(writer, piece);
+      writeElementGridCellData(writer, piece);
+    }
+    writer.endAppended();
   }
 
   //write data file to stream
   template<class ctype,int dim>
-  void psurface::VTKIO<ctype,dim>::writeGraphDataFile(std::ostream& s)
+  void psurface::VTKIO<ctype,dim>::writeGraphDataFile(std::ostream& s, const Piece& piece) const
   {
     VTK::FileType fileType = VTK::unstructuredGrid;
-    VTK::OutputType outputtype = VTK::ascii;
-    VTK::VTUWriter writer(s, outputtype, fileType);
+    VTK::VTUWriter writer(s, outputType, fileType);
 
-    writer.beginMain(numParamEdges, numNodes);
+    writer.beginMain(piece.numParamEdges, piece.numNodes);
 
     // Write nodes types
-    writeGraphNodeTypes(writer);
+    writeGraphNodeTypes(writer, piece);
     // Points
-    writeGraphGridPoints(writer);
+    writeGraphGridPoints(writer, piece);
     // Cells
-    writeGraphGridCells(writer);
+    writeGraphGridCells(writer, piece);
 
     writer.endMain();
+
+    // write the appended section, if required by the output type
+    if (writer.beginAppended()) {
+      writeGraphNodeTypes(writer, piece);
+      writeGraphGridPoints(writer, piece);
+      writeGraphGridCells(writer, piece);
+    }
+    writer.endAppended();
   }
 
   template<class ctype,int dim>
-  void psurface::VTKIO<ctype,dim>::writeGraphNodeTypes(VTK::VTUWriter& writer)
+  void psurface::VTKIO<ctype,dim>::writeGraphNodeTypes(VTK::VTUWriter& writer, const Piece& piece) const
   {
       std::string scalars = "nodetype";
       std::string vectors = "";
@@ -144,9 +267,15 @@
       writer.beginPointData(scalars, vectors);
       {
             std::tr1::shared_ptr<VTK::DataArrayWriter<ctype> > p
-            (writer.makeArrayWriter<ctype>(scalars, 1, numNodes));
-            for (int i = 0; i < numNodes; i++)
-                p->write(nodeType[i]);
+            (writer.makeArrayWriter<ctype>(scalars, 1, piece.numNodes));
+            if(!p->writeIsNoop()) {
+                for (int i = piece.begin; i < piece.end; i++) {
+                    const DomainTriangle<ctype>& cT = par->triangles(i);
+                    for (size_t cN = 0; cN < cT.nodes.size(); cN++)
+                        p->write(cT.nodes[cN].type);
+                }
+            }
+            p->finish();
       } // p needs to go out of scope before we call endPointData()
 
       writer.endPointData();
@@ -154,139 +283,181 @@
 
   // write the positions of vertices
   template<class ctype,int dim>
-  void psurface::VTKIO<ctype,dim>::writeElementGridPoints(VTK::VTUWriter& writer)
+  void psurface::VTKIO<ctype,dim>::writeElementGridPoints(VTK::VTUWriter& writer, const Piece& piece) const
   {
+      int n = piece.vertices.empty() ? numVertices : piece.vertices.size();
+
       writer.beginPoints();
       {
             std::tr1::shared_ptr<VTK::DataArrayWriter<ctype> > p
-            (writer.makeArrayWriter<ctype>("Coordinates", 3, numVertices));
+            (writer.makeArrayWriter<ctype>("Coordinates", 3, n));
             if(!p->writeIsNoop()) {
-                  for(int i = 0; i < numVertices; i++)
+                  for(int i = 0; i < n; i++) {
+                        int v = piece.vertices.empty() ? i : piece.vertices[i];
                         for(int l = 0; l < 3; l++)
-                            p->write((par->vertices(i))[l]);
+                            p->write((par->vertices(v))[l]);
+                  }
             }
+            p->finish();
       }
       writer.endPoints();
   }
 
   template<class ctype,int dim>
-  void psurface::VTKIO<ctype,dim>::writeGraphGridPoints(VTK::VTUWriter& writer)
+  void psurface::VTKIO<ctype,dim>::writeGraphGridPoints(VTK::VTUWriter& writer, const Piece& piece) const
   {
       writer.beginPoints();
       {
             std::tr1::shared_ptr<VTK::DataArrayWriter<ctype> > p
-            (writer.makeArrayWriter<ctype>("Coordinates", 3, numNodes));
+            (writer.makeArrayWriter<ctype>("Coordinates", 3, piece.numNodes));
             if(!p->writeIsNoop()) {
-              for(int i = 0; i < numNodes; i++)
-                for(int l = 0; l < 3; l++)
-                  p->write((nodePositions[i])[l]);
+              for (int i = piece.begin; i < piece.end; i++) {
+                const DomainTriangle<ctype>& cT = par->triangles(i);
+
+                // Copy triangle vertex coordinates, for easier-to-write access
+                StaticVector<ctype,3> cCoords[3];
+                for(int j = 0; j < 3; j++)
+                  cCoords[j] = par->vertices(cT.vertices[j]);
+
+                for (size_t cN = 0; cN < cT.nodes.size(); cN++) {
+                  StaticVector<ctype,2> dP = cT.nodes[cN].domainPos();
+                  for(int l = 0; l < 3; l++)
+                    p->write(cCoords[0][l]*dP[0] + cCoords[1][l]*dP[1] + cCoords[2][l]*(1 - dP[0] - dP[1]));
+                }
+              }
             }
+            p->finish();
       }
       writer.endPoints();
   }
 
   // write the connectivity array
   template<class ctype,int dim>
-  void psurface::VTKIO<ctype,dim>::writeElementGridCells(VTK::VTUWriter& writer)
+  void psurface::VTKIO<ctype,dim>::writeElementGridCells(VTK::VTUWriter& writer, const Piece& piece) const
   {
+      int numPieceTriangles = piece.end - piece.begin;
+
       writer.beginCells();
       // connectivity
       {
           std::tr1::shared_ptr<VTK::DataArrayWriter<int> > p1
-          (writer.makeArrayWriter<int>("connectivity", 1, 3*numTriangles));
+          (writer.makeArrayWriter<int>("connectivity", 1, 3*numPieceTriangles));
           if(!p1->writeIsNoop())
           {
-              for(int i = 0; i < numTriangles; i++)
-                  for( int l = 0; l < 3; l++)
-                      p1->write(par->triangles(i).vertices[l]);
+              for(int i = piece.begin; i < piece.end; i++)
+                  for( int l = 0; l < 3; l++) {
+                      int v = par->triangles(i).vertices[l];
+                      if (!piece.vertices.empty())
+                          v = std::lower_bound(piece.vertices.begin(), piece.vertices.end(), v) - piece.vertices.begin();
+                      p1->write(v);
+                  }
           }
+          p1->finish();
       }
 
       // offsets
       {
           std::tr1::shared_ptr<VTK::DataArrayWriter<int> > p2
-          (writer.makeArrayWriter<int>("offsets", 1, numTriangles));
+          (writer.makeArrayWriter<int>("offsets", 1, numPieceTriangles));
           if(!p2->writeIsNoop()) {
               int offset = 0;
-              for(int i = 0; i < numTriangles; i++)
+              for(int i = 0; i < numPieceTriangles; i++)
               {
                   offset += 3;
                   p2->write(offset);
               }
           }
+          p2->finish();
       }
 
       // types
       {
           std::tr1::shared_ptr<VTK::DataArrayWriter<unsigned char> > p3
-          (writer.makeArrayWriter<unsigned char>("types", 1, numTriangles));
+          (writer.makeArrayWriter<unsigned char>("types", 1, numPieceTriangles));
           if(!p3->writeIsNoop())
           {
-              for(int i = 0; i < numTriangles;i++)
+              for(int i = 0; i < numPieceTriangles;i++)
               p3->write(5); //vtktype of triangle
           }
+          p3->finish();
       }
 
       writer.endCells();
   }
 
   template<class ctype,int dim>
-  void psurface::VTKIO<ctype,dim>::writeGraphGridCells(VTK::VTUWriter& writer)
+  void psurface::VTKIO<ctype,dim>::writeGraphGridCells(VTK::VTUWriter& writer, const Piece& piece) const
   {
       writer.beginCells();
       // connectivity
       {
           std::tr1::shared_ptr<VTK::DataArrayWriter<int> > p1
-          (writer.makeArrayWriter<int>("connectivity", 1, 2*numParamEdges));
+          (writer.makeArrayWriter<int>("connectivity", 1, 2*piece.numParamEdges));
           if(!p1->writeIsNoop())
           {
-            for (size_t i = 0; i < parameterEdgeArray.size(); i++)
-              for(int l = 0; l < 2; l++)
-                p1->write((parameterEdgeArray[i])[l]);
+            // the nodes of each triangle are numbered consecutively, starting
+            // after the nodes of all previous triangles of the piece
+            int nodeOffset = 0;
+            for (int i = piece.begin; i < piece.end; i++) {
+              const DomainTriangle<ctype>& cT = par->triangles(i);
+
+              typename PlaneParam<ctype>::UndirectedEdgeIterator cE;
+              for (cE = cT.firstUndirectedEdge(); cE.isValid(); ++cE)
+                if (cE.isRegularEdge()) {
+                  p1->write(nodeOffset + cE.from());
+                  p1->write(nodeOffset + cE.to());
+                }
+
+              nodeOffset += cT.nodes.size();
+            }
           }
+          p1->finish();
       }
 
       // offsets
       {
           std::tr1::shared_ptr<VTK::DataArrayWriter<int> > p2
-          (writer.makeArrayWriter<int>("offsets", 1, numParamEdges));
+          (writer.makeArrayWriter<int>("offsets", 1, piece.numParamEdges));
           if(!p2->writeIsNoop()) {
               int offset = 0;
-              for (size_t i = 0; i < parameterEdgeArray.size(); i++)
+              for (int i = 0; i < piece.numParamEdges; i++)
                 {
                   offset += 2;
                   p2->write(offset);
                 }
           }
+          p2->finish();
       }
 
       // types
       {
           std::tr1::shared_ptr<VTK::DataArrayWriter<unsigned char> > p3
-          (writer.makeArrayWriter<unsigned char>("types", 1, numParamEdges));
+          (writer.makeArrayWriter<unsigned char>("types", 1, piece.numParamEdges));
           if(!p3->writeIsNoop())
           {
-            for (size_t i = 0; i < parameterEdgeArray.size(); i++)
+            for (int i = 0; i < piece.numParamEdges; i++)
               p3->write(3);//vtktype of edges
           }
+          p3->finish();
       }
 
       writer.endCells();
   }
 
   template<class ctype,int dim>
-  void psurface::VTKIO<ctype,dim>::writeElementGridCellData(VTK::VTUWriter& writer)
+  void psurface::VTKIO<ctype,dim>::writeElementGridCellData(VTK::VTUWriter& writer, const Piece& piece) const
   {
     writer.beginCellData();
 
     // patch numbers
     {
       std::tr1::shared_ptr<VTK::DataArrayWriter<int> > p
-        (writer.makeArrayWriter<int>("Patch", 1, numTriangles));
+        (writer.makeArrayWriter<int>("Patch", 1, piece.end - piece.begin));
       if(!p->writeIsNoop()) {
-        for(int i = 0; i < numTriangles; i++)
+        for(int i = piece.begin; i < piece.end; i++)
           p->write(par->triangles(i).patch);
       }
+      p->finish();
     }
 
     writer.endCellData();
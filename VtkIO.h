@@ -4,6 +4,8 @@
 #include <vector>
 #include <string>
 
+#include "common.hh"
+
 namespace psurface{
 
 // Forward declaration
@@ -17,14 +19,6 @@ class VTKIO{
     /// Psurface object to be read to vtu file.
     PSurface<dim,ctype>* par;
 
-    /// Global coordinate of nodes
-    std::vector<StaticVector<ctype,3> > nodePositions;
-    /// Parameter Edge endpoints in global index
-    std::vector<StaticVector<int,2> > parameterEdgeArray;
-
-    ///Node type
-    std::vector<typename Node<ctype>::NodeType>  nodeType;
-
     /// Number of triangle vertices
     int numVertices;
     /// Number of base grid triangles
@@ -34,37 +28,79 @@ class VTKIO{
     /// Number of ParamEdge
     int numParamEdges;
 
+    /// How the data arrays are encoded in the vtu files
+    VTK::OutputType outputType;
+
+    /// A contiguous range of base grid triangles that is written to one file
+    struct Piece {
+        /// First triangle of the piece
+        int begin;
+        /// One past the last triangle of the piece
+        int end;
+        /// Number of nodes on the triangles of the piece
+        int numNodes;
+        /// Number of ParamEdges on the triangles of the piece
+        int numParamEdges;
+        /// Sorted global indices of the base grid vertices used by the piece.
+        /// If this is empty, all vertices are written and no renumbering takes place.
+        std::vector<int> vertices;
+    };
+
     public:
     VTKIO(PSurface<dim,ctype>* psurface);
 
     ///write the parametrization into vtu file
-    void createVTU(const std::string& element_filename, const std::string& graph_filename);
+    /** \param element_filename File for the base grid triangles
+        \param graph_filename File for the plane graphs; nothing is written if this is empty
+        \param outputType How the data arrays are encoded (ascii, inline or appended binary, compressed)
+    */
+    void createVTU(const std::string& element_filename, const std::string& graph_filename,
+                   VTK::OutputType outputType = VTK::ascii);
+
+    ///write the parametrization into partitioned pvtu files
+    /** The base grid triangles are split into pieces with roughly the same number of nodes.
+        Each piece is written to a vtu file of its own, concurrently if OpenMP is available,
+        and the given pvtu files list the pieces.  The piece of number i of foo.pvtu is
+        written to foo-i.vtu.
+        \param element_filename pvtu file for the base grid triangles
+        \param graph_filename pvtu file for the plane graphs; nothing is written if this is empty
+        \param numPieces Number of pieces; if this is not positive, one piece per OpenMP thread is written
+        \param outputType How the data arrays are encoded (ascii, inline or appended binary, compressed)
+    */
+    void createPVTU(const std::string& element_filename, const std::string& graph_filename,
+                    int numPieces = 0, VTK::OutputType outputType = VTK::ascii);
 
 private:
+    /// set up the piece with the triangles [begin, end)
+    void makePiece(int begin, int end, bool renumberVertices, Piece& piece) const;
+
+    /// write the pieces of a pvtu file and the pvtu file itself
+    void writePieces(const std::string& filename, const std::vector<Piece>& pieces, bool graph) const;
+
     ///write data file to stream
-    void writeElementDataFile(std::ostream& s);
+    void writeElementDataFile(std::ostream& s, const Piece& piece) const;
 
     /// write the positions of vertices
-    void writeElementGridPoints(VTK::VTUWriter& writer);
+    void writeElementGridPoints(VTK::VTUWriter& writer, const Piece& piece) const;
 
     /// write the connectivity array
-    void writeElementGridCells(VTK::VTUWriter& writer);
+    void writeElementGridCells(VTK::VTUWriter& writer, const Piece& piece) const;
 
     /// write cell data
-    void writeElementGridCellData(VTK::VTUWriter& writer);
+    void writeElementGridCellData(VTK::VTUWriter& writer, const Piece& piece) const;
 
 
     ///write data file to stream
-    void writeGraphDataFile(std::ostream& s);
+    void writeGraphDataFile(std::ostream& s, const Piece& piece) const;
 
     /// write point data
-    void writeGraphNodeTypes(VTK::VTUWriter& writer);
+    void writeGraphNodeTypes(VTK::VTUWriter& writer, const Piece& piece) const;
 
     /// write the positions of vertices
-    void writeGraphGridPoints(VTK::VTUWriter& writer);
+    void writeGraphGridPoints(VTK::VTUWriter& writer, const Piece& piece) const;
 
     /// write the connectivity array
-    void writeGraphGridCells(VTK::VTUWriter& writer);
+    void writeGraphGridCells(VTK::VTUWriter& writer, const Piece& piece) const;
 };
 }// namespace psurface
 #endif
@@ -5,6 +5,13 @@
 #define PSURFACE_B64ENC_HH
 
 #include <assert.h>
+#include <cstddef>
+
+#if defined __AVX2__
+#include <immintrin.h>
+#elif defined __SSSE3__
+#include <tmmintrin.h>
+#endif
 
 namespace psurface{
 
@@ -72,6 +79,136 @@ namespace psurface{
     b64data data;
   };
 
+  /** @brief number of base64 characters needed to encode n bytes, including padding */
+  inline std::size_t b64size(std::size_t n)
+  {
+    return (n + 2) / 3 * 4;
+  }
+
+#if defined __SSSE3__
+  /** @brief turn 16 six-bit values (one per byte) into their base64 characters */
+  inline __m128i b64lookup(const __m128i indices)
+  {
+    // Map the ranges [0,26), [26,52), [52,62), 62, 63 to an offset that is added
+    // to the index.  First compute a small key per range, then fetch the offset
+    // by a byte shuffle.
+    const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                          '/' - 63, 'A', 0, 0);
+    __m128i key = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    key = _mm_or_si128(key, _mm_and_si128(less, _mm_set1_epi8(13)));
+    return _mm_add_epi8(_mm_shuffle_epi8(offsets, key), indices);
+  }
+
+  /** @brief split 12 input bytes, arranged as [b1, b0, b2, b1] per 32-bit lane, into 16 six-bit values */
+  inline __m128i b64unpack(const __m128i in)
+  {
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+  }
+#endif
+
+#if defined __AVX2__
+  /** @brief AVX2 version of b64lookup, for 32 values */
+  inline __m256i b64lookup(const __m256i indices)
+  {
+    const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                             '/' - 63, 'A', 0, 0,
+                                             'a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                             '/' - 63, 'A', 0, 0);
+    __m256i key = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    key = _mm256_or_si256(key, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+    return _mm256_add_epi8(_mm256_shuffle_epi8(offsets, key), indices);
+  }
+
+  /** @brief AVX2 version of b64unpack, for 24 bytes */
+  inline __m256i b64unpack(const __m256i in)
+  {
+    const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    return _mm256_or_si256(t1, t3);
+  }
+#endif
+
+  /** @brief base64 encode a whole buffer
+   *
+   * @param in  The data to encode.
+   * @param n   Number of bytes to encode.
+   * @param out Output buffer, must have room for b64size(n) characters.
+   * @return    The number of characters written, i.e. b64size(n).
+   *
+   * The output is the same as that of feeding the bytes one by one through a
+   * b64chunk.  The bulk of the data is encoded 24 (AVX2) or 12 (SSSE3) bytes
+   * at a time if the code is compiled with support for these instruction
+   * sets, the rest by a scalar loop.
+   */
+  inline std::size_t b64encode(const char* in, std::size_t n, char* out)
+  {
+    const unsigned char* src = reinterpret_cast<const unsigned char*>(in);
+    char* dst = out;
+    std::size_t i = 0;
+
+#if defined __SSSE3__
+    // Order the three input bytes of each output quadruple such that every
+    // 32-bit lane holds them as [b1, b0, b2, b1], see b64unpack.
+    const __m128i spread = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+                                        4, 5, 3, 4, 1, 2, 0, 1);
+#endif
+
+#if defined __AVX2__
+    // Each iteration reads 28 bytes and consumes 24 of them.
+    const __m256i spread2 = _mm256_broadcastsi128_si256(spread);
+    for (; i + 28 <= n; i += 24, dst += 32) {
+      const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 12));
+      __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+      v = _mm256_shuffle_epi8(v, spread2);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), b64lookup(b64unpack(v)));
+    }
+#endif
+
+#if defined __SSSE3__
+    // Each iteration reads 16 bytes and consumes 12 of them.
+    for (; i + 16 <= n; i += 12, dst += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      v = _mm_shuffle_epi8(v, spread);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), b64lookup(b64unpack(v)));
+    }
+#endif
+
+    for (; i + 3 <= n; i += 3, dst += 4) {
+      const unsigned int chunk = (unsigned(src[i]) << 16) | (unsigned(src[i+1]) << 8) | src[i+2];
+      dst[0] = base64table[(chunk >> 18) & 63];
+      dst[1] = base64table[(chunk >> 12) & 63];
+      dst[2] = base64table[(chunk >> 6) & 63];
+      dst[3] = base64table[chunk & 63];
+    }
+
+    if (i < n) {
+      const unsigned int chunk = (unsigned(src[i]) << 16)
+        | ((i + 1 < n) ? (unsigned(src[i+1]) << 8) : 0);
+      dst[0] = base64table[(chunk >> 18) & 63];
+      dst[1] = base64table[(chunk >> 12) & 63];
+      dst[2] = (i + 1 < n) ? base64table[(chunk >> 6) & 63] : '=';
+      dst[3] = '=';
+      dst += 4;
+    }
+
+    return dst - out;
+  }
+
   /** @} */
 
 } // namespace Dune
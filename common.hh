@@ -6,6 +6,7 @@
 
 #include <limits>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 
 
@@ -42,12 +43,29 @@ namespace psurface
       //! Ouput is to the file is appended raw binary
       appendedraw,
       //! Ouput is to the file is appended base64 binary
-      appendedbase64
+      appendedbase64,
       // //! Output to the file is compressed inline binary.
       // binarycompressed,
-      // //! Ouput is compressed and appended to the file.
-      // compressedappended
+      //! Ouput is zlib-compressed and appended raw to the file.
+      compressedappended
     };
+
+    //! get the OutputType belonging to a name
+    /**
+     * \param name One of "ascii", "base64", "appendedraw", "appendedbase64"
+     *             or "compressedappended".
+     *
+     * This is mainly useful for parsing command line options.
+     */
+    inline OutputType getOutputType(const std::string& name)
+    {
+      if (name == "ascii")              return ascii;
+      if (name == "base64")             return base64;
+      if (name == "appendedraw")        return appendedraw;
+      if (name == "appendedbase64")     return appendedbase64;
+      if (name == "compressedappended") return compressedappended;
+      throw(std::runtime_error("Unknown VTK output type '" + name + "'"));
+    }
     //! Whether to produce conforming or non-conforming output.
     /**
      * \code
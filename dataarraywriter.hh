@@ -4,12 +4,20 @@
 #ifndef PSURFACE_DATAARRAYWRITER_HH
 #define PSURFACE_DATAARRAYWRITER_HH
 
+#include <algorithm>
+#include <cstring>
+#include <deque>
 #include <ostream>
 #include <string>
+#include <vector>
 
 #include "indent.hh"
 #include <stdexcept>
 
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #include "streams.hh"
 #include "common.hh"
 
@@ -47,6 +55,8 @@ namespace psurface
      * would be written, the actual writing has to happen later independent of
      * the writer).  Finally, in the destructor, the stream is put back in a
      * sane state.  That usually means writing something line "</DataArray>".
+     * Writers that can fail after the last write() do that work in finish()
+     * instead, which must be called before the writer is destroyed.
      */
     template<class T>
     class DataArrayWriter
@@ -56,6 +66,8 @@ namespace psurface
       virtual void write (T data) = 0;
       //! whether calls to write may be skipped
       virtual bool writeIsNoop() const { return false; }
+      //! complete the array after the last write, throws on failure
+      virtual void finish() {}
       //! virtual destructor
       virtual ~DataArrayWriter () {}
     };
@@ -112,7 +124,11 @@ namespace psurface
       Indent indent;
     };
 
-    //! a streaming writer for data array tags, uses binary inline format
+    //! a writer for data array tags, uses binary inline format
+    /**
+     * The data is collected and base64 encoded in one go when the writer is
+     * destroyed, which is a lot faster than encoding it item by item.
+     */
     template<class T>
     class BinaryDataArrayWriter : public DataArrayWriter<T>
     {
@@ -130,7 +146,7 @@ namespace psurface
        */
       BinaryDataArrayWriter(std::ostream& theStream, std::string name,
                             int ncomps, int nitems, const Indent& indent_)
-        : s(theStream), b64(theStream), indent(indent_)
+        : s(theStream), indent(indent_)
       {
         TypeName<T> tn;
         s << indent << "<DataArray type=\"" << tn() << "\" "
@@ -141,21 +157,24 @@ namespace psurface
         // write indentation for the data chunk
         s << indent+1;
         // store size
-        unsigned long int size = ncomps*nitems*sizeof(T);
-        b64.write(size);
-        b64.flush();
+        unsigned int size = ncomps*nitems*sizeof(T);
+        writeBase64(s, reinterpret_cast<const char*>(&size), sizeof(size));
+
+        data.reserve(size);
       }
 
-      //! write one data element to output stream
-      void write (T data)
+      //! collect one data element
+      void write (T d)
       {
-        b64.write(data);
+        const std::size_t size = data.size();
+        data.resize(size + sizeof(T));
+        std::memcpy(&data[size], &d, sizeof(T));
       }
 
-      //! finish output; writes end tag
+      //! finish output; encodes the data and writes end tag
       ~BinaryDataArrayWriter ()
       {
-        b64.flush();
+        writeBase64(s, data.empty() ? 0 : &data[0], data.size());
         // append newline to written data
         s << "\n";
         s << indent << "</DataArray>\n";
@@ -164,7 +183,7 @@ namespace psurface
 
     private:
       std::ostream& s;
-      Base64Stream b64;
+      std::vector<char> data;
       const Indent& indent;
     };
 
@@ -247,12 +266,153 @@ namespace psurface
       bool writeIsNoop() const { return true; }
     };
 
+#if HAVE_ZLIB
+    //! compress a byte buffer into the block layout of vtkZLibDataCompressor
+    /**
+     * \param in        The uncompressed data.
+     * \param out       Receives the compressed data, including the header.
+     * \param blockSize Uncompressed size of each block.
+     *
+     * The result starts with a header of UInt32 values: the number of
+     * blocks, the block size, the size of the last block if it is only
+     * partially filled (zero otherwise), and then the compressed size of each
+     * block.  The compressed blocks follow the header.  Since the blocks are
+     * compressed independently of each other, this is done in parallel if
+     * OpenMP is available.
+     */
+    inline void zlibCompress(const std::vector<char>& in, std::vector<char>& out,
+                             unsigned int blockSize = 32768)
+    {
+      const long nBlocks = (in.size() + blockSize - 1) / blockSize;
+
+      std::vector<std::vector<Bytef> > blocks(nBlocks);
+      bool failed = false;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+      for (long i = 0; i < nBlocks; i++) {
+        const std::size_t begin = i*std::size_t(blockSize);
+        const uLong size = std::min(std::size_t(blockSize), in.size() - begin);
+
+        uLongf compressedSize = compressBound(size);
+        blocks[i].resize(compressedSize);
+        if (compress2(&blocks[i][0], &compressedSize,
+                      reinterpret_cast<const Bytef*>(&in[begin]), size,
+                      Z_DEFAULT_COMPRESSION) != Z_OK)
+          failed = true;
+        blocks[i].resize(compressedSize);
+      }
+
+      if (failed)
+        throw(std::runtime_error("VTK::zlibCompress: compression with zlib failed"));
+
+      std::vector<unsigned int> header(3 + nBlocks);
+      header[0] = nBlocks;
+      header[1] = blockSize;
+      header[2] = in.size() % blockSize;
+
+      std::size_t totalSize = header.size()*sizeof(unsigned int);
+      for (long i = 0; i < nBlocks; i++) {
+        header[3+i] = blocks[i].size();
+        totalSize += blocks[i].size();
+      }
+
+      out.resize(totalSize);
+      char* p = &out[0];
+      std::memcpy(p, &header[0], header.size()*sizeof(unsigned int));
+      p += header.size()*sizeof(unsigned int);
+      for (long i = 0; i < nBlocks; i++) {
+        if (blocks[i].empty())
+          continue;
+        std::memcpy(p, &blocks[i][0], blocks[i].size());
+        p += blocks[i].size();
+      }
+    }
+
+    //! a writer for data array tags, uses zlib-compressed appended raw format
+    /**
+     * Unlike the other appended writers this one needs the actual data in the
+     * main section already, since the offsets of the following arrays depend
+     * on the compressed size.  The data is compressed by finish(), and the
+     * result is queued until the appended section is written by a
+     * NakedCompressedDataArrayWriter.  Hence all compressed arrays of a file
+     * are held in memory at once.  Writing them as they become ready is not
+     * possible, since the appended section follows the main one.
+     */
+    template<class T>
+    class AppendedCompressedDataArrayWriter : public DataArrayWriter<T>
+    {
+    public:
+      //! make a new data array writer
+      /**
+       * \param s         Stream to write to.
+       * \param name      Name of array to write.
+       * \param ncomps    Number of components of the array.
+       * \param nitems    Number of cells for cell data/Number of vertices for
+       *                  point data.
+       * \param offset_   Byte count variable: this is incremented by the size
+       *                  of the compressed data including its header.
+       * \param blocks_   Queue that receives the compressed data.
+       * \param indent    Indentation to use.  This is uses as-is for the
+       *                  header line.
+       */
+      AppendedCompressedDataArrayWriter(std::ostream& s, std::string name,
+                                        int ncomps, unsigned nitems,
+                                        unsigned& offset_,
+                                        std::deque<std::vector<char> >& blocks_,
+                                        const Indent& indent)
+        : offset(offset_), blocks(blocks_)
+      {
+        TypeName<T> tn;
+        s << indent << "<DataArray type=\"" << tn() << "\" "
+          << "Name=\"" << name << "\" ";
+        s << "NumberOfComponents=\"" << ncomps << "\" ";
+        s << "format=\"appended\" offset=\""<< offset << "\" />\n";
+        data.reserve(ncomps*nitems*sizeof(T));
+      }
+
+      //! collect one data element
+      void write (T d)
+      {
+        const std::size_t size = data.size();
+        data.resize(size + sizeof(T));
+        std::memcpy(&data[size], &d, sizeof(T));
+      }
+
+      //! compress the collected data and account for its size
+      /**
+       * \throws std::runtime_error if the compression fails.  If finish() is
+       * not called, nothing is queued and writing the appended section fails.
+       */
+      void finish()
+      {
+        std::vector<char> compressed;
+        zlibCompress(data, compressed);
+        std::vector<char>().swap(data);
+
+        offset += compressed.size();
+        blocks.push_back(std::vector<char>());
+        blocks.back().swap(compressed);
+      }
+
+    private:
+      std::vector<char> data;
+      unsigned& offset;
+      std::deque<std::vector<char> >& blocks;
+    };
+#endif
+
     //////////////////////////////////////////////////////////////////////
     //
     //  Naked ArrayWriters for the appended section
     //
 
-    //! a streaming writer for appended data array tags, uses base64 format
+    //! a writer for appended data array tags, uses base64 format
+    /**
+     * Like BinaryDataArrayWriter, the data is collected and base64 encoded
+     * in one go when the writer is destroyed.
+     */
     template<class T>
     class NakedBase64DataArrayWriter : public DataArrayWriter<T>
     {
@@ -266,22 +426,32 @@ namespace psurface
        */
       NakedBase64DataArrayWriter(std::ostream& theStream, int ncomps,
                                  int nitems)
-        : b64(theStream)
+        : s(theStream)
       {
         // store size
-        unsigned long int size = ncomps*nitems*sizeof(T);
-        b64.write(size);
-        b64.flush();
+        unsigned int size = ncomps*nitems*sizeof(T);
+        writeBase64(s, reinterpret_cast<const char*>(&size), sizeof(size));
+
+        data.reserve(size);
       }
 
-      //! write one data element to output stream
-      void write (T data)
+      //! collect one data element
+      void write (T d)
+      {
+        const std::size_t size = data.size();
+        data.resize(size + sizeof(T));
+        std::memcpy(&data[size], &d, sizeof(T));
+      }
+
+      //! encode the collected data and write it to the stream
+      ~NakedBase64DataArrayWriter ()
       {
-        b64.write(data);
+        writeBase64(s, data.empty() ? 0 : &data[0], data.size());
       }
 
     private:
-      Base64Stream b64;
+      std::ostream& s;
+      std::vector<char> data;
     };
 
     //! a streaming writer for appended data arrays, uses raw format
@@ -312,6 +482,36 @@ namespace psurface
       }
     };
 
+#if HAVE_ZLIB
+    //! a writer for appended data arrays, writes previously compressed data
+    template<class T>
+    class NakedCompressedDataArrayWriter : public DataArrayWriter<T>
+    {
+    public:
+      //! make a new data array writer
+      /**
+       * \param theStream Stream to write to.
+       * \param blocks    Queue of compressed arrays from the main section.
+       *                  The first one is written and removed.
+       */
+      NakedCompressedDataArrayWriter(std::ostream& theStream,
+                                     std::deque<std::vector<char> >& blocks)
+      {
+        if (blocks.empty())
+          throw(std::runtime_error("NakedCompressedDataArrayWriter: no compressed data left"));
+        if (!blocks.front().empty())
+          theStream.write(&blocks.front()[0], blocks.front().size());
+        blocks.pop_front();
+      }
+
+      //! write one data element to output stream (noop)
+      void write (T data) { }
+
+      //! whether calls to write may be skipped
+      bool writeIsNoop() const { return true; }
+    };
+#endif
+
     //////////////////////////////////////////////////////////////////////
     //
     //  Factory
@@ -331,6 +531,8 @@ namespace psurface
       unsigned offset;
       //! whether we are in the main or in the appended section writing phase
       Phase phase;
+      //! compressed arrays waiting for the appended section, all of them until it is written
+      std::deque<std::vector<char> > compressedBlocks;
 
     public:
       //! create a DataArrayWriterFactory
@@ -365,6 +567,7 @@ namespace psurface
         case base64 :         return false;
         case appendedraw :    return true;
         case appendedbase64 : return true;
+        case compressedappended : return true;
         }
         throw(std::runtime_error("Dune::VTK::DataArrayWriter: unsupported OutputType "));
       }
@@ -380,6 +583,7 @@ namespace psurface
           throw(std::runtime_error("DataArrayWriterFactory::appendedEncoding(): No appended encoding for OutputType "));
         case appendedraw :    return rawString;
         case appendedbase64 : return base64String;
+        case compressedappended : return rawString;
         }
         throw(std::runtime_error("DataArrayWriterFactory::appendedEncoding(): unsupported OutputType " ));
       }
@@ -416,6 +620,16 @@ namespace psurface
             return new AppendedBase64DataArrayWriter<T>(stream, name, ncomps,
                                                         nitems, offset,
                                                         indent);
+          case compressedappended :
+#if HAVE_ZLIB
+            return new AppendedCompressedDataArrayWriter<T>(stream, name,
+                                                            ncomps, nitems,
+                                                            offset,
+                                                            compressedBlocks,
+                                                            indent);
+#else
+            throw(std::runtime_error("VTK::DataArrayWriterFactory: compressed output requires zlib"));
+#endif
           }
           break;
         case appended :
@@ -427,6 +641,13 @@ namespace psurface
             return new NakedRawDataArrayWriter<T>(stream, ncomps, nitems);
           case appendedbase64 :
             return new NakedBase64DataArrayWriter<T>(stream, ncomps, nitems);
+          case compressedappended :
+#if HAVE_ZLIB
+            return new NakedCompressedDataArrayWriter<T>(stream,
+                                                         compressedBlocks);
+#else
+            break;
+#endif
           }
           break;
         }
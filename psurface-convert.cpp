@@ -9,6 +9,7 @@
 #include <fstream>
 #include <memory>
 #include <tr1/memory>
+#include <stdexcept>
 
 #ifdef PSURFACE_STANDALONE
 #include "TargetSurface.h"
@@ -21,6 +22,7 @@
 #include "Hdf5IO.h"
 #include "GmshIO.h"
 #include "VtkIO.h"
+#include "AsyncWriter.h"
 
 #if defined HAVE_AMIRAMESH || !defined PSURFACE_STANDALONE
 #include <amiramesh/AmiraMesh.h>
@@ -32,6 +34,7 @@ enum FileTypes
   AMIRA,
   HDF5,
   VTU,
+  PVTU,
   GMSH
 };
 
@@ -40,19 +43,23 @@ using namespace psurface;
 int main(int argc, char **argv)
 {
     if (argc < 4) {
-      fprintf(stderr, "Usage: psurface_convert -i inputname -o outputname (-t type) \n");
+      fprintf(stderr, "Usage: psurface_convert -i inputname -o outputname [-o outputname ...] (-t type) \n");
       fprintf(stderr, "Input file type could be amiramesh(*.am) , hdf5(*.h5) or gmsh(*.msh).\n");
-      fprintf(stderr, "Output file type could be amiramesh(*.am) , hdf5(*.h5) or vtu(*.vtu).\n");
+      fprintf(stderr, "Output file type could be amiramesh(*.am) , hdf5(*.h5), vtu(*.vtu) or partitioned vtu(*.pvtu, one piece per OpenMP thread).\n");
       fprintf(stderr, "type could be b(basegrid) or r(readable hdf5 file).\n -t b means that the output should only have base grid trianlge(This option is used when the output type is vtu type.\n -t r means that we get readable output hdf5 type data(This option is used when the output type is hdf5).\n");
+      fprintf(stderr, "-e encoding sets the encoding of vtu output: ascii (default), base64, appendedraw, appendedbase64 or compressedappended.\n");
+      fprintf(stderr, "-o may be given several times; all output files are then written concurrently.\n");
       exit(0);
     }
 
     //use get opt to deal with the argv
-    char *input, *output, *type;
+    char *input, *type = NULL;
+    std::vector<char*> outputs;
+    VTK::OutputType vtuEncoding = VTK::ascii;
     bool basegrid = 0, basehdf5 = 1;
     int opt=0;
     int i=0;
-    const char* optstring=":i:o:t:";
+    const char* optstring=":i:o:t:e:";
     const int num=3;
 
     while((opt=getopt(argc,argv,optstring)) != -1)
@@ -63,11 +70,14 @@ int main(int argc, char **argv)
              input = optarg;
              break;
         case 'o':
-             output = optarg;
+             outputs.push_back(optarg);
              break;
         case 't':
              type = optarg;
              break;
+        case 'e':
+             vtuEncoding = VTK::getOutputType(optarg);
+             break;
         case ':':
             printf("the option needs a value\n");
             break;
@@ -85,7 +95,8 @@ int main(int argc, char **argv)
             printf("excess argument:%s/n",argv[optind]);
     }
 
-    FileTypes inputType, outputType;
+    FileTypes inputType;
+    std::vector<FileTypes> outputType(outputs.size());
     if(strstr(input,".am") != NULL || strstr(input,".par") != NULL )
         inputType = AMIRA;
     else if(strstr(input,".h5") != NULL)
@@ -97,22 +108,31 @@ int main(int argc, char **argv)
     else
       printf(" could not tell the input type by file extension\n");
 
-    if(strstr(output,".am") != NULL)
-        outputType = AMIRA;
-    else if(strstr(output,".h5") != NULL)
-    {
-        outputType = HDF5;
-        if( type != NULL && *type == 'r')  basehdf5 = 0;
-    }
-    else if(strstr(output,".vtu") != NULL)
+    for (size_t k = 0; k < outputs.size(); k++)
     {
-        outputType = VTU;
-        if( type != NULL && *type == 'b')  basegrid = 1;
+      const char* output = outputs[k];
+      if(strstr(output,".am") != NULL)
+          outputType[k] = AMIRA;
+      else if(strstr(output,".h5") != NULL)
+      {
+          outputType[k] = HDF5;
+          if( type != NULL && *type == 'r')  basehdf5 = 0;
+      }
+      else if(strstr(output,".pvtu") != NULL)
+      {
+          outputType[k] = PVTU;
+          if( type != NULL && *type == 'b')  basegrid = 1;
+      }
+      else if(strstr(output,".vtu") != NULL)
+      {
+          outputType[k] = VTU;
+          if( type != NULL && *type == 'b')  basegrid = 1;
+      }
+      else if(strstr(output,".msh") != NULL)
+          outputType[k] = GMSH;
+      else
+        printf(" could not tell the output type by file extension\n");
     }
-    else if(strstr(output,".msh") != NULL)
-        outputType = GMSH;
-    else
-      printf(" could not tell the output type by file extension\n");
 
   PSurface<2,float>* par;
 
@@ -163,48 +183,27 @@ int main(int argc, char **argv)
     }
   };
 
-  std::string str(output);
-  switch(outputType)
-   {
-    case HDF5:
-      {
-#if HAVE_HDF5
-        std::string xdmffile(output);
-        xdmffile.erase (xdmffile.end() - 3, xdmffile.end());
-        xdmffile.append(".xdmf");
-        Hdf5IO<float,2>* pn = new Hdf5IO<float,2>(par);
-        pn->createHdfAndXdmf(xdmffile, output,basehdf5);
-#else
-        std::cerr << "You have given an hdf5 output file, but psurface-convert" << std::endl;
-        std::cerr << "has been compiled without hdf5 support!" << std::endl;
-        exit(1);
-#endif
-      }
-      break;
-
-    case VTU:
-      {
-        VTKIO<float,2> pn(par);
-        pn.createVTU(str.c_str(), basegrid ? "" : (str.substr(0, str.length()-std::string(".vtu").length())) + "-graph.vtu");
-      }
-      break;
+  // All output files are written at once, each one on a thread of its own
+  std::vector<AsyncWriter<float,2>::Job*> jobs;
 
-    case AMIRA:
-      {
-#if HAVE_AMIRAMESH
-          PSURFACE_API AmiraMeshIO<float> amIO;
-          amIO.writeAmiraMesh(par, output);
-#else
-        std::cerr << "You have given an AmiraMesh output file, but psurface-convert" << std::endl;
-        std::cerr << "has been compiled without AmiraMesh support!" << std::endl;
-        exit(1);
-#endif
-      }
-      break;
-    default:
-       printf("unknown output type\n");
-//     throw(std::runtime_error("unkown output type\n"));
-   };
+  for (size_t k = 0; k < outputs.size(); k++)
+  {
+    try {
+      jobs.push_back(AsyncWriter<float,2>::makeJob(outputs[k], outputType[k] == HDF5 ? basehdf5 : basegrid, vtuEncoding));
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+    }
+  }
+
+  // Nothing is computed meanwhile, hence the surface can be written without taking a copy
+  AsyncWriter<float,2> writer;
+  try {
+    writer.writeInPlace(par, jobs);
+    writer.wait();
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    exit(1);
+  }
 
   return 0;
 }
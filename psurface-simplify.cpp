@@ -21,6 +21,7 @@
 #include "Hdf5IO.h"
 #include "GmshIO.h"
 #include "VtkIO.h"
+#include "AsyncWriter.h"
 
 #if defined HAVE_AMIRAMESH
 #include <amiramesh/AmiraMesh.h>
@@ -45,6 +46,7 @@ enum FileType
   AMIRA,
   HDF5,
   VTU,
+  PVTU,
   GMSH
 };
 
@@ -69,6 +71,10 @@ void print_usage() {
        << "-d x : set importance of Hausdorff distance to x (default: " << req.hausdorffDistance      << ")" << endl
        << "-b   : set to output just the basegrid           (default: " << "0"                        << ")" << endl
        << "-s   : set to not allow self intersection        (default: " << req.intersections          << ")" << endl
+       << "-e x : set vtu encoding to x, one of ascii, base64, appendedraw," << endl
+       << "       appendedbase64, compressedappended        (default: ascii)" << endl
+       << "-w k : write a snapshot every k removed points, to <outputfilename>" << endl
+       << "       with the point count appended to its base name (default: no snapshots)" << endl
        << endl;
 }
 
@@ -83,6 +89,8 @@ FileType filetypeOf(const string& filename) {
     type = AMIRA;
   else if(hasExtension(filename,".h5"))
     type = HDF5;
+  else if(hasExtension(filename,".pvtu"))
+    type = PVTU;
   else if(hasExtension(filename,".vtu"))
     type = VTU;
   else if(hasExtension(filename,".msh"))
@@ -93,13 +101,32 @@ FileType filetypeOf(const string& filename) {
   return type;
 }
 
+/** \brief Writes snapshots of the psurface while points are being removed */
+struct Snapshots {
+  AsyncWriter<float,2>* writer;
+  int interval;
+  string output;
+  bool base;
+  VTK::OutputType vtuEncoding;
+
+  /** \brief Start writing a snapshot, if removedPoints is a multiple of the interval */
+  void operator()(const PSurface<2,float>& par, int removedPoints) const {
+    if (interval <= 0 || removedPoints % interval != 0)
+      return;
+
+    stringstream suffix;
+    suffix << "-" << removedPoints;
+    writer->write(par, AsyncWriter<float,2>::makeJob(AsyncWriter<float,2>::withSuffix(output, suffix.str()), base, vtuEncoding));
+  }
+};
+
 
 ////////////////////////////////////////////////////////////////////////////////
 //// Routines for removing multiple points according to a QualityRequest.
 ////////////////////////////////////////////////////////////////////////////////
 
 void calcError(int vertex, const QualityRequest& quality, VertexHeap::ErrorValue& error,
-               PSurface<2, float>* par, MultiDimOctree<Edge, EdgeIntersectionFunctor, float, 3>& edgetree) {
+               PSurface<2, float>* par, const MultiDimOctree<Edge, EdgeIntersectionFunctor, float, 3>& edgetree) {
   int featureEdgeA, featureEdgeB;
 
   std::vector<std::vector<int> > halfStarVertices;
@@ -192,7 +219,7 @@ int removePoint(int vertex, const psurface::QualityRequest& quality,
 }
 
 void updateErrors(int vertex, vector<int>& neighbors, const psurface::QualityRequest& quality,
-                  PSurface<2, float>* par, MultiDimOctree<Edge, EdgeIntersectionFunctor, float, 3>& edgetree, VertexHeap& vertexHeap) {
+                  PSurface<2, float>* par, const MultiDimOctree<Edge, EdgeIntersectionFunctor, float, 3>& edgetree, VertexHeap& vertexHeap) {
     for (int k = 0; k < neighbors.size(); ++k) {
       VertexHeap::ErrorValue error = vertexHeap.getError(neighbors[k]);
 
@@ -202,7 +229,8 @@ void updateErrors(int vertex, vector<int>& neighbors, const psurface::QualityReq
 }
 
 // Returns number of points removed.
-int removeNumberOfPoints (int n, psurface::QualityRequest& req, PSurface<2, float>* par) {
+int removeNumberOfPoints (int n, psurface::QualityRequest& req, PSurface<2, float>* par,
+                          const Snapshots* snapshots = NULL) {
   //// Setup certain objects
 
   // Setup quality request.
@@ -223,9 +251,9 @@ int removeNumberOfPoints (int n, psurface::QualityRequest& req, PSurface<2, floa
     // Careful: Storing a POINTER to the EdgeIntersectionIterator here !
     edgetree.init(box, &ef);
 
-    // Simply insert every edge without specific order.
-    for (int k = 0; k < par->getNumEdges(); ++k)
-      edgetree.insert(&(par->edges(k)));
+    // Build the tree from all edges at once.
+    if (par->getNumEdges() > 0)
+      edgetree.build(&(par->edges(0)), &(par->edges(0)) + par->getNumEdges());
   }
 
 
@@ -261,6 +289,9 @@ int removeNumberOfPoints (int n, psurface::QualityRequest& req, PSurface<2, floa
     if (removePoint(index, req, par, &edgetree)) {
       updateErrors(index, neighbors, req, par, edgetree, vertexHeap);
       ++removedPoints;
+
+      if (snapshots and removedPoints < n)
+        (*snapshots)(*par, removedPoints);
     } else {
       VertexHeap::ErrorValue oldErr = vertexHeap.getMinErrorStatus();
 
@@ -277,6 +308,7 @@ int removeNumberOfPoints (int n, psurface::QualityRequest& req, PSurface<2, floa
 
   if (removedPoints > 0) {
     par->hasUpToDatePointLocationStructure = false;
+    par->hasUpToDateOverlapStructure = false;
     par->createPointLocationStructure();
   }
 
@@ -292,14 +324,16 @@ int main(int argc, char **argv) try {
   ////// Parse arguments.
   string input, output;
   bool base = false;
+  VTK::OutputType vtuEncoding = VTK::ascii;
   QualityRequest req;
 
   bool nodeCount = false, nodeNumber = false;
   int n;
+  int snapshotInterval = 0;
 
   int opt;
 
-  while ((opt = getopt(argc, argv, ":i:o:n:c:bt:l:r:d:s")) != EOF) {
+  while ((opt = getopt(argc, argv, ":i:o:n:c:bt:l:r:d:se:w:")) != EOF) {
     switch (opt) {
     case 'i':
       input = optarg;
@@ -340,6 +374,12 @@ int main(int argc, char **argv) try {
     case 's':
       req.intersections = true;
       break;
+    case 'e':
+      vtuEncoding = VTK::getOutputType(optarg);
+      break;
+    case 'w':
+      stringstream(optarg) >> snapshotInterval;
+      break;
     default:
       print_usage();
       throw runtime_error("Tried to set invalid flag.");
@@ -360,8 +400,8 @@ int main(int argc, char **argv) try {
   }
 
   // Check Filetype.
-  FileType inputType = filetypeOf(input),
-    outputType = filetypeOf(output);
+  FileType inputType = filetypeOf(input);
+  filetypeOf(output);
 
   ////// Read input file.
   auto_ptr<PSurface<2,float> > par(new PSurface<2,float>);
@@ -409,10 +449,13 @@ int main(int argc, char **argv) try {
 
 
   ////// Remove points.
+  // Snapshots are written in the background while the removal goes on
+  AsyncWriter<float,2> writer;
+  Snapshots snapshots = {&writer, snapshotInterval, output, base, vtuEncoding};
   int ret;
 
   if (true == nodeCount)
-    ret = removeNumberOfPoints(n, req, par.get());
+    ret = removeNumberOfPoints(n, req, par.get(), &snapshots);
   else // true == nodeNumber
     ret = removePoint(n, req, par.get(), NULL);
 
@@ -421,45 +464,8 @@ int main(int argc, char **argv) try {
 
 
   ////// Write output file.
-  switch(outputType) {
-  case HDF5:
-    {
-#if HAVE_HDF5
-      string xdmffile(output);
-      xdmffile.erase (xdmffile.end() - 3, xdmffile.end());
-      xdmffile.append(".xdmf");
-      auto_ptr<Hdf5IO<float,2> > pn(new Hdf5IO<float,2>(par.get()));
-      pn->createHdfAndXdmf(xdmffile, output, base);
-#else
-      cerr << "You have given an hdf5 output file, but psurface-simplify" << endl;
-      cerr << "has been compiled without hdf5 support!" << endl;
-      throw runtime_error("No hdf5 support.");
-#endif
-    }
-    break;
-
-  case VTU:
-    {
-      auto_ptr<VTKIO<float,2> > pn(new VTKIO<float,2>(par.get()));
-      pn->createVTU(output.c_str(), base ? "" : (output.substr(0, output.length()-string(".vtu").length())) + "-graph.vtu");
-    }
-    break;
-
-  case AMIRA:
-    {
-#if defined HAVE_AMIRAMESH
-      AmiraMeshIO<float> amIO;
-      amIO.writeAmiraMesh(par.get(), output.c_str());
-#else
-      std::cerr << "You have given an amira output file, but psurface-simplify" << std::endl;
-      std::cerr << "has been compiled without amira support!" << std::endl;
-      throw runtime_error("No amira support.");
-#endif
-    }
-    break;
-  default:
-    throw runtime_error("Unknown output type.");
-  };
+  writer.writeInPlace(par.get(), std::vector<AsyncWriter<float,2>::Job*>(1, AsyncWriter<float,2>::makeJob(output, base, vtuEncoding)));
+  writer.wait();
 
   return 0;
  } catch (const exception& e) {
@@ -16,6 +16,7 @@
 #include "PSurface.h"
 #include "Hdf5IO.h"
 #include "VtkIO.h"
+#include "AsyncWriter.h"
 
 #if defined HAVE_AMIRAMESH
 #include <amiramesh/AmiraMesh.h>
@@ -34,6 +35,7 @@ enum FileType
   AMIRA,
   HDF5,
   VTU,
+  PVTU,
   GMSH
 };
 
@@ -44,7 +46,11 @@ enum FileType
 void print_usage() {
   cerr << "Usage:" << endl
        << "   psurface-smooth -i <inputfilename> -o <outputfilename> -n <number of smoothing cycles>" << endl
-       << "                   -k (optional) set if patches need NOT to be preserved (default: not set)"
+       << "                   -k (optional) set if patches need NOT to be preserved (default: not set)" << endl
+       << "                   -e (optional) vtu encoding: ascii, base64, appendedraw, appendedbase64" << endl
+       << "                      or compressedappended (default: ascii)" << endl
+       << "                   -w (optional) write a snapshot every <k> smoothing cycles, to <outputfilename>" << endl
+       << "                      with the cycle number appended to its base name (default: no snapshots)"
        << endl;
 }
 
@@ -59,6 +65,8 @@ FileType filetypeOf(const string& filename) {
     type = AMIRA;
   else if(hasExtension(filename,".h5"))
     type = HDF5;
+  else if(hasExtension(filename,".pvtu"))
+    type = PVTU;
   else if(hasExtension(filename,".vtu"))
     type = VTU;
   else if(hasExtension(filename,".msh"))
@@ -69,8 +77,6 @@ FileType filetypeOf(const string& filename) {
   return type;
 }
 
-
-
 ////////////////////////////////////////////////////////////////////////////////
 //// Main
 ////////////////////////////////////////////////////////////////////////////////
@@ -79,11 +85,13 @@ int main(int argc, char **argv) try {
   ////// Parse arguments.
   string input, output;
   int n = -1;
+  int snapshotInterval = 0;
   bool keepPatches = true;
+  VTK::OutputType vtuEncoding = VTK::ascii;
 
   int opt;
 
-  while ((opt = getopt(argc, argv, ":i:o:n:k")) != EOF) {
+  while ((opt = getopt(argc, argv, ":i:o:n:ke:w:")) != EOF) {
     switch (opt) {
     case 'i':
       input = optarg;
@@ -97,6 +105,12 @@ int main(int argc, char **argv) try {
     case 'k':
       keepPatches = false;
       break;
+    case 'e':
+      vtuEncoding = VTK::getOutputType(optarg);
+      break;
+    case 'w':
+      stringstream(optarg) >> snapshotInterval;
+      break;
     default:
       print_usage();
       throw runtime_error("Tried to set invalid flag.");
@@ -117,8 +131,8 @@ int main(int argc, char **argv) try {
   }
 
   // Check Filetype.
-  FileType inputType = filetypeOf(input),
-    outputType = filetypeOf(output);
+  FileType inputType = filetypeOf(input);
+  filetypeOf(output);
 
   ////// Read input file.
   auto_ptr<PSurface<2,float> > par(new PSurface<2,float>);
@@ -160,53 +174,26 @@ int main(int argc, char **argv) try {
 
 
   ////// Smooth.
+  // Snapshots are written in the background while smoothing goes on
+  AsyncWriter<float,2> writer;
+  PSurfaceSmoother<float> smoother;
   std::vector<unsigned int> nodeStack;
 
-  for (int i = 0; i < n; ++i)
+  for (int i = 0; i < n; ++i) {
     for (int k = 0; k < par->getNumEdges(); ++k)
-      PSurfaceSmoother<float>::applyEdgeRelaxation(par.get(), k, keepPatches, nodeStack);
+      smoother.applyEdgeRelaxation(par.get(), k, keepPatches, nodeStack);
 
-
-  ////// Write output file.
-  switch(outputType) {
-  case HDF5:
-    {
-#if HAVE_HDF5
-      string xdmffile(output);
-      xdmffile.erase (xdmffile.end() - 3, xdmffile.end());
-      xdmffile.append(".xdmf");
-      auto_ptr<Hdf5IO<float,2> > pn(new Hdf5IO<float,2>(par.get()));
-      pn->createHdfAndXdmf(xdmffile, output, false);
-#else
-      cerr << "You have given an hdf5 output file, but psurface-smooth" << endl;
-      cerr << "has been compiled without hdf5 support!" << endl;
-      throw runtime_error("No hdf5 support.");
-#endif
+    if (snapshotInterval > 0 && (i+1) % snapshotInterval == 0 && i+1 < n) {
+      stringstream suffix;
+      suffix << "-" << i+1;
+      writer.write(*par, AsyncWriter<float,2>::makeJob(AsyncWriter<float,2>::withSuffix(output, suffix.str()), false, vtuEncoding));
     }
-    break;
+  }
 
-  case VTU:
-    {
-      auto_ptr<VTKIO<float,2> > pn(new VTKIO<float,2>(par.get()));
-      pn->createVTU(output.c_str(), output.substr(0, output.length()-string(".vtu").length()) + "-graph.vtu");
-    }
-    break;
 
-  case AMIRA:
-    {
-#if defined HAVE_AMIRAMESH
-      PSURFACE_API AmiraMeshIO<float> amIO;
-      amIO.writeAmiraMesh(par.get(), output.c_str());
-#else
-      cerr << "You have given an amira output file, but psurface-smooth" << endl;
-      cerr << "has been compiled without amira support!" << endl;
-      throw runtime_error("No amira support.");
-#endif
-    }
-    break;
-  default:
-    throw runtime_error("Unknown output type.");
-  };
+  ////// Write output file.
+  writer.writeInPlace(par.get(), std::vector<AsyncWriter<float,2>::Job*>(1, AsyncWriter<float,2>::makeJob(output, false, vtuEncoding)));
+  writer.wait();
 
   return 0;
  } catch (const exception& e) {
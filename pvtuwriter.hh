@@ -0,0 +1,217 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef PSURFACE_PVTUWRITER_HH
+#define PSURFACE_PVTUWRITER_HH
+
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+#include "indent.hh"
+#include "common.hh"
+
+namespace psurface {
+
+  //! \addtogroup VTK
+  //! \{
+
+  namespace VTK {
+
+    //! Dump a .pvtu/.pvtp files contents to a stream
+    /**
+     * This will help generating a .pvtu/.pvtp file, i.e. the header file
+     * that ties together the pieces of a partitioned .vtu/.vtp output.
+     * Typical use is like this:
+     * \code
+     * {
+     *   // create writer, writes begin tag
+     *   PVTUWriter writer(std::cout, unstructuredGrid);
+     *
+     *   writer.beginMain();
+     *
+     *   // declare the point data fields (optional)
+     *   writer.beginPointData();
+     *   writer.addArray<float>("temperature", 1);
+     *   writer.endPointData();
+     *
+     *   // declare the point coordinates
+     *   writer.beginPoints();
+     *   writer.addArray<float>("Coordinates", 3);
+     *   writer.endPoints();
+     *
+     *   // list the pieces
+     *   for(each piece)
+     *     writer.addPiece(piece.filename);
+     *
+     *   writer.endMain();
+     *
+     *   // end scope so the destructor gets called and the closing tag is written
+     * }
+     * \endcode
+     */
+    class PVTUWriter {
+      std::ostream& stream;
+
+      std::string fileType;
+
+      Indent indent;
+
+    public:
+      //! create a PVTUWriter object
+      /**
+       * \param stream_   Stream to write to.
+       * \param fileType_ Whether to write PolyData (1D) or UnstructuredGrid
+       *                  (nD) format.
+       *
+       * Create object and write header.
+       */
+      inline PVTUWriter(std::ostream& stream_, FileType fileType_)
+        : stream(stream_)
+      {
+        switch(fileType_) {
+        case polyData :
+          fileType = "PPolyData";
+          break;
+        case unstructuredGrid :
+          fileType = "PUnstructuredGrid";
+          break;
+        default :
+          throw(std::runtime_error("PVTUWriter: Unknown fileType"));
+        }
+        const std::string& byteOrder = getEndiannessString();
+
+        stream << indent << "<?xml version=\"1.0\"?>\n";
+        stream << indent << "<VTKFile"
+               << " type=\"" << fileType << "\""
+               << " version=\"0.1\""
+               << " byte_order=\"" << byteOrder << "\">\n";
+        ++indent;
+      }
+
+      //! write footer
+      inline ~PVTUWriter() {
+        --indent;
+        stream << indent << "</VTKFile>\n"
+               << std::flush;
+      }
+
+      //! start PPointData section
+      /**
+       * \param scalars Name of field to which should be marked as default
+       *                scalars field.  If this is the empty string, don't set
+       *                any default.
+       * \param vectors Name of field to which should be marked as default
+       *                vectors field.  If this is the empty string, don't set
+       *                any default.
+       */
+      inline void beginPointData(const std::string& scalars = "",
+                                 const std::string& vectors = "") {
+        stream << indent << "<PPointData";
+        if(scalars != "") stream << " Scalars=\"" << scalars << "\"";
+        if(vectors != "") stream << " Vectors=\"" << vectors << "\"";
+        stream << ">\n";
+        ++indent;
+      }
+      //! finish PPointData section
+      inline void endPointData() {
+        --indent;
+        stream << indent << "</PPointData>\n";
+      }
+
+      //! start PCellData section
+      /**
+       * \param scalars Name of field to which should be marked as default
+       *                scalars field.  If this is the empty string, don't set
+       *                any default.
+       * \param vectors Name of field to which should be marked as default
+       *                vectors field.  If this is the empty string, don't set
+       *                any default.
+       */
+      inline void beginCellData(const std::string& scalars = "",
+                                const std::string& vectors = "") {
+        stream << indent << "<PCellData";
+        if(scalars != "") stream << " Scalars=\"" << scalars << "\"";
+        if(vectors != "") stream << " Vectors=\"" << vectors << "\"";
+        stream << ">\n";
+        ++indent;
+      }
+      //! finish PCellData section
+      inline void endCellData() {
+        --indent;
+        stream << indent << "</PCellData>\n";
+      }
+
+      //! start section for the point coordinates
+      /**
+       * Between the call to this method an the following call to the
+       * endPoints(), there must be a single call to addArray() with the name
+       * "Coordinates" and 3 components.
+       */
+      inline void beginPoints() {
+        stream << indent << "<PPoints>\n";
+        ++indent;
+      }
+      //! finish section for the point coordinates
+      inline void endPoints() {
+        --indent;
+        stream << indent << "</PPoints>\n";
+      }
+
+      //! start the main PPolyData/PUnstructuredGrid section
+      /**
+       * \param ghostLevel Number of layers of ghost cells in the pieces.
+       *
+       * Inbetween the call to this method and to endMain(), there should be
+       * calls to declare the data fields and to list the pieces:
+       * <ul>
+       * <li> (optional) beginPointData()/endPointData(),
+       * <li> (optional) beginCellData()/endCellData(),
+       * <li> beginPoints()/endPoints(),
+       * <li> addPiece() for each piece.
+       * </ul>
+       */
+      inline void beginMain(unsigned ghostLevel = 0) {
+        stream << indent << "<" << fileType
+               << " GhostLevel=\"" << ghostLevel << "\">\n";
+        ++indent;
+      }
+      //! finish the main PPolyData/PUnstructuredGrid section
+      inline void endMain() {
+        --indent;
+        stream << indent << "</" << fileType << ">\n";
+      }
+
+      //! declare a data array
+      /**
+       * \tparam T Type of the data in the array.
+       *
+       * \param name   Name of the array.
+       * \param ncomps Number of components of the vectors in the array.
+       */
+      template<typename T>
+      void addArray(const std::string& name, unsigned ncomps) {
+        TypeName<T> tn;
+        stream << indent << "<PDataArray"
+               << " type=\"" << tn() << "\""
+               << " Name=\"" << name << "\""
+               << " NumberOfComponents=\"" << ncomps << "\"/>\n";
+      }
+
+      //! add a serial piece
+      /**
+       * \param filename Name of the file the piece is stored in, relative to
+       *                 the location of the .pvtu file.
+       */
+      inline void addPiece(const std::string& filename) {
+        stream << indent << "<Piece Source=\"" << filename << "\"/>\n";
+      }
+    };
+
+  } // namespace VTK
+
+  //! \} group VTK
+
+} // namespace psurface
+
+#endif // PSURFACE_PVTUWRITER_HH
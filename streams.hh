@@ -5,6 +5,7 @@
 #define PSURFACE_STREAMS_HH
 
 #include <ostream>
+#include <vector>
 
 #include "b64enc.hh"
 
@@ -47,6 +48,8 @@ namespace psurface {
         {
           chunk.data.write(obuf);
           s.write(obuf,4);
+          // clear the chunk, stale bytes would end up in the padded last quadruple
+          chunk.txt.read(0,0);
         }
       }
     }
@@ -65,6 +68,7 @@ namespace psurface {
       {
         chunk.data.write(obuf);
         s.write(obuf,4);
+        chunk.txt.read(0,0);
       }
     }
 
@@ -77,6 +81,26 @@ namespace psurface {
     }
   };
 
+  //! base64 encode a whole buffer at once and write it to a stream
+  /**
+   * \param s    The stream the resulting base64-encoded text will be written
+   *             to.
+   * \param data The data to encode.
+   * \param size Number of bytes to encode.
+   *
+   * Unlike Base64Stream, this encodes all data in a single call to
+   * b64encode(), which can then use vector instructions.  An end-marker is
+   * written if the size is not a multiple of three bytes.
+   */
+  inline void writeBase64(std::ostream& s, const char* data, std::size_t size)
+  {
+    std::vector<char> obuf(b64size(size));
+    if (!obuf.empty()) {
+      b64encode(data, size, &obuf[0]);
+      s.write(&obuf[0], obuf.size());
+    }
+  }
+
   //! write out data in binary
   class RawStream
   {
@@ -0,0 +1,77 @@
+#include "config.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "b64enc.hh"
+#include "streams.hh"
+
+using namespace std;
+using namespace psurface;
+
+
+/** \brief Encode the data byte by byte with Base64Stream */
+string encodeByStream(vector<char> data) {
+  ostringstream s;
+  {
+    Base64Stream stream(s);
+    for (size_t i = 0; i < data.size(); ++i)
+      stream.write(data[i]);
+  }
+  return s.str();
+}
+
+/** \brief Compare b64encode() and writeBase64() with Base64Stream for all lengths up to maxLength */
+void test(size_t maxLength) {
+  for (size_t n = 0; n <= maxLength; ++n) {
+    vector<char> data(n);
+    for (size_t i = 0; i < n; ++i)
+      data[i] = rand();
+
+    const string expected = encodeByStream(data);
+
+    // b64encode() may not write past b64size(n) characters
+    vector<char> out(b64size(n) + 1, '#');
+    size_t written = b64encode((n > 0) ? &data[0] : NULL, n, &out[0]);
+
+    ostringstream message;
+    message << "base64 encoding of " << n << " bytes: ";
+
+    if (written != b64size(n) || written != expected.size())
+      throw runtime_error(message.str() + "wrong number of characters");
+    if (string(&out[0], written) != expected)
+      throw runtime_error(message.str() + "b64encode differs from Base64Stream");
+    if (out[written] != '#')
+      throw runtime_error(message.str() + "b64encode writes past the end of the output");
+
+    ostringstream s;
+    writeBase64(s, (n > 0) ? &data[0] : NULL, n);
+    if (s.str() != expected)
+      throw runtime_error(message.str() + "writeBase64 differs from Base64Stream");
+  }
+}
+
+int main (int argc, char* argv[]) {
+
+#if defined __AVX2__
+  cout << "Testing the AVX2 base64 encoder" << endl;
+#elif defined __SSSE3__
+  cout << "Testing the SSSE3 base64 encoder" << endl;
+#else
+  cout << "Testing the scalar base64 encoder" << endl;
+#endif
+
+  try {
+    test(100);
+  } catch (const exception& e) {
+    cout << e.what() << endl;
+
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,259 @@
+#include "config.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "StaticVector.h"
+#include "PSurface.h"
+#include "ContactMapping.h"
+#include "NormalProjector.h"
+
+using namespace std;
+using namespace psurface;
+
+
+/** \brief A polyline through the points (x, f(x)), rotated by 90 degrees if requested
+ *
+ * The segments are numbered in random order.
+ */
+template <class ctype>
+void polyline(int n, ctype x0, ctype x1, ctype y0, ctype amplitude, ctype frequency, bool reverse, bool rotate,
+              vector<tr1::array<ctype,2> >& coords, vector<tr1::array<int,2> >& segments) {
+  for (int i = 0; i <= n; ++i) {
+    ctype x = x0 + (x1 - x0)*ctype(reverse ? n-i : i)/n;
+    ctype y = y0 + amplitude*sin(frequency*x);
+    tr1::array<ctype,2> p = {{rotate ? -y : x, rotate ? x : y}};
+    coords.push_back(p);
+  }
+
+  vector<int> order(n);
+  for (int i = 0; i < n; ++i)
+    order[i] = i;
+  random_shuffle(order.begin(), order.end());
+
+  for (int i = 0; i < n; ++i) {
+    tr1::array<int,2> e = {{order[i], order[i]+1}};
+    segments.push_back(e);
+  }
+}
+
+/** \brief The vertex normals of a polyline, the average of the adjacent segment normals */
+template <class ctype>
+vector<StaticVector<ctype,2> > vertexNormals(const vector<tr1::array<ctype,2> >& coords,
+                                             const vector<tr1::array<int,2> >& segments) {
+  vector<StaticVector<ctype,2> > normals(coords.size(), StaticVector<ctype,2>(0));
+  for (size_t i = 0; i < segments.size(); ++i) {
+    StaticVector<ctype,2> normal;
+    normal[0] =   coords[segments[i][1]][1] - coords[segments[i][0]][1];
+    normal[1] = -(coords[segments[i][1]][0] - coords[segments[i][0]][0]);
+    normal /= normal.length();
+
+    normals[segments[i][0]] += normal;
+    normals[segments[i][1]] += normal;
+  }
+
+  for (size_t i = 0; i < normals.size(); ++i)
+    normals[i] /= normals[i].length();
+  return normals;
+}
+
+/** \brief Project a target vertex onto the domain by trying every domain segment
+ *
+ * This is how ContactMapping<2>::build() used to find the projections
+ * before it swept through the segments.
+ */
+template <class ctype>
+void bruteForceProjection(const StaticVector<ctype,2>& q, const StaticVector<ctype,2>& targetNormal,
+                          const vector<tr1::array<ctype,2> >& coords, const vector<tr1::array<int,2> >& segments,
+                          const vector<StaticVector<ctype,2> >& normals,
+                          int& bestSegment, ctype& bestLocalPos) {
+  bestSegment = -1;
+  ctype bestDist = numeric_limits<ctype>::max();
+
+  for (size_t j = 0; j < segments.size(); ++j) {
+    StaticVector<ctype,2> p0, p1;
+    for (int k = 0; k < 2; ++k) {
+      p0[k] = coords[segments[j][0]][k];
+      p1[k] = coords[segments[j][1]][k];
+    }
+    const StaticVector<ctype,2>& n0 = normals[segments[j][0]];
+    const StaticVector<ctype,2>& n1 = normals[segments[j][1]];
+
+    ctype local;
+    if (!NormalProjector<ctype>::computeInverseNormalProjection(p0, p1, n0, n1, q, local))
+      continue;
+
+    StaticVector<ctype,2> segment, baseNormal;
+    for (int k = 0; k < 2; ++k) {
+      segment[k]    = q[k] - ((1-local)*p0[k] + local*p1[k]);
+      baseNormal[k] = (1-local)*n0[k] + local*n1[k];
+    }
+
+    ctype distance = segment.length2();
+    if (segment.dot(targetNormal) > -0.0001 && segment.dot(baseNormal) > -0.0001 && distance > 1e-8)
+      continue;
+
+    if (distance < bestDist) {
+      bestDist = distance;
+      bestLocalPos = local;
+      bestSegment = j;
+    }
+  }
+}
+
+/** \brief The nodes on target vertices must be those found by the brute-force search */
+template <class ctype>
+void checkTargetVertexNodes(const PSurface<1,ctype>& psurface,
+                            const vector<tr1::array<ctype,2> >& coords1, const vector<tr1::array<int,2> >& tri1,
+                            const vector<tr1::array<ctype,2> >& coords2, const vector<tr1::array<int,2> >& tri2,
+                            const string& message) {
+  const ctype eps = 1e-10;
+
+  vector<StaticVector<ctype,2> > domainNormals = vertexNormals(coords1, tri1);
+  vector<StaticVector<ctype,2> > targetNormals = vertexNormals(coords2, tri2);
+
+  // The target segments of each target vertex, in the order used by build()
+  vector<tr1::array<int,2> > segPerVertex(coords2.size());
+  for (size_t i = 0; i < coords2.size(); ++i)
+    segPerVertex[i][0] = segPerVertex[i][1] = -1;
+  for (size_t i = 0; i < tri2.size(); ++i)
+    for (int j = 0; j < 2; ++j)
+      segPerVertex[tri2[i][j]][(segPerVertex[tri2[i][j]][0] == -1) ? 0 : 1] = i;
+
+  // The expected nodes on target vertices, as (segment, local position, target vertex)
+  vector<tr1::array<ctype,3> > expected;
+  for (size_t i = 0; i < coords2.size(); ++i) {
+    StaticVector<ctype,2> q;
+    q[0] = coords2[i][0];
+    q[1] = coords2[i][1];
+
+    int segment;
+    ctype local;
+    bruteForceProjection(q, targetNormals[i], coords1, tri1, domainNormals, segment, local);
+    if (segment == -1)
+      continue;
+
+    const int* neighbor = psurface.domainSegments[segment].neighbor;
+    if (local < eps) {
+      tr1::array<ctype,3> node = {{ctype(segment), 0, ctype(i)}};
+      expected.push_back(node);
+      if (neighbor[0] != -1) {
+        tr1::array<ctype,3> other = {{ctype(neighbor[0]), 1, ctype(i)}};
+        expected.push_back(other);
+      }
+    } else if (local > 1-eps) {
+      tr1::array<ctype,3> node = {{ctype(segment), 1, ctype(i)}};
+      expected.push_back(node);
+      if (neighbor[1] != -1) {
+        tr1::array<ctype,3> other = {{ctype(neighbor[1]), 0, ctype(i)}};
+        expected.push_back(other);
+      }
+    } else {
+      tr1::array<ctype,3> node = {{ctype(segment), local, ctype(i)}};
+      expected.push_back(node);
+    }
+  }
+
+  // The nodes on target vertices that build() has created
+  vector<tr1::array<ctype,3> > actual;
+  for (size_t i = 0; i < psurface.domainSegments.size(); ++i) {
+    const vector<typename PSurface<1,ctype>::Node>& nodes = psurface.domainSegments[i].nodes;
+    for (size_t j = 0; j < nodes.size(); ++j) {
+      if (!nodes[j].isNodeOnTargetVertex)
+        continue;
+
+      // Find the target vertex from its pair of target segments
+      int vertex = -1;
+      for (size_t k = 0; k < segPerVertex.size(); ++k)
+        if (segPerVertex[k][0] == nodes[j].rangeSegments[0] && segPerVertex[k][1] == nodes[j].rangeSegments[1])
+          vertex = k;
+
+      tr1::array<ctype,3> node = {{ctype(i), nodes[j].domainLocalPosition, ctype(vertex)}};
+      actual.push_back(node);
+    }
+  }
+
+  sort(expected.begin(), expected.end());
+  sort(actual.begin(), actual.end());
+
+  if (expected.size() != actual.size())
+    throw runtime_error(message + ": wrong number of nodes on target vertices");
+  for (size_t i = 0; i < expected.size(); ++i)
+    if (expected[i][0] != actual[i][0] || expected[i][2] != actual[i][2]
+        || fabs(expected[i][1] - actual[i][1]) > 1e-12)
+      throw runtime_error(message + ": the sweep found other nodes than the brute-force search");
+}
+
+/** \brief positionMap() must map the overlaps onto their target segments */
+template <class ctype>
+void checkPositionMap(const PSurface<1,ctype>& psurface, const vector<IntersectionPrimitive<1,ctype> >& overlaps,
+                      const string& message) {
+  if (overlaps.empty())
+    throw runtime_error(message + ": no overlaps");
+
+  for (size_t i = 0; i < overlaps.size(); ++i) {
+    const IntersectionPrimitive<1,ctype>& overlap = overlaps[i];
+
+    const StaticVector<ctype,2>& a = psurface.targetVertices[psurface.targetSegments[overlap.tris[1]][0]];
+    const StaticVector<ctype,2>& b = psurface.targetVertices[psurface.targetSegments[overlap.tris[1]][1]];
+
+    for (int k = 1; k < 10; ++k) {
+      const ctype t = ctype(k)/10;
+
+      StaticVector<ctype,1> p;
+      p[0] = (1-t)*overlap.localCoords[0][0][0] + t*overlap.localCoords[0][1][0];
+      const ctype targetLocal = (1-t)*overlap.localCoords[1][0][0] + t*overlap.localCoords[1][1][0];
+
+      StaticVector<ctype,2> result;
+      if (!psurface.positionMap(overlap.tris[0], p, result))
+        throw runtime_error(message + ": positionMap() fails inside of an overlap");
+
+      StaticVector<ctype,2> expected = (1-targetLocal)*a + targetLocal*b;
+      if ((result - expected).length() > 1e-10)
+        throw runtime_error(message + ": positionMap() differs from the overlap");
+    }
+  }
+}
+
+template <class ctype>
+void test(int n, int m, bool rotate) {
+  ostringstream message;
+  message << "2d contact mapping with " << n << " and " << m << " segments" << (rotate ? ", rotated" : "");
+
+  // Two wavy curves facing each other, the target one is longer than the domain one
+  vector<tr1::array<ctype,2> > coords1, coords2;
+  vector<tr1::array<int,2> > tri1, tri2;
+  polyline<ctype>(n, 0, 3, 0, 0.1, 3, false, rotate, coords1, tri1);
+  polyline<ctype>(m, -0.2, 3.2, 0.6, 0.1, 2, true, rotate, coords2, tri2);
+
+  ContactMapping<2,ctype> contactMapping;
+  contactMapping.build(coords1, tri1, coords2, tri2);
+
+  checkTargetVertexNodes(contactMapping.getPSurface(), coords1, tri1, coords2, tri2, message.str());
+
+  vector<IntersectionPrimitive<1,ctype> > overlaps;
+  contactMapping.getOverlaps(overlaps);
+  checkPositionMap(contactMapping.getPSurface(), overlaps, message.str());
+}
+
+int main (int argc, char* argv[]) {
+
+  try {
+    test<double>(40, 57, false);
+    test<double>(40, 57, true);
+    test<double>(100, 31, false);
+    test<double>(100, 31, true);
+  } catch (const exception& e) {
+    cout << e.what() << endl;
+
+    return 1;
+  }
+
+  return 0;
+}
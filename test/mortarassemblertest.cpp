@@ -0,0 +1,159 @@
+#include "config.h"
+
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "ContactMapping.h"
+#include "MortarAssembler.h"
+
+#include "testsurfaces.h"
+
+using namespace std;
+using namespace psurface;
+
+
+/** \brief The P1 mass matrix of a flat grid, with world coordinates coords */
+template <int dim, typename ctype>
+CSRMatrix<ctype> massMatrix(const vector<tr1::array<ctype,dim+1> >& coords,
+                            const vector<tr1::array<int,dim+1> >& elements) {
+  vector<typename CSRMatrix<ctype>::Triplet> entries;
+
+  for (size_t e = 0; e < elements.size(); ++e) {
+    ctype measure;
+    if (dim == 1) {
+      ctype dx = coords[elements[e][1]][0] - coords[elements[e][0]][0];
+      ctype dy = coords[elements[e][1]][1] - coords[elements[e][0]][1];
+      measure = sqrt(dx*dx + dy*dy);
+    } else {
+      // the grids of this test lie in planes z=const
+      const tr1::array<ctype,dim+1>& p0 = coords[elements[e][0]];
+      const tr1::array<ctype,dim+1>& p1 = coords[elements[e][1]];
+      const tr1::array<ctype,dim+1>& p2 = coords[elements[e][dim]];
+      measure = 0.5*fabs((p1[0]-p0[0])*(p2[1]-p0[1]) - (p1[1]-p0[1])*(p2[0]-p0[0]));
+    }
+
+    // int phi_a phi_b = measure * (1 + delta_ab) / ((dim+1)(dim+2))
+    for (int a = 0; a < dim+1; ++a)
+      for (int b = 0; b < dim+1; ++b)
+        entries.push_back(typename CSRMatrix<ctype>::Triplet(elements[e][a], elements[e][b],
+                                                             measure * ((a == b) ? 2 : 1) / ((dim+1)*(dim+2))));
+  }
+
+  CSRMatrix<ctype> mass;
+  mass.setFromTriplets(coords.size(), coords.size(), entries);
+  return mass;
+}
+
+template <typename ctype>
+void check_result(ctype value, ctype trueValue, ctype tolerance, char const * const message) {
+  if (fabs(value - trueValue) > tolerance)
+    throw runtime_error(message);
+}
+
+/** \brief Compare D and M with the mass matrices of the two grids
+ *
+ * If the grids cover each other, D is the mass matrix of the domain grid, the
+ * row sums of M are the ones of D, and the column sums of M are the row sums
+ * of the target mass matrix.
+ */
+template <int dim, typename ctype>
+void check_matrices(const CSRMatrix<ctype>& D, const CSRMatrix<ctype>& M,
+                    const CSRMatrix<ctype>& domainMass, const CSRMatrix<ctype>& targetMass,
+                    ctype tolerance) {
+  if (D.nRows() != domainMass.nRows() || M.nRows() != domainMass.nRows() || M.nCols() != targetMass.nRows())
+    throw runtime_error("wrong matrix sizes");
+
+  for (size_t i = 0; i < D.nRows(); ++i)
+    for (int k = domainMass.rowStart[i]; k < domainMass.rowStart[i+1]; ++k)
+      check_result(D(i, domainMass.colIndex[k]), domainMass.values[k], tolerance, "D is not the domain mass matrix");
+
+  vector<ctype> domainOnes(domainMass.nRows(), 1), targetOnes(targetMass.nRows(), 1);
+  vector<ctype> dRowSums, mRowSums, targetRowSums;
+
+  D.multVec(domainOnes, dRowSums);
+  M.multVec(targetOnes, mRowSums);
+  targetMass.multVec(targetOnes, targetRowSums);
+
+  for (size_t i = 0; i < D.nRows(); ++i)
+    check_result(mRowSums[i], dRowSums[i], tolerance, "row sums of M and D differ");
+
+  vector<ctype> mColSums(M.nCols(), 0);
+  for (size_t i = 0; i < M.nRows(); ++i)
+    for (int k = M.rowStart[i]; k < M.rowStart[i+1]; ++k)
+      mColSums[M.colIndex[k]] += M.values[k];
+
+  for (size_t j = 0; j < M.nCols(); ++j)
+    check_result(mColSums[j], targetRowSums[j], tolerance, "column sums of M are wrong");
+}
+
+/** \brief Two unit squares, triangulated with n resp. m squares per side, on top of each other */
+template <typename ctype>
+void test3d(int n, int m, int order, ctype tolerance) {
+  vector<tr1::array<ctype,3> > coords[2];
+  vector<tr1::array<int,3> > tris[2];
+
+  // The surfaces face each other, hence the second one is oriented the other way
+  square<ctype>(n, 0, 1, 0, false, coords[0], tris[0]);
+  square<ctype>(m, 0, 1, 0.01, true, coords[1], tris[1]);
+
+  ContactMapping<3,ctype> contactMapping;
+  contactMapping.build(coords[0], tris[0], coords[1], tris[1]);
+
+  OverlapSet<2,ctype> overlaps;
+  contactMapping.getOverlaps(overlaps);
+
+  CSRMatrix<ctype> D, M;
+  MortarAssembler<2,ctype>(order).assemble(overlaps, tris[0], coords[0].size(), tris[1], coords[1].size(), D, M);
+
+  check_matrices<2>(D, M, massMatrix<2>(coords[0], tris[0]), massMatrix<2>(coords[1], tris[1]), tolerance);
+}
+
+/** \brief Two unit segments, divided into n resp. m parts, on top of each other */
+template <typename ctype>
+void test2d(int n, int m, int order, ctype tolerance) {
+  vector<tr1::array<ctype,2> > coords[2];
+  vector<tr1::array<int,2> > segments[2];
+
+  for (int s = 0; s < 2; ++s) {
+    const int N = (s == 0) ? n : m;
+
+    for (int i = 0; i <= N; ++i) {
+      tr1::array<ctype,2> p = {{ctype((s == 0) ? i : N-i)/N, ctype(0.01)*s}};
+      coords[s].push_back(p);
+    }
+
+    for (int i = 0; i < N; ++i) {
+      tr1::array<int,2> e = {{i, i+1}};
+      segments[s].push_back(e);
+    }
+  }
+
+  ContactMapping<2,ctype> contactMapping;
+  contactMapping.build(coords[0], segments[0], coords[1], segments[1]);
+
+  vector<IntersectionPrimitive<1,ctype> > overlaps;
+  contactMapping.getOverlaps(overlaps);
+
+  CSRMatrix<ctype> D, M;
+  MortarAssembler<1,ctype>(order).assemble(overlaps, segments[0], coords[0].size(), segments[1], coords[1].size(), D, M);
+
+  check_matrices<1>(D, M, massMatrix<1>(coords[0], segments[0]), massMatrix<1>(coords[1], segments[1]), tolerance);
+}
+
+int main (int argc, char* argv[]) {
+
+  try {
+    test2d<double>(10, 13, 2, 1e-8);
+    test2d<double>(10, 13, 5, 1e-8);
+    test3d<double>(10, 13, 2, 1e-8);
+    test3d<double>(10, 13, 5, 1e-8);
+  } catch (const exception& e) {
+    cout << e.what() << endl;
+
+    return 1;
+  }
+
+  return 0;
+}
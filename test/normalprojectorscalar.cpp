@@ -0,0 +1,4 @@
+// The NormalProjector of normalprojectortest_scalar.  It is compiled with
+// -DPSURFACE_SCALAR_KERNELS, and its definitions take the place of those in
+// libpsurface, which uses the batched kernels.
+#include "NormalProjector.cpp"
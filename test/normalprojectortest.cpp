@@ -0,0 +1,445 @@
+#include "config.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef PSURFACE_STANDALONE
+#include "TargetSurface.h"
+#else
+#include "hxsurface/Surface.h"
+#endif
+
+#include "PSurface.h"
+#include "NormalProjector.h"
+#include "DirectionFunction.h"
+#include "StaticMatrix.h"
+
+#include "testsurfaces.h"
+
+using namespace std;
+using namespace psurface;
+
+
+/** \brief Set up the domain of a parametrization and its target surface, like ContactMapping<3>::build() */
+template <typename ctype>
+void setup(const vector<tr1::array<ctype,3> >& coords1, const vector<tr1::array<int,3> >& tri1,
+           const vector<tr1::array<ctype,3> >& coords2, const vector<tr1::array<int,3> >& tri2,
+           PSurface<2,ctype>& psurface, Surface& surface) {
+#ifndef PSURFACE_STANDALONE
+  surface.patches.resize(1);
+  surface.patches[0] = new Surface::Patch;
+  surface.patches[0]->innerRegion = 0;
+  surface.patches[0]->outerRegion = 1;
+  surface.patches[0]->boundaryId  = 0;
+  surface.patches[0]->triangles.resize(tri2.size());
+#endif
+
+  surface.points.resize(coords2.size());
+  for (size_t i = 0; i < coords2.size(); ++i)
+    for (int j = 0; j < 3; ++j)
+      surface.points[i][j] = coords2[i][j];
+
+  surface.triangles.resize(tri2.size());
+  for (size_t i = 0; i < tri2.size(); ++i) {
+    for (int j = 0; j < 3; ++j)
+      surface.triangles[i].points[j] = tri2[i][j];
+#ifndef PSURFACE_STANDALONE
+    surface.triangles[i].patch = 0;
+    surface.patches[0]->triangles[i] = i;
+#endif
+  }
+
+  psurface.surface = &surface;
+
+  for (size_t i = 0; i < coords1.size(); ++i)
+    psurface.newVertex(StaticVector<ctype,3>(coords1[i][0], coords1[i][1], coords1[i][2]));
+
+  for (size_t i = 0; i < tri1.size(); ++i) {
+    int newTri = psurface.createSpaceForTriangle(tri1[i][0], tri1[i][1], tri1[i][2]);
+    psurface.integrateTriangle(newTri);
+    psurface.triangles(newTri).patch = 0;
+  }
+}
+
+/** \brief The image of the ghost node of each domain vertex, NaN for vertices without one */
+template <typename ctype>
+vector<StaticVector<ctype,3> > ghostNodeImages(const PSurface<2,ctype>& psurface) {
+  const ctype nan = numeric_limits<ctype>::quiet_NaN();
+  vector<StaticVector<ctype,3> > images(psurface.getNumVertices(), StaticVector<ctype,3>(nan, nan, nan));
+
+  for (size_t i = 0; i < psurface.getNumTriangles(); ++i) {
+    const DomainTriangle<ctype>& cT = psurface.triangles(i);
+    for (size_t j = 0; j < cT.nodes.size(); ++j)
+      if (cT.nodes[j].isGHOST_NODE())
+        images[cT.vertices[cT.nodes[j].getCorner()]] = psurface.imagePos(i, j);
+  }
+
+  return images;
+}
+
+/** \brief Vertices whose normal ray misses the target get a ghost node on its closest point, if that is within maxGap */
+template <typename ctype>
+void testClosestPointFallback(bool fallback, ctype maxGap) {
+  ostringstream message;
+  message << "closest point fallback " << (fallback ? "on" : "off") << ", maximum gap " << maxGap;
+
+  // The target surface only covers the middle of the domain surface
+  const ctype lower = 0.25, upper = 0.75, height = 0.05;
+
+  vector<tr1::array<ctype,3> > coords1, coords2;
+  vector<tr1::array<int,3> > tri1, tri2;
+  square<ctype>(10, 0, 1, 0, false, coords1, tri1);
+  square<ctype>(5, lower, upper, height, true, coords2, tri2);
+
+  PSurface<2,ctype> psurface;
+  Surface surface;
+  setup(coords1, tri1, coords2, tri2, psurface, surface);
+
+  NormalProjector<ctype> projector(&psurface);
+  projector.setClosestPointFallback(fallback);
+  projector.project(&surface, NULL, NULL, maxGap);
+
+  vector<StaticVector<ctype,3> > images = ghostNodeImages(psurface);
+
+  int nFallback = 0;
+  for (size_t i = 0; i < coords1.size(); ++i) {
+    StaticVector<ctype,3> closest(min(max(coords1[i][0], lower), upper),
+                                  min(max(coords1[i][1], lower), upper),
+                                  height);
+    ctype distance = (closest - StaticVector<ctype,3>(coords1[i][0], coords1[i][1], coords1[i][2])).length();
+
+    // The normal ray hits the target surface, or the fallback maps the vertex to the closest point
+    bool hit = closest[0] == coords1[i][0] && closest[1] == coords1[i][1];
+    bool expected = hit || (fallback && distance <= maxGap);
+
+    if (!expected) {
+      if (images[i][0] == images[i][0])
+        throw runtime_error(message.str() + ": a vertex far from the target surface has a ghost node");
+      continue;
+    }
+
+    if (images[i][0] != images[i][0])
+      throw runtime_error(message.str() + ": a vertex close to the target surface has no ghost node");
+    if ((images[i] - closest).length() > 1e-6)
+      throw runtime_error(message.str() + ": a ghost node is not on the closest target point");
+
+    if (!hit)
+      nFallback++;
+  }
+
+  if (fallback && nFallback == 0)
+    throw runtime_error(message.str() + ": the fallback has not been used");
+}
+
+/** \brief Directions that are tilted away from the z axis differently at each vertex */
+template <typename ctype>
+struct TiltedDirections : public DiscreteDirectionFunction<3,ctype>
+{
+  StaticVector<ctype,3> operator()(size_t index) const {
+    return StaticVector<ctype,3>(ctype(0.3)*sin(ctype(7*index)), ctype(0.3)*cos(ctype(5*index)), 1);
+  }
+};
+
+/** \brief The closest hit of a ray with any target triangle, by trying all of them
+ *
+ * This is how NormalProjector placed the ghost nodes before it used the octree,
+ * with the same acceptance test as rayIntersectsTriangle().  Hits farther away
+ * than maxGap are ignored.
+ */
+template <typename ctype>
+bool linearScan(const StaticVector<ctype,3>& p, const StaticVector<ctype,3>& direction,
+                const vector<tr1::array<ctype,3> >& coords, const vector<tr1::array<int,3> >& tris,
+                ctype maxGap, StaticVector<ctype,3>& image) {
+  const ctype eps = 1e-4;
+  ctype bestDist = numeric_limits<ctype>::max();
+
+  for (size_t i = 0; i < tris.size(); ++i) {
+    StaticVector<ctype,3> a, b, c;
+    for (int k = 0; k < 3; ++k) {
+      a[k] = coords[tris[i][0]][k];
+      b[k] = coords[tris[i][1]][k];
+      c[k] = coords[tris[i][2]][k];
+    }
+
+    StaticVector<ctype,3> e1 = b-a, e2 = c-a;
+    e1.normalize();
+    e2.normalize();
+    if (fabs(StaticMatrix<ctype,3>(e1, e2, direction).det()) < eps)
+      continue;
+
+    ctype det = StaticMatrix<ctype,3>(b-a, c-a, direction).det();
+    ctype nu = StaticMatrix<ctype,3>(b-a, c-a, p-a).det() / det;
+    ctype lambda = StaticMatrix<ctype,3>(p-a, c-a, direction).det() / det;
+    ctype mu = StaticMatrix<ctype,3>(b-a, p-a, direction).det() / det;
+    if (nu > 1e-1 || lambda < -eps || mu < -eps || lambda + mu > 1+eps)
+      continue;
+    if (fabs(nu)*direction.length() > maxGap)
+      continue;
+
+    if (-nu < bestDist) {
+      bestDist = -nu;
+      image = (1-lambda-mu)*a + lambda*b + mu*c;
+    }
+  }
+
+  return bestDist < numeric_limits<ctype>::max();
+}
+
+/** \brief The ghost nodes found with the octree must be those found by trying all target triangles */
+template <typename ctype>
+void testGhostNodes(ctype maxGap) {
+  ostringstream message;
+  message << "ghost nodes, maximum gap " << maxGap;
+
+  // A bumpy target surface above the domain surface, larger than it
+  vector<tr1::array<ctype,3> > coords1, coords2;
+  vector<tr1::array<int,3> > tri1, tri2;
+  square<ctype>(12, 0, 1, 0, false, coords1, tri1);
+  square<ctype>(30, -0.5, 1.5, 0.2, true, coords2, tri2);
+  for (size_t i = 0; i < coords2.size(); ++i)
+    coords2[i][2] += ctype(0.05)*sin(6*coords2[i][0])*cos(5*coords2[i][1]);
+
+  PSurface<2,ctype> psurface;
+  Surface surface;
+  setup(coords1, tri1, coords2, tri2, psurface, surface);
+
+  TiltedDirections<ctype> directions;
+  NormalProjector<ctype>(&psurface).project(&surface, &directions, NULL, maxGap);
+
+  vector<StaticVector<ctype,3> > images = ghostNodeImages(psurface);
+
+  int nGhostNodes = 0;
+  for (size_t i = 0; i < coords1.size(); ++i) {
+    StaticVector<ctype,3> expected;
+    if (!linearScan(StaticVector<ctype,3>(coords1[i][0], coords1[i][1], coords1[i][2]), directions(i),
+                    coords2, tri2, maxGap, expected)) {
+      if (images[i][0] == images[i][0])
+        throw runtime_error(message.str() + ": a ghost node has been found where the linear scan finds none");
+      continue;
+    }
+
+    if (images[i][0] != images[i][0])
+      throw runtime_error(message.str() + ": a ghost node found by the linear scan is missing");
+    if ((images[i] - expected).length() > 1e-6)
+      throw runtime_error(message.str() + ": a ghost node differs from the one found by the linear scan");
+
+    nGhostNodes++;
+  }
+
+  if (nGhostNodes == 0)
+    throw runtime_error(message.str() + ": no ghost nodes");
+}
+
+/** \brief Exactly the target vertices within maxGap of the domain surface are projected onto it */
+template <typename ctype>
+void testTargetVertexNodes(ctype maxGap) {
+  ostringstream message;
+  message << "target vertex nodes, maximum gap " << maxGap;
+
+  // A target surface above the domain surface that rises from 0.05 to 0.35
+  vector<tr1::array<ctype,3> > coords1, coords2;
+  vector<tr1::array<int,3> > tri1, tri2;
+  square<ctype>(10, 0, 1, 0, false, coords1, tri1);
+  square<ctype>(7, 0.1, 0.9, 0, true, coords2, tri2);
+  for (size_t i = 0; i < coords2.size(); ++i)
+    coords2[i][2] = ctype(0.05) + ctype(0.375)*(coords2[i][0] - ctype(0.1));
+
+  PSurface<2,ctype> psurface;
+  Surface surface;
+  setup(coords1, tri1, coords2, tri2, psurface, surface);
+
+  NormalProjector<ctype>(&psurface).project(&surface, NULL, NULL, maxGap);
+
+  vector<bool> projected(coords2.size(), false);
+  for (size_t i = 0; i < psurface.getNumTriangles(); ++i) {
+    const DomainTriangle<ctype>& cT = psurface.triangles(i);
+    for (size_t j = 0; j < cT.nodes.size(); ++j)
+      if (cT.nodes[j].isINTERIOR_NODE() || cT.nodes[j].isTOUCHING_NODE() || cT.nodes[j].isCORNER_NODE())
+        projected[cT.nodes[j].getNodeNumber()] = true;
+  }
+
+  // The domain normals point straight up, hence the height of a vertex is the length of its projection
+  int nProjected = 0;
+  for (size_t i = 0; i < coords2.size(); ++i) {
+    if (projected[i] != (coords2[i][2] <= maxGap))
+      throw runtime_error(message.str() + (projected[i] ? ": a vertex farther away than maxGap has been projected"
+                                                        : ": a vertex close to the domain surface has not been projected"));
+    nProjected += projected[i];
+  }
+
+  if (nProjected == 0)
+    throw runtime_error(message.str() + ": no vertex has been projected");
+}
+
+/** \brief Gives access to the kernels of NormalProjector */
+template <typename ctype>
+struct KernelTester : public NormalProjector<ctype>
+{
+  KernelTester(PSurface<2,ctype>* psurface) : NormalProjector<ctype>(psurface) {}
+
+  using NormalProjector<ctype>::projectionBatchSize;
+  using NormalProjector<ctype>::computeInverseNormalProjections;
+  using NormalProjector<ctype>::computeInverseNormalProjection;
+  using NormalProjector<ctype>::triangleEdgesIntersectNormalFan;
+  using NormalProjector<ctype>::edgeIntersectsNormalFan;
+  using NormalProjector<ctype>::rayIntersectsTriangles;
+  using NormalProjector<ctype>::rayIntersectsTriangle;
+};
+
+/** \brief A random number in [a,b] */
+template <typename ctype>
+ctype uniform(ctype a, ctype b) {
+  return a + (b-a)*ctype(rand())/RAND_MAX;
+}
+
+/** \brief The batched kernels must give the results of the scalar ones
+ *
+ * Built with PSURFACE_SCALAR_KERNELS, the batched kernels call the scalar
+ * ones, and the other tests check the results of the scalar kernels.
+ */
+template <typename ctype>
+void testKernels() {
+  const ctype tolerance = 1e-8;
+
+  // A bumpy domain surface with tilted vertex normals
+  vector<tr1::array<ctype,3> > coords, targetCoords;
+  vector<tr1::array<int,3> > tris, targetTris;
+  square<ctype>(6, 0, 1, 0, false, coords, tris);
+  square<ctype>(1, 0, 1, 0.2, true, targetCoords, targetTris);
+  for (size_t i = 0; i < coords.size(); ++i)
+    coords[i][2] = ctype(0.1)*sin(5*coords[i][0])*cos(4*coords[i][1]);
+
+  PSurface<2,ctype> psurface;
+  Surface surface;
+  setup(coords, tris, targetCoords, targetTris, psurface, surface);
+
+  TiltedDirections<ctype> directions;
+  vector<StaticVector<ctype,3> > normals(coords.size());
+  for (size_t i = 0; i < coords.size(); ++i) {
+    normals[i] = directions(i);
+    normals[i].normalize();
+  }
+
+  KernelTester<ctype> kernels(&psurface);
+  const int B = KernelTester<ctype>::projectionBatchSize;
+  const int nTris = psurface.getNumTriangles();
+
+  for (int trial = 0; trial < 200; ++trial) {
+    StaticVector<ctype,3> target(uniform<ctype>(-0.2, 1.2), uniform<ctype>(-0.2, 1.2), uniform<ctype>(-0.3, 0.3));
+    StaticVector<ctype,3> direction(uniform<ctype>(-0.5, 0.5), uniform<ctype>(-0.5, 0.5), 1);
+    StaticVector<ctype,3> q1(uniform<ctype>(-0.2, 1.2), uniform<ctype>(-0.2, 1.2), uniform<ctype>(-0.3, 0.3));
+
+    // The inverse normal projections of a point onto all domain triangles, in batches
+    for (int first = 0; first < nTris; first += B) {
+      int batch[B];
+      const int n = min(B, nTris - first);
+      for (int k = 0; k < n; ++k)
+        batch[k] = first + k;
+
+      StaticVector<ctype,3> x[B];
+      bool success[B];
+      kernels.computeInverseNormalProjections(batch, n, normals, target, x, success);
+
+      for (int k = 0; k < n; ++k) {
+        const DomainTriangle<ctype>& cT = psurface.triangles(batch[k]);
+        StaticVector<ctype,3> expected;
+        bool expectedSuccess = kernels.computeInverseNormalProjection(psurface.vertices(cT.vertices[0]),
+                                                                      psurface.vertices(cT.vertices[1]),
+                                                                      psurface.vertices(cT.vertices[2]),
+                                                                      normals[cT.vertices[0]],
+                                                                      normals[cT.vertices[1]],
+                                                                      normals[cT.vertices[2]],
+                                                                      target, expected);
+        if (success[k] != expectedSuccess)
+          throw runtime_error("computeInverseNormalProjections() and computeInverseNormalProjection() disagree on a hit");
+        if (success[k] && (x[k] - expected).length() > tolerance)
+          throw runtime_error("computeInverseNormalProjections() differs from computeInverseNormalProjection()");
+      }
+    }
+
+    // A target edge against the normal fans of the edges of all domain triangles
+    for (int tri = 0; tri < nTris; ++tri) {
+      StaticVector<ctype,3> x[3];
+      bool hit[3];
+      kernels.triangleEdgesIntersectNormalFan(target, q1, tri, -1, normals, x, hit);
+
+      const DomainTriangle<ctype>& cT = psurface.triangles(tri);
+      for (int k = 0; k < 3; ++k) {
+        const int p = cT.vertices[k], q = cT.vertices[(k+1)%3];
+        StaticVector<ctype,3> expected(0, 0, 0);
+        bool expectedHit = kernels.edgeIntersectsNormalFan(target, q1, psurface.vertices(p), psurface.vertices(q),
+                                                           normals[p], normals[q], expected);
+        if (hit[k] != expectedHit)
+          throw runtime_error("triangleEdgesIntersectNormalFan() and edgeIntersectsNormalFan() disagree on a hit");
+        if (hit[k] && (x[k] - expected).length() > tolerance)
+          throw runtime_error("triangleEdgesIntersectNormalFan() differs from edgeIntersectsNormalFan()");
+      }
+    }
+
+    // A ray against all domain triangles, in batches
+    for (int first = 0; first < nTris; first += B) {
+      const int n = min(B, nTris - first);
+      StaticVector<ctype,3> a[B], b[B], c[B];
+      for (int k = 0; k < n; ++k) {
+        const DomainTriangle<ctype>& cT = psurface.triangles(first + k);
+        a[k] = psurface.vertices(cT.vertices[0]);
+        b[k] = psurface.vertices(cT.vertices[1]);
+        c[k] = psurface.vertices(cT.vertices[2]);
+      }
+
+      StaticVector<ctype,2> localCoords[B];
+      ctype normalDist[B];
+      bool hit[B];
+      kernels.rayIntersectsTriangles(target, direction, a, b, c, n, localCoords, normalDist, hit, ctype(1e-4));
+
+      for (int k = 0; k < n; ++k) {
+        StaticVector<ctype,2> expectedCoords;
+        ctype expectedDist;
+        bool expectedHit = kernels.rayIntersectsTriangle(target, direction, a[k], b[k], c[k],
+                                                         expectedCoords, expectedDist, ctype(1e-4));
+        if (hit[k] != expectedHit)
+          throw runtime_error("rayIntersectsTriangles() and rayIntersectsTriangle() disagree on a hit");
+        if (hit[k] && ((localCoords[k] - expectedCoords).length() > tolerance
+                       || fabs(normalDist[k] - expectedDist) > tolerance))
+          throw runtime_error("rayIntersectsTriangles() differs from rayIntersectsTriangle()");
+      }
+    }
+  }
+}
+
+int main (int argc, char* argv[]) {
+
+#ifdef PSURFACE_SCALAR_KERNELS
+  cout << "Testing the scalar projection kernels" << endl;
+#else
+  cout << "Testing the batched projection kernels" << endl;
+#endif
+
+  try {
+    testKernels<double>();
+
+    testClosestPointFallback<double>(false, 1);
+    testClosestPointFallback<double>(true, 1);
+    testClosestPointFallback<double>(true, 0.15);
+
+    testGhostNodes<double>(numeric_limits<double>::max());
+    testGhostNodes<double>(0.5);
+    testGhostNodes<double>(0.2);
+
+    testTargetVertexNodes<double>(numeric_limits<double>::max());
+    testTargetVertexNodes<double>(0.2);
+  } catch (const exception& e) {
+    cout << e.what() << endl;
+
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,617 @@
+#include "config.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "StaticVector.h"
+#include "SurfaceParts.h"
+#include "LinearOctree.h"
+#include "MultiDimOctree.h"
+#include "EdgeIntersectionFunctor.h"
+#include "PointIntersectionFunctor.h"
+
+using namespace std;
+using namespace psurface;
+
+typedef LinearOctree<Edge, EdgeIntersectionFunctor, float, 3> LinearEdgeTree;
+typedef MultiDimOctree<Edge, EdgeIntersectionFunctor, float, 3> EdgeTree;
+typedef MultiDimOctree<StaticVector<float,3>, PointIntersectionFunctor<float>, float, 3> PointTree;
+typedef LinearOctree<StaticVector<float,3>, PointIntersectionFunctor<float>, float, 3> LinearPointTree;
+
+float random(float lower, float upper) {
+  return lower + (upper - lower) * rand() / RAND_MAX;
+}
+
+/** \brief n short random edges in the unit cube */
+void randomEdges(int n, vector<Vertex<float> >& vertices, vector<Edge>& edges) {
+  for (int i = 0; i < n; ++i) {
+    StaticVector<float,3> a(random(0, 1), random(0, 1), random(0, 1));
+    StaticVector<float,3> b(a[0] + random(-0.1, 0.1), a[1] + random(-0.1, 0.1), a[2] + random(-0.1, 0.1));
+    vertices.push_back(Vertex<float>(a));
+    vertices.push_back(Vertex<float>(b));
+    edges.push_back(Edge(2*i, 2*i+1));
+  }
+}
+
+Box<float,3> randomBox(float size) {
+  tr1::array<float,3> lower, upper;
+  for (int i = 0; i < 3; ++i) {
+    lower[i] = random(-0.1, 1);
+    upper[i] = lower[i] + random(0, size);
+  }
+  return Box<float,3>(lower, upper);
+}
+
+void check_same(vector<int> a, vector<int> b, char const * const message) {
+  sort(a.begin(), a.end());
+  sort(b.begin(), b.end());
+  if (a != b)
+    throw runtime_error(message);
+}
+
+/** \brief Compare the lookups of a LinearOctree with a brute-force search */
+void testLinearOctree(int n) {
+  vector<Vertex<float> > vertices;
+  vector<Edge> edges;
+  randomEdges(n, vertices, edges);
+
+  // The bounding box contains all edges
+  tr1::array<float,3> lower = {{-0.2, -0.2, -0.2}}, upper = {{1.2, 1.2, 1.2}};
+  Box<float,3> box(lower, upper);
+  EdgeIntersectionFunctor ef(&vertices[0]);
+
+  LinearEdgeTree linearTree(box, &ef);
+  linearTree.build(&edges[0], &edges[0] + n);
+
+  for (int k = 0; k < 1000; ++k) {
+    Box<float,3> queryBox = randomBox((k % 2) ? 0.05 : 0.3);
+
+    vector<int> expected, result;
+    for (int i = 0; i < n; ++i)
+      if (ef(queryBox.lower(), queryBox.upper(), edges[i]))
+        expected.push_back(i);
+
+    linearTree.lookupIndex(queryBox, result);
+    check_same(result, expected, "box lookup is wrong");
+
+    // The pointer version must report the same elements
+    LinearEdgeTree::ResultContainer pointers;
+    linearTree.lookup(queryBox, pointers);
+    if (pointers.size() != result.size())
+      throw runtime_error("box lookups of pointers and indices differ");
+    for (size_t i = 0; i < pointers.size(); ++i)
+      if (pointers[i] - &edges[0] != result[i])
+        throw runtime_error("box lookups of pointers and indices differ");
+  }
+
+  // A point lookup has to return at least all edges through a point
+  for (int k = 0; k < 1000; ++k) {
+    const Edge& edge = edges[rand() % n];
+    float lambda = random(0, 1);
+    tr1::array<float,3> pos;
+    for (int i = 0; i < 3; ++i)
+      pos[i] = (1-lambda) * vertices[edge.from][i] + lambda * vertices[edge.to][i];
+
+    if (!box.contains(pos))
+      continue;
+
+    vector<int> result;
+    linearTree.lookupIndex(pos, result);
+    if (find(result.begin(), result.end(), &edge - &edges[0]) == result.end())
+      throw runtime_error("point lookup misses an element");
+  }
+}
+
+vector<int> indices(const vector<Edge*>& pointers, const vector<Edge>& edges) {
+  vector<int> result;
+  for (size_t i = 0; i < pointers.size(); ++i)
+    result.push_back(pointers[i] - &edges[0]);
+  return result;
+}
+
+/** \brief The Euclidean distance of two points */
+struct PointDistance {
+  float operator()(const tr1::array<float,3>& pos, const StaticVector<float,3>& p) const {
+    return sqrt((pos[0]-p[0])*(pos[0]-p[0]) + (pos[1]-p[1])*(pos[1]-p[1]) + (pos[2]-p[2])*(pos[2]-p[2]));
+  }
+};
+
+/** \brief The segment and nearest lookups of a LinearOctree, also after a round trip
+    through write() and read(), must give the results of a MultiDimOctree */
+void testLinearOctreeQueries(int n) {
+  vector<Vertex<float> > vertices;
+  vector<Edge> edges;
+  randomEdges(n, vertices, edges);
+
+  tr1::array<float,3> lower = {{-0.2, -0.2, -0.2}}, upper = {{1.2, 1.2, 1.2}};
+  Box<float,3> box(lower, upper);
+  EdgeIntersectionFunctor ef(&vertices[0]);
+
+  EdgeTree tree(box, &ef);
+  tree.build(&edges[0], &edges[0] + n);
+  tree.enableUniqueLookup(n, &edges[0]);
+
+  LinearEdgeTree linearTree(box, &ef);
+  linearTree.build(&edges[0], &edges[0] + n);
+
+  ostringstream out;
+  linearTree.write(out, &edges[0]);
+  string data = out.str();
+
+  LinearEdgeTree readTree;
+  readTree.init(Box<float,3>(), &ef);
+  if (readTree.read(data.data(), data.data() + data.size(), &edges[0], n) != data.data() + data.size())
+    throw runtime_error("tree data not read completely");
+
+  OctreeLookupScratch scratch;
+
+  for (int k = 0; k < 200; ++k) {
+    tr1::array<float,3> from, direction;
+    for (int i = 0; i < 3; ++i) {
+      from[i] = random(-0.5, 1.5);
+      direction[i] = (k % 4 == 0 && i == 0) ? 0 : random(-1, 1);
+    }
+
+    vector<Edge*> expected, result, readResult;
+    OctreeSegmentCollector<Edge,float> expectedCollector(expected), collector(result), readCollector(readResult);
+    tree.traverseSegment(from, direction, -0.5f, 1.5f, expectedCollector, scratch);
+    linearTree.traverseSegment(from, direction, -0.5f, 1.5f, collector, scratch);
+    readTree.traverseSegment(from, direction, -0.5f, 1.5f, readCollector, scratch);
+
+    check_same(indices(result, edges), indices(expected, edges), "segment traversal of the linear octree is wrong");
+    check_same(indices(readResult, edges), indices(expected, edges), "segment traversal of the tree read back is wrong");
+  }
+
+  // Nearest lookups, on points which are in one leaf each
+  vector<StaticVector<float,3> > points(n);
+  for (int i = 0; i < n; ++i)
+    points[i] = StaticVector<float,3>(random(0, 1), random(0, 1), random(0, 1));
+
+  tr1::array<float,3> unitLower = {{0, 0, 0}}, unitUpper = {{1, 1, 1}};
+  PointIntersectionFunctor<float> pf;
+  PointDistance distance;
+
+  PointTree pointTree(Box<float,3>(unitLower, unitUpper), &pf);
+  pointTree.build(&points[0], &points[0] + n);
+  pointTree.enableUniqueLookup(n, &points[0]);
+
+  LinearPointTree linearPointTree(Box<float,3>(unitLower, unitUpper), &pf);
+  linearPointTree.build(&points[0], &points[0] + n);
+
+  for (int q = 0; q < 200; ++q) {
+    tr1::array<float,3> pos = {{random(-0.2, 1.2), random(-0.2, 1.2), random(-0.2, 1.2)}};
+    const int k = 1 + q % 10;
+    const float maxDistance = (q % 3 == 0) ? 0.05 : numeric_limits<float>::max();
+
+    PointTree::ResultContainer expected, result;
+    vector<float> expectedDistances, distances;
+    pointTree.lookupNearest(pos, k, distance, expected, expectedDistances, scratch, maxDistance);
+    linearPointTree.lookupNearest(pos, k, distance, result, distances, scratch, maxDistance);
+
+    if (result != expected || distances != expectedDistances)
+      throw runtime_error("nearest lookup of the linear octree is wrong");
+  }
+
+  // corrupt data: a subtree that ends before the cell, and items out of range
+  string corrupt(data);
+  const size_t cells = 6*sizeof(int) + 6*sizeof(float);
+  int invalid = 0;
+  corrupt.replace(cells + 3*sizeof(int), sizeof(int), (const char*)&invalid, sizeof(int));
+
+  bool thrown = false;
+  try {
+    readTree.read(corrupt.data(), corrupt.data() + corrupt.size(), &edges[0], n);
+  } catch (const runtime_error&) {
+    thrown = true;
+  }
+  if (!thrown)
+    throw runtime_error("tree with an invalid subtree accepted");
+
+  thrown = false;
+  try {
+    readTree.read(data.data(), data.data() + data.size(), &edges[0], n/2);
+  } catch (const runtime_error&) {
+    thrown = true;
+  }
+  if (!thrown)
+    throw runtime_error("tree with items out of range accepted");
+}
+
+/** \brief Compare the box lookups of a MultiDimOctree, built at once and by insertion, with a brute-force search */
+void testMultiDimOctree(int n) {
+  vector<Vertex<float> > vertices;
+  vector<Edge> edges;
+  randomEdges(n, vertices, edges);
+
+  tr1::array<float,3> lower = {{-0.2, -0.2, -0.2}}, upper = {{1.2, 1.2, 1.2}};
+  Box<float,3> box(lower, upper);
+  EdgeIntersectionFunctor ef(&vertices[0]);
+
+  EdgeTree builtTree(box, &ef), insertedTree(box, &ef);
+  builtTree.build(&edges[0], &edges[0] + n);
+  for (int i = 0; i < n; ++i)
+    insertedTree.insert(&edges[i]);
+
+  builtTree.enableUniqueLookup(n, &edges[0]);
+  insertedTree.enableUniqueLookup(n, &edges[0]);
+
+  for (int k = 0; k < 1000; ++k) {
+    Box<float,3> queryBox = randomBox((k % 2) ? 0.05 : 0.3);
+
+    vector<int> expected;
+    for (int i = 0; i < n; ++i)
+      if (ef(queryBox.lower(), queryBox.upper(), edges[i]))
+        expected.push_back(i);
+
+    EdgeTree::ResultContainer built, inserted;
+    builtTree.lookup(queryBox, built);
+    insertedTree.lookup(queryBox, inserted);
+
+    vector<int> builtIndices, insertedIndices;
+    for (size_t i = 0; i < built.size(); ++i)
+      builtIndices.push_back(built[i] - &edges[0]);
+    for (size_t i = 0; i < inserted.size(); ++i)
+      insertedIndices.push_back(inserted[i] - &edges[0]);
+
+    check_same(builtIndices, expected, "box lookup of the built octree is wrong");
+    check_same(insertedIndices, expected, "box lookup of the inserted octree is wrong");
+  }
+}
+
+/** \brief A tree read back from its binary form gives the same lookups as the original */
+void testWriteRead(int n) {
+  vector<Vertex<float> > vertices;
+  vector<Edge> edges;
+  randomEdges(n, vertices, edges);
+
+  tr1::array<float,3> lower = {{-0.2, -0.2, -0.2}}, upper = {{1.2, 1.2, 1.2}};
+  EdgeIntersectionFunctor ef(&vertices[0]);
+
+  EdgeTree tree(Box<float,3>(lower, upper), &ef);
+  tree.build(&edges[0], &edges[0] + n);
+
+  ostringstream out;
+  tree.write(out, &edges[0]);
+  string data = out.str();
+
+  // the tree is read for a copy of the edges
+  vector<Edge> copies(edges);
+  EdgeTree readTree;
+  readTree.init(Box<float,3>(), &ef);
+  if (readTree.read(data.data(), data.data() + data.size(), &copies[0], n) != data.data() + data.size())
+    throw runtime_error("tree data not read completely");
+
+  tree.enableUniqueLookup(n, &edges[0]);
+  readTree.enableUniqueLookup(n, &copies[0]);
+
+  // the tree can be modified afterwards
+  readTree.remove(&copies[0]);
+  readTree.insert(&copies[0]);
+
+  for (int k = 0; k < 1000; ++k) {
+    Box<float,3> queryBox = randomBox((k % 2) ? 0.05 : 0.3);
+
+    vector<int> expected, result;
+    tree.lookupIndex(queryBox, expected);
+    readTree.lookupIndex(queryBox, result);
+
+    check_same(result, expected, "box lookup of the tree read back is wrong");
+  }
+
+  // data that does not fit
+  bool thrown = false;
+  try {
+    readTree.read(data.data(), data.data() + data.size(), &copies[0], n/2);
+  } catch (const runtime_error&) {
+    thrown = true;
+  }
+  if (!thrown)
+    throw runtime_error("tree with items out of range accepted");
+}
+
+/** \brief Compare the slab test of EdgeIntersectionFunctor with points sampled on the edges,
+    and the test against all subcells at once with the tests of the single subcells */
+void testEdgeFunctor(int n) {
+  vector<Vertex<float> > vertices;
+  vector<Edge> edges;
+  randomEdges(n, vertices, edges);
+
+  // edges parallel to the coordinate planes, some of them in the planes of the box faces
+  for (int i = 0; i < n; ++i) {
+    StaticVector<float,3> a = vertices[2*i], b = vertices[2*i+1];
+    int direction = i % 3;
+    b[direction] = a[direction] = (i % 2) ? 0.25 : a[direction];
+    vertices.push_back(Vertex<float>(a));
+    vertices.push_back(Vertex<float>(b));
+    edges.push_back(Edge(2*(n+i), 2*(n+i)+1));
+  }
+
+  EdgeIntersectionFunctor ef(&vertices[0]);
+
+  for (int k = 0; k < 200; ++k) {
+    Box<float,3> box = (k % 2) ? randomBox(0.3) : Box<float,3>(StaticVector<float,3>(0.25, 0.25, 0.25),
+                                                                StaticVector<float,3>(0.75, 0.75, 0.75));
+
+    for (size_t i = 0; i < edges.size(); ++i) {
+      bool hits[8];
+      intersectSubcells(ef, box, edges[i], hits);
+
+      for (int j = 0; j < 8; ++j) {
+        tr1::array<float,3> lower, upper;
+        for (int d = 0; d < 3; ++d) {
+          lower[d] = (j & (1 << d)) ? box.center()[d] : box.lower()[d];
+          upper[d] = (j & (1 << d)) ? box.upper()[d] : box.center()[d];
+        }
+
+        bool hit = ef(lower, upper, edges[i]);
+        if (hits[j] != hit)
+          throw runtime_error("subcell test differs from the test of the single subcell");
+
+        // a point of the edge within the subcell
+        const StaticVector<float,3>& a = vertices[edges[i].from];
+        const StaticVector<float,3>& b = vertices[edges[i].to];
+        for (int s = 0; s <= 20 && !hit; ++s) {
+          StaticVector<float,3> p = a + (b - a) * (s / 20.0f);
+          if (p[0] > lower[0] && p[0] < upper[0] && p[1] > lower[1] && p[1] < upper[1]
+              && p[2] > lower[2] && p[2] < upper[2])
+            throw runtime_error("edge misses a box that contains one of its points");
+        }
+      }
+    }
+  }
+}
+
+/** \brief Run the const box lookups of both octrees from several threads at once */
+void testConcurrentLookups(int n) {
+  vector<Vertex<float> > vertices;
+  vector<Edge> edges;
+  randomEdges(n, vertices, edges);
+
+  tr1::array<float,3> lower = {{-0.2, -0.2, -0.2}}, upper = {{1.2, 1.2, 1.2}};
+  Box<float,3> box(lower, upper);
+  EdgeIntersectionFunctor ef(&vertices[0]);
+
+  EdgeTree tree(box, &ef);
+  tree.build(&edges[0], &edges[0] + n);
+  tree.enableUniqueLookup(n, &edges[0]);
+
+  LinearEdgeTree linearTree(box, &ef);
+  linearTree.build(&edges[0], &edges[0] + n);
+
+  const int numQueries = 1000;
+  vector<Box<float,3> > queryBoxes;
+  for (int k = 0; k < numQueries; ++k)
+    queryBoxes.push_back(randomBox((k % 2) ? 0.05 : 0.3));
+
+  // The results of the serial, non-const lookups
+  vector<vector<int> > expected(numQueries), expectedLinear(numQueries);
+  for (int k = 0; k < numQueries; ++k) {
+    tree.lookupIndex(queryBoxes[k], expected[k]);
+    linearTree.lookupIndex(queryBoxes[k], expectedLinear[k]);
+  }
+
+  const EdgeTree& constTree = tree;
+  const LinearEdgeTree& constLinearTree = linearTree;
+  vector<vector<int> > result(numQueries), resultLinear(numQueries);
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+  {
+    OctreeLookupScratch scratch;
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for (int k = 0; k < numQueries; ++k) {
+      constTree.lookupIndex(queryBoxes[k], result[k], scratch);
+      constLinearTree.lookupIndex(queryBoxes[k], resultLinear[k], scratch);
+    }
+  }
+
+  for (int k = 0; k < numQueries; ++k) {
+    check_same(result[k], expected[k], "concurrent lookup differs from the serial one");
+    check_same(resultLinear[k], expectedLinear[k], "concurrent lookup differs from the serial one");
+  }
+}
+
+/** \brief Shortens the segment to half its length as soon as it visits an element */
+struct HalfSegmentVisitor {
+  HalfSegmentVisitor(vector<Edge*>& result) : result(result) {}
+
+  void operator()(Edge* edge, float& tMax) {
+    result.push_back(edge);
+    tMax = min(tMax, 0.5f);
+  }
+
+  vector<Edge*>& result;
+};
+
+/** \brief Check the segment queries against point lookups along the segment */
+void testSegmentLookups(int n) {
+  vector<Vertex<float> > vertices;
+  vector<Edge> edges;
+  randomEdges(n, vertices, edges);
+
+  tr1::array<float,3> lower = {{-0.2, -0.2, -0.2}}, upper = {{1.2, 1.2, 1.2}};
+  Box<float,3> box(lower, upper);
+  EdgeIntersectionFunctor ef(&vertices[0]);
+
+  EdgeTree tree(box, &ef);
+  tree.build(&edges[0], &edges[0] + n);
+  tree.enableUniqueLookup(n, &edges[0]);
+
+  OctreeLookupScratch scratch;
+
+  for (int k = 0; k < 200; ++k) {
+    // The segments may start and end outside of the tree
+    tr1::array<float,3> from, to, mid;
+    for (int i = 0; i < 3; ++i) {
+      from[i] = random(-0.5, 1.5);
+      to[i]   = (k % 4 == 0 && i == 0) ? from[i] : random(-0.5, 1.5);
+      mid[i]  = 0.5 * (from[i] + to[i]);
+    }
+
+    EdgeTree::ResultContainer segmentResult;
+    tree.lookupSegment(from, to, segmentResult, scratch);
+    vector<int> segmentIndices = indices(segmentResult, edges);
+    sort(segmentIndices.begin(), segmentIndices.end());
+
+    if (adjacent_find(segmentIndices.begin(), segmentIndices.end()) != segmentIndices.end())
+      throw runtime_error("segment lookup reports an element twice");
+
+    // The leaf of each point on the segment has been visited
+    for (int j = 0; j <= 100; ++j) {
+      tr1::array<float,3> pos;
+      for (int i = 0; i < 3; ++i)
+        pos[i] = from[i] + (to[i] - from[i]) * j / 100.0;
+
+      vector<int> pointIndices;
+      tree.lookupIndex(pos, pointIndices, scratch);
+      for (size_t i = 0; i < pointIndices.size(); ++i)
+        if (!binary_search(segmentIndices.begin(), segmentIndices.end(), pointIndices[i]))
+          throw runtime_error("segment lookup misses an element");
+    }
+
+    // Shortening the segment during the traversal stops it at the new end
+    EdgeTree::ResultContainer halfResult, shortenedResult;
+    tree.lookupSegment(from, mid, halfResult, scratch);
+
+    tr1::array<float,3> direction;
+    for (int i = 0; i < 3; ++i)
+      direction[i] = to[i] - from[i];
+    HalfSegmentVisitor visitor(shortenedResult);
+    tree.traverseSegment(from, direction, 0.0f, 1.0f, visitor, scratch);
+
+    // Unless the first half is empty, the segment is shortened in a leaf entered before the middle
+    if (!halfResult.empty())
+      check_same(indices(shortenedResult, edges), indices(halfResult, edges), "segment traversal does not stop early");
+  }
+}
+
+/** \brief Tests a point against an OctreeCone */
+struct ConeContainsPoint {
+  bool operator()(const OctreeCone<float,3>& cone, const StaticVector<float,3>& p) const {
+    return cone.contains(p);
+  }
+};
+
+/** \brief Compare cone lookups with a brute-force search */
+void testConeLookups(int n) {
+  vector<StaticVector<float,3> > points(n);
+  for (int i = 0; i < n; ++i)
+    points[i] = StaticVector<float,3>(random(0, 1), random(0, 1), random(0, 1));
+
+  tr1::array<float,3> lower = {{0, 0, 0}}, upper = {{1, 1, 1}};
+  PointIntersectionFunctor<float> pf;
+
+  PointTree tree(Box<float,3>(lower, upper), &pf);
+  tree.build(&points[0], &points[0] + n);
+  tree.enableUniqueLookup(n, &points[0]);
+
+  OctreeLookupScratch scratch;
+
+  for (int k = 0; k < 200; ++k) {
+    tr1::array<float,3> apex, axis;
+    for (int i = 0; i < 3; ++i) {
+      apex[i] = random(-0.2, 1.2);
+      axis[i] = random(-1, 1);
+    }
+    OctreeCone<float,3> cone(apex, axis, random(0.05, 1), random(0.1, 1));
+
+    vector<int> expected, result;
+    for (int i = 0; i < n; ++i)
+      if (cone.contains(points[i]))
+        expected.push_back(i);
+
+    PointTree::ResultContainer pointers;
+    tree.lookupRegion(cone, ConeContainsPoint(), pointers, scratch);
+    for (size_t i = 0; i < pointers.size(); ++i)
+      result.push_back(pointers[i] - &points[0]);
+
+    check_same(result, expected, "cone lookup is wrong");
+  }
+}
+
+/** \brief Compare nearest-neighbor lookups with a brute-force search */
+void testNearestLookups(int n) {
+  vector<StaticVector<float,3> > points(n);
+  for (int i = 0; i < n; ++i)
+    points[i] = StaticVector<float,3>(random(0, 1), random(0, 1), random(0, 1));
+
+  tr1::array<float,3> lower = {{0, 0, 0}}, upper = {{1, 1, 1}};
+  PointIntersectionFunctor<float> pf;
+  PointDistance distance;
+
+  // With unique lookup, and with points in several leafs each
+  PointTree tree(Box<float,3>(lower, upper), &pf);
+  tree.build(&points[0], &points[0] + n);
+  tree.enableUniqueLookup(n, &points[0]);
+
+  PointTree insertedTree(Box<float,3>(lower, upper), &pf);
+  for (int i = 0; i < n; ++i)
+    insertedTree.insert(&points[i]);
+
+  OctreeLookupScratch scratch;
+
+  for (int q = 0; q < 200; ++q) {
+    tr1::array<float,3> pos = {{random(-0.2, 1.2), random(-0.2, 1.2), random(-0.2, 1.2)}};
+    const int k = 1 + q % 10;
+    const float maxDistance = (q % 3 == 0) ? 0.05 : numeric_limits<float>::max();
+
+    vector<pair<float,int> > all;
+    for (int i = 0; i < n; ++i)
+      if (distance(pos, points[i]) <= maxDistance)
+        all.push_back(make_pair(distance(pos, points[i]), i));
+    sort(all.begin(), all.end());
+
+    vector<int> expected;
+    for (int i = 0; i < k && i < int(all.size()); ++i)
+      expected.push_back(all[i].second);
+
+    for (int t = 0; t < 2; ++t) {
+      PointTree::ResultContainer result;
+      vector<float> distances;
+      ((t == 0) ? tree : insertedTree).lookupNearest(pos, k, distance, result, distances, scratch, maxDistance);
+
+      if (result.size() != expected.size())
+        throw runtime_error("nearest lookup returns the wrong number of elements");
+      for (size_t i = 0; i < result.size(); ++i)
+        if (result[i] - &points[0] != expected[i] || distances[i] != all[i].first)
+          throw runtime_error("nearest lookup is wrong");
+    }
+
+    float bestDistance;
+    StaticVector<float,3>* nearest = tree.lookupNearest(pos, distance, bestDistance, scratch, maxDistance);
+    if ((nearest == NULL) != all.empty() || (nearest && nearest - &points[0] != all[0].second))
+      throw runtime_error("nearest lookup is wrong");
+  }
+}
+
+int main (int argc, char* argv[]) {
+
+  try {
+    testLinearOctree(5000);
+    testLinearOctreeQueries(5000);
+    testMultiDimOctree(5000);
+    testEdgeFunctor(500);
+    testWriteRead(5000);
+    testConcurrentLookups(5000);
+    testSegmentLookups(5000);
+    testConeLookups(20000);
+    testNearestLookups(20000);
+  } catch (const exception& e) {
+    cout << e.what() << endl;
+
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,113 @@
+#include "config.h"
+
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef PSURFACE_STANDALONE
+#include "TargetSurface.h"
+#else
+#include "hxsurface/Surface.h"
+#endif
+
+#include "PSurface.h"
+#include "GmshIO.h"
+#include "ContactMapping.h"
+#include "IntersectionPrimitiveCollector.h"
+
+#include "testsurfaces.h"
+
+using namespace std;
+using namespace psurface;
+
+
+template <typename ctype>
+void compare(const vector<IntersectionPrimitive<2,ctype> >& a,
+             const vector<IntersectionPrimitive<2,ctype> >& b,
+             char const * const message) {
+  if (a.empty())
+    throw runtime_error(string(message) + ": no overlaps found");
+
+  if (a.size() != b.size())
+    throw runtime_error(string(message) + ": numbers of overlaps differ");
+
+  for (size_t k = 0; k < a.size(); ++k) {
+    if (a[k].tris != b[k].tris)
+      throw runtime_error(string(message) + ": overlapping triangles differ");
+
+    for (int j = 0; j < 3; ++j)
+      for (int c = 0; c < 3; ++c)
+        if (std::abs(a[k].points[j][c] - b[k].points[j][c]) > 1e-6)
+          throw runtime_error(string(message) + ": overlaps differ");
+  }
+}
+
+/** \brief Building a contact mapping again must not reuse the overlaps of the first build */
+template <typename ctype>
+void testReprojection() {
+  vector<tr1::array<ctype,3> > coords[3];
+  vector<tr1::array<int,3> > tris[3];
+  square<ctype>(20, 0, 1, 0, false, coords[0], tris[0]);
+  square<ctype>(27, 0, 1, 0.01, true, coords[1], tris[1]);
+  square<ctype>(13, 0, 1, 0.02, true, coords[2], tris[2]);
+
+  ContactMapping<3,ctype> contactMapping;
+  contactMapping.build(coords[0], tris[0], coords[1], tris[1]);
+
+  vector<IntersectionPrimitive<2,ctype> > first;
+  contactMapping.getOverlaps(first);
+
+  contactMapping.build(coords[0], tris[0], coords[2], tris[2]);
+
+  vector<IntersectionPrimitive<2,ctype> > second;
+  contactMapping.getOverlaps(second);
+
+  ContactMapping<3,ctype> fresh;
+  fresh.build(coords[0], tris[0], coords[2], tris[2]);
+
+  vector<IntersectionPrimitive<2,ctype> > expected;
+  fresh.getOverlaps(expected);
+
+  compare(second, expected, "re-projection");
+}
+
+/** \brief Overlaps collected after a simplification must match those of a freshly simplified surface */
+void testSimplification(const string& filename) {
+  for (int index = 0; index < 8; ++index) {
+    auto_ptr<PSurface<2,float> > par(GmshIO<float,2>::readGmsh(filename));
+
+    vector<IntersectionPrimitive<2,float> > before;
+    IntersectionPrimitiveCollector<float>::collect(par.get(), before);
+
+    removeNode(par.get(), index);
+
+    vector<IntersectionPrimitive<2,float> > after;
+    IntersectionPrimitiveCollector<float>::collect(par.get(), after);
+
+    auto_ptr<PSurface<2,float> > fresh(GmshIO<float,2>::readGmsh(filename));
+    removeNode(fresh.get(), index);
+
+    vector<IntersectionPrimitive<2,float> > expected;
+    IntersectionPrimitiveCollector<float>::collect(fresh.get(), expected);
+
+    compare(after, expected, "simplification");
+  }
+}
+
+int main (int argc, char* argv[]) {
+
+  try {
+    testReprojection<double>();
+    testSimplification("examplefiles/tricube-anticlockwise.msh");
+    testSimplification("examplefiles/tricube-clockwise.msh");
+  } catch (const exception& e) {
+    cout << e.what() << endl;
+
+    return 1;
+  }
+
+  return 0;
+}
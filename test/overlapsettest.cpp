@@ -0,0 +1,147 @@
+#include "config.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "ContactMapping.h"
+
+#include "testsurfaces.h"
+
+using namespace std;
+using namespace psurface;
+
+
+/** \brief Collects all chunks it is handed */
+template <int dim, typename ctype>
+struct CollectingVisitor : public OverlapVisitor<dim,ctype> {
+  vector<IntersectionPrimitive<dim,ctype> > overlaps;
+  size_t maxChunk;
+
+  CollectingVisitor() : maxChunk(0) {}
+
+  void visit(const IntersectionPrimitive<dim,ctype>* chunk, size_t n) {
+    maxChunk = max(maxChunk, n);
+    overlaps.insert(overlaps.end(), chunk, chunk+n);
+  }
+};
+
+template <int dim, typename ctype>
+bool equal(const IntersectionPrimitive<dim,ctype>& a, const IntersectionPrimitive<dim,ctype>& b) {
+  if (a.tris != b.tris)
+    return false;
+
+  for (int j = 0; j < dim+1; ++j) {
+    for (int c = 0; c < dim+1; ++c)
+      if (a.points[j][c] != b.points[j][c])
+        return false;
+    for (int c = 0; c < dim; ++c)
+      if (a.localCoords[0][j][c] != b.localCoords[0][j][c] || a.localCoords[1][j][c] != b.localCoords[1][j][c])
+        return false;
+  }
+
+  return true;
+}
+
+template <int dim, typename ctype>
+void check_overlaps(const vector<IntersectionPrimitive<dim,ctype> >& overlaps,
+                    const OverlapSet<dim,ctype>& overlapSet,
+                    const CollectingVisitor<dim,ctype>& visitor,
+                    size_t chunkSize, char const * const message) {
+  if (overlaps.empty())
+    throw runtime_error(string(message) + ": no overlaps found");
+
+  if (overlapSet.size() != overlaps.size() || visitor.overlaps.size() != overlaps.size())
+    throw runtime_error(string(message) + ": numbers of overlaps differ");
+
+  if (visitor.maxChunk > chunkSize)
+    throw runtime_error(string(message) + ": chunk too large");
+
+  IntersectionPrimitive<dim,ctype> primitive;
+  for (size_t k = 0; k < overlaps.size(); ++k) {
+    overlapSet.get(k, primitive);
+    if (!equal(primitive, overlaps[k]) || !equal(visitor.overlaps[k], overlaps[k]))
+      throw runtime_error(string(message) + ": overlaps differ");
+  }
+
+  // round trip through the array of structs
+  vector<IntersectionPrimitive<dim,ctype> > primitives;
+  OverlapSet<dim,ctype>(overlaps).toPrimitives(primitives);
+  for (size_t k = 0; k < overlaps.size(); ++k)
+    if (!equal(primitives[k], overlaps[k]))
+      throw runtime_error(string(message) + ": conversion failed");
+}
+
+/** \brief Two unit squares, triangulated with n resp. m squares per side, on top of each other */
+template <typename ctype>
+void test3d(int n, int m, size_t chunkSize) {
+  vector<tr1::array<ctype,3> > coords[2];
+  vector<tr1::array<int,3> > tris[2];
+
+  // The surfaces face each other, hence the second one is oriented the other way
+  square<ctype>(n, 0, 1, 0, false, coords[0], tris[0]);
+  square<ctype>(m, 0, 1, 0.01, true, coords[1], tris[1]);
+
+  ContactMapping<3,ctype> contactMapping;
+  contactMapping.build(coords[0], tris[0], coords[1], tris[1]);
+
+  vector<IntersectionPrimitive<2,ctype> > overlaps;
+  contactMapping.getOverlaps(overlaps);
+
+  OverlapSet<2,ctype> overlapSet;
+  contactMapping.getOverlaps(overlapSet);
+
+  CollectingVisitor<2,ctype> visitor;
+  contactMapping.getOverlaps(visitor, chunkSize);
+
+  check_overlaps(overlaps, overlapSet, visitor, chunkSize, "3d overlaps");
+}
+
+/** \brief Two unit segments, divided into n resp. m parts, on top of each other */
+template <typename ctype>
+void test2d(int n, int m, size_t chunkSize) {
+  vector<tr1::array<ctype,2> > coords[2];
+  vector<tr1::array<int,2> > segments[2];
+
+  for (int s = 0; s < 2; ++s) {
+    const int N = (s == 0) ? n : m;
+
+    for (int i = 0; i <= N; ++i) {
+      tr1::array<ctype,2> p = {{ctype((s == 0) ? i : N-i)/N, ctype(0.01)*s}};
+      coords[s].push_back(p);
+    }
+
+    for (int i = 0; i < N; ++i) {
+      tr1::array<int,2> e = {{i, i+1}};
+      segments[s].push_back(e);
+    }
+  }
+
+  ContactMapping<2,ctype> contactMapping;
+  contactMapping.build(coords[0], segments[0], coords[1], segments[1]);
+
+  vector<IntersectionPrimitive<1,ctype> > overlaps;
+  contactMapping.getOverlaps(overlaps);
+
+  OverlapSet<1,ctype> overlapSet;
+  contactMapping.getOverlaps(overlapSet);
+
+  CollectingVisitor<1,ctype> visitor;
+  contactMapping.getOverlaps(visitor, chunkSize);
+
+  check_overlaps(overlaps, overlapSet, visitor, chunkSize, "2d overlaps");
+}
+
+int main (int argc, char* argv[]) {
+
+  try {
+    test2d<double>(20, 27, 3);
+    test3d<double>(20, 27, 100);
+  } catch (const exception& e) {
+    cout << e.what() << endl;
+
+    return 1;
+  }
+
+  return 0;
+}
@@ -2,6 +2,7 @@
 
 #include "fenv.h"
 #include "SparseMatrix.h"
+#include "CSRMatrix.h"
 
 using namespace std;
 using namespace psurface;
@@ -18,8 +19,8 @@ void check_result(const Vector<ctype>& result,
     throw runtime_error(message);
 }
 
-template<typename ctype>
-void check_result_by_mult(const SparseMatrix<ctype>& matrix,
+template<typename Matrix, typename ctype>
+void check_result_by_mult(const Matrix& matrix,
                           const Vector<ctype>& result,
                           const Vector<ctype>& b,
                           const ctype& tolerance, char const * const message) {
@@ -29,7 +30,7 @@ void check_result_by_mult(const SparseMatrix<ctype>& matrix,
 
 
 template<typename ctype>
-void test(const ctype tolerance, const int n, const int maxIter) {
+void test(const ctype tolerance, const size_t n, const int maxIter) {
   //// setup for n-dimensional tests
   // id matrix test
   Vector<ctype> residue(n);
@@ -154,6 +155,258 @@ void test(const ctype tolerance, const int n, const int maxIter) {
   check_result_by_mult(test3, result3, b3, tolerance, "specific matrix check 3 failed");
 }
 
+/** \brief A CSRMatrix with a preallocated pattern solves like a SparseMatrix with the same entries */
+template<typename ctype>
+void testCSR(const ctype tolerance, const int maxIter) {
+  /*
+    2 -1  0  0  0
+   -1  3 -1  0 -1
+    0 -1  3 -1  0
+    0  0 -1  2  0
+    0 -1  0  0  2
+   */
+  const int n = 5;
+  const int start[n+1] = {0, 2, 6, 9, 11, 13};
+  const int columns[13] = {1, 0,   4, 2, 1, 0,   1, 3, 2,   3, 2,   4, 1};
+
+  CSRMatrix<ctype> csr;
+  csr.setPattern(n, n, vector<int>(start, start+n+1), vector<int>(columns, columns+13));
+
+  if (csr.nRows() != n || csr.nCols() != n || csr.nNonZeros() != 13)
+    throw runtime_error("CSR pattern has the wrong size");
+
+  // fill in the negative off-diagonal entries, then the diagonal like PlaneParam
+  SparseMatrix<ctype> sparse(n);
+  for (int i = 0; i < n; ++i)
+    for (int k = start[i]; k < start[i+1]; ++k)
+      if (columns[k] != i) {
+        csr.addToEntry(i, columns[k], 0.5);
+        csr.addToEntry(i, columns[k], 0.5);
+        sparse.setEntry(i, columns[k], -1);
+      }
+
+  csr *= -1;
+
+  for (int i = 0; i < n; ++i) {
+    csr.setEntry(i, i, start[i+1] - start[i] - 1 + (i == 0 || i == 3));
+    sparse.setEntry(i, i, csr(i, i));
+  }
+
+  if (csr(1, 4) != -1 || csr(0, 4) != 0)
+    throw runtime_error("CSR entries are wrong");
+
+  for (int i = 0; i < n; ++i)
+    if (csr.diagonal[i] != csr.find(i, i))
+      throw runtime_error("CSR diagonal positions are wrong");
+
+  bool thrown = false;
+  try {
+    csr.setEntry(0, 4, 1);
+  } catch (const runtime_error&) {
+    thrown = true;
+  }
+  if (!thrown)
+    throw runtime_error("CSR entry outside of the pattern accepted");
+
+  Vector<ctype> b(n), result(n, StaticVector<ctype, 2>(0)), residue(n);
+  for (int i = 0; i < n; ++i)
+    b[i] = StaticVector<ctype, 2>(i+1, n-i);
+
+  csr.BiCGSTAB(b, result, residue, maxIter, ctype(1e-6));
+  check_result_by_mult(csr, result, b, tolerance, "CSR matrix check failed");
+  check_result_by_mult(sparse, result, b, tolerance, "CSR matrix check against SparseMatrix failed");
+
+  csr.setZero();
+  if (csr.nNonZeros() != 13 || csr(1, 4) != 0)
+    throw runtime_error("CSR setZero failed");
+}
+
+/** \brief A CSRMatrix with the pattern of a 2d Laplacian on an m x m grid
+ *
+ * With convection > 0 the matrix is nonsymmetric.
+ */
+template<typename ctype>
+void laplacian(int m, ctype convection, CSRMatrix<ctype>& A) {
+  const int n = m*m;
+  vector<int> start(n+1, 0), columns;
+  for (int i = 0; i < n; ++i) {
+    columns.push_back(i);
+    if (i%m > 0)   columns.push_back(i-1);
+    if (i%m < m-1) columns.push_back(i+1);
+    if (i >= m)    columns.push_back(i-m);
+    if (i < n-m)   columns.push_back(i+m);
+    start[i+1] = columns.size();
+  }
+
+  A.setPattern(n, n, start, columns);
+  for (int i = 0; i < n; ++i)
+    for (int k = start[i]; k < start[i+1]; ++k) {
+      int j = columns[k];
+      if (j == i)
+        A.setEntry(i, i, 4);
+      else
+        A.setEntry(i, j, (j == i-1) ? -1-convection : -1);
+    }
+}
+
+/** \brief The preconditioned solvers, with a workspace shared by all solves */
+template<typename ctype>
+void testPreconditioned(const ctype tolerance, const int maxIter) {
+  const int m = 12, n = m*m;
+
+  Vector<ctype> b(n), zero(n, StaticVector<ctype, 2>(0));
+  for (int i = 0; i < n; ++i)
+    b[i] = StaticVector<ctype, 2>(1, ctype(i)/n);
+
+  IterativeSolverWorkspace<ctype> workspace;
+  IdentityPreconditioner<ctype> identity;
+  JacobiPreconditioner<ctype> jacobi;
+  ILU0Preconditioner<ctype> ilu;
+
+  for (int symmetric = 0; symmetric < 2; ++symmetric) {
+    CSRMatrix<ctype> A;
+    laplacian(m, ctype(symmetric ? 0 : 0.5), A);
+    jacobi.setup(A);
+    ilu.setup(A);
+
+    size_t plainIterations, iluIterations;
+    Vector<ctype> x(zero);
+    if (!BiCGSTAB(A, identity, b, x, workspace, maxIter, ctype(1e-6), &plainIterations))
+      throw runtime_error("BiCGSTAB did not converge");
+    check_result_by_mult(A, x, b, tolerance, "BiCGSTAB check failed");
+
+    x = zero;
+    if (!BiCGSTAB(A, jacobi, b, x, workspace, maxIter, ctype(1e-6)))
+      throw runtime_error("BiCGSTAB with Jacobi preconditioner did not converge");
+    check_result_by_mult(A, x, b, tolerance, "BiCGSTAB with Jacobi preconditioner check failed");
+
+    x = zero;
+    if (!BiCGSTAB(A, ilu, b, x, workspace, maxIter, ctype(1e-6), &iluIterations))
+      throw runtime_error("BiCGSTAB with ILU(0) preconditioner did not converge");
+    check_result_by_mult(A, x, b, tolerance, "BiCGSTAB with ILU(0) preconditioner check failed");
+
+    if (iluIterations >= plainIterations)
+      throw runtime_error("ILU(0) preconditioner does not speed up BiCGSTAB");
+
+    // the residual is the one of the original system
+    Vector<ctype> r = b - A.multVec(x);
+    if ((r - workspace.r).length() > tolerance)
+      throw runtime_error("BiCGSTAB returns the wrong residual");
+
+    // too few iterations
+    x = zero;
+    if (BiCGSTAB(A, identity, b, x, workspace, 2, ctype(1e-6)))
+      throw runtime_error("BiCGSTAB converged in two iterations");
+
+    if (symmetric) {
+      x = zero;
+      if (!CG(A, identity, b, x, workspace, maxIter, ctype(1e-6), &plainIterations))
+        throw runtime_error("CG did not converge");
+      check_result_by_mult(A, x, b, tolerance, "CG check failed");
+
+      x = zero;
+      if (!CG(A, ilu, b, x, workspace, maxIter, ctype(1e-6), &iluIterations))
+        throw runtime_error("CG with ILU(0) preconditioner did not converge");
+      check_result_by_mult(A, x, b, tolerance, "CG with ILU(0) preconditioner check failed");
+
+      if (iluIterations >= plainIterations)
+        throw runtime_error("ILU(0) preconditioner does not speed up CG");
+    }
+  }
+
+  // ILU(0) of a tridiagonal matrix is its LU decomposition
+  CSRMatrix<ctype> tridiagonal;
+  {
+    vector<int> start(n+1), columns;
+    start[0] = 0;
+    for (int i = 0; i < n; ++i) {
+      for (int j = max(i-1, 0); j <= min(i+1, n-1); ++j)
+        columns.push_back(j);
+      start[i+1] = columns.size();
+    }
+    tridiagonal.setPattern(n, n, start, columns);
+    for (int i = 0; i < n; ++i)
+      for (int k = start[i]; k < start[i+1]; ++k)
+        tridiagonal.setEntry(i, columns[k], (columns[k] == i) ? 3 : (columns[k] < i) ? -1 : -1.5);
+  }
+  ilu.setup(tridiagonal);
+
+  Vector<ctype> x(n);
+  ilu.apply(b, x);
+  check_result_by_mult(tridiagonal, x, b, tolerance, "ILU(0) of a tridiagonal matrix is not exact");
+
+  // the zero matrix breaks BiCGSTAB down at once
+  tridiagonal.setZero();
+  bool thrown = false;
+  try {
+    x = zero;
+    BiCGSTAB(tridiagonal, identity, b, x, workspace, maxIter, ctype(1e-6));
+  } catch (const runtime_error&) {
+    thrown = true;
+  }
+  if (!thrown)
+    throw runtime_error("BiCGSTAB accepted the zero matrix");
+
+  // a negative definite matrix breaks CG down
+  for (int i = 0; i < n; ++i)
+    tridiagonal.setEntry(i, i, -2);
+  thrown = false;
+  try {
+    x = zero;
+    CG(tridiagonal, identity, b, x, workspace, maxIter, ctype(1e-6));
+  } catch (const runtime_error&) {
+    thrown = true;
+  }
+  if (!thrown)
+    throw runtime_error("CG accepted a negative definite matrix");
+}
+
+/** \brief Solving for a single component gives the first component of the two-component solution */
+template<typename ctype>
+void testSingleComponent(const ctype tolerance, const int maxIter) {
+  const int m = 10, n = m*m;
+
+  CSRMatrix<ctype> A;
+  laplacian(m, ctype(0.5), A);
+
+  ILU0Preconditioner<ctype> ilu;
+  ilu.setup(A);
+
+  Vector<ctype> b(n), x(n, StaticVector<ctype, 2>(0));
+  Vector<ctype,1> b1(n), x1(n, StaticVector<ctype, 1>(0));
+  for (int i = 0; i < n; ++i) {
+    b[i] = StaticVector<ctype, 2>(ctype(i%m)/m, 0);
+    b1[i][0] = b[i][0];
+  }
+
+  IterativeSolverWorkspace<ctype> workspace;
+  IterativeSolverWorkspace<ctype,1> workspace1;
+  if (!BiCGSTAB(A, ilu, b, x, workspace, maxIter, ctype(1e-6))
+      || !BiCGSTAB(A, ilu, b1, x1, workspace1, maxIter, ctype(1e-6)))
+    throw runtime_error("single component BiCGSTAB did not converge");
+
+  if ((A.multVec(x1) - b1).length() > tolerance)
+    throw runtime_error("single component BiCGSTAB check failed");
+
+  for (int i = 0; i < n; ++i)
+    if (std::abs(x[i][0] - x1[i][0]) > tolerance || x[i][1] != 0)
+      throw runtime_error("single component solution differs");
+
+  // the same with a SparseMatrix
+  SparseMatrix<ctype> sparse(n);
+  for (int i = 0; i < n; ++i)
+    for (int k = A.rowStart[i]; k < A.rowStart[i+1]; ++k)
+      sparse.setEntry(i, A.colIndex[k], A.values[k]);
+
+  Vector<ctype,1> r1(n);
+  x1.assign(n, StaticVector<ctype, 1>(0));
+  BiCGSTAB(sparse, b1, x1, r1, maxIter, ctype(1e-6));
+
+  for (int i = 0; i < n; ++i)
+    if (std::abs(x[i][0] - x1[i][0]) > tolerance)
+      throw runtime_error("single component solution with a SparseMatrix differs");
+}
+
 int main (int argc, char* argv[]) {
 
   feenableexcept(FE_INVALID);
@@ -165,6 +418,12 @@ int main (int argc, char* argv[]) {
     test<float>(tolerance, n, maxIter);
     test<double>(tolerance, n, maxIter);
     test<long double>(tolerance, n, maxIter);
+    testCSR<float>(tolerance, maxIter);
+    testCSR<double>(tolerance, maxIter);
+    testPreconditioned<float>(tolerance, maxIter);
+    testPreconditioned<double>(tolerance, maxIter);
+    testSingleComponent<float>(tolerance, maxIter);
+    testSingleComponent<double>(tolerance, maxIter);
   } catch (const exception& e) {
     cout << e.what() << endl;
 
@@ -0,0 +1,161 @@
+#include "config.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ContactMapping.h"
+#include "TargetSurfaceIndex.h"
+
+#include "testsurfaces.h"
+
+using namespace std;
+using namespace psurface;
+
+
+template <typename ctype>
+void overlaps(const vector<tr1::array<ctype,3> > coords[2], const vector<tr1::array<int,3> > tris[2],
+              ctype maxGap, const TargetSurfaceIndex<ctype>* index, vector<IntersectionPrimitive<2,ctype> >& result) {
+  ContactMapping<3,ctype> contactMapping;
+  contactMapping.build(coords[0], tris[0], coords[1], tris[1], NULL, NULL, maxGap, index);
+  contactMapping.getOverlaps(result);
+}
+
+template <typename ctype>
+void check_same(const vector<IntersectionPrimitive<2,ctype> >& a, const vector<IntersectionPrimitive<2,ctype> >& b,
+                char const * const message) {
+  if (a.empty() || a.size() != b.size())
+    throw runtime_error(string(message) + ": numbers of overlaps differ");
+
+  for (size_t k = 0; k < a.size(); ++k) {
+    if (a[k].tris != b[k].tris)
+      throw runtime_error(string(message) + ": overlaps differ");
+    for (int j = 0; j < 3; ++j)
+      for (int c = 0; c < 3; ++c)
+        if (a[k].points[j][c] != b[k].points[j][c])
+          throw runtime_error(string(message) + ": overlaps differ");
+  }
+}
+
+/** \brief The projection with a prebuilt index, also after a round trip through a file,
+    gives the same overlaps as the one that builds its own */
+template <typename ctype>
+void testPrebuiltIndex(int n, int m) {
+  vector<tr1::array<ctype,3> > coords[2];
+  vector<tr1::array<int,3> > tris[2];
+  surfaces(n, m, coords, tris);
+
+  TargetSurfaceIndex<ctype> index;
+  index.build(coords[1], tris[1]);
+
+  if (index.size() != int(tris[1].size()) || index.getNumSurfaceTriangles() != int(tris[1].size()))
+    throw runtime_error("wrong number of triangles in the index");
+
+  const string filename = "targetsurfaceindextest.idx";
+  index.write(filename);
+
+  TargetSurfaceIndex<ctype> readIndex;
+  readIndex.read(filename);
+  remove(filename.c_str());
+
+  const ctype gaps[2] = {numeric_limits<ctype>::max(), ctype(0.05)};
+
+  for (int g = 0; g < 2; ++g) {
+    vector<IntersectionPrimitive<2,ctype> > expected, prebuilt, read;
+    overlaps(coords, tris, gaps[g], (const TargetSurfaceIndex<ctype>*)NULL, expected);
+    overlaps(coords, tris, gaps[g], &index, prebuilt);
+    overlaps(coords, tris, gaps[g], &readIndex, read);
+
+    check_same(prebuilt, expected, "projection with a prebuilt index");
+    check_same(read, expected, "projection with an index read from a file");
+  }
+}
+
+/** \brief Invalid data and indices of other surfaces are rejected */
+template <typename ctype>
+void testInvalidIndex(int n, int m) {
+  vector<tr1::array<ctype,3> > coords[2];
+  vector<tr1::array<int,3> > tris[2];
+  surfaces(n, m, coords, tris);
+
+  // the other surface, with the same number of triangles, and a deformed copy of the right one
+  vector<tr1::array<ctype,3> > deformed(coords[1]);
+  deformed[deformed.size()/2][2] += 0.001;
+
+  TargetSurfaceIndex<ctype> index, deformedIndex;
+  index.build(coords[0], tris[0]);
+  deformedIndex.build(deformed, tris[1]);
+
+  bool thrown = false;
+  try {
+    vector<IntersectionPrimitive<2,ctype> > result;
+    overlaps(coords, tris, numeric_limits<ctype>::max(), &index, result);
+  } catch (const runtime_error&) {
+    thrown = true;
+  }
+  if (!thrown)
+    throw runtime_error("index of another surface accepted");
+
+  thrown = false;
+  try {
+    vector<IntersectionPrimitive<2,ctype> > result;
+    overlaps(coords, tris, numeric_limits<ctype>::max(), &deformedIndex, result);
+  } catch (const runtime_error&) {
+    thrown = true;
+  }
+  if (!thrown)
+    throw runtime_error("index of a deformed surface accepted");
+
+  ostringstream out;
+  index.write(out);
+  string data = out.str();
+
+  // every truncation of the data is detected
+  for (size_t size = 0; size < data.size(); size += 1 + size/3) {
+    TargetSurfaceIndex<ctype> readIndex;
+    thrown = false;
+    try {
+      readIndex.read(data.data(), data.data() + size);
+    } catch (const runtime_error&) {
+      thrown = true;
+    }
+    if (!thrown)
+      throw runtime_error("truncated index accepted");
+  }
+
+  // an index for the other coordinate type
+  thrown = false;
+  try {
+    TargetSurfaceIndex<float> floatIndex;
+    TargetSurfaceIndex<double> doubleIndex;
+    ostringstream floatOut;
+    floatIndex.build(vector<tr1::array<float,3> >(3), vector<tr1::array<int,3> >(1));
+    floatIndex.write(floatOut);
+    string floatData = floatOut.str();
+    doubleIndex.read(floatData.data(), floatData.data() + floatData.size());
+  } catch (const runtime_error&) {
+    thrown = true;
+  }
+  if (!thrown)
+    throw runtime_error("index of another coordinate type accepted");
+}
+
+int main (int argc, char* argv[]) {
+
+  try {
+    testPrebuiltIndex<float>(30, 35);
+    testPrebuiltIndex<double>(30, 35);
+    testInvalidIndex<double>(10, 10);
+  } catch (const exception& e) {
+    cout << e.what() << endl;
+
+    return 1;
+  }
+
+  return 0;
+}
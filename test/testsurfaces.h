@@ -0,0 +1,62 @@
+#ifndef PSURFACE_TEST_SURFACES_H
+#define PSURFACE_TEST_SURFACES_H
+
+#include <vector>
+
+#include "PSurface.h"
+#include "MultiDimOctree.h"
+#include "EdgeIntersectionFunctor.h"
+#include "QualityRequest.h"
+#include "HxParamToolBox.h"
+
+/** \brief A square [x0,x1]^2 with n squares per side, at height z
+ *
+ * With flip set, the triangles are oriented the other way, e.g. for a
+ * target surface facing the square below it.
+ */
+template <typename ctype>
+void square(int n, ctype x0, ctype x1, ctype z, bool flip,
+            std::vector<std::tr1::array<ctype,3> >& coords, std::vector<std::tr1::array<int,3> >& tris) {
+  for (int j = 0; j <= n; ++j)
+    for (int i = 0; i <= n; ++i) {
+      std::tr1::array<ctype,3> p = {{x0 + (x1-x0)*i/n, x0 + (x1-x0)*j/n, z}};
+      coords.push_back(p);
+    }
+
+  for (int j = 0; j < n; ++j)
+    for (int i = 0; i < n; ++i) {
+      const int a = j*(n+1)+i, b = a+1, c = a+n+2, d = a+n+1;
+      std::tr1::array<int,3> t0 = {{a, flip ? c : b, flip ? b : c}};
+      std::tr1::array<int,3> t1 = {{a, flip ? d : c, flip ? c : d}};
+      tris.push_back(t0);
+      tris.push_back(t1);
+    }
+}
+
+/** \brief A unit square with n squares per side, and a curved patch with m squares per side above its center */
+template <typename ctype>
+void surfaces(int n, int m, std::vector<std::tr1::array<ctype,3> > coords[2], std::vector<std::tr1::array<int,3> > tris[2]) {
+  square<ctype>(n, 0, 1, 0, false, coords[0], tris[0]);
+  square<ctype>(m, 0.3, 0.7, 0, true, coords[1], tris[1]);
+
+  for (size_t i = 0; i < coords[1].size(); ++i) {
+    const ctype x = coords[1][i][0], y = coords[1][i][1];
+    coords[1][i][2] = 0.01 + 2*((x-0.5)*(x-0.5) + (y-0.5)*(y-0.5));
+  }
+}
+
+/** \brief Remove a node from a surface, and update the point location structure like psurface-simplify */
+inline void removeNode(psurface::PSurface<2,float>* par, int index) {
+  psurface::Box<float, 3> box;
+  par->getBoundingBox(box);
+  psurface::EdgeIntersectionFunctor ef(&(par->vertices(0)));
+  psurface::MultiDimOctree<psurface::Edge, psurface::EdgeIntersectionFunctor, float, 3> edgebox(box, &ef);
+
+  psurface::QualityRequest req;
+  psurface::ParamToolBox::removeRegularPoint(par, index, req, &edgebox);
+
+  par->garbageCollection();
+  par->createPointLocationStructure();
+}
+
+#endif
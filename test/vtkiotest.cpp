@@ -0,0 +1,448 @@
+#include "config.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef PSURFACE_STANDALONE
+#include "TargetSurface.h"
+#else
+#include "hxsurface/Surface.h"
+#endif
+
+#include "PSurface.h"
+#include "GmshIO.h"
+#include "VtkIO.h"
+#include "dataarraywriter.hh"
+#include "AsyncWriter.h"
+
+#include "testsurfaces.h"
+
+using namespace std;
+using namespace psurface;
+
+
+/** \brief A data array of a vtu file, with the values converted to double */
+struct DataArray {
+  int components;
+  vector<double> values;
+};
+
+/** \brief The data arrays of a vtu file, indexed by "section/name", e.g. "Cells/offsets" */
+typedef map<string, DataArray> VtuFile;
+
+string readFile(const string& filename) {
+  ifstream in(filename.c_str(), ios::binary);
+  if (!in)
+    throw runtime_error("Cannot open " + filename);
+  ostringstream s;
+  s << in.rdbuf();
+  return s.str();
+}
+
+/** \brief The value of an attribute of an xml tag, empty if it is not there */
+string attribute(const string& tag, const string& name) {
+  const string key = " " + name + "=\"";
+  size_t begin = tag.find(key);
+  if (begin == string::npos)
+    return "";
+  begin += key.size();
+  return tag.substr(begin, tag.find('"', begin) - begin);
+}
+
+/** \brief Decode base64 without padding characters in between */
+vector<char> decodeBase64(const string& text) {
+  static const string alphabet =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  vector<char> out;
+  unsigned int buffer = 0;
+  int bits = 0;
+  for (size_t i = 0; i < text.size() && text[i] != '='; ++i) {
+    size_t digit = alphabet.find(text[i]);
+    if (digit == string::npos)
+      throw runtime_error("Invalid base64 character");
+    buffer = (buffer << 6) | digit;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      out.push_back(char((buffer >> bits) & 0xff));
+    }
+  }
+  return out;
+}
+
+unsigned int readUInt32(const char* p) {
+  unsigned int value;
+  memcpy(&value, p, 4);
+  return value;
+}
+
+/** \brief Convert the binary values of a data array to double */
+vector<double> convert(const string& type, const vector<char>& bytes) {
+  vector<double> values;
+  if (type == "Float32") {
+    for (size_t i = 0; i + 4 <= bytes.size(); i += 4) {
+      float v;
+      memcpy(&v, &bytes[i], 4);
+      values.push_back(v);
+    }
+  } else if (type == "Int32") {
+    for (size_t i = 0; i + 4 <= bytes.size(); i += 4) {
+      int v;
+      memcpy(&v, &bytes[i], 4);
+      values.push_back(v);
+    }
+  } else if (type == "UInt8") {
+    for (size_t i = 0; i < bytes.size(); ++i)
+      values.push_back((unsigned char)bytes[i]);
+  } else
+    throw runtime_error("Unknown data array type " + type);
+  return values;
+}
+
+/** \brief Uncompress the blocks written in the layout of vtkZLibDataCompressor */
+vector<char> uncompressBlocks(const char* p) {
+#if HAVE_ZLIB
+  const unsigned int nBlocks = readUInt32(p);
+  const unsigned int blockSize = readUInt32(p + 4);
+  const unsigned int lastSize = readUInt32(p + 8);
+
+  vector<char> out;
+  const char* block = p + 4*(3 + nBlocks);
+  for (unsigned int i = 0; i < nBlocks; ++i) {
+    const unsigned int compressedSize = readUInt32(p + 4*(3 + i));
+    uLongf size = (i + 1 == nBlocks && lastSize != 0) ? lastSize : blockSize;
+    vector<char> buffer(size);
+    if (uncompress((Bytef*)&buffer[0], &size, (const Bytef*)block, compressedSize) != Z_OK)
+      throw runtime_error("Cannot uncompress data array");
+    out.insert(out.end(), buffer.begin(), buffer.begin() + size);
+    block += compressedSize;
+  }
+  return out;
+#else
+  throw runtime_error("Compressed data arrays need zlib");
+#endif
+}
+
+/** \brief Read the data arrays of a vtu file in any of the VTK::OutputType formats */
+VtuFile readVtu(const string& filename) {
+  const string text = readFile(filename);
+
+  const size_t appendedTag = text.find("<AppendedData");
+  const size_t appended = (appendedTag == string::npos) ? string::npos : text.find('_', appendedTag) + 1;
+  const string encoding = (appendedTag == string::npos) ? "" :
+    attribute(text.substr(appendedTag, text.find('>', appendedTag) - appendedTag), "encoding");
+  const bool compressed = !attribute(text.substr(0, text.find("<UnstructuredGrid")), "compressor").empty();
+
+  VtuFile file;
+  string section;
+  for (size_t pos = text.find('<'); pos < appendedTag; pos = text.find('<', pos + 1)) {
+    const size_t end = text.find('>', pos);
+    const string tag = text.substr(pos, end - pos);
+    const string tagName = tag.substr(1, tag.find_first_of(" />") - 1);
+
+    if (tagName == "PointData" || tagName == "CellData" || tagName == "Points" || tagName == "Cells")
+      section = tagName;
+    if (tagName != "DataArray")
+      continue;
+
+    DataArray& array = file[section + "/" + attribute(tag, "Name")];
+    array.components = atoi(attribute(tag, "NumberOfComponents").c_str());
+
+    const string type = attribute(tag, "type");
+    const string format = attribute(tag, "format");
+    if (format == "ascii") {
+      istringstream content(text.substr(end + 1, text.find("</DataArray>", end) - end - 1));
+      double v;
+      while (content >> v)
+        array.values.push_back(v);
+    } else if (format == "binary") {
+      istringstream content(text.substr(end + 1, text.find("</DataArray>", end) - end - 1));
+      string base64;
+      content >> base64;
+      const vector<char> header = decodeBase64(base64.substr(0, 8));
+      vector<char> bytes = decodeBase64(base64.substr(8));
+      bytes.resize(readUInt32(&header[0]));
+      array.values = convert(type, bytes);
+    } else if (format == "appended") {
+      const size_t offset = appended + atoi(attribute(tag, "offset").c_str());
+      if (compressed) {
+        array.values = convert(type, uncompressBlocks(&text[offset]));
+      } else if (encoding == "raw") {
+        const unsigned int size = readUInt32(&text[offset]);
+        array.values = convert(type, vector<char>(&text[offset + 4], &text[offset + 4] + size));
+      } else {
+        const unsigned int size = readUInt32(&decodeBase64(text.substr(offset, 8))[0]);
+        vector<char> bytes = decodeBase64(text.substr(offset + 8, 4*((size + 2)/3)));
+        bytes.resize(size);
+        array.values = convert(type, bytes);
+      }
+    } else
+      throw runtime_error("Unknown data array format " + format + " in " + filename);
+  }
+
+  if (file.empty())
+    throw runtime_error("No data arrays in " + filename);
+  return file;
+}
+
+/** \brief The values of all arrays, cell by cell, with the point data of the cell corners
+ *
+ * Unlike the arrays themselves this does not depend on the numbering of the points,
+ * hence the cells of the pieces of a pvtu file expand to those of the whole vtu file.
+ */
+vector<double> expandCells(VtuFile& file) {
+  const vector<double>& connectivity = file["Cells/connectivity"].values;
+  const vector<double>& offsets = file["Cells/offsets"].values;
+  const vector<double>& types = file["Cells/types"].values;
+
+  vector<double> out;
+  for (size_t c = 0; c < offsets.size(); ++c) {
+    out.push_back(types.at(c));
+    for (VtuFile::iterator it = file.begin(); it != file.end(); ++it) {
+      if (it->first.compare(0, 9, "CellData/") != 0)
+        continue;
+      for (int k = 0; k < it->second.components; ++k)
+        out.push_back(it->second.values.at(c*it->second.components + k));
+    }
+
+    for (size_t i = (c == 0) ? 0 : size_t(offsets[c-1]); i < size_t(offsets[c]); ++i) {
+      const size_t point = size_t(connectivity.at(i));
+      for (VtuFile::iterator it = file.begin(); it != file.end(); ++it) {
+        if (it->first != "Points/Coordinates" && it->first.compare(0, 10, "PointData/") != 0)
+          continue;
+        for (int k = 0; k < it->second.components; ++k)
+          out.push_back(it->second.values.at(point*it->second.components + k));
+      }
+    }
+  }
+  return out;
+}
+
+/** \brief Expand the cells of all pieces of a pvtu file, and check that the pieces have the listed arrays */
+vector<double> expandPvtu(const string& filename, size_t numPieces) {
+  const string text = readFile(filename);
+  const string directory = (filename.rfind('/') == string::npos) ? "" : filename.substr(0, filename.rfind('/') + 1);
+
+  // The arrays listed in the pvtu file, with the names used by readVtu()
+  vector<string> arrays;
+  vector<string> pieces;
+  string section;
+  for (size_t pos = text.find('<'); pos != string::npos; pos = text.find('<', pos + 1)) {
+    const string tag = text.substr(pos, text.find('>', pos) - pos);
+    const string tagName = tag.substr(1, tag.find_first_of(" />") - 1);
+
+    if (tagName == "PPointData" || tagName == "PCellData" || tagName == "PPoints")
+      section = tagName.substr(1);
+    else if (tagName == "PDataArray")
+      arrays.push_back(section + "/" + attribute(tag, "Name"));
+    else if (tagName == "Piece")
+      pieces.push_back(attribute(tag, "Source"));
+  }
+
+  if (pieces.size() != numPieces)
+    throw runtime_error("Wrong number of pieces in " + filename);
+
+  vector<double> out;
+  for (size_t i = 0; i < pieces.size(); ++i) {
+    VtuFile piece = readVtu(directory + pieces[i]);
+
+    for (size_t j = 0; j < arrays.size(); ++j)
+      if (piece.find(arrays[j]) == piece.end())
+        throw runtime_error("Piece " + pieces[i] + " misses the array " + arrays[j]);
+    for (VtuFile::const_iterator it = piece.begin(); it != piece.end(); ++it)
+      if (it->first.compare(0, 6, "Cells/") != 0 && find(arrays.begin(), arrays.end(), it->first) == arrays.end())
+        throw runtime_error("The array " + it->first + " is not listed in " + filename);
+
+    vector<double> cells = expandCells(piece);
+    out.insert(out.end(), cells.begin(), cells.end());
+  }
+  return out;
+}
+
+void compare(const VtuFile& a, const VtuFile& b, double tolerance, const string& message) {
+  if (a.size() != b.size())
+    throw runtime_error(message + ": different data arrays");
+  for (VtuFile::const_iterator it = a.begin(), jt = b.begin(); it != a.end(); ++it, ++jt) {
+    if (it->first != jt->first || it->second.components != jt->second.components)
+      throw runtime_error(message + ": different data arrays");
+    if (it->second.values.size() != jt->second.values.size())
+      throw runtime_error(message + ": different size of " + it->first);
+    for (size_t i = 0; i < it->second.values.size(); ++i) {
+      const double x = it->second.values[i], y = jt->second.values[i];
+      if (fabs(x - y) > tolerance*(1 + fabs(y)))
+        throw runtime_error(message + ": different values of " + it->first);
+    }
+  }
+}
+
+/** \brief A tricube surface with a few nodes removed, such that the plane graphs are not trivial */
+PSurface<2,float>* makeSurface(const string& filename) {
+  auto_ptr<PSurface<2,float> > par(GmshIO<float,2>::readGmsh(filename));
+
+  for (int index = 0; index < 6; index += 2)
+    removeNode(par.get(), index);
+
+  return par.release();
+}
+
+const char* const outputTypeNames[] = { "ascii", "base64", "appendedraw", "appendedbase64", "compressedappended" };
+
+/** \brief All output types must encode the same values */
+void testOutputTypes(PSurface<2,float>* par) {
+  VTKIO<float,2> vtkio(par);
+
+  vtkio.createVTU("vtkiotest-base64-element.vtu", "vtkiotest-base64-graph.vtu", VTK::base64);
+  VtuFile element = readVtu("vtkiotest-base64-element.vtu");
+  VtuFile graph = readVtu("vtkiotest-base64-graph.vtu");
+
+  if (element["Cells/offsets"].values.size() != size_t(par->getNumTriangles()))
+    throw runtime_error("Wrong number of triangles in the element file");
+
+  vector<VTK::OutputType> types;
+  types.push_back(VTK::ascii);
+  types.push_back(VTK::appendedraw);
+  types.push_back(VTK::appendedbase64);
+#if HAVE_ZLIB
+  types.push_back(VTK::compressedappended);
+#endif
+
+  for (size_t i = 0; i < types.size(); ++i) {
+    const string name = string("vtkiotest-") + outputTypeNames[types[i]];
+    vtkio.createVTU(name + "-element.vtu", name + "-graph.vtu", types[i]);
+
+    // Ascii output has only the default precision of the stream
+    const double tolerance = (types[i] == VTK::ascii) ? 1e-5 : 0;
+    compare(readVtu(name + "-element.vtu"), element, tolerance, name + "-element.vtu");
+    compare(readVtu(name + "-graph.vtu"), graph, tolerance, name + "-graph.vtu");
+  }
+}
+
+/** \brief The pieces of a pvtu file must contain the cells of the vtu file */
+void testPieces(PSurface<2,float>* par, VTK::OutputType type) {
+  VTKIO<float,2> vtkio(par);
+
+  const string name = string("vtkiotest-pieces-") + outputTypeNames[type];
+  vtkio.createVTU(name + "-element.vtu", name + "-graph.vtu", type);
+  vtkio.createPVTU(name + "-element.pvtu", name + "-graph.pvtu", 3, type);
+
+  VtuFile element = readVtu(name + "-element.vtu");
+  VtuFile graph = readVtu(name + "-graph.vtu");
+
+  if (expandPvtu(name + "-element.pvtu", 3) != expandCells(element))
+    throw runtime_error(name + "-element.pvtu: the pieces differ from the vtu file");
+  if (expandPvtu(name + "-graph.pvtu", 3) != expandCells(graph))
+    throw runtime_error(name + "-graph.pvtu: the pieces differ from the vtu file");
+}
+
+/** \brief Asynchronous output must be that of the surface at the time of the call */
+void testAsyncWriter(const string& filename) {
+  auto_ptr<PSurface<2,float> > par(makeSurface(filename));
+
+  VTKIO<float,2>(par.get()).createVTU("vtkiotest-sync-element.vtu", "vtkiotest-sync-graph.vtu", VTK::appendedraw);
+  VtuFile element = readVtu("vtkiotest-sync-element.vtu");
+
+  AsyncWriter<float,2> writer;
+  vector<AsyncWriter<float,2>::Job*> jobs;
+  jobs.push_back(new AsyncWriter<float,2>::VtuJob("vtkiotest-async-element.vtu", "vtkiotest-async-graph.vtu",
+                                                  VTK::appendedraw));
+  jobs.push_back(new AsyncWriter<float,2>::PvtuJob("vtkiotest-async-element.pvtu", "", 2, VTK::appendedraw));
+  writer.write(*par, jobs);
+
+  // Change the surface while the jobs run
+  removeNode(par.get(), 1);
+
+  writer.wait();
+
+  if (readFile("vtkiotest-async-element.vtu") != readFile("vtkiotest-sync-element.vtu"))
+    throw runtime_error("AsyncWriter: vtkiotest-async-element.vtu differs from the synchronous output");
+  if (readFile("vtkiotest-async-graph.vtu") != readFile("vtkiotest-sync-graph.vtu"))
+    throw runtime_error("AsyncWriter: vtkiotest-async-graph.vtu differs from the synchronous output");
+  if (expandPvtu("vtkiotest-async-element.pvtu", 2) != expandCells(element))
+    throw runtime_error("AsyncWriter: the pieces of vtkiotest-async-element.pvtu differ from the surface");
+
+  // Errors of the jobs are reported by wait()
+  writer.write(*par, new AsyncWriter<float,2>::PvtuJob("vtkiotest-nonexistent/element.pvtu", "", 2));
+  bool thrown = false;
+  try {
+    writer.wait();
+  } catch (const runtime_error&) {
+    thrown = true;
+  }
+  if (!thrown)
+    throw runtime_error("AsyncWriter: a failing job has not been reported");
+}
+
+#if HAVE_ZLIB
+/** \brief A compressed array is queued by finish(), an array without it makes the appended section fail */
+void testCompressedFinish() {
+  ostringstream out;
+  VTK::DataArrayWriterFactory factory(VTK::compressedappended, out);
+  Indent indent;
+
+  {
+    auto_ptr<VTK::DataArrayWriter<int> > p(factory.make<int>("finished", 1, 100, indent));
+    for (int i = 0; i < 100; i++)
+      p->write(i);
+    p->finish();
+  }
+  {
+    auto_ptr<VTK::DataArrayWriter<int> > p(factory.make<int>("unfinished", 1, 100, indent));
+    for (int i = 0; i < 100; i++)
+      p->write(i);
+  }
+
+  factory.beginAppended();
+  delete factory.make<int>("", 1, 100, indent);
+
+  bool thrown = false;
+  try {
+    delete factory.make<int>("", 1, 100, indent);
+  } catch (const runtime_error&) {
+    thrown = true;
+  }
+  if (!thrown)
+    throw runtime_error("compressedappended: an array without finish() has not been reported");
+}
+#endif
+
+int main (int argc, char* argv[]) {
+
+  try {
+    const string filename = "examplefiles/tricube-anticlockwise.msh";
+    auto_ptr<PSurface<2,float> > par(makeSurface(filename));
+
+    testOutputTypes(par.get());
+
+    testPieces(par.get(), VTK::ascii);
+    testPieces(par.get(), VTK::base64);
+    testPieces(par.get(), VTK::appendedraw);
+#if HAVE_ZLIB
+    testPieces(par.get(), VTK::compressedappended);
+#endif
+
+    testAsyncWriter(filename);
+#if HAVE_ZLIB
+    testCompressedFinish();
+#endif
+  } catch (const exception& e) {
+    cout << e.what() << endl;
+
+    return 1;
+  }
+
+  return 0;
+}
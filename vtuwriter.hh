@@ -49,6 +49,7 @@ namespace psurface {
      *     std::shared_ptr<DataArrayWriter<T> > arraywriter
      *       (writer.makeArrayWriter(field.name, field.ncomps, ncells));
      *     // iterate over the points and write data for each
+     *     arraywriter->finish();
      *   }
      *   writer.endCellData();
      *
@@ -58,6 +59,7 @@ namespace psurface {
      *     std::shared_ptr<DataArrayWriter<T> > arraywriter
      *       (writer.makeArrayWriter(field.name, field.ncomps, npoints));
      *     // iterate over the points and write data for each
+     *     arraywriter->finish();
      *   }
      *   writer.endPointData();
      *
@@ -67,6 +69,7 @@ namespace psurface {
      *     std::shared_ptr<DataArrayWriter<float> > arraywriter
      *       (writer.makeArrayWriter("Coordinates", 3, npoints));
      *     // iterate over the points and write data for each
+     *     arraywriter->finish();
      *   }
      *   writer.endPoints();
      *
@@ -76,16 +79,19 @@ namespace psurface {
      *     std::shared_ptr<DataArrayWriter<int> > arraywriter
      *       (writer.makeArrayWriter("connectivity", 1, ncorners));
      *     // iterate over the cells and write data for each
+     *     arraywriter->finish();
      *   }
      *   { // connectivity
      *     std::shared_ptr<DataArrayWriter<int> > arraywriter
      *       (writer.makeArrayWriter("offsets", 1, ncells));
      *     // iterate over the cells and write data for each
+     *     arraywriter->finish();
      *   }
      *   if(fileType == unstructuredGrid) { // types
      *     std::shared_ptr<DataArrayWriter<unsigned char> > arraywriter
      *       (writer.makeArrayWriter("types", 1, ncells));
      *     // iterate over the cells and write data for each
+     *     arraywriter->finish();
      *   }
      *   writer.endCells();
      * }
@@ -137,7 +143,10 @@ namespace psurface {
         stream << indent << "<VTKFile"
                << " type=\"" << fileType << "\""
                << " version=\"0.1\""
-               << " byte_order=\"" << byteOrder << "\">\n";
+               << " byte_order=\"" << byteOrder << "\"";
+        if(outputType == compressedappended)
+          stream << " compressor=\"vtkZLibDataCompressor\"";
+        stream << ">\n";
         ++indent;
       }
 
@@ -370,8 +379,8 @@ namespace psurface {
        *               of points/number of corners).
        *
        * There should never be more than one DataArrayWriter created by the
-       * same VTUWriter around.  The returned object should be freed with
-       * delete.
+       * same VTUWriter around.  Call finish() on the returned object after
+       * the last write, then free it with delete.
        */
       template<typename T>
       DataArrayWriter<T>* makeArrayWriter(const std::string& name,